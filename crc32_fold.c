@@ -0,0 +1,396 @@
+/*
+ * NX-GZIP compression accelerator user library
+ * implementing zlib compression library interfaces
+ *
+ * Copyright (C) IBM Corporation, 2011-2017
+ *
+ * Licenses for GPLv2 and Apache v2.0:
+ *
+ * GPLv2:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * Apache v2.0:
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+   nx_crc32() is the crc32 of every software checksum in the library:
+   the gzip header crc, the trailers that inflate checks and the
+   exported crc32().  The kernel is picked once when the library is
+   loaded:
+
+     POWER8 and later   vpmsum, crc32_ppc_asm.S
+     x86 AVX-512        VPCLMULQDQ folding 4 x 512 bits at a time
+     x86 SSE4.1         PCLMULQDQ folding 4 x 128 bits at a time
+     otherwise          slicing by 16
+
+   The folding kernels carry the crc in the low 32 bits of a vector
+   of data and fold it forward by multiplying with x^n mod P, then
+   reduce the last 128 bits with a Barrett step.  Their constants and
+   the slicing tables come from crc32_fold_gen, which the Makefile
+   runs to make crc32_fold_constants.h.
+
+   nx_crc32_combine() is here too, since it is the same arithmetic:
+   crc32(A B) = crc32(A) * x^(8 len(B)) + crc32(B) mod P.  The power
+   of x comes from a table with an entry per byte of len(B), so a
+   combine is at most eight multiplies mod P, carry-less where the
+   cpu has it.  nx_crc32_combine_gen() returns the power for a length
+   and nx_crc32_combine_op() applies it, for callers that combine
+   many pieces of one length.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include "crc32_fold_constants.h"
+
+typedef uint32_t (*crc32_fn)(uint32_t, const unsigned char *, uint64_t);
+
+#define CRC32_FOLD_MIN_LEN  64   /* shorter goes to the slicing loop */
+
+/* ========================================================================= */
+static uint32_t crc32_slice16(uint32_t crc, const unsigned char *buf, uint64_t len)
+{
+	const uint32_t (*t)[256] = crc32_slice16_table;
+
+	crc = ~crc;
+	while (len >= 16) {
+		crc ^= (uint32_t)buf[0] | (uint32_t)buf[1] << 8 |
+			(uint32_t)buf[2] << 16 | (uint32_t)buf[3] << 24;
+		crc = t[15][crc & 0xff] ^ t[14][(crc >> 8) & 0xff] ^
+			t[13][(crc >> 16) & 0xff] ^ t[12][crc >> 24] ^
+			t[11][buf[4]] ^ t[10][buf[5]] ^ t[9][buf[6]] ^ t[8][buf[7]] ^
+			t[7][buf[8]] ^ t[6][buf[9]] ^ t[5][buf[10]] ^ t[4][buf[11]] ^
+			t[3][buf[12]] ^ t[2][buf[13]] ^ t[1][buf[14]] ^ t[0][buf[15]];
+		buf += 16;
+		len -= 16;
+	}
+	while (len--)
+		crc = t[0][(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+/* ========================================================================= */
+#if defined(__powerpc64__)
+#include "crc32_ppc.h"
+#define CRC32_VPMSUM
+
+/* crc32_ppc takes 32 bit lengths */
+static uint32_t crc32_vpmsum(uint32_t crc, const unsigned char *buf, uint64_t len)
+{
+	while (len > 0) {
+		unsigned n = (len > (1U << 30)) ? (1U << 30) : (unsigned)len;
+
+		crc = crc32_ppc(crc, (unsigned char *)buf, n);
+		buf += n;
+		len -= n;
+	}
+	return crc;
+}
+#endif
+
+/* ========================================================================= */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define CRC32_X86
+
+/* folds 128 bits x forward over 128 bits and adds in the next 128 */
+#define FOLD128(x, k, next) \
+	_mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00), \
+				    _mm_clmulepi64_si128(x, k, 0x11)), next)
+
+/* crc of the 128 bits x followed by len bytes at buf, len a multiple
+   of 16; returns the crc not yet inverted */
+__attribute__((target("sse4.1,pclmul")))
+static uint32_t crc32_fold_tail(__m128i x, const unsigned char *buf, uint64_t len)
+{
+	const __m128i k3k4 = _mm_set_epi64x(CRC32_FOLD_128_LO, CRC32_FOLD_128_HI);
+	const __m128i k5 = _mm_set_epi64x(0, CRC32_FOLD_64);
+	const __m128i poly = _mm_set_epi64x(CRC32_BARRETT_MU, CRC32_BARRETT_POLY);
+	const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+	__m128i y;
+
+	while (len >= 16) {
+		x = FOLD128(x, k3k4, _mm_loadu_si128((const __m128i *)buf));
+		buf += 16;
+		len -= 16;
+	}
+
+	/* 128 bits to 64 */
+	y = _mm_clmulepi64_si128(x, k3k4, 0x10);
+	x = _mm_xor_si128(_mm_srli_si128(x, 8), y);
+	y = _mm_srli_si128(x, 4);
+	x = _mm_clmulepi64_si128(_mm_and_si128(x, mask32), k5, 0x00);
+	x = _mm_xor_si128(x, y);
+
+	/* Barrett reduction of 64 bits to 32 */
+	y = _mm_and_si128(x, mask32);
+	y = _mm_clmulepi64_si128(y, poly, 0x10);
+	y = _mm_and_si128(y, mask32);
+	y = _mm_clmulepi64_si128(y, poly, 0x00);
+	x = _mm_xor_si128(x, y);
+	return (uint32_t)_mm_extract_epi32(x, 1);
+}
+
+/* len >= CRC32_FOLD_MIN_LEN */
+__attribute__((target("sse4.1,pclmul")))
+static uint32_t crc32_pclmul(uint32_t crc, const unsigned char *buf, uint64_t len)
+{
+	const __m128i k1k2 = _mm_set_epi64x(CRC32_FOLD_512_LO, CRC32_FOLD_512_HI);
+	const __m128i k3k4 = _mm_set_epi64x(CRC32_FOLD_128_LO, CRC32_FOLD_128_HI);
+	__m128i x1, x2, x3, x4;
+	uint64_t rest = len & 15;
+
+	len -= rest;
+	x1 = _mm_loadu_si128((const __m128i *)buf);
+	x2 = _mm_loadu_si128((const __m128i *)(buf + 16));
+	x3 = _mm_loadu_si128((const __m128i *)(buf + 32));
+	x4 = _mm_loadu_si128((const __m128i *)(buf + 48));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(~crc));
+	buf += 64;
+	len -= 64;
+
+	while (len >= 64) {
+		x1 = FOLD128(x1, k1k2, _mm_loadu_si128((const __m128i *)buf));
+		x2 = FOLD128(x2, k1k2, _mm_loadu_si128((const __m128i *)(buf + 16)));
+		x3 = FOLD128(x3, k1k2, _mm_loadu_si128((const __m128i *)(buf + 32)));
+		x4 = FOLD128(x4, k1k2, _mm_loadu_si128((const __m128i *)(buf + 48)));
+		buf += 64;
+		len -= 64;
+	}
+
+	x2 = FOLD128(x1, k3k4, x2);
+	x3 = FOLD128(x2, k3k4, x3);
+	x4 = FOLD128(x3, k3k4, x4);
+
+	crc = ~crc32_fold_tail(x4, buf, len);
+	return crc32_slice16(crc, buf + len, rest);
+}
+
+/* len >= CRC32_FOLD_MIN_LEN; short buffers go to crc32_pclmul */
+__attribute__((target("avx512f,avx512vl,vpclmulqdq,sse4.1,pclmul")))
+static uint32_t crc32_vpclmul(uint32_t crc, const unsigned char *buf, uint64_t len)
+{
+	const __m512i k2048 = _mm512_broadcast_i32x4(_mm_set_epi64x(CRC32_FOLD_2048_LO, CRC32_FOLD_2048_HI));
+	const __m512i k512 = _mm512_broadcast_i32x4(_mm_set_epi64x(CRC32_FOLD_512_LO, CRC32_FOLD_512_HI));
+	/* lanes 0..2 fold forward to lane 3 */
+	const __m512i klanes = _mm512_set_epi64(0, 0,
+		CRC32_FOLD_128_LO, CRC32_FOLD_128_HI,
+		CRC32_FOLD_256_LO, CRC32_FOLD_256_HI,
+		CRC32_FOLD_384_LO, CRC32_FOLD_384_HI);
+	__m512i z1, z2, z3, z4;
+	__m128i x;
+	uint64_t rest;
+
+	if (len < 256)
+		return crc32_pclmul(crc, buf, len);
+
+	rest = len & 15;
+	len -= rest;
+	z1 = _mm512_loadu_si512((const void *)buf);
+	z2 = _mm512_loadu_si512((const void *)(buf + 64));
+	z3 = _mm512_loadu_si512((const void *)(buf + 128));
+	z4 = _mm512_loadu_si512((const void *)(buf + 192));
+	z1 = _mm512_xor_si512(z1, _mm512_castsi128_si512(_mm_cvtsi32_si128(~crc)));
+	buf += 256;
+	len -= 256;
+
+#define FOLD512(z, k, next) \
+	_mm512_ternarylogic_epi64(_mm512_clmulepi64_epi128(z, k, 0x00), \
+				  _mm512_clmulepi64_epi128(z, k, 0x11), next, 0x96)
+
+	while (len >= 256) {
+		z1 = FOLD512(z1, k2048, _mm512_loadu_si512((const void *)buf));
+		z2 = FOLD512(z2, k2048, _mm512_loadu_si512((const void *)(buf + 64)));
+		z3 = FOLD512(z3, k2048, _mm512_loadu_si512((const void *)(buf + 128)));
+		z4 = FOLD512(z4, k2048, _mm512_loadu_si512((const void *)(buf + 192)));
+		buf += 256;
+		len -= 256;
+	}
+
+	z2 = FOLD512(z1, k512, z2);
+	z3 = FOLD512(z2, k512, z3);
+	z4 = FOLD512(z3, k512, z4);
+	while (len >= 64) {
+		z4 = FOLD512(z4, k512, _mm512_loadu_si512((const void *)buf));
+		buf += 64;
+		len -= 64;
+	}
+
+	/* lane 3 is not multiplied, its constant is 0 */
+	z1 = FOLD512(z4, klanes, _mm512_maskz_mov_epi64(0xc0, z4));
+#undef FOLD512
+	x = _mm_xor_si128(_mm512_extracti32x4_epi32(z1, 0), _mm512_extracti32x4_epi32(z1, 1));
+	x = _mm_xor_si128(x, _mm512_extracti32x4_epi32(z1, 2));
+	x = _mm_xor_si128(x, _mm512_extracti32x4_epi32(z1, 3));
+
+	crc = ~crc32_fold_tail(x, buf, len);
+	return crc32_slice16(crc, buf + len, rest);
+}
+#endif
+
+/* ========================================================================= */
+/* picked once when the library is loaded; see nx_crc32 */
+static crc32_fn crc32_resolve(void)
+{
+#if defined(CRC32_VPMSUM)
+	if (__builtin_cpu_supports("arch_2_07"))
+		return crc32_vpmsum;
+#elif defined(CRC32_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl") &&
+	    __builtin_cpu_supports("vpclmulqdq") && __builtin_cpu_supports("pclmul"))
+		return crc32_vpclmul;
+	if (__builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("pclmul"))
+		return crc32_pclmul;
+#endif
+	return crc32_slice16;
+}
+
+#if (defined(CRC32_VPMSUM) || defined(CRC32_X86)) && defined(__ELF__)
+static uint32_t crc32_vec(uint32_t crc, const unsigned char *buf, uint64_t len)
+	__attribute__((ifunc("crc32_resolve")));
+#else
+static uint32_t crc32_vec(uint32_t crc, const unsigned char *buf, uint64_t len)
+{
+	static crc32_fn fn = NULL;
+
+	if (fn == NULL)
+		fn = crc32_resolve();
+	return fn(crc, buf, len);
+}
+#endif
+
+unsigned long nx_crc32(unsigned long crc, const unsigned char *buf, uint64_t len)
+{
+	if (buf == NULL)
+		return 0UL;
+	if (len < CRC32_FOLD_MIN_LEN)
+		return crc32_slice16((uint32_t)crc, buf, len);
+	return crc32_vec((uint32_t)crc, buf, len);
+}
+
+/* ========================================================================= */
+/* a * b mod P, bit 31 is x^0 */
+static uint32_t multmodp_scalar(uint32_t a, uint32_t b)
+{
+	uint32_t m = 1U << 31, p = 0;
+
+	for (;;) {
+		if (a & m) {
+			p ^= b;
+			if ((a & (m - 1)) == 0)
+				break;
+		}
+		m >>= 1;
+		b = (b & 1) ? (b >> 1) ^ 0xedb88320U : b >> 1;
+	}
+	return p;
+}
+
+/* v * x^32 mod P, the slicing step over four zero bytes */
+static inline uint32_t mulx32modp(uint32_t v)
+{
+	const uint32_t (*t)[256] = crc32_slice16_table;
+
+	return t[3][v & 0xff] ^ t[2][(v >> 8) & 0xff] ^
+		t[1][(v >> 16) & 0xff] ^ t[0][v >> 24];
+}
+
+/* The 63 bit carry-less product shifted left by one has x^0..x^31 in
+   its high word and x^32..x^63 in its low word */
+#if defined(CRC32_X86)
+__attribute__((target("sse4.1,pclmul")))
+static uint32_t multmodp_pclmul(uint32_t a, uint32_t b)
+{
+	__m128i x = _mm_clmulepi64_si128(_mm_cvtsi32_si128(a), _mm_cvtsi32_si128(b), 0x00);
+	uint64_t p = ((uint64_t)(uint32_t)_mm_extract_epi32(x, 1) << 32 |
+		      (uint32_t)_mm_cvtsi128_si32(x)) << 1;
+
+	return (uint32_t)(p >> 32) ^ mulx32modp((uint32_t)p);
+}
+
+typedef uint32_t (*multmodp_fn)(uint32_t, uint32_t);
+
+static multmodp_fn multmodp_resolve(void)
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("pclmul"))
+		return multmodp_pclmul;
+	return multmodp_scalar;
+}
+
+#if defined(__ELF__)
+static uint32_t crc32_multmodp(uint32_t a, uint32_t b)
+	__attribute__((ifunc("multmodp_resolve")));
+#else
+static uint32_t crc32_multmodp(uint32_t a, uint32_t b)
+{
+	static multmodp_fn fn = NULL;
+
+	if (fn == NULL)
+		fn = multmodp_resolve();
+	return fn(a, b);
+}
+#endif
+
+#elif defined(__powerpc64__) && defined(__CRYPTO__)
+#include <altivec.h>
+
+static uint32_t crc32_multmodp(uint32_t a, uint32_t b)
+{
+	/* the product of the other doublewords is a * 0 */
+	vector unsigned long long va = { a, a }, vb = { b, 0 };
+	vector unsigned long long x = __builtin_crypto_vpmsumd(va, vb);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	uint64_t p = x[0] << 1;
+#else
+	uint64_t p = x[1] << 1;
+#endif
+
+	return (uint32_t)(p >> 32) ^ mulx32modp((uint32_t)p);
+}
+#else
+#define crc32_multmodp multmodp_scalar
+#endif
+
+unsigned long nx_crc32_combine_gen(uint64_t len2)
+{
+	uint32_t p = 1U << 31;	/* x^0 */
+	int j;
+
+	for (j = 0; len2 != 0; j++, len2 >>= 8)
+		if (len2 & 0xff)
+			p = crc32_multmodp(p, crc32_x8n_table[j][len2 & 0xff]);
+	return p;
+}
+
+unsigned long nx_crc32_combine_op(unsigned long crc1, unsigned long crc2, unsigned long op)
+{
+	return crc32_multmodp((uint32_t)op, (uint32_t)crc1) ^ (crc2 & 0xffffffffUL);
+}
+
+unsigned long nx_crc32_combine(unsigned long crc1, unsigned long crc2, uint64_t len2)
+{
+	return nx_crc32_combine_op(crc1, crc2, nx_crc32_combine_gen(len2));
+}
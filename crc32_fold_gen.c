@@ -0,0 +1,139 @@
+/*
+ * Generates crc32_fold_constants.h for crc32_fold.c: the slicing by 16
+ * tables and the carry-less multiply folding constants of the gzip
+ * crc32, polynomial 0x04C11DB7, in the bit reflected form that
+ * PCLMULQDQ and VPCLMULQDQ code uses.
+ *
+ * A folding constant for a distance of d bits is x^(d+32) or
+ * x^(d-32) mod P, bit reflected and shifted left by one; see "Fast
+ * CRC Computation for Generic Polynomials Using PCLMULQDQ
+ * Instruction", Intel, 2009.
+ *
+ * The combine tables hold x^(8 * b * 256^j) mod P for each byte b of
+ * a length, in zlib's form where bit 31 is x^0, so that the crc of
+ * zeros of any length takes at most eight multiplies.
+ *
+ * usage: crc32_fold_gen > crc32_fold_constants.h
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define POLY 0x04C11DB7U	/* x^32 implied */
+
+static uint64_t reflect(uint64_t v, int bits)
+{
+	uint64_t r = 0;
+	int i;
+
+	for (i = 0; i < bits; i++)
+		if (v & (1ULL << i))
+			r |= 1ULL << (bits - 1 - i);
+	return r;
+}
+
+/* x^n mod P */
+static uint32_t xpow_mod(int n)
+{
+	uint32_t r = 1;		/* x^0 */
+
+	while (n--)
+		r = (r & 0x80000000U) ? (r << 1) ^ POLY : r << 1;
+	return r;
+}
+
+static uint64_t fold_const(int n)
+{
+	return reflect(xpow_mod(n), 32) << 1;
+}
+
+/* floor(x^64 / P), 33 bits */
+static uint64_t barrett_mu(void)
+{
+	uint64_t p = (1ULL << 32) | POLY;
+	uint64_t rem = 1ULL << 32;	/* x^64 after 32 steps */
+	uint64_t q = 0;
+	int i;
+
+	/* long division of x^64 by p one bit of quotient at a time */
+	for (i = 32; i >= 0; i--) {
+		if (rem & (1ULL << 32)) {
+			q |= 1ULL << i;
+			rem ^= p;
+		}
+		rem <<= 1;
+	}
+	return q;
+}
+
+/* a * b mod P, bit 31 is x^0 */
+static uint32_t multmodp(uint32_t a, uint32_t b)
+{
+	uint32_t m = 1U << 31, p = 0;
+
+	for (;;) {
+		if (a & m) {
+			p ^= b;
+			if ((a & (m - 1)) == 0)
+				break;
+		}
+		m >>= 1;
+		b = (b & 1) ? (b >> 1) ^ (uint32_t)reflect(POLY, 32) : b >> 1;
+	}
+	return p;
+}
+
+int main(void)
+{
+	uint32_t x8n[8][256], pw = 1U << (31 - 8);	/* x^8, one zero byte */
+	uint32_t t[16][256], c;
+	int i, j, k;
+
+	for (i = 0; i < 256; i++) {
+		c = i;
+		for (k = 0; k < 8; k++)
+			c = (c & 1) ? (c >> 1) ^ (uint32_t)reflect(POLY, 32) : c >> 1;
+		t[0][i] = c;
+	}
+	for (j = 1; j < 16; j++)
+		for (i = 0; i < 256; i++)
+			t[j][i] = (t[j-1][i] >> 8) ^ t[0][t[j-1][i] & 0xff];
+
+	printf("/*\n * THIS FILE IS GENERATED WITH\n./crc32_fold_gen\n\n * DO NOT MODIFY IT MANUALLY!\n */\n");
+	printf("#ifndef CRC32_FOLD_CONST_H\n#define CRC32_FOLD_CONST_H\n\n");
+
+	printf("/* x^(d+32) and x^(d-32) mod P for folding d bits */\n");
+	for (i = 0; i < 5; i++) {
+		static const int d[] = { 2048, 512, 384, 256, 128 };
+		printf("#define CRC32_FOLD_%d_HI 0x%09llxULL\n", d[i], (unsigned long long)fold_const(d[i] + 32));
+		printf("#define CRC32_FOLD_%d_LO 0x%09llxULL\n", d[i], (unsigned long long)fold_const(d[i] - 32));
+	}
+	printf("#define CRC32_FOLD_64 0x%09llxULL\n", (unsigned long long)fold_const(64));
+	printf("#define CRC32_BARRETT_MU 0x%09llxULL\n", (unsigned long long)reflect(barrett_mu(), 33));
+	printf("#define CRC32_BARRETT_POLY 0x%09llxULL\n\n", (unsigned long long)reflect((1ULL << 32) | POLY, 33));
+
+	printf("static const uint32_t crc32_slice16_table[16][256] = {\n");
+	for (j = 0; j < 16; j++) {
+		printf("\t{\n");
+		for (i = 0; i < 256; i++)
+			printf("%s0x%08x,%s", (i % 4) ? " " : "\t\t", t[j][i], (i % 4 == 3) ? "\n" : "");
+		printf("\t},\n");
+	}
+	printf("};\n\n");
+
+	for (j = 0; j < 8; j++) {
+		x8n[j][0] = 1U << 31;
+		for (i = 1; i < 256; i++)
+			x8n[j][i] = multmodp(x8n[j][i-1], pw);
+		pw = multmodp(x8n[j][255], pw);
+	}
+	printf("static const uint32_t crc32_x8n_table[8][256] = {\n");
+	for (j = 0; j < 8; j++) {
+		printf("\t{\n");
+		for (i = 0; i < 256; i++)
+			printf("%s0x%08x,%s", (i % 4) ? " " : "\t\t", x8n[j][i], (i % 4 == 3) ? "\n" : "");
+		printf("\t},\n");
+	}
+	printf("};\n\n#endif\n");
+	return 0;
+}
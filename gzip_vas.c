@@ -50,6 +50,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <signal.h>
+#include <pthread.h>
 #include "nx-gzip.h"
 #include "crb.h"
 #include "nx.h"
@@ -58,7 +59,7 @@
 #include "copy-paste.h"
 #include "nxu.h"
 #include "nx_dbg.h"
-#include <sys/platform/ppc.h>
+#include "nx_clock.h"
 
 #define barrier()
 #define hwsync()    asm volatile("hwsync" ::: "memory")
@@ -71,6 +72,10 @@
 #define cpu_pri_low()      do{;}while(0)
 #endif
 
+/* defaults of nxu_set_wait() */
+#define SPIN_NS       1000
+#define USLEEP_NS     600000
+
 void *nx_fault_storage_address;
 uint64_t dbgtimer=0;
 
@@ -169,10 +174,58 @@ int nx_function_end(void *handle)
         return rc;
 }
 
+__thread struct nxu_run_stats nxu_run_stats;
+
+/* the wait policy, nxu_set_wait(); the thresholds are the same in
+   nx_clock ticks, set on first use */
+static pthread_mutex_t wait_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t wait_spin_ns = SPIN_NS, wait_sleep_ns = USLEEP_NS;
+static uint64_t spin_th, usleep_th;
+static int wait_th_ok;
+
+static void nx_wait_th_set(void)
+{
+	__atomic_store_n(&spin_th, nx_clock_from_ns(wait_spin_ns), __ATOMIC_RELAXED);
+	__atomic_store_n(&usleep_th, nx_clock_from_ns(wait_sleep_ns), __ATOMIC_RELAXED);
+	__atomic_store_n(&wait_th_ok, 1, __ATOMIC_RELEASE);
+}
+
+static void nx_wait_th_init(void)
+{
+	if (__atomic_load_n(&wait_th_ok, __ATOMIC_ACQUIRE))
+		return;
+	pthread_mutex_lock(&wait_mutex);
+	if (!wait_th_ok)
+		nx_wait_th_set();
+	pthread_mutex_unlock(&wait_mutex);
+}
+
+/*
+   A paste the NX does not take is tried again after spin_ns; a job
+   not done after sleep_ns of polling sleeps between polls.  Jobs
+   started after the call use the new values.
+*/
+void nxu_set_wait(uint64_t spin_ns, uint64_t sleep_ns)
+{
+	pthread_mutex_lock(&wait_mutex);
+	wait_spin_ns = spin_ns;
+	wait_sleep_ns = sleep_ns;
+	nx_wait_th_set();
+	pthread_mutex_unlock(&wait_mutex);
+}
+
+void nxu_get_wait(uint64_t *spin_ns, uint64_t *sleep_ns)
+{
+	pthread_mutex_lock(&wait_mutex);
+	*spin_ns = wait_spin_ns;
+	*sleep_ns = wait_sleep_ns;
+	pthread_mutex_unlock(&wait_mutex);
+}
+
 static int nx_wait_for_csb( nx_gzip_crb_cpb_t *cmdp )
 {
 	volatile long poll = 0;
-	uint64_t t;
+	uint64_t t, sleep_th;
 
 	/* Save power and let other threads use the h/w. top may show
 	   100% but only because OS doesn't know we slowed the this
@@ -182,9 +235,10 @@ static int nx_wait_for_csb( nx_gzip_crb_cpb_t *cmdp )
 	cpu_pri_low();
 	
 #define CSB_MAX_POLL 200000000UL
-#define USLEEP_TH     300000UL
 
-	t = __ppc_get_timebase();
+	nx_wait_th_init();
+	sleep_th = __atomic_load_n(&usleep_th, __ATOMIC_RELAXED);
+	t = nx_clock_now();
 	
 	while( getnn( cmdp->crb.csb, csb_v ) == 0 )
 	{
@@ -193,10 +247,9 @@ static int nx_wait_for_csb( nx_gzip_crb_cpb_t *cmdp )
 
 		cpu_pri_low();
 		
-		/* usleep(0) takes around 29000 ticks ~60 us.
-		   300000 is spinning for about 600 us then
-		   start sleeping */
-		if ( (__ppc_get_timebase() - t) > USLEEP_TH) {
+		/* usleep(0) takes around 60 us.  Spin for
+		   sleep_ns then start sleeping */
+		if (nx_clock_diff(t, nx_clock_now()) > sleep_th) {
 			cpu_pri_default();		  
 			usleep(1);
 		}
@@ -211,12 +264,14 @@ static int nx_wait_for_csb( nx_gzip_crb_cpb_t *cmdp )
 		/* fault address from signal handler */		
 		if( nx_fault_storage_address ) {
 			cpu_pri_default();
+			nxu_run_stats.csb_polls += poll;
 			return -EAGAIN;
 		}
 		
 	}
 
 	cpu_pri_default();
+	nxu_run_stats.csb_polls += poll;
 	
 	/* hw has updated csb and output buffer */
 	hwsync();
@@ -243,15 +298,16 @@ int nxu_run_job(nx_gzip_crb_cpb_t *cmdp, void *handle)
 	assert(handle != NULL);
 	i = 0;
 	retries = 5000;
+	memset(&nxu_run_stats, 0, sizeof(nxu_run_stats));
 	while (i++ < retries) {
 		/* uint64_t t; */
 
-		/* t = __ppc_get_timebase(); */
+		/* t = nx_clock_now(); */
 		hwsync();
 		vas_copy( &cmdp->crb, 0);
 		ret = vas_paste(nxhandle->paste_addr, 0);
 		hwsync();
-		/* dbgtimer +=  __ppc_get_timebase() - t; */
+		/* dbgtimer += nx_clock_diff(t, nx_clock_now()); */
 		
 		NXPRT( fprintf( stderr, "Paste attempt %d/%d returns 0x%x\n", i, retries, ret) );
 
@@ -275,6 +331,7 @@ int nxu_run_job(nx_gzip_crb_cpb_t *cmdp, void *handle)
 				x = *(long *)nx_fault_storage_address;
 				*(long *)nx_fault_storage_address = x;
 				nx_fault_storage_address = 0;
+				++nxu_run_stats.faults;
 				continue;
 			}
 			else {
@@ -282,12 +339,15 @@ int nxu_run_job(nx_gzip_crb_cpb_t *cmdp, void *handle)
 				break;
 			}
 		} else {
+			++nxu_run_stats.paste_busy;
 			if (i < 10) {
-				/* spin for few ticks */
-#define SPIN_TH 500UL
-				uint64_t fail_spin;											
-				fail_spin = __ppc_get_timebase();
-				while ( (__ppc_get_timebase() - fail_spin) < SPIN_TH ) {;}
+				/* spin for spin_ns */
+				uint64_t fail_spin, th;
+
+				nx_wait_th_init();
+				th = __atomic_load_n(&spin_th, __ATOMIC_RELAXED);
+				fail_spin = nx_clock_now();
+				while (nx_clock_diff(fail_spin, nx_clock_now()) < th) {;}
 			}
 			else {
 				/* sleep */
@@ -0,0 +1,93 @@
+/*
+ * NX-GZIP compression accelerator user library
+ * implementing zlib compression library interfaces
+ *
+ * Copyright (C) IBM Corporation, 2011-2017
+ *
+ * Licenses for GPLv2 and Apache v2.0:
+ *
+ * GPLv2:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * Apache v2.0:
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef _NX_CLOCK_H
+#define _NX_CLOCK_H
+
+/*
+   The clock that all library timing is in.  nx_clock_now() reads the
+   timebase on POWER, the TSC on x86 when cpuid says it is invariant,
+   and CLOCK_MONOTONIC in ns otherwise.  nx_clock_freq() is its ticks
+   per second: the timebase frequency the kernel reports, or for the
+   TSC a one time calibration against CLOCK_MONOTONIC.  Convert ticks
+   with nx_clock_to_ns() and nx_clock_from_ns() rather than dividing
+   by a frequency, which loses everything below the unit.
+*/
+
+#include <stdint.h>
+#include <time.h>
+#if defined(__powerpc__)
+#include <sys/platform/ppc.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define NX_CLOCK_MONOTONIC 0
+#define NX_CLOCK_TIMEBASE  1
+#define NX_CLOCK_TSC       2
+
+extern int nx_clock_source;
+
+extern void nx_clock_init(void);
+extern uint64_t nx_clock_freq(void);
+extern const char *nx_clock_name(void);
+extern double nx_clock_to_ns(uint64_t ticks);
+extern uint64_t nx_clock_from_ns(double ns);
+
+static inline uint64_t nx_clock_now(void)
+{
+#if defined(__powerpc__)
+	return __ppc_get_timebase();
+#else
+	struct timespec ts;
+
+#if defined(__x86_64__) || defined(__i386__)
+	if (nx_clock_source == NX_CLOCK_TSC)
+		return __rdtsc();
+#endif
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000UL + ts.tv_nsec;
+#endif
+}
+
+/* ticks from t1 to t2; modular, and 0 if t2 reads before t1 as the
+   TSCs of two cpus can */
+static inline uint64_t nx_clock_diff(uint64_t t1, uint64_t t2)
+{
+	return ((int64_t)(t2 - t1) > 0) ? t2 - t1 : 0;
+}
+
+#endif /* _NX_CLOCK_H */
@@ -42,6 +42,7 @@
 
 extern FILE *nx_gzip_log;
 extern int nx_gzip_trace;
+extern int nx_gzip_stats_live;	/* an nxstat reader is attached */
 extern unsigned int nx_gzip_inflate_impl;
 extern unsigned int nx_gzip_deflate_impl;
 extern unsigned int nx_gzip_inflate_flags;
@@ -53,9 +54,20 @@ pthread_mutex_t mutex_log;
 #define nx_gzip_trace_enabled()       (nx_gzip_trace & 0x1)
 #define nx_gzip_hw_trace_enabled()    (nx_gzip_trace & 0x2)
 #define nx_gzip_sw_trace_enabled()    (nx_gzip_trace & 0x4)
-#define nx_gzip_gather_statistics()   (nx_gzip_trace & 0x8)
+#define nx_gzip_gather_statistics()   ((nx_gzip_trace & 0x8) || nx_gzip_stats_live)
+#define nx_gzip_print_statistics()    (nx_gzip_trace & 0x8)
 #define nx_gzip_per_stream_stat()     (nx_gzip_trace & 0x10)
 
+/* nx_log.c; weak so that programs built without it still link */
+#define NX_LOG_PID  0		/* timestamp and pid before the message */
+#define NX_LOG_TIME 1		/* timestamp */
+#define NX_LOG_RAW  2
+extern int nx_log_async __attribute__((weak));
+extern void nx_log(int kind, const char *fmt, ...) __attribute__((weak, format(printf, 2, 3)));
+extern void nx_log_drain(void);
+extern void nx_log_stop(void);
+#define nx_log_enabled()  (&nx_log_async != NULL && nx_log_async)
+
 #define prt_timestamp() do {	\
 	time_t t; struct tm* m; time(&t); m=localtime(&t);	\
 	fprintf(nx_gzip_log, "[%04d/%02d/%02d %02d:%02d:%02d] ",	\
@@ -64,6 +76,10 @@ pthread_mutex_t mutex_log;
 } while(0)
 
 #define prt(fmt, ...) do { \
+	if (nx_log_enabled()) {						\
+		nx_log(NX_LOG_PID, fmt, ## __VA_ARGS__);		\
+		break;							\
+	}								\
 	pthread_mutex_lock (&mutex_log);				\
 	flock(nx_gzip_log->_fileno, LOCK_EX);				\
 	prt_timestamp();						\
@@ -97,19 +113,27 @@ pthread_mutex_t mutex_log;
 }} while (0)
 
 /* Trace statistics */
-#define prt_stat(fmt, ...) do {	if (nx_gzip_gather_statistics()) {	\
+#define prt_stat(fmt, ...) do {	if (nx_gzip_print_statistics()) {	\
 	prt("### "fmt, ## __VA_ARGS__);					\
 }} while (0)
 
 /* Trace zlib hardware implementation */
 #define hw_trace(fmt, ...) do {						\
-		if (nx_gzip_hw_trace_enabled())				\
+		if (!nx_gzip_hw_trace_enabled())			\
+			break;						\
+		if (nx_log_enabled())					\
+			nx_log(NX_LOG_RAW, "hhh " fmt, ## __VA_ARGS__);	\
+		else							\
 			fprintf(nx_gzip_log, "hhh " fmt, ## __VA_ARGS__); \
 	} while (0)
 
 /* Trace zlib software implementation */
 #define sw_trace(fmt, ...) do {						\
-		if (nx_gzip_sw_trace_enabled()) {			\
+		if (!nx_gzip_sw_trace_enabled())			\
+			break;						\
+		if (nx_log_enabled()) {					\
+			nx_log(NX_LOG_TIME, "sss " fmt, ## __VA_ARGS__); \
+		} else {						\
 			prt_timestamp();				\
 			fprintf(nx_gzip_log, "sss " fmt, ## __VA_ARGS__); \
 		}							\
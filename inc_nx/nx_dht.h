@@ -77,6 +77,31 @@ typedef struct dht_entry_t {
 	int dist[DHT_TOPSYM_MAX];
 } dht_entry_t;
 
+/* most frequent symbols; the dht cache keys */
+typedef struct top_sym_t {
+	struct { 
+		uint32_t lzcnt;
+		int sym;
+	} sorted[3];
+} top_sym_t;
+
+/* Summary of the lzcounts of the last job made in one pass over the
+   cpb; the cpb counts are left unmodified. Entropies are order-0
+   estimates in bits */
+typedef struct dht_hist_t {
+	uint32_t lzcount[LLSZ+DSZ] __attribute__ ((aligned (16))); /* host endian */
+	uint64_t lit;        /* literal count */
+	uint64_t len;        /* match count */
+	uint64_t dist;       /* distance count */
+	uint64_t lit_bits;   /* entropy of the literals */
+	uint64_t ent_bits;   /* entropy of all lit/len and dist symbols */
+	uint64_t fht_bits;   /* the same symbols coded with the fixed table */
+	long     src_bytes;  /* source bytes the counts came from */
+	int      incompressible;
+	int      changed;    /* the summary differs from the lookup before */
+	top_sym_t top;
+} dht_hist_t;
+
 typedef struct dht_tab_t {
 	/* put any locks here */
 	int last_used_builtin_idx;
@@ -86,10 +111,37 @@ typedef struct dht_tab_t {
 	long nbytes_accumulated;
 	dht_entry_t *last_used_entry;
 	dht_entry_t *builtin;
+	int builtin_num;             /* entries in builtin[] */
+	int config;                  /* nx_dht_config of this handle; -1 the global */
+	dht_hist_t hist;             /* lzcounts summary of the last lookup */
+	dht_entry_t flat;            /* dht for incompressible data */
 	dht_entry_t cache[DHT_NUM_MAX+1];
 } dht_tab_t;
 
 
+/* Table set file; a trained replacement for the nx_dht_builtin.c
+   tables.  samples/dht_train.c makes one from a corpus.  The header
+   is followed by num records.  All integers are big endian; the first
+   record is the default dht */
+#define DHT_SET_MAGIC    "NXDHTSET"
+#define DHT_SET_VERSION  1
+
+typedef struct dht_set_hdr_t {
+	char     magic[8];
+	uint32_t version;
+	uint32_t num;
+} dht_set_hdr_t;
+
+typedef struct dht_set_rec_t {
+	/* 32bit XOR of the entire record, inclusive of cksum, must
+	   equal 0 */
+	uint32_t cksum;
+	uint32_t in_dhtlen;
+	int32_t  litlen[DHT_TOPSYM_MAX];
+	int32_t  dist[DHT_TOPSYM_MAX];
+	char     in_dht_char[DHT_MAXSZ];
+} dht_set_rec_t;
+
 #define dht_default_req    0  /* use this if no lzcounts available */
 #define dht_search_req     1  /* search the cache and generate if not found */
 #define dht_gen_req        2  /* unconditionally generate; do not cache */
@@ -105,9 +157,35 @@ void dht_end(void *handle);
 /* call in deflate */
 int dht_lookup(nx_gzip_crb_cpb_t *cmdp, int request, void *handle);
 
+/* estimated bits of the next nbytes with the fixed table and with
+   the dht in the cpb; call after a dht_search_req lookup */
+void dht_estimate(nx_gzip_crb_cpb_t *cmdp, void *handle, uint64_t nbytes,
+		  uint64_t *fht_bits, uint64_t *dht_bits);
+
+/* nonzero when the last lookup summarized different lzcounts than the
+   one before it, so an earlier dht_estimate may be stale */
+int dht_hist_changed(void *handle);
+
 /* use this utility to make built-in dht data structures */
 int dht_print(void *handle);
 
+/* read a table set file; returns the number of entries in *set or -1
+   on error. Caller frees *set */
+int dht_load_set(const char *fname, dht_entry_t **set);
+
+/* write num entries to a table set file; returns 0 on success */
+int dht_save_set(const char *fname, dht_entry_t *set, int num);
+
+/* handles made by dht_begin from now on use the table set file as
+   their builtin table; fname NULL reverts to nx_dht_builtin.c */
+int dht_set_default(const char *fname);
+
+/* switch one handle's builtin table to the table set file */
+int dht_use_set(void *handle, const char *fname);
+
+/* nx_dht_config for one handle; -1 follows the global again */
+int dht_set_config(void *handle, int config);
+
 /* given lzcounts produce a dynamic huffman table */
 int dhtgen(uint32_t  *lhist,        /* supply the P9 LZ counts here */
 	   int num_lhist,
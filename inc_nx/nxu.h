@@ -57,10 +57,10 @@
 #endif
 
 #ifdef NXTIMER
-#include <sys/platform/ppc.h>
+#include "nx_clock.h"
 #define NX_CLK(X)      do { X; } while(0)
-#define nx_get_time()  __ppc_get_timebase()
-#define nx_get_freq()  __ppc_get_timebase_freq()
+#define nx_get_time()  nx_clock_now()
+#define nx_get_freq()  nx_clock_freq()
 #else
 #define NX_CLK(X)      do {;} while(0)
 #define nx_get_time()  (-1)
@@ -559,12 +559,22 @@ typedef struct {
 #define INIT_CRC   0  /* crc32(0L, Z_NULL, 0) */
 #define INIT_ADLER 1  /* adler32(0L, Z_NULL, 0) */ /* adler is initalized to 1 */
 
+/* what nxu_run_job went through for the last job of the thread */
+struct nxu_run_stats {
+	uint32_t paste_busy;	/* pastes the NX did not take */
+	uint32_t csb_polls;	/* CSB reads until valid */
+	uint32_t faults;	/* pages touched after a fault */
+};
+extern __thread struct nxu_run_stats nxu_run_stats;
+
 /* prototypes */
 #ifdef NX_JOB_CALLBACK
 int nxu_run_job(nx_gzip_crb_cpb_t *c, void *handle, int (*callback)(const void *));
 #else
 int nxu_run_job(nx_gzip_crb_cpb_t *c, void *handle);
 #endif
+void nxu_set_wait(uint64_t spin_ns, uint64_t sleep_ns);
+void nxu_get_wait(uint64_t *spin_ns, uint64_t *sleep_ns);
 
 
 /* caller supplies a print buffer 4*sizeof(crb) */
@@ -5,6 +5,8 @@
  * Changes:
  *    derived from adler32.c in zlib 1.2.11
  *    extern function names prefixed with nx_ to prevent zlib name collisions
+ *    VSX, SSSE3, AVX2 and NEON versions picked at load time; the zlib
+ *    loop is kept as the reference and for short lengths
  */
 
 #include <stddef.h>
@@ -65,9 +67,9 @@ typedef size_t  z_size_t;
 #endif
 
 /* ========================================================================= */
-unsigned long nx_adler32_z(adler, buf, len)
+static unsigned long adler32_scalar(adler, buf, len)
     unsigned long adler;
-    const char *buf;
+    const unsigned char *buf;
     z_size_t len;
 {
     unsigned long sum2;
@@ -135,6 +137,230 @@ unsigned long nx_adler32_z(adler, buf, len)
     return adler | (sum2 << 16);
 }
 
+/* ========================================================================= */
+/*
+   The vector versions sum blocks of 16 (32 for AVX2) bytes x[b][0..15]
+   of a run of n bytes.  Over the run
+
+     adler += sum of all x
+     sum2  += n * adler + 16 * sum over b of (x of the blocks before b)
+                        + sum of (16 - i) * x[b][i]
+
+   so per block the lanes keep the byte sums, their running total
+   before the block and the weighted sums.  A run is at most NMAX
+   bytes so no lane overflows and one modulo is enough.  What is left
+   under a block goes to adler32_scalar.
+*/
+#define VEC_MIN_LEN 64  /* shorter is faster with the scalar loop */
+
+#if defined(__powerpc64__) && defined(__VSX__)
+#include <altivec.h>
+#define ADLER_VSX
+
+static unsigned long adler32_vsx(unsigned long adler, const unsigned char *buf, z_size_t len)
+{
+    const vector unsigned char w = {16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1};
+    const vector unsigned int zero = {0, 0, 0, 0};
+    unsigned long sum2 = (adler >> 16) & 0xffff;
+    unsigned int t1[4], tps[4], t2[4];
+    z_size_t n;
+    int i;
+
+    adler &= 0xffff;
+    while (len >= 16) {
+        vector unsigned int v1 = zero, vps = zero, v2 = zero;
+
+        n = (len < NMAX ? len : NMAX) & ~(z_size_t)15;
+        len -= n;
+        sum2 += n * adler;
+        for (; n; n -= 16, buf += 16) {
+            vector unsigned char x = vec_xl(0, buf);
+            vps = vec_add(vps, v1);
+            v1 = vec_sum4s(x, v1);
+            v2 = vec_msum(x, w, v2);
+        }
+        vec_xst(v1, 0, t1);
+        vec_xst(vps, 0, tps);
+        vec_xst(v2, 0, t2);
+        for (i = 0; i < 4; i++) {
+            adler += t1[i];
+            sum2 += 16 * (unsigned long)tps[i] + t2[i];
+        }
+        MOD(adler);
+        MOD(sum2);
+    }
+    return adler32_scalar(adler | (sum2 << 16), buf, len);
+}
+#endif
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define ADLER_X86
+
+__attribute__((target("ssse3")))
+static unsigned long adler32_ssse3(unsigned long adler, const unsigned char *buf, z_size_t len)
+{
+    const __m128i w = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i zero = _mm_setzero_si128();
+    unsigned long sum2 = (adler >> 16) & 0xffff;
+    unsigned int t1[4], tps[4], t2[4];
+    z_size_t n;
+    int i;
+
+    adler &= 0xffff;
+    while (len >= 16) {
+        __m128i v1 = zero, vps = zero, v2 = zero;
+
+        n = (len < NMAX ? len : NMAX) & ~(z_size_t)15;
+        len -= n;
+        sum2 += n * adler;
+        for (; n; n -= 16, buf += 16) {
+            __m128i x = _mm_loadu_si128((const __m128i *)buf);
+            vps = _mm_add_epi32(vps, v1);
+            v1 = _mm_add_epi32(v1, _mm_sad_epu8(x, zero));
+            v2 = _mm_add_epi32(v2, _mm_madd_epi16(_mm_maddubs_epi16(x, w), ones));
+        }
+        _mm_storeu_si128((__m128i *)t1, v1);
+        _mm_storeu_si128((__m128i *)tps, vps);
+        _mm_storeu_si128((__m128i *)t2, v2);
+        for (i = 0; i < 4; i++) {
+            adler += t1[i];
+            sum2 += 16 * (unsigned long)tps[i] + t2[i];
+        }
+        MOD(adler);
+        MOD(sum2);
+    }
+    return adler32_scalar(adler | (sum2 << 16), buf, len);
+}
+
+__attribute__((target("avx2")))
+static unsigned long adler32_avx2(unsigned long adler, const unsigned char *buf, z_size_t len)
+{
+    const __m256i w = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+                                       16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+    const __m256i ones = _mm256_set1_epi16(1);
+    const __m256i zero = _mm256_setzero_si256();
+    unsigned long sum2 = (adler >> 16) & 0xffff;
+    unsigned int t1[8], tps[8], t2[8];
+    z_size_t n;
+    int i;
+
+    adler &= 0xffff;
+    while (len >= 32) {
+        __m256i v1 = zero, vps = zero, v2 = zero;
+
+        n = (len < NMAX ? len : NMAX) & ~(z_size_t)31;
+        len -= n;
+        sum2 += n * adler;
+        for (; n; n -= 32, buf += 32) {
+            __m256i x = _mm256_loadu_si256((const __m256i *)buf);
+            vps = _mm256_add_epi32(vps, v1);
+            v1 = _mm256_add_epi32(v1, _mm256_sad_epu8(x, zero));
+            v2 = _mm256_add_epi32(v2, _mm256_madd_epi16(_mm256_maddubs_epi16(x, w), ones));
+        }
+        _mm256_storeu_si256((__m256i *)t1, v1);
+        _mm256_storeu_si256((__m256i *)tps, vps);
+        _mm256_storeu_si256((__m256i *)t2, v2);
+        for (i = 0; i < 8; i++) {
+            adler += t1[i];
+            sum2 += 32 * (unsigned long)tps[i] + t2[i];
+        }
+        MOD(adler);
+        MOD(sum2);
+    }
+    return adler32_scalar(adler | (sum2 << 16), buf, len);
+}
+#endif
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#define ADLER_NEON
+
+/* NEON is part of ARMv8-A; no dispatch needed */
+static unsigned long adler32_neon(unsigned long adler, const unsigned char *buf, z_size_t len)
+{
+    static const uint8_t wb[16] = {16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1};
+    const uint8x16_t w = vld1q_u8(wb);
+    unsigned long sum2 = (adler >> 16) & 0xffff;
+    z_size_t n;
+
+    adler &= 0xffff;
+    while (len >= 16) {
+        uint32x4_t v1 = vdupq_n_u32(0), vps = vdupq_n_u32(0), v2 = vdupq_n_u32(0);
+
+        n = (len < NMAX ? len : NMAX) & ~(z_size_t)15;
+        len -= n;
+        sum2 += n * adler;
+        for (; n; n -= 16, buf += 16) {
+            uint8x16_t x = vld1q_u8(buf);
+            uint16x8_t t;
+            vps = vaddq_u32(vps, v1);
+            v1 = vpadalq_u16(v1, vpaddlq_u8(x));
+            t = vmull_u8(vget_low_u8(x), vget_low_u8(w));
+            t = vmlal_u8(t, vget_high_u8(x), vget_high_u8(w));
+            v2 = vpadalq_u16(v2, t);
+        }
+        adler += vaddvq_u32(v1);
+        sum2 += 16 * (unsigned long)vaddvq_u32(vps) + vaddvq_u32(v2);
+        MOD(adler);
+        MOD(sum2);
+    }
+    return adler32_scalar(adler | (sum2 << 16), buf, len);
+}
+#endif
+
+/* ========================================================================= */
+typedef unsigned long (*adler32_fn)(unsigned long, const unsigned char *, z_size_t);
+
+static unsigned long adler32_ref(unsigned long adler, const unsigned char *buf, z_size_t len)
+{
+    return adler32_scalar(adler, buf, len);
+}
+
+/* picked once when the library is loaded; see nx_adler32_z */
+static adler32_fn adler32_resolve(void)
+{
+#if defined(ADLER_VSX)
+    if (__builtin_cpu_supports("vsx"))
+        return adler32_vsx;
+#elif defined(ADLER_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return adler32_avx2;
+    if (__builtin_cpu_supports("ssse3"))
+        return adler32_ssse3;
+#elif defined(ADLER_NEON)
+    return adler32_neon;
+#endif
+    return adler32_ref;
+}
+
+#if (defined(ADLER_VSX) || defined(ADLER_X86)) && defined(__ELF__)
+static unsigned long adler32_vec(unsigned long adler, const unsigned char *buf, z_size_t len)
+    __attribute__((ifunc("adler32_resolve")));
+#else
+static unsigned long adler32_vec(unsigned long adler, const unsigned char *buf, z_size_t len)
+{
+    static adler32_fn fn = NULL;
+
+    if (fn == NULL)
+        fn = adler32_resolve();
+    return fn(adler, buf, len);
+}
+#endif
+
+unsigned long nx_adler32_z(adler, buf, len)
+    unsigned long adler;
+    const char *buf;
+    z_size_t len;
+{
+    /* keeps the len == 1 and buf == NULL cases of the scalar loop */
+    if (len < VEC_MIN_LEN || buf == NULL)
+        return adler32_scalar(adler, (const unsigned char *)buf, len);
+    return adler32_vec(adler, (const unsigned char *)buf, len);
+}
+
 /* ========================================================================= */
 unsigned long nx_adler32(adler, buf, len)
     unsigned long adler;
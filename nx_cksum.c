@@ -0,0 +1,297 @@
+/*
+ * NX-GZIP compression accelerator user library
+ * implementing zlib compression library interfaces
+ *
+ * Copyright (C) IBM Corporation, 2011-2017
+ *
+ * Licenses for GPLv2 and Apache v2.0:
+ *
+ * GPLv2:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * Apache v2.0:
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+   Checksums of large buffers on several threads.
+
+   nx_checksum_mt() cuts the buffer in to CKSUM_CHUNK pieces.  The
+   caller and a pool of worker threads take pieces in turn from a
+   shared counter and checksum each with nx_crc32 and nx_adler32_z,
+   a slice at a time so that the adler32 pass reads what the crc32
+   pass just brought in to the cache.  The caller then merges the
+   pieces in order with the combine functions.
+
+   The pool is started on first use with nx_config.cksum_threads - 1
+   workers and serves one call at a time; a call that finds it busy,
+   or a buffer of less than two pieces, runs on the calling thread
+   alone.  The vector crc32 and adler32 kernels are faster than an
+   NX GZIP_FC_WRAP job, which also needs a target buffer, so the
+   workers do not use the accelerator.
+*/
+
+/*
+   nx_copy_cksum() is the software side of nx_copy(): it copies a
+   slice small enough to stay in the L1 cache, then checksums the
+   copy, so the source is read from memory once as with an NX
+   GZIP_FC_WRAP job instead of once for memcpy and again for each
+   checksum.  nx_copy() calibrates where the NX job gets faster.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <zlib.h>
+#include "nxu.h"
+#include "nx_zlib.h"
+#include "nx_dbg.h"
+
+#define CKSUM_CHUNK  (4UL<<20)	/* bytes a thread takes at a time */
+#define CKSUM_SLICE  (64UL<<10)	/* crc32 then adler32 of this much */
+#define COPY_SLICE   (8UL<<10)	/* copy, crc32 and adler32 from L1 */
+
+struct cksum_job {
+	const unsigned char *buf;
+	uint64_t len;
+	uint64_t nchunks;
+	uint64_t next;		/* next chunk to take */
+	int max_workers;	/* the caller's thread is not one */
+	uint32_t *crc;		/* per chunk, NULL if not wanted */
+	uint32_t *adler;
+};
+
+static pthread_mutex_t cksum_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t cksum_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cksum_work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t cksum_done_cond = PTHREAD_COND_INITIALIZER;
+static struct cksum_job *cksum_job;	/* current call, under cksum_pool_mutex */
+static uint64_t cksum_gen;		/* bumped for each call */
+static int cksum_active;		/* workers in cksum_run */
+static int cksum_workers;		/* started so far */
+
+static void cksum_chunk(struct cksum_job *j, uint64_t i)
+{
+	const unsigned char *p = j->buf + i * CKSUM_CHUNK;
+	uint64_t len = NX_MIN(CKSUM_CHUNK, j->len - i * CKSUM_CHUNK);
+	unsigned long crc = INIT_CRC, adler = INIT_ADLER;
+
+	while (len > 0) {
+		uint64_t n = NX_MIN(CKSUM_SLICE, len);
+
+		if (j->crc != NULL)
+			crc = nx_crc32(crc, p, n);
+		if (j->adler != NULL)
+			adler = nx_adler32_z(adler, (const char *)p, n);
+		p += n;
+		len -= n;
+	}
+	if (j->crc != NULL)
+		j->crc[i] = crc;
+	if (j->adler != NULL)
+		j->adler[i] = adler;
+}
+
+/* takes chunks of j until there are none left */
+static void cksum_run(struct cksum_job *j)
+{
+	uint64_t i;
+
+	while ((i = __atomic_fetch_add(&j->next, 1, __ATOMIC_RELAXED)) < j->nchunks)
+		cksum_chunk(j, i);
+}
+
+static void *cksum_worker(void *arg)
+{
+	uint64_t gen = 0;
+	struct cksum_job *j;
+
+	(void)arg;
+	for (;;) {
+		pthread_mutex_lock(&cksum_pool_mutex);
+		while (cksum_gen == gen || cksum_job == NULL)
+			pthread_cond_wait(&cksum_work_cond, &cksum_pool_mutex);
+		gen = cksum_gen;
+		j = cksum_job;
+		if (cksum_active >= j->max_workers) {
+			pthread_mutex_unlock(&cksum_pool_mutex);
+			continue;
+		}
+		++cksum_active;
+		pthread_mutex_unlock(&cksum_pool_mutex);
+
+		cksum_run(j);
+
+		/* the caller waits for this before j goes away */
+		pthread_mutex_lock(&cksum_pool_mutex);
+		if (--cksum_active == 0)
+			pthread_cond_signal(&cksum_done_cond);
+		pthread_mutex_unlock(&cksum_pool_mutex);
+	}
+	return NULL;
+}
+
+/* a forked child has none of the workers */
+static void cksum_atfork_child(void)
+{
+	pthread_mutex_init(&cksum_mutex, NULL);
+	pthread_mutex_init(&cksum_pool_mutex, NULL);
+	pthread_cond_init(&cksum_work_cond, NULL);
+	pthread_cond_init(&cksum_done_cond, NULL);
+	cksum_job = NULL;
+	cksum_active = 0;
+	cksum_workers = 0;
+}
+
+/* starts workers up to want; under cksum_mutex */
+static void cksum_pool_start(int want)
+{
+	static int atfork_done;
+	pthread_attr_t attr;
+	pthread_t t;
+
+	if (!atfork_done) {
+		pthread_atfork(NULL, NULL, cksum_atfork_child);
+		atfork_done = 1;
+	}
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	while (cksum_workers < want) {
+		if (pthread_create(&t, &attr, cksum_worker, NULL) != 0) {
+			prt_err("nx_checksum_mt: started %d of %d threads\n", cksum_workers, want);
+			break;
+		}
+		++cksum_workers;
+	}
+	pthread_attr_destroy(&attr);
+}
+
+/*
+   Copies len bytes from src to dst.  *crc and *adler, either of which
+   may be NULL, are updated with the checksums of the data.
+*/
+void nx_copy_cksum(char *dst, const char *src, uint64_t len, uint32_t *crc, uint32_t *adler)
+{
+	unsigned long c = (crc != NULL) ? *crc : 0, a = (adler != NULL) ? *adler : 0;
+
+	while (len > 0) {
+		uint64_t n = NX_MIN(COPY_SLICE, len);
+
+		memcpy(dst, src, n);
+		if (crc != NULL)
+			c = nx_crc32(c, (const unsigned char *)dst, n);
+		if (adler != NULL)
+			a = nx_adler32_z(a, dst, n);
+		dst += n;
+		src += n;
+		len -= n;
+	}
+	if (crc != NULL)
+		*crc = c;
+	if (adler != NULL)
+		*adler = a;
+}
+
+/*
+   crc32 and/or adler32 of len bytes at buf.  *crc and *adler are the
+   checksums of the data before buf and are updated; either may be
+   NULL.  threads is the most threads to use including the caller's,
+   0 for nx_config.cksum_threads.
+*/
+int nx_checksum_mt(const unsigned char *buf, uint64_t len, uint32_t *crc, uint32_t *adler, int threads)
+{
+	struct cksum_job j;
+	unsigned long crc_op, c, a;
+	uint64_t i, clen;
+
+	if (buf == NULL || (crc == NULL && adler == NULL))
+		return Z_STREAM_ERROR;
+
+	if (threads <= 0)
+		threads = nx_config.cksum_threads;
+
+	j.nchunks = (len + CKSUM_CHUNK - 1) / CKSUM_CHUNK;
+	if (threads < 2 || j.nchunks < 2 || pthread_mutex_trylock(&cksum_mutex) != 0) {
+		if (crc != NULL)
+			*crc = nx_crc32(*crc, buf, len);
+		if (adler != NULL)
+			*adler = nx_adler32_z(*adler, (const char *)buf, len);
+		return Z_OK;
+	}
+
+	j.buf = buf;
+	j.len = len;
+	j.next = 0;
+	j.max_workers = NX_MIN((uint64_t)threads, j.nchunks) - 1;
+	j.crc = (crc != NULL) ? malloc(j.nchunks * sizeof(uint32_t)) : NULL;
+	j.adler = (adler != NULL) ? malloc(j.nchunks * sizeof(uint32_t)) : NULL;
+	if ((crc != NULL && j.crc == NULL) || (adler != NULL && j.adler == NULL)) {
+		free(j.crc);
+		free(j.adler);
+		pthread_mutex_unlock(&cksum_mutex);
+		return Z_MEM_ERROR;
+	}
+
+	cksum_pool_start(j.max_workers);
+
+	pthread_mutex_lock(&cksum_pool_mutex);
+	cksum_job = &j;
+	++cksum_gen;
+	pthread_cond_broadcast(&cksum_work_cond);
+	pthread_mutex_unlock(&cksum_pool_mutex);
+
+	cksum_run(&j);
+
+	/* every chunk is taken now; workers still in cksum_run hold a
+	   pointer to j */
+	pthread_mutex_lock(&cksum_pool_mutex);
+	while (cksum_active > 0)
+		pthread_cond_wait(&cksum_done_cond, &cksum_pool_mutex);
+	cksum_job = NULL;
+	pthread_mutex_unlock(&cksum_pool_mutex);
+
+	/* all chunks but the last are CKSUM_CHUNK long */
+	crc_op = nx_crc32_combine_gen(CKSUM_CHUNK);
+	c = (crc != NULL) ? *crc : 0;
+	a = (adler != NULL) ? *adler : 0;
+	for (i = 0; i < j.nchunks; i++) {
+		clen = NX_MIN(CKSUM_CHUNK, len - i * CKSUM_CHUNK);
+		if (crc != NULL)
+			c = (clen == CKSUM_CHUNK) ? nx_crc32_combine_op(c, j.crc[i], crc_op) :
+				nx_crc32_combine(c, j.crc[i], clen);
+		if (adler != NULL)
+			a = nx_adler32_combine(a, j.adler[i], clen);
+	}
+	if (crc != NULL)
+		*crc = c;
+	if (adler != NULL)
+		*adler = a;
+
+	pthread_mutex_unlock(&cksum_mutex);
+	free(j.crc);
+	free(j.adler);
+	return Z_OK;
+}
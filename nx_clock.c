@@ -0,0 +1,158 @@
+/*
+ * NX-GZIP compression accelerator user library
+ * implementing zlib compression library interfaces
+ *
+ * Copyright (C) IBM Corporation, 2011-2017
+ *
+ * Licenses for GPLv2 and Apache v2.0:
+ *
+ * GPLv2:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * Apache v2.0:
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+/*
+   The clock of nx_clock.h.  nx_clock_init() picks the source; it runs
+   as a constructor, and again first thing in nx_hw_init() in case that
+   constructor runs first, so that nx_clock_now() never changes source
+   under a caller.  The frequency is found on first use: POWER reads
+   the timebase frequency, the TSC is timed against CLOCK_MONOTONIC
+   over NX_CLOCK_CAL_NS, about 10 ppm from the two bracketing reads.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+#include "nx_clock.h"
+
+#define NX_CLOCK_CAL_NS 10000000L
+
+int nx_clock_source;
+
+static pthread_once_t clock_once = PTHREAD_ONCE_INIT;
+static uint64_t clock_hz;
+static double clock_ns_per_tick;
+
+#if !defined(__powerpc__)
+static uint64_t clock_mono_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+/* TSC ticks per second, timed against CLOCK_MONOTONIC */
+static uint64_t clock_tsc_calibrate(void)
+{
+	struct timespec d = { 0, NX_CLOCK_CAL_NS };
+	uint64_t m0, m1, c0, c1;
+
+	m0 = clock_mono_ns();
+	c0 = __rdtsc();
+	m0 = (m0 + clock_mono_ns()) / 2;
+	nanosleep(&d, NULL);
+	m1 = clock_mono_ns();
+	c1 = __rdtsc();
+	m1 = (m1 + clock_mono_ns()) / 2;
+	if (m1 <= m0 || c1 <= c0)
+		return 0;
+	return (uint64_t)((double)(c1 - c0) * 1.0e9 / (m1 - m0) + 0.5);
+}
+#endif
+
+static void clock_calibrate(void)
+{
+#if defined(__powerpc__)
+	clock_hz = __ppc_get_timebase_freq();
+#else
+	clock_hz = 1000000000UL;
+#if defined(__x86_64__) || defined(__i386__)
+	if (nx_clock_source == NX_CLOCK_TSC) {
+		uint64_t hz = clock_tsc_calibrate();
+
+		if (hz != 0)
+			clock_hz = hz;
+		else
+			nx_clock_source = NX_CLOCK_MONOTONIC;
+	}
+#endif
+#endif
+	clock_ns_per_tick = 1.0e9 / clock_hz;
+}
+
+void nx_clock_init(void) __attribute__((constructor));
+void nx_clock_init(void)
+{
+#if defined(__powerpc__)
+	nx_clock_source = NX_CLOCK_TIMEBASE;
+#elif defined(__x86_64__) || defined(__i386__)
+	unsigned int a, b, c, d;
+
+	/* cpuid 0x80000007 edx bit 8: invariant TSC */
+	if (__get_cpuid(0x80000007, &a, &b, &c, &d) && (d & (1 << 8)))
+		nx_clock_source = NX_CLOCK_TSC;
+	else
+		nx_clock_source = NX_CLOCK_MONOTONIC;
+#else
+	nx_clock_source = NX_CLOCK_MONOTONIC;
+#endif
+}
+
+/* ticks per second */
+uint64_t nx_clock_freq(void)
+{
+	pthread_once(&clock_once, clock_calibrate);
+	return clock_hz;
+}
+
+const char *nx_clock_name(void)
+{
+	switch (nx_clock_source) {
+	case NX_CLOCK_TIMEBASE: return "timebase";
+	case NX_CLOCK_TSC:      return "tsc";
+	default:                return "monotonic";
+	}
+}
+
+double nx_clock_to_ns(uint64_t ticks)
+{
+	pthread_once(&clock_once, clock_calibrate);
+	return (double)ticks * clock_ns_per_tick;
+}
+
+uint64_t nx_clock_from_ns(double ns)
+{
+	pthread_once(&clock_once, clock_calibrate);
+	return (uint64_t)(ns / clock_ns_per_tick + 0.5);
+}
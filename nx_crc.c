@@ -33,7 +33,6 @@
 #include <stdint.h>
 #include <stddef.h>  /* ptrdiff_t */
 #include <byteswap.h>
-#include "crc32_ppc.h"
 
 /* make crc32.c work without external zlib headers */
 #undef MAKECRCH
@@ -55,6 +54,12 @@ typedef off_t    z_off64_t;
 #define Z_NULL NULL
 #define ZSWAP32(q) bswap_32(q)
 
+/* crc32_fold.c */
+extern unsigned long nx_crc32(unsigned long crc, const unsigned char *buf, uint64_t len);
+extern unsigned long nx_crc32_combine(unsigned long crc1, unsigned long crc2, uint64_t len2);
+extern unsigned long nx_crc32_combine_gen(uint64_t len2);
+extern unsigned long nx_crc32_combine_op(unsigned long crc1, unsigned long crc2, unsigned long op);
+
 
 #ifdef MAKECRCH
 #  include <stdio.h>
@@ -79,12 +84,6 @@ typedef off_t    z_off64_t;
 #  define TBLS 1
 #endif /* BYFOUR */
 
-/* Local functions for crc concatenation */
-local unsigned long gf2_matrix_times OF((unsigned long *mat,
-                                         unsigned long vec));
-local void gf2_matrix_square OF((unsigned long *square, unsigned long *mat));
-local uLong crc32_combine_ OF((uLong crc1, uLong crc2, z_off64_t len2));
-
 
 #ifdef DYNAMIC_CRC_TABLE
 
@@ -269,7 +268,8 @@ local unsigned long nx_crc32_z(crc, buf, len)
 }
 
 /* ========================================================================= */
-unsigned long ZEXPORT nx_crc32(crc, buf, len)
+/* zlib's table driven crc32; nx_crc32 in crc32_fold.c is the one in use */
+unsigned long ZEXPORT nx_crc32_table(crc, buf, len)
     unsigned long crc;
     const unsigned char FAR *buf;
     uint64_t len;
@@ -373,132 +373,66 @@ local unsigned long crc32_big(crc, buf, len)
 
 #endif /* BYFOUR */
 
-#define GF2_DIM 32      /* dimension of GF(2) vectors (length of CRC) */
-
 /* ========================================================================= */
-local unsigned long gf2_matrix_times(mat, vec)
-    unsigned long *mat;
-    unsigned long vec;
+uLong nx_crc32_combine64(crc1, crc2, len2)
+    uLong crc1;
+    uLong crc2;
+    uint64_t len2;
 {
-    unsigned long sum;
-
-    sum = 0;
-    while (vec) {
-        if (vec & 1)
-            sum ^= *mat;
-        vec >>= 1;
-        mat++;
-    }
-    return sum;
+    return nx_crc32_combine(crc1, crc2, len2);
 }
 
-/* ========================================================================= */
-local void gf2_matrix_square(square, mat)
-    unsigned long *square;
-    unsigned long *mat;
+#ifdef ZLIB_API
+unsigned long crc32(crc, buf, len)
+    unsigned long crc;
+    const unsigned char FAR *buf;
+    uint64_t len;
 {
-    int n;
-
-    for (n = 0; n < GF2_DIM; n++)
-        square[n] = gf2_matrix_times(mat, mat[n]);
+    return nx_crc32(crc, buf, len);
 }
 
-/* ========================================================================= */
-local uLong crc32_combine_(crc1, crc2, len2)
-    uLong crc1;
-    uLong crc2;
-    z_off64_t len2;
+unsigned long crc32_z(crc, buf, len)
+    unsigned long crc;
+    const unsigned char FAR *buf;
+    z_size_t len;
 {
-    int n;
-    unsigned long row;
-    unsigned long even[GF2_DIM];    /* even-power-of-two zeros operator */
-    unsigned long odd[GF2_DIM];     /* odd-power-of-two zeros operator */
-
-    /* degenerate case (also disallow negative lengths) */
-    if (len2 <= 0)
-        return crc1;
-
-    /* put operator for one zero bit in odd */
-    odd[0] = 0xedb88320UL;          /* CRC-32 polynomial */
-    row = 1;
-    for (n = 1; n < GF2_DIM; n++) {
-        odd[n] = row;
-        row <<= 1;
-    }
-
-    /* put operator for two zero bits in even */
-    gf2_matrix_square(even, odd);
-
-    /* put operator for four zero bits in odd */
-    gf2_matrix_square(odd, even);
-
-    /* apply len2 zeros to crc1 (first square will put the operator for one
-       zero byte, eight zero bits, in even) */
-    do {
-        /* apply zeros operator for this bit of len2 */
-        gf2_matrix_square(even, odd);
-        if (len2 & 1)
-            crc1 = gf2_matrix_times(even, crc1);
-        len2 >>= 1;
-
-        /* if no more bits set, then done */
-        if (len2 == 0)
-            break;
-
-        /* another iteration of the loop with odd and even swapped */
-        gf2_matrix_square(odd, even);
-        if (len2 & 1)
-            crc1 = gf2_matrix_times(odd, crc1);
-        len2 >>= 1;
-
-        /* if no more bits set, then done */
-    } while (len2 != 0);
-
-    /* return combined crc */
-    crc1 ^= crc2;
-    return crc1;
+    return nx_crc32(crc, buf, len);
 }
 
-/* ========================================================================= */
-uLong nx_crc32_combine(crc1, crc2, len2)
+uLong crc32_combine(crc1, crc2, len2)
     uLong crc1;
     uLong crc2;
     uint64_t len2;
 {
-    return crc32_combine_(crc1, crc2, len2);
+    return nx_crc32_combine(crc1, crc2, len2);
 }
 
-uLong nx_crc32_combine64(crc1, crc2, len2)
+uLong crc32_combine64(crc1, crc2, len2)
     uLong crc1;
     uLong crc2;
     uint64_t len2;
 {
-    return crc32_combine_(crc1, crc2, len2);
+    return nx_crc32_combine64(crc1, crc2, len2);
 }
 
-#ifdef ZLIB_API
-unsigned long crc32(crc, buf, len)
-    unsigned long crc;
-    const unsigned char FAR *buf;
-    uint64_t len;
+uLong crc32_combine_gen(len2)
+    z_off_t len2;
 {
-    return crc32_ppc(crc, (unsigned char *)buf, len);
+    return nx_crc32_combine_gen(len2);
 }
 
-uLong crc32_combine(crc1, crc2, len2)
-    uLong crc1;
-    uLong crc2;
-    uint64_t len2;
+uLong crc32_combine_gen64(len2)
+    z_off64_t len2;
 {
-    return nx_crc32_combine(crc1, crc2, len2);
+    return nx_crc32_combine_gen(len2);
 }
 
-uLong crc32_combine64(crc1, crc2, len2)
+uLong crc32_combine_op(crc1, crc2, op)
     uLong crc1;
     uLong crc2;
-    uint64_t len2;
+    uLong op;
 {
-    return nx_crc32_combine64(crc1, crc2, len2);
+    return nx_crc32_combine_op(crc1, crc2, op);
 }
 #endif
 
@@ -71,6 +71,7 @@
 /* deflateSetDictionary constants */
 #define DEF_MAX_DICT_LEN   ((1L<<15)-272)
 #define DEF_DICT_THRESHOLD (1<<8) /* TODO make this config variable */
+#define DEF_FHT_THRESHOLD  (1<<10) /* first block smaller than this does not pay for a dht */
 
 #define fifo_out_len_check(s) \
 do { if ((s)->cur_out > (s)->len_out/2) { \
@@ -716,8 +717,6 @@ static int nx_deflateResetKeep(z_streamp strm)
 	else if (s->wrap == 1) s->status = NX_ZLIB_INIT_ST;
 	else if (s->wrap == 2) s->status = NX_GZIP_INIT_ST;
 
-	s->len_out = nx_config.deflate_fifo_out_len;
-
 	if (s->strategy == Z_DEFAULT_STRATEGY && s->dhthandle == NULL)
 		s->dhthandle = dht_begin(NULL, NULL);
 
@@ -737,7 +736,16 @@ static int nx_deflateResetKeep(z_streamp strm)
 	if (s->wrap == 1)      strm->adler = s->adler32;
 	else if (s->wrap == 2) strm->adler = s->crc32;
 
+	/* a shared dictionary stays attached; every message gets it */
+	if (s->shared_dict != NULL && s->wrap != 2) {
+		s->dict_len = s->shared_dict->len;
+		s->dict_end = s->shared_dict->buf + s->shared_dict->len;
+		s->dict_id = s->shared_dict->dict_id;
+		if (s->wrap == 1) strm->adler = s->dict_id;
+	}
+
 	s->invoke_cnt = 0;
+	s->fc_nbytes = 0;
 
 	return Z_OK;
 }
@@ -763,7 +771,7 @@ int nx_deflateEnd(z_streamp strm)
 		return Z_STREAM_ERROR;
 
 	/* statistic*/
-	zlib_stats_inc(&zlib_stats.deflateEnd);
+	zlib_stats_inc(deflateEnd);
 
 	status = s->status;
 	/* TODO add here Z_DATA_ERROR if the stream was freed
@@ -774,6 +782,7 @@ int nx_deflateEnd(z_streamp strm)
 	nx_free_buffer(s->fifo_in, s->len_in, 0);
 	nx_free_buffer(s->fifo_out, s->len_out, 0);
 	nx_free_buffer(s->dict, s->dict_alloc_len, 0);
+	nx_dictRelease(s->shared_dict);
 
 	nx_close(s->nxdevp);
 
@@ -802,7 +811,7 @@ int nx_deflateInit2_(z_streamp strm, int level, int method, int windowBits,
 	if (strm == Z_NULL) return Z_STREAM_ERROR;
 
 	/* statistic */
-	zlib_stats_inc(&zlib_stats.deflateInit);
+	zlib_stats_inc(deflateInit);
 
 	strm->msg = Z_NULL;
 
@@ -854,7 +863,7 @@ int nx_deflateInit2_(z_streamp strm, int level, int method, int windowBits,
 	s->method     = method;
 
 	s->strategy   = strategy;
-	if (s->strategy == Z_FIXED || nx_strategy_override == 0)
+	if (s->strategy == Z_FIXED || __atomic_load_n(&nx_strategy_override, __ATOMIC_RELAXED) == 0)
 		s->strategy = Z_FIXED;
 	else
 		s->strategy = Z_DEFAULT_STRATEGY;
@@ -870,7 +879,7 @@ int nx_deflateInit2_(z_streamp strm, int level, int method, int windowBits,
 	s->dict = NULL;
 	s->dict_len = 0;
 
-	s->len_out = nx_config.deflate_fifo_out_len;
+	s->len_out = __atomic_load_n(&nx_config.deflate_fifo_out_len, __ATOMIC_RELAXED);
 	s->len_out = NX_MAX(s->len_out, DEF_MAX_EXPANSION_LEN);
 	if (NULL == (s->fifo_out = nx_alloc_buffer(s->len_out, nx_config.page_sz, 0)))
 		return Z_MEM_ERROR;
@@ -1050,7 +1059,7 @@ static uint32_t nx_compress_nxstrm_to_ddl_in(nx_streamp s, char *resume_buf, uin
 	/* TODO may need a way to limit the input size from top level
 	   to prevent CC=13 */
 
-	avail_in = NX_MIN(s->avail_in, nx_config.strm_def_bufsz);
+	avail_in = NX_MIN(s->avail_in, s->job_bufsz);
 
 	clearp_dde(s->ddl_in);
 
@@ -1092,7 +1101,7 @@ static uint32_t nx_compress_nxstrm_to_ddl_out(nx_streamp s)
 	// s->cur_out = s->used_out = 0; /* reset fifo_out head */
 
 	/* restrict NX per dde size to 1GB */
-	avail_out = NX_MIN(s->avail_out, nx_config.strm_def_bufsz);
+	avail_out = NX_MIN(s->avail_out, s->job_bufsz);
 
 	clearp_dde(s->ddl_out);
 
@@ -1173,7 +1182,7 @@ static int  nx_compress_block_update_offsets(nx_streamp s, int fc)
 	/* output first written to next_out then the overflow amount
 	   goes to fifo_out */
 
-	copy_bytes = NX_MIN(NX_MIN(tpbc, s->avail_out), nx_config.strm_def_bufsz);
+	copy_bytes = NX_MIN(NX_MIN(tpbc, s->avail_out), s->job_bufsz);
 
 	int bfinal;
 	int bfinal_offset;
@@ -1332,6 +1341,47 @@ static inline int nx_compress_block_append_flush_block(nx_streamp s)
 /* compress as much input as possible creating a single deflate block
    nx_gzip_crb_cpb_t of nx_streamp contains nx parameters and status.
    limit is the max input data to compress: set limit=0 for unlimited  */
+/*
+  Dynamic huffman streams: pick the fixed table for the next block if
+  it encodes smaller than the dht that dht_lookup put in the cpb; the
+  dht header costs up to 288 bytes. Either function code collects
+  lzcounts for the next decision.
+*/
+static int nx_deflate_choose_fc(nx_streamp s)
+{
+	uint64_t fht_bits, dht_bits;
+	uint64_t nbytes = NX_MIN((uint64_t)s->used_in + s->avail_in,
+				 nx_stream_opt(s, NX_OPT_PER_JOB_LEN, per_job_len));
+	uint32_t dhtlen = getnn(s->nxcmdp->cpb, in_dhtlen);
+	int fht;
+
+	if (s->invoke_cnt == 0) {
+		/* no lzcounts yet; go by the size */
+		fht = (nbytes < DEF_FHT_THRESHOLD);
+	}
+	else if (!dht_hist_changed(s->dhthandle) && nbytes == s->fc_nbytes &&
+		 dhtlen == s->fc_dhtlen) {
+		/* same lzcounts, dht and size as the last block */
+		fht = s->fc_fht;
+	}
+	else {
+		dht_estimate(s->nxcmdp, s->dhthandle, nbytes, &fht_bits, &dht_bits);
+		fht = (fht_bits < dht_bits);
+		prt_trace("nx_deflate_choose_fc: %ld bytes fht %ld bits dht %ld bits\n",
+			  (long)nbytes, (long)fht_bits, (long)dht_bits);
+		s->fc_fht = fht;
+		s->fc_dhtlen = dhtlen;
+		s->fc_nbytes = nbytes;
+	}
+
+	if (fht) {
+		zlib_stats_inc(deflate_fht_wins);
+		return GZIP_FC_COMPRESS_RESUME_FHT_COUNT;
+	}
+	zlib_stats_inc(deflate_dht_wins);
+	return GZIP_FC_COMPRESS_RESUME_DHT_COUNT;
+}
+
 static int nx_compress_block(nx_streamp s, int fc, int limit)
 {
 	uint32_t bytes_in, bytes_out;
@@ -1350,6 +1400,8 @@ static int nx_compress_block(nx_streamp s, int fc, int limit)
 	ddl_in = s->ddl_in;
 	ddl_out = s->ddl_out;
 	pgsz = s->page_sz;
+	/* the same for the whole job */
+	s->job_bufsz = nx_stream_opt(s, NX_OPT_DEF_BUF_SIZE, strm_def_bufsz);
 
 	put32(nxcmdp->crb, gzip_fc, 0);
 	putnn(nxcmdp->crb, gzip_fc, fc);
@@ -1371,7 +1423,7 @@ static int nx_compress_block(nx_streamp s, int fc, int limit)
 		/* round down to 16 byte multiple */
 		resume_len = (resume_len / sizeof(nx_qw_t)) * sizeof(nx_qw_t);
 		/* use the last ~32KB of the dictionary */
-		resume_buf = s->dict + (s->dict_len - resume_len);
+		resume_buf = s->dict_end - resume_len;
 		/* if we use dict once, we don't reuse it until the
 		   next setDictionary */
 		s->dict_len = 0;
@@ -1578,69 +1630,69 @@ static int nx_deflate_add_header(nx_streamp s)
 		}
 		else { /* caller supplied header */
 
-			uint8_t flg;
+			uint8_t hdr[10];
+			unsigned long hcrc;
+			unsigned int j, len;
 
-			/* k = 0; */
-			nx_put_byte(s, 0x1f); /* ID1 */
-			nx_put_byte(s, 0x8b); /* ID2 */
-			nx_put_byte(s, 0x08); /* CM */
+			hdr[0] = 0x1f; /* ID1 */
+			hdr[1] = 0x8b; /* ID2 */
+			hdr[2] = 0x08; /* CM */
 
 			/* flg */
-			flg = ((s->gzhead->text) ? 1 : 0) +
-				(s->gzhead->hcrc ? 0 : 0) + /* TODO no hcrc */
+			hdr[3] = ((s->gzhead->text) ? 1 : 0) +
+				(s->gzhead->hcrc ? 2 : 0) +
 				(s->gzhead->extra == NULL ? 0 : 4) +
 				(s->gzhead->name == NULL ? 0 : 8) +
 				(s->gzhead->comment == NULL ? 0 : 16);
-			nx_put_byte(s, flg);
 
 			/* mtime */
-			nx_put_byte(s, (uint8_t)(s->gzhead->time & 0xff));
-			nx_put_byte(s, (uint8_t)((s->gzhead->time >> 8) & 0xff));
-			nx_put_byte(s, (uint8_t)((s->gzhead->time >> 16) & 0xff));
-			nx_put_byte(s, (uint8_t)((s->gzhead->time >> 24) & 0xff));
+			hdr[4] = (uint8_t)(s->gzhead->time & 0xff);
+			hdr[5] = (uint8_t)((s->gzhead->time >> 8) & 0xff);
+			hdr[6] = (uint8_t)((s->gzhead->time >> 16) & 0xff);
+			hdr[7] = (uint8_t)((s->gzhead->time >> 24) & 0xff);
 
 			/* xfl=4 fastest */
-			nx_put_byte(s, 4);
+			hdr[8] = 4;
 			/* os type */
-			nx_put_byte(s, (uint8_t)(s->gzhead->os & 0xff));
+			hdr[9] = (uint8_t)(s->gzhead->os & 0xff);
+
+			for (j = 0; j < sizeof(hdr); j++)
+				nx_put_byte(s, hdr[j]);
+			hcrc = nx_crc32(INIT_CRC, hdr, sizeof(hdr));
 
 			/* fextra, xlen */
 			if (s->gzhead->extra != NULL) {
-				nx_put_byte(s, (uint8_t)(s->gzhead->extra_len & 0xff));
-				nx_put_byte(s, (uint8_t)((s->gzhead->extra_len >> 8) & 0xff));
-
-				int val;
-				int j = 0;
-				int xlen = s->gzhead->extra_len;
-				while (j++ < xlen) {
-					val = s->gzhead->extra[j];
-					nx_put_byte(s, (uint8_t)val);
-				}
+				len = s->gzhead->extra_len;
+				hdr[0] = (uint8_t)(len & 0xff);
+				hdr[1] = (uint8_t)((len >> 8) & 0xff);
+				nx_put_byte(s, hdr[0]);
+				nx_put_byte(s, hdr[1]);
+				for (j = 0; j < len; j++)
+					nx_put_byte(s, s->gzhead->extra[j]);
+				hcrc = nx_crc32(hcrc, hdr, 2);
+				hcrc = nx_crc32(hcrc, s->gzhead->extra, len);
 			}
 
 			/* fname */
 			if (s->gzhead->name != NULL) {
-				int val;
-				int j=0;
-				do {
-					val = s->gzhead->name[j++];
-					nx_put_byte(s, (uint8_t)val);
-				} while (val != 0);
+				len = strlen((char *)s->gzhead->name) + 1;
+				for (j = 0; j < len; j++)
+					nx_put_byte(s, s->gzhead->name[j]);
+				hcrc = nx_crc32(hcrc, s->gzhead->name, len);
 			}
 
 			/* fcomment */
 			if (s->gzhead->comment != NULL) {
-				int val;
-				int j=0;
-				do {
-					val = s->gzhead->comment[j++];
-					nx_put_byte(s, (uint8_t)val);
-				} while (val != 0);
+				len = strlen((char *)s->gzhead->comment) + 1;
+				for (j = 0; j < len; j++)
+					nx_put_byte(s, s->gzhead->comment[j]);
+				hcrc = nx_crc32(hcrc, s->gzhead->comment, len);
 			}
 
-			/* fhcrc */
+			/* fhcrc, the low 16 bits of the crc32 of the header */
 			if (s->gzhead->hcrc) {
-				/* TODO */
+				nx_put_byte(s, (uint8_t)(hcrc & 0xff));
+				nx_put_byte(s, (uint8_t)((hcrc >> 8) & 0xff));
 			}
 		}
 		s->zstrm->adler = s->crc32;
@@ -1677,8 +1729,29 @@ static inline void nx_compress_update_checksum(nx_streamp s, int combine)
 	prt_info("nx_compress_update_checksum crc32 %08x adler32 %08x\n", s->crc32, s->adler32);
 }
 
+static int __nx_deflate(z_streamp strm, int flush);
+
 /* deflate interface */
 int nx_deflate(z_streamp strm, int flush)
+{
+	unsigned long total_in, total_out;
+	uint64_t t;
+	int rc;
+
+	if (!nx_gzip_gather_statistics() || strm == Z_NULL)
+		return __nx_deflate(strm, flush);
+
+	total_in = strm->total_in;
+	total_out = strm->total_out;
+	t = get_nxtime_now();
+	rc = __nx_deflate(strm, flush);
+	zlib_stats_add(deflate_time, get_nxtime_diff(t, get_nxtime_now()));
+	zlib_stats_add(deflate_len, strm->total_in - total_in);
+	zlib_stats_add(deflate_out_len, strm->total_out - total_out);
+	return rc;
+}
+
+static int __nx_deflate(z_streamp strm, int flush)
 {
 	retlibnx_t rc;
 	nx_streamp s;
@@ -1695,18 +1768,16 @@ int nx_deflate(z_streamp strm, int flush)
 
 	/* statistic*/
 	if (nx_gzip_gather_statistics()) {
-		pthread_mutex_lock(&zlib_stats_mutex);
 		avail_in_slot = strm->avail_in / 4096;
 		if (avail_in_slot >= ZLIB_SIZE_SLOTS)
 			avail_in_slot = ZLIB_SIZE_SLOTS - 1;
-		zlib_stats.deflate_avail_in[avail_in_slot]++;
+		zlib_stats_inc(deflate_avail_in[avail_in_slot]);
 
 		avail_out_slot = strm->avail_out / 4096;
 		if (avail_out_slot >= ZLIB_SIZE_SLOTS)
 			avail_out_slot = ZLIB_SIZE_SLOTS - 1;
-		zlib_stats.deflate_avail_out[avail_out_slot]++;
-		zlib_stats.deflate++;
-		pthread_mutex_unlock(&zlib_stats_mutex);
+		zlib_stats_inc(deflate_avail_out[avail_out_slot]);
+		zlib_stats_inc(deflate);
 	}
 
 	nx_gzip_crb_cpb_t *cmdp = s->nxcmdp;
@@ -1810,7 +1881,7 @@ s2:
 	/*  avail_out > 0 and used_out == 0 */
 	// assert(s->avail_out > 0 && s->used_out == 0);
 
-	if ( ((s->used_in + s->avail_in) > nx_config.compress_threshold) || /* large input */
+	if ( ((s->used_in + s->avail_in) > nx_stream_opt(s, NX_OPT_COMPRESS_THRESHOLD, compress_threshold)) || /* large input */
 	     (flush == Z_SYNC_FLUSH)    ||      /* or requesting flush */
 	     (flush == Z_PARTIAL_FLUSH) ||
 	     (flush == Z_FULL_FLUSH)    ||
@@ -1875,7 +1946,7 @@ s3:
 		/* for small input data and with a dictionary Z_FIXED should yield smaller output */
 		print_dbg_info(s, __LINE__);
 
-		rc = nx_compress_block(s, GZIP_FC_COMPRESS_RESUME_FHT, nx_config.per_job_len);
+		rc = nx_compress_block(s, GZIP_FC_COMPRESS_RESUME_FHT, nx_stream_opt(s, NX_OPT_PER_JOB_LEN, per_job_len));
 
 		if (unlikely(rc == LIBNX_OK_BIG_TARGET)) {
 			/* compressed data has expanded; write a type0 block */
@@ -1901,7 +1972,7 @@ s3:
 		else
 			dht_lookup(cmdp, dht_search_req, s->dhthandle);
 
-		rc = nx_compress_block(s, GZIP_FC_COMPRESS_RESUME_DHT_COUNT, nx_config.per_job_len);
+		rc = nx_compress_block(s, nx_deflate_choose_fc(s), nx_stream_opt(s, NX_OPT_PER_JOB_LEN, per_job_len));
 
 		if (unlikely(rc == LIBNX_OK_BIG_TARGET)) {
 			/* compressed data has expanded; write a type0 block */
@@ -1960,7 +2031,7 @@ s3:
 
 unsigned long nx_deflateBound(z_streamp strm, unsigned long sourceLen)
 {
-	zlib_stats_inc(&zlib_stats.deflateBound);
+	zlib_stats_inc(deflateBound);
 	return (2 * sourceLen + DEF_MAX_DHT_LEN + 1);
 }
 
@@ -1980,19 +2051,86 @@ int nx_deflateSetHeader(z_streamp strm, gz_headerp head)
 	return Z_OK;
 }
 
-int nx_deflateSetDictionary(z_streamp strm, const unsigned char *dictionary, unsigned int dictLength)
+/*
+  Use the dht table set file fname for this stream instead of the
+  builtin tables; see samples/dht_train.c. NX_GZIP_DHT_FILE sets
+  the default for all streams
+*/
+int nx_deflateSetDhtSet(z_streamp strm, const char *fname)
 {
 	nx_streamp s;
-	uint32_t adler;
-	int cc;
 
-	sw_trace("%s\n", __FUNCTION__);
-	if (dictionary == NULL || strm == NULL)
+	if (strm == NULL || fname == NULL)
 		return Z_STREAM_ERROR;
 
 	if (NULL == (s = (nx_streamp) strm->state))
 		return Z_STREAM_ERROR;
 
+	/* fixed huffman streams do not use a dht */
+	if (s->strategy != Z_DEFAULT_STRATEGY || s->dhthandle == NULL)
+		return Z_STREAM_ERROR;
+
+	if (dht_use_set(s->dhthandle, fname) != 0) {
+		prt_err("cannot load dht table set %s\n", fname);
+		return Z_DATA_ERROR;
+	}
+
+	return Z_OK;
+}
+
+/*
+  Overrides option opt for this stream: NX_OPT_PER_JOB_LEN,
+  NX_OPT_COMPRESS_THRESHOLD, NX_OPT_DEF_BUF_SIZE or NX_OPT_DHT_CONFIG.
+  NX_OPT_DEF_BUF_SIZE also sizes fifo_out again, so it is refused
+  while fifo_out holds output not yet copied to next_out.
+*/
+int nx_deflateSetOption(z_streamp strm, int opt, uint64_t value)
+{
+	nx_streamp s;
+	char *buf;
+	uint32_t len;
+
+	if (strm == NULL || NULL == (s = (nx_streamp) strm->state))
+		return Z_STREAM_ERROR;
+
+	value = nx_option_limit(opt, value);
+	switch (opt) {
+	case NX_OPT_PER_JOB_LEN:
+		s->opt.per_job_len = value;
+		break;
+	case NX_OPT_COMPRESS_THRESHOLD:
+		s->opt.compress_threshold = value;
+		break;
+	case NX_OPT_DEF_BUF_SIZE:
+		if (s->used_out > 0)
+			return Z_STREAM_ERROR;
+		len = NX_MAX(value * 2, DEF_MAX_EXPANSION_LEN);
+		if (len != s->len_out) {
+			if (NULL == (buf = nx_alloc_buffer(len, nx_config.page_sz, 0)))
+				return Z_MEM_ERROR;
+			nx_free_buffer(s->fifo_out, s->len_out, 0);
+			s->fifo_out = buf;
+			s->len_out = len;
+		}
+		s->cur_out = 0;
+		s->opt.strm_def_bufsz = value;
+		break;
+	case NX_OPT_DHT_CONFIG:
+		/* fixed huffman streams do not use a dht */
+		if (s->dhthandle == NULL)
+			return Z_STREAM_ERROR;
+		dht_set_config(s->dhthandle, (int)value);
+		return Z_OK;
+	default:
+		return Z_STREAM_ERROR;
+	}
+	s->opt.set |= 1U << opt;
+	return Z_OK;
+}
+
+/* zlib permits a dictionary only at these points of a stream */
+static int nx_deflate_dict_ok(nx_streamp s)
+{
 	if (s->status == NX_BFINAL_ST || s->status == NX_TRAILER_ST)
 		return Z_STREAM_ERROR;
 
@@ -2037,6 +2175,28 @@ int nx_deflateSetDictionary(z_streamp strm, const unsigned char *dictionary, uns
 			return Z_STREAM_ERROR;
 		}
 	}
+	return Z_OK;
+}
+
+int nx_deflateSetDictionary(z_streamp strm, const unsigned char *dictionary, unsigned int dictLength)
+{
+	nx_streamp s;
+	uint32_t adler;
+	int cc;
+
+	sw_trace("%s\n", __FUNCTION__);
+	if (dictionary == NULL || strm == NULL)
+		return Z_STREAM_ERROR;
+
+	if (NULL == (s = (nx_streamp) strm->state))
+		return Z_STREAM_ERROR;
+
+	if (nx_deflate_dict_ok(s) != Z_OK)
+		return Z_STREAM_ERROR;
+
+	/* a private dictionary replaces a shared one */
+	nx_dictRelease(s->shared_dict);
+	s->shared_dict = NULL;
 
 	if (s->dict == NULL) {
 		/* one time allocation until deflateEnd() */
@@ -2075,6 +2235,7 @@ int nx_deflateSetDictionary(z_streamp strm, const unsigned char *dictionary, uns
 	   dictionary is present; deflate() will insert dict_id in the
 	   zlib format header; raw format doesn't use an ID */
 	s->dict_len = dictLength;
+	s->dict_end = s->dict + dictLength;
 	s->dict_id = adler;
 
 	/* copy dictionary id back to the caller of setDictionary */
@@ -2144,6 +2305,36 @@ int nx_deflateSetDictionary(z_streamp strm, const unsigned char *dictionary, uns
 	*/
 }
 
+/*
+  Attaches a dictionary made by nx_dictCreate() without copying it.
+  Unlike deflateSetDictionary() it stays attached across
+  deflateReset() so that each message compressed on the stream
+  starts with it, until the stream ends or d is NULL.  Same rules as
+  deflateSetDictionary() for when it may be called.
+*/
+int nx_deflateSetSharedDictionary(z_streamp strm, nx_dictp d)
+{
+	nx_streamp s;
+
+	if (strm == NULL || NULL == (s = (nx_streamp) strm->state))
+		return Z_STREAM_ERROR;
+
+	if (s->wrap == HEADER_GZIP || nx_deflate_dict_ok(s) != Z_OK)
+		return Z_STREAM_ERROR;
+
+	nx_dictRelease(s->shared_dict);
+	s->shared_dict = nx_dictGet(d);
+	s->dict_len = 0;
+
+	if (d != NULL) {
+		s->dict_len = d->len;
+		s->dict_end = d->buf + d->len;
+		s->dict_id = d->dict_id;
+		strm->adler = d->dict_id;
+	}
+	return Z_OK;
+}
+
 #ifdef ZLIB_API
 int deflateInit_(z_streamp strm, int level, const char* version, int stream_size)
 {
@@ -47,8 +47,13 @@
 #include <sys/mman.h>
 #include <sys/ioctl.h>
 #include <endian.h>
+#include <pthread.h>
 #include "nxu.h"
 #include "nx_dht.h"
+#if defined(__POWER9_VECTOR__)
+#include <altivec.h>
+#define DHT_VSX
+#endif
 
 /* If cache keys are too many then dhtgen overhead increases; if cache
    keys are too few then compression ratio suffers.
@@ -78,13 +83,6 @@
 #define NUMLIT 256  /* literals count in deflate */
 #define EOB 256     /* end of block symbol */
 
-typedef struct top_sym_t {
-	struct { 
-		uint32_t lzcnt;
-		int sym;
-	} sorted[3];
-} top_sym_t;
-
 const int llns = 0;
 const int dsts = 1;
 
@@ -92,6 +90,95 @@ extern dht_entry_t *get_builtin_table();
 
 int nx_dht_config = 0; 
 
+/* Table set files loaded so far. Handles point in to the tables
+   therefore they live until the process exits */
+typedef struct dht_set_t {
+	char *fname;
+	dht_entry_t *tab;
+	int num;
+	struct dht_set_t *next;
+} dht_set_t;
+
+static dht_set_t *dht_sets = NULL;
+static dht_set_t *dht_default_set = NULL;
+static pthread_mutex_t dht_sets_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* returns the loaded set; loads the file only once */
+static dht_set_t *dht_find_set(const char *fname)
+{
+	dht_set_t *set;
+	dht_entry_t *tab;
+	int num;
+
+	pthread_mutex_lock(&dht_sets_mutex);
+
+	for (set = dht_sets; set != NULL; set = set->next)
+		if (strcmp(set->fname, fname) == 0)
+			goto out;
+
+	if ((num = dht_load_set(fname, &tab)) <= 0)
+		goto out; /* set is NULL */
+
+	if (NULL == (set = malloc(sizeof(dht_set_t)))
+	    || NULL == (set->fname = strdup(fname))) {
+		free(set);
+		free(tab);
+		set = NULL;
+		goto out;
+	}
+	set->tab = tab;
+	set->num = num;
+	set->next = dht_sets;
+	dht_sets = set;
+
+out:
+	pthread_mutex_unlock(&dht_sets_mutex);
+	return set;
+}
+
+int dht_set_default(const char *fname)
+{
+	dht_set_t *set = NULL;
+
+	if (fname != NULL && NULL == (set = dht_find_set(fname)))
+		return -1;
+
+	dht_default_set = set;
+	return 0;
+}
+
+int dht_use_set(void *handle, const char *fname)
+{
+	dht_set_t *set;
+	dht_tab_t *dht_tab = (dht_tab_t *) handle;
+
+	if (dht_tab == NULL || fname == NULL)
+		return -1;
+
+	if (NULL == (set = dht_find_set(fname)))
+		return -1;
+
+	dht_tab->builtin = set->tab;
+	dht_tab->builtin_num = set->num;
+	/* do not reuse an entry of the previous set */
+	dht_tab->last_used_builtin_idx = -1;
+	dht_tab->last_used_entry = NULL;
+	dht_tab->nbytes_accumulated = 0;
+
+	return 0;
+}
+
+int dht_set_config(void *handle, int config)
+{
+	dht_tab_t *dht_tab = (dht_tab_t *) handle;
+
+	if (dht_tab == NULL)
+		return -1;
+
+	dht_tab->config = config;
+	return 0;
+}
+
 /* One time setup of the tables. Returns a handle.  ifile ofile
    unused */
 void *dht_begin5(char *ifile, char *ofile)
@@ -108,7 +195,20 @@ void *dht_begin5(char *ifile, char *ofile)
 		dht_tab->cache[i].ref_count = 0;
 		dht_tab->cache[i].accessed = 0;
 	}
-	dht_tab->builtin = get_builtin_table();
+	if (dht_default_set != NULL) {
+		dht_tab->builtin = dht_default_set->tab;
+		dht_tab->builtin_num = dht_default_set->num;
+	}
+	else {
+		dht_tab->builtin = get_builtin_table();
+		dht_tab->builtin_num = DHT_NUM_BUILTIN;
+	}
+	dht_tab->config = -1;
+	memset(&dht_tab->hist, 0, sizeof(dht_tab->hist));
+	dht_tab->hist.changed = 1;
+	dht_tab->flat.valid = 0;
+	dht_tab->flat.ref_count = 0;
+	dht_tab->flat.accessed = 0;
 	dht_tab->last_used_builtin_idx = -1;
 	dht_tab->last_cache_idx = -1;
 	dht_tab->last_used_entry = NULL;	
@@ -129,89 +229,240 @@ void *dht_begin(char *ifile, char *ofile)
 	return dht_begin5(ifile, ofile);
 }
 
-static int dht_sort4(nx_gzip_crb_cpb_t *cmdp, top_sym_t *t)
+static long dht_src_bytes(nx_gzip_crb_cpb_t *cmdp);
+
+/* log2(1 + m/128) in 1/256 units */
+static const uint8_t dht_log2_frac[128] = {
+	  0,   3,   6,   9,  11,  14,  17,  20,  22,  25,  28,  30,  33,  36,  38,  41,
+	 44,  46,  49,  51,  54,  56,  59,  61,  63,  66,  68,  71,  73,  75,  78,  80,
+	 82,  85,  87,  89,  92,  94,  96,  98, 100, 103, 105, 107, 109, 111, 113, 116,
+	118, 120, 122, 124, 126, 128, 130, 132, 134, 136, 138, 140, 142, 144, 146, 148,
+	150, 152, 154, 155, 157, 159, 161, 163, 165, 167, 169, 170, 172, 174, 176, 178,
+	179, 181, 183, 185, 186, 188, 190, 192, 193, 195, 197, 198, 200, 202, 203, 205,
+	207, 208, 210, 212, 213, 215, 216, 218, 220, 221, 223, 224, 226, 228, 229, 231,
+	232, 234, 235, 237, 238, 240, 241, 243, 244, 246, 247, 249, 250, 252, 253, 255,
+};
+
+#define DHT_LOG_Q 8  /* fraction bits of dht_log2q */
+
+/* log2(x) in 1/256 units; x > 0 */
+static inline uint64_t dht_log2q(uint32_t x)
+{
+	int e = 31 - __builtin_clz(x);
+	uint32_t m = (e >= 7) ? (x >> (e - 7)) : (x << (7 - e));
+	return ((uint64_t)e << DHT_LOG_Q) + dht_log2_frac[m & 0x7f];
+}
+
+/* c*log2(c) in 1/256 units, 0 for 0 and 1, without a branch */
+static inline uint64_t dht_clogc(uint32_t c)
+{
+	return (uint64_t)c * dht_log2q(c + !c);
+}
+
+/* n*log2(n) - sum(c*log2(c)) is the entropy of n symbols in bits */
+static inline uint64_t dht_entropy(uint64_t n, uint64_t sum_clogc)
+{
+	uint64_t nlogn;
+	if (n == 0)
+		return 0;
+	/* counts of one job fit 32 bits */
+	nlogn = n * dht_log2q((n > UINT32_MAX) ? UINT32_MAX : (uint32_t) n);
+	return (nlogn > sum_clogc) ? (nlogn - sum_clogc) >> DHT_LOG_Q : 0;
+}
+
+/* Literal only data near 8 bits/literal does not compress; neither
+   the cache keys nor a new dht would help it. Thresholds are the
+   match to literal ratio and the entropy in 1/256 bits per literal */
+#define DHT_INCOMP_MATCHES(lit)   ((lit) / 64)
+#define DHT_INCOMP_LIT_BITS       2022  /* 7.9 bits */
+
+/* fixed huffman code lengths; rfc1951 3.2.6 */
+#define FHT_LIT_BITS       8	/* 9 from 144 */
+#define FHT_LEN_BITS       7	/* 8 from 280 */
+#define FHT_DIST_BITS      5
+
+/* counts and c*log2(c) of count[lo, hi) */
+static inline void dht_range(const uint32_t *count, int lo, int hi,
+			     uint64_t *sum, uint64_t *clogc)
+{
+	uint64_t s = 0, e = 0;
+	int j;
+
+	for (j = lo; j < hi; j++) {
+		s += count[j];
+		e += dht_clogc(count[j]);
+	}
+	*sum = s;
+	*clogc = e;
+}
+
+/* A key is the count, saturated to 23 bits, above the inverted 9 bit
+   symbol: keys differ and a tie goes to the lower symbol as the
+   insertion with DHT_GT did.  Counts of one job are at most
+   per_job_len, well under the saturation */
+#define DHT_KEY_SYM_BITS 9
+#define DHT_KEY_SYM_MASK ((1U << DHT_KEY_SYM_BITS) - 1)
+#define DHT_KEY_MAX_CNT  ((1U << (32 - DHT_KEY_SYM_BITS)) - 1)
+#define DHT_KEY(c, sym)  ((((c) < DHT_KEY_MAX_CNT ? (c) : DHT_KEY_MAX_CNT) << DHT_KEY_SYM_BITS) | \
+			  (DHT_KEY_SYM_MASK - (sym)))
+
+/* key in to a top 3 with max/min in place of compares and branches */
+static inline void dht_top3_insert(uint32_t *k0, uint32_t *k1, uint32_t *k2, uint32_t k)
+{
+	uint32_t lo;
+
+	lo = (k < *k0) ? k : *k0;
+	*k0 = (k < *k0) ? *k0 : k;
+	k = lo;
+	lo = (k < *k1) ? k : *k1;
+	*k1 = (k < *k1) ? *k1 : k;
+	*k2 = (lo < *k2) ? *k2 : lo;
+}
+
+/* the top 3 symbols of count[0, n); sym -1 where fewer than 3 counts
+   are non zero.  Each of four lanes keeps a top 3 of every fourth
+   count, in a vector each with VSX, so that no insert waits on the
+   one before; their 12 keys are merged at the end */
+static void dht_top3(top_sym_t *t, const uint32_t *count, int n)
+{
+	uint32_t k0[4], k1[4], k2[4], f0 = 0, f1 = 0, f2 = 0;
+	int i, j, sym;
+#if defined(DHT_VSX)
+	const vector unsigned int vmax = vec_splats(DHT_KEY_MAX_CNT);
+	const vector unsigned int vshift = vec_splats((unsigned int)DHT_KEY_SYM_BITS);
+	const vector unsigned int vfour = vec_splats(4U);
+	vector unsigned int vsym = { DHT_KEY_SYM_MASK, DHT_KEY_SYM_MASK - 1,
+				     DHT_KEY_SYM_MASK - 2, DHT_KEY_SYM_MASK - 3 };
+	vector unsigned int v0 = vec_splats(0U), v1 = v0, v2 = v0, k, lo;
+
+	for (j = 0; j + 4 <= n; j += 4) {
+		k = vec_min(vec_xl(0, (unsigned int *)(count + j)), vmax);
+		k = vec_or(vec_sl(k, vshift), vsym);
+		vsym = vec_sub(vsym, vfour);
+		lo = vec_min(k, v0);
+		v0 = vec_max(k, v0);
+		k = lo;
+		lo = vec_min(k, v1);
+		v1 = vec_max(k, v1);
+		v2 = vec_max(lo, v2);
+	}
+	vec_xst(v0, 0, k0);
+	vec_xst(v1, 0, k1);
+	vec_xst(v2, 0, k2);
+#else
+	memset(k0, 0, sizeof(k0));
+	memset(k1, 0, sizeof(k1));
+	memset(k2, 0, sizeof(k2));
+	for (j = 0; j + 4 <= n; j += 4)
+		for (i = 0; i < 4; i++)
+			dht_top3_insert(&k0[i], &k1[i], &k2[i], DHT_KEY(count[j + i], j + i));
+#endif
+	for (; j < n; j++)
+		dht_top3_insert(&f0, &f1, &f2, DHT_KEY(count[j], j));
+	for (i = 0; i < 4; i++) {
+		dht_top3_insert(&f0, &f1, &f2, k0[i]);
+		dht_top3_insert(&f0, &f1, &f2, k1[i]);
+		dht_top3_insert(&f0, &f1, &f2, k2[i]);
+	}
+
+	k0[0] = f0;
+	k0[1] = f1;
+	k0[2] = f2;
+	for (i = 0; i < 3; i++) {
+		sym = DHT_KEY_SYM_MASK - (k0[i] & DHT_KEY_SYM_MASK);
+		t->sorted[i].lzcnt = (k0[i] >> DHT_KEY_SYM_BITS) ? count[sym] : 0;
+		t->sorted[i].sym = (k0[i] >> DHT_KEY_SYM_BITS) ? sym : -1;
+	}
+}
+
+/* 
+   Passes over cmdp->cpb.out_lzcount (big endian as NX wrote them).
+   Writes host endian counts to h->lzcount for dhtgen, and computes the
+   totals, entropies and the top symbols in lit, len range which we
+   use as cache keys to locate a matching dht. The cpb is not modified
+   so the counts can be consumed more than once.
+
+   The byte swap goes 4 counts at a time.  The sums then go over each
+   range of fixed huffman code length on its own, so no loop tests a
+   symbol; the fixed huffman bits follow from the range sums.  The top
+   symbols are one branch free scan, four lanes wide.  config is the handle's
+   nx_dht_config, -1 for the global one.
+*/
+static void dht_hist(nx_gzip_crb_cpb_t *cmdp, dht_hist_t *h, int config)
 {
 	int i;
 	int llscan;
-	uint32_t *lzcount;
-	top_sym_t top[1];
+	const uint32_t *src = (const uint32_t *)cmdp->cpb.out_lzcount;
+	uint32_t *dst = h->lzcount;
+	uint64_t lit, lit_hi, len, len_hi, eob, dist;
+	uint64_t lit_clogc, lit_hi_clogc, len_clogc, len_hi_clogc, dist_clogc;
+	uint64_t fht_bits, ent_bits;
+	long src_bytes;
+	top_sym_t *t = &h->top;
 
 	/* where to look for the top search keys */
-	if ( (nx_dht_config & 0x1) == 0x1 )
+	if (config < 0)
+		config = __atomic_load_n(&nx_dht_config, __ATOMIC_RELAXED);
+	if ( (config & 0x1) == 0x1 )
 		llscan = LLSZ;   /* scan literals and lengths */
 	else 
 		llscan = NUMLIT; /* scan literals only */
-	
-	/* init */
-	top[llns].sorted[0].lzcnt = 0;
-	top[llns].sorted[0].sym = -1;
-	top[llns].sorted[2] = top[llns].sorted[1] = top[llns].sorted[0];
-	/* top[dsts] = top[llns]; */
-
-	lzcount = (uint32_t *)cmdp->cpb.out_lzcount;
-
-	/* EOB symbol decimal 256 comes out with a count of 1 which we
-	   use as an endian detector */
-	if (1 != lzcount[EOB]) {
-		for (i = 0; i < LLSZ+DSZ; i++) 
-			lzcount[i] = be32toh(lzcount[i]);
-		lzcount[EOB] = 1;
-		DHTPRT( fprintf(stderr, "dht_sort: lzcounts endian corrected\n") );
-	} 
-	else {
-		DHTPRT( fprintf(stderr, "dht_sort: lzcounts endian ok\n") );
-	}
 
-	for (i = 0; i < llscan; i++) { /* Look for the top keys */
-		uint32_t c = lzcount[i];
-
-		DHTPRT( fprintf(stderr, "%d %d, ", i, lzcount[i] ) );
-		
-		if ( DHT_GT(c, top[llns].sorted[0].lzcnt) ) {
-			/* count greater than the top count */
-#if !defined(DHT_ONE_KEY)
-			top[llns].sorted[1] = top[llns].sorted[0];
+	/* LLSZ+DSZ = 316 is a multiple of 4 */
+	for (i = 0; i < LLSZ+DSZ; i += 4) {
+#if defined(DHT_VSX)
+		vector unsigned int v = vec_xl(0, (unsigned int *)(src + i));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		v = vec_revb(v);
 #endif
-			top[llns].sorted[0].lzcnt = c;           
-			top[llns].sorted[0].sym = i;
-		} 
-#if !defined(DHT_ONE_KEY)
-		else if ( DHT_GT(c, top[llns].sorted[1].lzcnt) ) {
-			/* count greater than the second most count */
-			top[llns].sorted[2] = top[llns].sorted[1];
-			top[llns].sorted[1].lzcnt = c;
-			top[llns].sorted[1].sym = i;
-		}
-		else if ( DHT_GT(c, top[llns].sorted[2].lzcnt) ) {
-			/* count greater than the second most count */
-			top[llns].sorted[2].lzcnt = c;
-			top[llns].sorted[2].sym = i;
-		}
+		vec_xst(v, 0, (unsigned int *)(dst + i));
+#else
+		dst[i]   = be32toh(src[i]);
+		dst[i+1] = be32toh(src[i+1]);
+		dst[i+2] = be32toh(src[i+2]);
+		dst[i+3] = be32toh(src[i+3]);
 #endif
 	}
 
-	/* copy back */
-	t[llns] = top[llns];	
-	
-	/* Will not use distances as cache keys */
-
-	DHTPRT( fprintf(stderr, "top litlens %d %d %d\n", top[llns].sorted[0].sym, top[llns].sorted[1].sym, top[llns].sorted[2].sym) );
-
-	return 0;
-}
+	/* literals 0-143 and 144-255, end of block and lengths 257-279,
+	   lengths 280-285, distances; rfc1951 3.2.6 */
+	dht_range(dst, 0, 144, &lit, &lit_clogc);
+	dht_range(dst, 144, NUMLIT, &lit_hi, &lit_hi_clogc);
+	dht_range(dst, EOB, 280, &len, &len_clogc);
+	dht_range(dst, 280, LLSZ, &len_hi, &len_hi_clogc);
+	dht_range(dst, LLSZ, LLSZ+DSZ, &dist, &dist_clogc);
+
+	fht_bits = FHT_LIT_BITS * lit + (FHT_LIT_BITS + 1) * lit_hi +
+		   FHT_LEN_BITS * len + (FHT_LEN_BITS + 1) * len_hi + FHT_DIST_BITS * dist;
+	eob = dst[EOB];
+	lit += lit_hi;
+	lit_clogc += lit_hi_clogc;
+	len += len_hi - eob;
+	len_clogc += len_hi_clogc;
+
+	/* Look for the top keys */
+	dht_top3(t, dst, llscan);
+
+	ent_bits = dht_entropy(lit + len + eob, lit_clogc + len_clogc) + dht_entropy(dist, dist_clogc);
+	src_bytes = dht_src_bytes(cmdp);
+	h->changed = (h->lit != lit || h->len != len || h->dist != dist ||
+		      h->fht_bits != fht_bits || h->ent_bits != ent_bits ||
+		      h->src_bytes != src_bytes);
+
+	h->lit = lit;
+	h->len = len;
+	h->dist = dist;
+	h->fht_bits = fht_bits;
+	h->src_bytes = src_bytes;
+	h->lit_bits = dht_entropy(lit, lit_clogc);
+	h->ent_bits = ent_bits;
+	h->incompressible = (lit > 0 && len <= DHT_INCOMP_MATCHES(lit) &&
+			     (h->lit_bits << DHT_LOG_Q) >= lit * DHT_INCOMP_LIT_BITS);
 
-/* 
-   Finds the top symbols in lit, len and dist ranges.
-   cmdp->cpb.out_lzcount array will be endian reversed first.  (To
-   protect cmdp from double reversals I will test and set the Literal 256
-   count to 1 after the first endian reversal)
+	/* Will not use distances as cache keys */
 
-   Results returned in the top[3] struct.  We will use the top symbols
-   as cache keys to locate a matching dht.
-*/
-static int dht_sort(nx_gzip_crb_cpb_t *cmdp, top_sym_t *top)
-{
-	return dht_sort4(cmdp, top);
+	DHTPRT( fprintf(stderr, "dht_hist: lit %ld len %ld dist %ld ent_bits %ld incomp %d\n", (long)lit, (long)len, (long)dist, (long)h->ent_bits, h->incompressible) );
+	DHTPRT( fprintf(stderr, "top litlens %d %d %d\n", t->sorted[0].sym, t->sorted[1].sym, t->sorted[2].sym) );
 }
 
 static inline int copy_dht_to_cpb(nx_gzip_crb_cpb_t *cmdp, dht_entry_t *d)
@@ -366,14 +617,15 @@ static int dht_search_builtin(nx_gzip_crb_cpb_t *cmdp, dht_tab_t *dht_tab, top_s
 {
 	int i, sidx;
 	dht_entry_t *builtin = dht_tab->builtin;
+	int num = dht_tab->builtin_num;
 
 	/* speed up the search */	
 	sidx = dht_atomic_load( &dht_tab->last_used_builtin_idx );
 	sidx = (sidx < 0) ? 0 : sidx;
-	sidx = sidx % DHT_NUM_BUILTIN;
+	sidx = sidx % num;
 	
 	/* search the builtin dht cache */
-	for (i = 0; i < DHT_NUM_BUILTIN; i++, sidx = (sidx+1) % DHT_NUM_BUILTIN) {
+	for (i = 0; i < num; i++, sidx = (sidx+1) % num) {
 
 		if ( dht_atomic_load( &builtin[sidx].valid ) == 0)
 			continue; /* skip unused entries */
@@ -438,10 +690,48 @@ static int dht_search_cache(nx_gzip_crb_cpb_t *cmdp, dht_tab_t *dht_tab, top_sym
 	return -1;
 }
 
+/* source data amount the last crb has processed excluding the
+   history; -1 if the job did not produce lzcounts */
+static long dht_src_bytes(nx_gzip_crb_cpb_t *cmdp)
+{
+	long source_bytes = 0;
+	uint32_t fc, histlen;
+
+	fc = getnn(cmdp->crb, gzip_fc);
+
+	/* exclude history bytes read */
+	if (fc == GZIP_FC_COMPRESS_RESUME_FHT ||
+	    fc == GZIP_FC_COMPRESS_RESUME_DHT ||
+	    fc == GZIP_FC_COMPRESS_RESUME_FHT_COUNT ||
+	    fc == GZIP_FC_COMPRESS_RESUME_DHT_COUNT) {
+		histlen = getnn(cmdp->cpb, in_histlen) * 16;
+		DHTPRT( fprintf(stderr, "dht_src_bytes: resume fc 0x%x\n", fc) );
+	}
+	else { 
+		histlen = 0;
+	}
+
+	if (fc == GZIP_FC_COMPRESS_FHT_COUNT || 
+	    fc == GZIP_FC_COMPRESS_DHT_COUNT ||
+	    fc == GZIP_FC_COMPRESS_RESUME_FHT_COUNT ||
+	    fc == GZIP_FC_COMPRESS_RESUME_DHT_COUNT) {
+		source_bytes = get32(cmdp->cpb, out_spbc_comp_with_count) - histlen;
+		DHTPRT( fprintf(stderr, "dht_src_bytes: fc 0x%x source_bytes %ld\n", fc, source_bytes) );
+	}
+	else if (fc == GZIP_FC_COMPRESS_FHT || 
+		 fc == GZIP_FC_COMPRESS_DHT || 
+		 fc == GZIP_FC_COMPRESS_RESUME_FHT ||
+		 fc == GZIP_FC_COMPRESS_RESUME_DHT) {
+		DHTPRT( fprintf(stderr, "dht_src_bytes: producing a dht with no lzcounts???\n") );
+		return -1;
+	}
+
+	return (source_bytes < 0) ? 0 : source_bytes;
+}
+
 static int dht_use_last(nx_gzip_crb_cpb_t *cmdp, dht_tab_t *dht_tab)
 {
 	long source_bytes;
-	uint32_t fc, histlen;
 	dht_entry_t *dht_entry = dht_atomic_load( &dht_tab->last_used_entry );
 
 	if (dht_entry == NULL)
@@ -457,38 +747,9 @@ static int dht_use_last(nx_gzip_crb_cpb_t *cmdp, dht_tab_t *dht_tab)
 		}
 
 		/* extract the source data amount this crb has processed */
-		fc = getnn(cmdp->crb, gzip_fc);
-
-		/* exclude history bytes read */
-		if (fc == GZIP_FC_COMPRESS_RESUME_FHT ||
-		    fc == GZIP_FC_COMPRESS_RESUME_DHT ||
-		    fc == GZIP_FC_COMPRESS_RESUME_FHT_COUNT ||
-		    fc == GZIP_FC_COMPRESS_RESUME_DHT_COUNT) {
-			histlen = getnn(cmdp->cpb, in_histlen) * 16;
-			DHTPRT( fprintf(stderr, "dht_use_last: resume fc 0x%x\n", fc) );
-		}
-		else { 
-			histlen = 0;
-		}
-
-		source_bytes = 0;
-
-		if (fc == GZIP_FC_COMPRESS_FHT_COUNT || 
-		    fc == GZIP_FC_COMPRESS_DHT_COUNT ||
-		    fc == GZIP_FC_COMPRESS_RESUME_FHT_COUNT ||
-		    fc == GZIP_FC_COMPRESS_RESUME_DHT_COUNT) {
-			source_bytes = get32(cmdp->cpb, out_spbc_comp_with_count) - histlen;
-			DHTPRT( fprintf(stderr, "dht_use_last: fc 0x%x source_bytes %ld\n", fc, source_bytes) );
-		}
-		else if (fc == GZIP_FC_COMPRESS_FHT || 
-			 fc == GZIP_FC_COMPRESS_DHT || 
-			 fc == GZIP_FC_COMPRESS_RESUME_FHT ||
-			 fc == GZIP_FC_COMPRESS_RESUME_DHT) {
-			/* this might be an error producing a dht with no lzcounts */
-			source_bytes = get32(cmdp->cpb, out_spbc_comp) - histlen;
-			DHTPRT( fprintf(stderr, "dht_use_last: producing a dht with no lzcounts???\n") );
-			assert(0);
-		}
+		source_bytes = dht_src_bytes(cmdp);
+		/* this might be an error producing a dht with no lzcounts */
+		assert(source_bytes >= 0);
 
 		if (source_bytes < 0 ) source_bytes = 0;
 
@@ -521,13 +782,30 @@ static int dht_use_last(nx_gzip_crb_cpb_t *cmdp, dht_tab_t *dht_tab)
 	return -1;
 }
  
+/* incompressible data gets the same dht every time instead of a
+   cache search and dhtgen with meaningless keys */
+static int dht_use_flat(nx_gzip_crb_cpb_t *cmdp, dht_tab_t *dht_tab)
+{
+	if (dht_atomic_load( &dht_tab->flat.valid ) == 0)
+		return -1;
+
+	DHTPRT( fprintf(stderr, "dht_use_flat: incompressible data\n") );
+
+	copy_dht_to_cpb(cmdp, &dht_tab->flat);
+	dht_atomic_store( &dht_tab->last_used_entry, &dht_tab->flat );
+
+	return 0;
+}
+
 static int dht_lookup5(nx_gzip_crb_cpb_t *cmdp, int request, void *handle)
 {
 	int clock=0;
 	int dht_num_bytes, dht_num_valid_bits, dhtlen;
-	top_sym_t top[1];
 	dht_tab_t *dht_tab = (dht_tab_t *) handle;
 	dht_entry_t *dht_cache = dht_tab->cache;
+	dht_hist_t *hist = &dht_tab->hist;
+	top_sym_t *top = &hist->top;
+	uint32_t *lzcount = hist->lzcount;
 	
 	if (request == dht_default_req) {
 		/* first builtin entry is the default */
@@ -535,8 +813,10 @@ static int dht_lookup5(nx_gzip_crb_cpb_t *cmdp, int request, void *handle)
 		dht_atomic_store( &dht_tab->last_used_entry, &dht_tab->builtin[0] );
 		return 0;
 	}
-	else if (request == dht_gen_req)
+	else if (request == dht_gen_req) {
+		dht_hist(cmdp, hist, dht_tab->config);
 		goto force_dhtgen;
+	}
 	else if (request == dht_search_req)
 		goto search_cache;
 	else if (request == dht_invalidate_req) {
@@ -546,12 +826,19 @@ static int dht_lookup5(nx_gzip_crb_cpb_t *cmdp, int request, void *handle)
 	else assert(0);
 
 search_cache:
-	/* reuse the last dht to eliminate sort and dhtgen overheads */	
+	/* find most frequent symbols; the summary is also the
+	   estimate of dht_estimate() so make it every time */
+	dht_hist(cmdp, hist, dht_tab->config);
+
+	/* reuse the last dht to eliminate search and dhtgen overheads */	
 	if (!dht_use_last(cmdp, dht_tab))
 		return 0;
-	
-	/* find most frequent symbols */
-	dht_sort(cmdp, top);
+
+	if (hist->incompressible) {
+		if (!dht_use_flat(cmdp, dht_tab))
+			return 0;
+		goto force_dhtgen; /* first time; make the flat dht */
+	}
 
 	if (!dht_search_cache(cmdp, dht_tab, top))
 		return 0; /* found */
@@ -579,14 +866,14 @@ search_lru:
 
 force_dhtgen:
 	/* makes a universal dht with no missing codes */
-	fill_zero_lzcounts((uint32_t *)cmdp->cpb.out_lzcount,        /* LitLen */
-			   (uint32_t *)cmdp->cpb.out_lzcount + LLSZ, /* Dist */
+	fill_zero_lzcounts(lzcount,        /* LitLen */
+			   lzcount + LLSZ, /* Dist */
 			   1);
 
 	/* dhtgen writes directly to cpb; 286 LitLen counts followed by 30 Dist counts */
-	dhtgen( (uint32_t *)cmdp->cpb.out_lzcount,
+	dhtgen( lzcount,
 		LLSZ,
-	        (uint32_t *)cmdp->cpb.out_lzcount + LLSZ, 
+	        lzcount + LLSZ, 
 		DSZ,
 		(char *)(cmdp->cpb.in_dht_char), 
 		&dht_num_bytes, 
@@ -601,6 +888,16 @@ force_dhtgen:
 	if (request == dht_gen_req) /* without updating cache */
 		return 0;
 
+	if (hist->incompressible) {
+		/* the flat dht is kept outside the cache; its keys
+		   are noise */
+		memcpy(dht_tab->flat.in_dht_char, cmdp->cpb.in_dht_char, dht_num_bytes);
+		dht_tab->flat.in_dhtlen = dhtlen;
+		dht_atomic_store( &dht_tab->flat.valid, 1 );
+		dht_atomic_store( &dht_tab->last_used_entry, &dht_tab->flat );
+		return 0;
+	}
+
 copy_to_cache:
 	/* make a copy in the cache at the least used position */
 	memcpy(dht_cache[clock].in_dht_char, cmdp->cpb.in_dht_char, dht_num_bytes);
@@ -631,6 +928,35 @@ int dht_lookup(nx_gzip_crb_cpb_t *cmdp, int request, void *handle)
 	return dht_lookup5(cmdp, request, handle);
 }
 
+/*
+  Estimates the encoded bits of the next nbytes of source from the
+  lzcounts of the last dht_search_req lookup, with the fixed huffman
+  table and with the dht that lookup put in the cpb. The dht estimate
+  is the symbol entropy plus the dht itself; extra bits of lengths and
+  distances are the same for both and excluded. Both are 0 when there
+  are no lzcounts to go by.
+*/
+void dht_estimate(nx_gzip_crb_cpb_t *cmdp, void *handle, uint64_t nbytes,
+		  uint64_t *fht_bits, uint64_t *dht_bits)
+{
+	dht_hist_t *hist = &((dht_tab_t *) handle)->hist;
+
+	*fht_bits = *dht_bits = 0;
+
+	if (hist->src_bytes <= 0)
+		return;
+
+	*fht_bits = (hist->fht_bits * nbytes) / hist->src_bytes;
+	*dht_bits = (hist->ent_bits * nbytes) / hist->src_bytes + getnn(cmdp->cpb, in_dhtlen);
+
+	DHTPRT( fprintf(stderr, "dht_estimate: %ld bytes fht %ld bits dht %ld bits\n", (long)nbytes, (long)*fht_bits, (long)*dht_bits) );
+}
+
+int dht_hist_changed(void *handle)
+{
+	return ((dht_tab_t *) handle)->hist.changed;
+}
+
 /* use this utility to make built-in dht data structures */
 int dht_print(void *handle)
 {
@@ -678,3 +1004,111 @@ int dht_print(void *handle)
 	return 0;
 }
 
+
+/* 32bit XOR of the record words */
+static uint32_t dht_rec_cksum(dht_set_rec_t *r)
+{
+	int i;
+	uint32_t x = 0;
+	uint32_t w;
+
+	for (i = 0; i < sizeof(*r); i += sizeof(w)) {
+		memcpy(&w, (char *)r + i, sizeof(w));
+		x ^= w;
+	}
+	return x;
+}
+
+int dht_load_set(const char *fname, dht_entry_t **set)
+{
+	FILE *fp;
+	dht_set_hdr_t hdr;
+	dht_set_rec_t rec;
+	dht_entry_t *tab = NULL;
+	uint32_t i, j, num, dhtlen;
+
+	if (NULL == (fp = fopen(fname, "r")))
+		return -1;
+
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	    memcmp(hdr.magic, DHT_SET_MAGIC, sizeof(hdr.magic)) != 0 ||
+	    be32toh(hdr.version) != DHT_SET_VERSION) {
+		DHTPRT( fprintf(stderr, "dht_load_set: %s bad header\n", fname) );
+		goto err;
+	}
+
+	num = be32toh(hdr.num);
+	if (num == 0 || num > DHT_NUM_MAX)
+		goto err;
+
+	if (NULL == (tab = calloc(num, sizeof(dht_entry_t))))
+		goto err;
+
+	for (i = 0; i < num; i++) {
+		if (fread(&rec, sizeof(rec), 1, fp) != 1)
+			goto err;
+
+		/* XOR is endian agnostic; no need to swap before checking */
+		dhtlen = be32toh(rec.in_dhtlen);
+		if (dht_rec_cksum(&rec) != 0 || dhtlen == 0 || dhtlen > 8 * DHT_MAXSZ) {
+			DHTPRT( fprintf(stderr, "dht_load_set: %s bad record %d\n", fname, i) );
+			goto err;
+		}
+
+		tab[i].valid = 1;
+		tab[i].in_dhtlen = dhtlen;
+		memcpy(tab[i].in_dht_char, rec.in_dht_char, DHT_MAXSZ);
+		for (j = 0; j < DHT_TOPSYM_MAX; j++) {
+			tab[i].litlen[j] = (int32_t) be32toh(rec.litlen[j]);
+			tab[i].dist[j] = (int32_t) be32toh(rec.dist[j]);
+		}
+	}
+
+	fclose(fp);
+	*set = tab;
+	return (int) num;
+
+err:
+	free(tab);
+	fclose(fp);
+	return -1;
+}
+
+int dht_save_set(const char *fname, dht_entry_t *set, int num)
+{
+	FILE *fp;
+	dht_set_hdr_t hdr;
+	dht_set_rec_t rec;
+	int i, j;
+
+	if (set == NULL || num <= 0 || num > DHT_NUM_MAX)
+		return -1;
+
+	if (NULL == (fp = fopen(fname, "w")))
+		return -1;
+
+	memcpy(hdr.magic, DHT_SET_MAGIC, sizeof(hdr.magic));
+	hdr.version = htobe32(DHT_SET_VERSION);
+	hdr.num = htobe32((uint32_t) num);
+	if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1)
+		goto err;
+
+	for (i = 0; i < num; i++) {
+		memset(&rec, 0, sizeof(rec));
+		rec.in_dhtlen = htobe32(set[i].in_dhtlen);
+		memcpy(rec.in_dht_char, set[i].in_dht_char, (set[i].in_dhtlen + 7)/8);
+		for (j = 0; j < DHT_TOPSYM_MAX; j++) {
+			rec.litlen[j] = htobe32((uint32_t) set[i].litlen[j]);
+			rec.dist[j] = htobe32((uint32_t) set[i].dist[j]);
+		}
+		rec.cksum = dht_rec_cksum(&rec);
+		if (fwrite(&rec, sizeof(rec), 1, fp) != 1)
+			goto err;
+	}
+
+	return fclose(fp) ? -1 : 0;
+
+err:
+	fclose(fp);
+	return -1;
+}
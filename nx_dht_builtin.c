@@ -52,6 +52,11 @@
   those in the curly braces. Make sure that the DHT_NUM_BUILTIN definition
   matches the number of blocks in builtin1[]
   4. Re-make
+
+  Alternatively samples/dht_train clusters the LZ counts of a corpus
+  in to a table set file which is loaded at run time in place of
+  builtin1[] with NX_GZIP_DHT_FILE or nx_deflateSetDhtSet(); no
+  re-make needed.
   
   We use a builtin table to speedup execution.
 
@@ -0,0 +1,160 @@
+/*
+ * NX-GZIP compression accelerator user library
+ * implementing zlib compression library interfaces
+ *
+ * Copyright (C) IBM Corporation, 2011-2017
+ *
+ * Licenses for GPLv2 and Apache v2.0:
+ *
+ * GPLv2:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * Apache v2.0:
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+   Preset dictionaries shared by any number of streams.
+
+   Services compressing many small messages against the same
+   dictionary would otherwise copy and checksum it in every stream
+   on every deflateSetDictionary or inflateSetDictionary call.
+   nx_dictCreate() does that once: it keeps the last 32KB, which is
+   all that deflate and inflate can refer to, in a page aligned and
+   already faulted in buffer ending on a quadword boundary, so that
+   the buffer can go in to a DDE as is.  Creating the same dictionary
+   again returns the existing object with one more reference.
+   Objects are found by their adler32 dict_id.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "zlib.h"
+#include "nxu.h"
+#include "nx_zlib.h"
+#include "nx_dbg.h"
+
+#define NX_DICT_MAX_LEN  (1<<15)
+#define NX_DICT_BUCKETS  64
+
+static nx_dictp nx_dict_tab[NX_DICT_BUCKETS];
+static pthread_mutex_t nx_dict_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static nx_dictp nx_dict_alloc(const unsigned char *dictionary, unsigned int dictLength, uint32_t dict_id)
+{
+	nx_dictp d;
+	uint32_t len = NX_MIN(dictLength, NX_DICT_MAX_LEN);
+	uint32_t padded = ((len + NXQWSZ - 1) / NXQWSZ) * NXQWSZ;
+
+	if (NULL == (d = calloc(1, sizeof(*d))))
+		return NULL;
+
+	/* a quadword or more of zeros before the dictionary; NX reads
+	   history in quadwords and callers round the length up */
+	d->alloc_len = padded + NXQWSZ;
+	if (NULL == (d->alloc = nx_alloc_buffer(d->alloc_len, nx_config.page_sz, 0))) {
+		free(d);
+		return NULL;
+	}
+	/* writing every byte faults the pages in */
+	memset(d->alloc, 0, d->alloc_len);
+	d->buf = d->alloc + d->alloc_len - len;
+	memcpy(d->buf, dictionary + dictLength - len, len);
+
+	d->refcnt = 1;
+	d->dict_id = dict_id;
+	d->full_len = dictLength;
+	d->len = len;
+	return d;
+}
+
+/* returns a dictionary object holding one reference, or NULL if out of memory */
+nx_dictp nx_dictCreate(const unsigned char *dictionary, unsigned int dictLength)
+{
+	nx_dictp d, *head;
+	uint32_t dict_id, len;
+
+	if (dictionary == NULL)
+		return NULL;
+
+	dict_id = nx_adler32_z(INIT_ADLER, (const char *)dictionary, dictLength);
+	len = NX_MIN(dictLength, NX_DICT_MAX_LEN);
+	head = &nx_dict_tab[dict_id % NX_DICT_BUCKETS];
+
+	pthread_mutex_lock(&nx_dict_mutex);
+	for (d = *head; d != NULL; d = d->next) {
+		if (d->dict_id == dict_id && d->full_len == dictLength &&
+		    !memcmp(d->buf, dictionary + dictLength - len, len)) {
+			++d->refcnt;
+			pthread_mutex_unlock(&nx_dict_mutex);
+			return d;
+		}
+	}
+	if (NULL != (d = nx_dict_alloc(dictionary, dictLength, dict_id))) {
+		d->next = *head;
+		*head = d;
+	}
+	pthread_mutex_unlock(&nx_dict_mutex);
+
+	prt_info("dictionary %08x len %d created\n", dict_id, dictLength);
+	return d;
+}
+
+/* another reference to d; streams take one while attached */
+nx_dictp nx_dictGet(nx_dictp d)
+{
+	if (d == NULL)
+		return NULL;
+	pthread_mutex_lock(&nx_dict_mutex);
+	++d->refcnt;
+	pthread_mutex_unlock(&nx_dict_mutex);
+	return d;
+}
+
+void nx_dictRelease(nx_dictp d)
+{
+	nx_dictp *pp;
+
+	if (d == NULL)
+		return;
+
+	pthread_mutex_lock(&nx_dict_mutex);
+	if (--d->refcnt > 0) {
+		pthread_mutex_unlock(&nx_dict_mutex);
+		return;
+	}
+	for (pp = &nx_dict_tab[d->dict_id % NX_DICT_BUCKETS]; *pp != NULL; pp = &(*pp)->next) {
+		if (*pp == d) {
+			*pp = d->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&nx_dict_mutex);
+
+	nx_free_buffer(d->alloc, d->alloc_len, 0);
+	free(d);
+}
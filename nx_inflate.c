@@ -57,10 +57,18 @@
 #include "nx-gzip.h"
 #include "nx_zlib.h"
 #include "nx_dbg.h"
+#if defined(__POWER9_VECTOR__)
+#include <altivec.h>
+#define SYNC_VSX
+#endif
 
 #define INF_HIS_LEN (1<<15) /* Fixed 32K history length */
 #define INF_MAX_DICT_LEN  INF_HIS_LEN
 
+#define INF_BACK_OUT_LEN (1<<20) /* inflateBack target per job */
+
+#define INF_FIFO_EPOCH 64 /* jobs between fifo_out shrink checks */
+
 #define INF_MIN_INPUT_LEN 300 /* greater than 288 for dht plus 3 bit header plus 1 byte */
 #define INF_MAX_COMPRESSION_RATIO 1032 /* https://stackoverflow.com/a/42865320/5504692 */
 #define INF_MAX_EXPANSION_BYTES (INF_MIN_INPUT_LEN * INF_MAX_COMPRESSION_RATIO)
@@ -80,6 +88,19 @@ do { if ((s)->cur_in > (s)->len_in/2) { \
 } while(0)
 
 static int nx_inflate_(nx_streamp s, int flush);
+static void nx_inflate_index_free(nx_streamp s);
+static void nx_inflate_buf_free(char *buf, uint32_t len);
+
+static inline void nx_inflate_use_dict(nx_streamp s, char *end, unsigned int len)
+{
+	s->dict_end = end;
+	s->dict_len = len;
+	s->dict_hist = 0;
+}
+
+/* fifo_in and fifo_out bytes of all inflate streams */
+static uint64_t inf_mem_resident;
+static uint64_t inf_mem_peak;
 
 int nx_inflateResetKeep(z_streamp strm)
 {
@@ -112,9 +133,22 @@ int nx_inflateReset(z_streamp strm)
 	s->inf_state = 0;
 	s->resuming = 0;
 	s->history_len = 0;
+	s->hist_inplace = NULL;
+	s->hist_inplace_len = 0;
+	s->hist_ext = 0;
+	s->sync_have = 0;
+	s->sync_point = 0;
+	s->sync_nocheck = 0;
+	s->data_type = 0;
 	s->is_final = 0;
 	s->trailer_len = 0;
 
+	/* a raw stream starts every message with its shared dictionary;
+	   zlib streams pick it up when the header asks for it */
+	s->dict_len = 0;
+	if (s->shared_dict != NULL && s->wrap == HEADER_RAW)
+		nx_inflate_use_dict(s, s->shared_dict->buf + s->shared_dict->len, s->shared_dict->len);
+
 	s->nxcmdp  = &s->nxcmd0;
 
 	s->crc32 = INIT_CRC;
@@ -180,7 +214,7 @@ int nx_inflateInit2_(z_streamp strm, int windowBits, const char *version, int st
 	if (strm == Z_NULL) return Z_STREAM_ERROR;
 
 	/* statistic */
-	zlib_stats_inc(&zlib_stats.inflateInit);
+	zlib_stats_inc(inflateInit);
 
 	strm->msg = Z_NULL; /* in case we return an error */
 
@@ -202,6 +236,7 @@ int nx_inflateInit2_(z_streamp strm, int windowBits, const char *version, int st
 	s->gzhead  = nx_alloc_buffer(sizeof(gz_header), nx_config.page_sz, 0);
 	s->ddl_in  = s->dde_in;
 	s->ddl_out = s->dde_out;
+	s->hist_inplace_ok = nx_config.inflate_hist_inplace;
 
 	/* small input data will be buffered here */
 	s->fifo_in = NULL;
@@ -243,16 +278,20 @@ int nx_inflateEnd(z_streamp strm)
 	if (s == NULL) return Z_STREAM_ERROR;
 
 	/* statistic */
-	zlib_stats_inc(&zlib_stats.inflateEnd);
+	zlib_stats_inc(inflateEnd);
 
 	/* TODO add here Z_DATA_ERROR if the stream was freed
 	   prematurely (when some input or output was discarded). */
 
 	/* nx_inflateReset(strm); issue 111 */
 
-	nx_free_buffer(s->fifo_in, s->len_in, 0);
-	nx_free_buffer(s->fifo_out, s->len_out, 0);
+	nx_inflate_buf_free(s->fifo_in, s->len_in);
+	nx_inflate_buf_free(s->fifo_out, s->len_out);
 	nx_free_buffer(s->dict, s->dict_alloc_len, 0);
+	nx_dictRelease(s->shared_dict);
+	nx_inflate_index_free(s);
+	if (s->back_out != NULL)
+		nx_free_buffer(s->back_out, s->back_out_len, 0);
 	nx_close(s->nxdevp);
 
 	if (s->gzhead != NULL) nx_free_buffer(s->gzhead, sizeof(gz_header), 0);
@@ -262,58 +301,264 @@ int nx_inflateEnd(z_streamp strm)
 	return Z_OK;
 }
 
+void nx_inflate_mem_usage(uint64_t *resident, uint64_t *peak)
+{
+	if (resident != NULL)
+		*resident = __atomic_load_n(&inf_mem_resident, __ATOMIC_RELAXED);
+	if (peak != NULL)
+		*peak = __atomic_load_n(&inf_mem_peak, __ATOMIC_RELAXED);
+}
+
+static char *nx_inflate_buf_alloc(uint32_t len)
+{
+	uint64_t cur;
+	char *buf;
+
+	if (NULL == (buf = nx_alloc_buffer(len, nx_config.page_sz, 0)))
+		return NULL;
+	cur = __atomic_add_fetch(&inf_mem_resident, len, __ATOMIC_RELAXED);
+	/* a racing update may lose a peak by a buffer; it is a statistic */
+	if (cur > __atomic_load_n(&inf_mem_peak, __ATOMIC_RELAXED))
+		__atomic_store_n(&inf_mem_peak, cur, __ATOMIC_RELAXED);
+	return buf;
+}
+
+static void nx_inflate_buf_free(char *buf, uint32_t len)
+{
+	if (buf == NULL)
+		return;
+	nx_free_buffer(buf, len, 0);
+	__atomic_sub_fetch(&inf_mem_resident, len, __ATOMIC_RELAXED);
+}
+
+/*
+   fifo_out size for want bytes within the stream budget and what
+   NX_GZIP_INF_MEM_MAX leaves of the resident bytes; held is what the
+   stream will give back.  Never less than the max expansion of a
+   INF_MIN_INPUT_LEN job so that ERR_NX_TARGET_SPACE retries end.
+*/
+static uint32_t nx_inflate_fifo_out_size(nx_streamp s, uint64_t want, uint32_t held)
+{
+	uint64_t floor = NX_MAX(INF_MAX_EXPANSION_BYTES, INF_HIS_LEN << 3);
+	uint64_t mem_max = __atomic_load_n(&nx_config.inflate_mem_max, __ATOMIC_RELAXED);
+	uint64_t used, left;
+
+	want = NX_MIN(want, NX_MAX(floor, (uint64_t)nx_stream_opt(s, NX_OPT_INF_STREAM_MEM, inflate_stream_mem)));
+	if (mem_max > 0) {
+		used = __atomic_load_n(&inf_mem_resident, __ATOMIC_RELAXED) - held;
+		left = (used < mem_max) ? mem_max - used : 0;
+		want = NX_MIN(want, left);
+	}
+	want = NX_MAX(want, floor);
+	return (uint32_t)((want + nx_config.page_sz - 1) & ~((uint64_t)nx_config.page_sz - 1));
+}
+
+static int nx_inflate_alloc_fifo_out(nx_streamp s)
+{
+	/* overflow buffer is about 40% of s->avail_in */
+	s->len_out = nx_inflate_fifo_out_size(s, INF_HIS_LEN*2 + ((uint64_t)s->zstrm->avail_in * 40)/100, 0);
+	if (NULL == (s->fifo_out = nx_inflate_buf_alloc(s->len_out))) {
+		prt_err("nx_alloc_buffer for inflate fifo_out\n");
+		return Z_MEM_ERROR;
+	}
+	s->fifo_out_hwm = s->fifo_out_jobs = s->fifo_out_grow = 0;
+	return Z_OK;
+}
+
+/*
+   Resize fifo_out between jobs.  Double it after a job ran out of
+   target space; halve it or more when the largest overflow of the
+   last INF_FIFO_EPOCH jobs, i.e. the output beyond next_out that the
+   observed compression ratio produced, used under a quarter of it.
+   With used_out 0 only the history before cur_out is live.
+*/
+static void nx_inflate_fifo_out_policy(nx_streamp s)
+{
+	uint32_t len = s->len_out;
+	char *buf;
+
+	if (s->used_out != 0)
+		return;
+
+	if (s->fifo_out_grow) {
+		len = NX_MAX(s->len_out, nx_inflate_fifo_out_size(s, (uint64_t)s->len_out * 2, s->len_out));
+		s->fifo_out_grow = 0;
+	}
+	else if (s->fifo_out_jobs >= INF_FIFO_EPOCH) {
+		/* the overflow lands after the history and at most half
+		   of fifo_out is left once fifo_out_len_check runs */
+		uint32_t need = nx_inflate_fifo_out_size(s, 2 * ((uint64_t)s->fifo_out_hwm + 2*INF_HIS_LEN), s->len_out);
+		if (need <= s->len_out / 2)
+			len = need;
+		s->fifo_out_hwm = s->fifo_out_jobs = 0;
+	}
+
+	if (len == s->len_out || NULL == (buf = nx_inflate_buf_alloc(len)))
+		return;
+
+	prt_info("fifo_out resized from %d to %d bytes\n", s->len_out, len);
+	if (len > s->len_out)
+		zlib_stats_inc(inflate_fifo_grow);
+	else
+		zlib_stats_inc(inflate_fifo_shrink);
+
+	memcpy(buf, s->fifo_out + s->cur_out - INF_HIS_LEN, INF_HIS_LEN);
+	nx_inflate_buf_free(s->fifo_out, s->len_out);
+	s->fifo_out = buf;
+	s->len_out = len;
+	s->cur_out = INF_HIS_LEN;
+}
+
+/*
+   The byte at a time header states below cost a macro, two counter
+   updates and a ckbuf store per byte.  When the whole header is in
+   next_in parse it in one pass instead.  Returns 0 when the header
+   was consumed; -1 leaves everything to the byte states, which also
+   report any error in the header.
+*/
+static int nx_inflate_header_bulk(nx_streamp s)
+{
+	unsigned char *p = (unsigned char *) s->next_in;
+	unsigned char *e;
+	uint32_t n = s->avail_in;
+	uint32_t off = 10, xlen = 0, xoff = 0, noff = 0, coff = 0;
+	gz_headerp g = s->gzhead;
+	int flg;
+
+	if (n < 2)
+		return -1;
+
+	if ((s->wrap & HEADER_ZLIB) && !((s->wrap & HEADER_GZIP) && p[0] == 0x1f)) {
+		/* rfc1950; a preset dictionary goes the long way */
+		if ((p[0] & 0x0f) != 0x08 || (p[0] >> 4) >= 8 ||
+		    ((p[0] << 8) | p[1]) % 31 != 0 || (p[1] & 0x20))
+			return -1;
+		if (g != NULL)
+			g->done = -1;
+		s->zlib_cmf = p[0];
+		s->wrap = HEADER_ZLIB;
+		update_stream_in(s, 2);
+		s->adler = s->adler32 = INIT_ADLER;
+		s->inf_state = inf_state_inflate;
+		return 0;
+	}
+
+	if (!(s->wrap & HEADER_GZIP) || n < 10 ||
+	    p[0] != 0x1f || p[1] != 0x8b || p[2] != 0x08 || (p[3] & 0xe0))
+		return -1;
+
+	/* rfc1952; find where the optional fields end */
+	flg = p[3];
+	if (flg & 0x04) {
+		if (off + 2 > n)
+			return -1;
+		xlen = p[off] | (p[off + 1] << 8);
+		xoff = off + 2;
+		off = xoff + xlen;
+		if (off > n)
+			return -1;
+	}
+	if (flg & 0x08) {
+		if (off >= n || NULL == (e = memchr(p + off, 0, n - off)))
+			return -1;
+		noff = off;
+		off = e - p + 1;
+	}
+	if (flg & 0x10) {
+		if (off >= n || NULL == (e = memchr(p + off, 0, n - off)))
+			return -1;
+		coff = off;
+		off = e - p + 1;
+	}
+	if (flg & 0x02) {
+		if (off + 2 > n ||
+		    (p[off] | (p[off + 1] << 8)) != (nx_crc32(INIT_CRC, p, off) & 0xffff))
+			return -1;
+		off += 2;
+	}
+
+	if (g != NULL) {
+		g->text = flg & 1;
+		g->time = p[4] | (p[5] << 8) | (p[6] << 16) | ((uLong) p[7] << 24);
+		g->xflags = p[8];
+		g->os = p[9];
+		if (flg & 0x04) {
+			g->extra_len = xlen;
+			if (g->extra != NULL)
+				memcpy(g->extra, p + xoff, NX_MIN(xlen, g->extra_max));
+		}
+		else
+			g->extra = NULL;
+		if (!(flg & 0x08))
+			g->name = NULL;
+		else if (g->name != NULL && g->name_max > 0)
+			memcpy(g->name, p + noff, NX_MIN(strlen((char *) p + noff) + 1, g->name_max));
+		if (!(flg & 0x10))
+			g->comment = NULL;
+		else if (g->comment != NULL && g->comm_max > 0)
+			memcpy(g->comment, p + coff, NX_MIN(strlen((char *) p + coff) + 1, g->comm_max));
+		g->hcrc = (flg >> 1) & 1;
+		g->done = 1;
+	}
+
+	s->gzflags = flg;
+	s->wrap = HEADER_GZIP;
+	update_stream_in(s, off);
+	s->adler = s->crc32 = INIT_CRC;
+	s->inf_state = inf_state_inflate;
+	return 0;
+}
+
+/* header bytes the byte states did not put through ckbuf */
+static void nx_inflate_hcrc_add(nx_streamp s, const char *buf, int len)
+{
+	s->cksum = nx_crc32(s->cksum, (unsigned char *) s->ckbuf.buf, s->ckidx);
+	s->ckidx = 0;
+	if (len > 0)
+		s->cksum = nx_crc32(s->cksum, (unsigned char *) buf, len);
+}
+
 int nx_inflate(z_streamp strm, int flush)
 {
 	int rc = Z_OK;
 	nx_streamp s;
 	unsigned int avail_in_slot, avail_out_slot;
 	uint64_t t1, t2;
+	unsigned long total_in, total_out;
+	int in_header;
+	int stats = nx_gzip_gather_statistics(); /* nxstat may turn it on meanwhile */
 
 	if (strm == Z_NULL) return Z_STREAM_ERROR;
 	s = (nx_streamp) strm->state;
 	if (s == NULL) return Z_STREAM_ERROR;
 
-	if (flush == Z_BLOCK || flush == Z_TREES) {
-		strm->msg = (char *)"Z_BLOCK or Z_TREES not implemented";
-		prt_err("Z_BLOCK or Z_TREES not implemented!\n");
-		return Z_STREAM_ERROR;
-	}
-
-	if (s->fifo_out == NULL) {
-		/* overflow buffer is about 40% of s->avail_in */
-		s->len_out = (INF_HIS_LEN*2 + (s->zstrm->avail_in * 40)/100);
-		/* for the max possible expansion of inflate input */
-		s->len_out = NX_MAX( INF_MAX_EXPANSION_BYTES, s->len_out);
-		s->len_out = NX_MAX( INF_HIS_LEN << 3, s->len_out );
-		if (NULL == (s->fifo_out = nx_alloc_buffer(s->len_out, nx_config.page_sz, 0))) {
-			prt_err("nx_alloc_buffer for inflate fifo_out\n");
-			return Z_MEM_ERROR;
-		}
-	}
+	if (s->fifo_out == NULL && nx_inflate_alloc_fifo_out(s) != Z_OK)
+		return Z_MEM_ERROR;
 
 	/* statistic */
-	if (nx_gzip_gather_statistics()) {
-		pthread_mutex_lock(&zlib_stats_mutex);
+	if (stats) {
 		avail_in_slot = strm->avail_in / 4096;
 		if (avail_in_slot >= ZLIB_SIZE_SLOTS)
 			avail_in_slot = ZLIB_SIZE_SLOTS - 1;
-		zlib_stats.inflate_avail_in[avail_in_slot]++;
+		zlib_stats_inc(inflate_avail_in[avail_in_slot]);
 
 		avail_out_slot = strm->avail_out / 4096;
 		if (avail_out_slot >= ZLIB_SIZE_SLOTS)
 			avail_out_slot = ZLIB_SIZE_SLOTS - 1;
-		zlib_stats.inflate_avail_out[avail_out_slot]++;
-		zlib_stats.inflate++;
+		zlib_stats_inc(inflate_avail_out[avail_out_slot]);
+		zlib_stats_inc(inflate);
 
-		zlib_stats.inflate_len += strm->avail_in;
+		total_in = strm->total_in;
+		total_out = strm->total_out;
 		t1 = get_nxtime_now();
-		pthread_mutex_unlock(&zlib_stats_mutex);
 	}
 
 	/* copy in from user stream to internal structures */
 	copy_stream_in(s, s->zstrm);
 	copy_stream_out(s, s->zstrm);
 
+	in_header = (s->inf_state != inf_state_inflate);
+
 inf_forever:
 	/* inflate state machine */
 
@@ -324,6 +569,9 @@ inf_forever:
 
 	case inf_state_header:
 
+		if (nx_inflate_header_bulk(s) == 0)
+			break;
+
 		if (s->wrap == (HEADER_ZLIB | HEADER_GZIP)) {
 			/* auto detect zlib/gzip */
 			nx_inflate_get_byte(s, c);
@@ -405,7 +653,7 @@ inf_forever:
 		nx_inflate_get_byte(s, c);
 		s->gzflags = c;
 
-		if (s->gzflags & 0xe0 != 0) { /* reserved bits are set */
+		if ((s->gzflags & 0xe0) != 0) { /* reserved bits are set */
 			strm->msg = (char *)"unknown header flags set";
 			s->inf_state = inf_state_data_error;
 			break;
@@ -482,6 +730,8 @@ inf_forever:
 			copy = s->length;
 			if (copy > s->avail_in) copy = s->avail_in;
 			if (copy) {
+				if (s->gzflags & 0x02)
+					nx_inflate_hcrc_add(s, s->next_in, copy);
 				if (s->gzhead != NULL &&
 				    s->gzhead->extra != NULL) {
 					unsigned int len = s->gzhead->extra_len - s->length;
@@ -511,6 +761,8 @@ inf_forever:
 				    s->length < s->gzhead->name_max )
 					s->gzhead->name[s->length++] = (char) c;
 			} while (!!c && copy < s->avail_in);
+			if (s->gzflags & 0x02)
+				nx_inflate_hcrc_add(s, s->next_in, copy);
 			update_stream_in(s, copy);
 			if (!!c) goto inf_return; /* need more name */
 		}
@@ -533,6 +785,8 @@ inf_forever:
 				    s->length < s->gzhead->comm_max )
 					s->gzhead->comment[s->length++] = (char) c;
 			} while (!!c && copy < s->avail_in);
+			if (s->gzflags & 0x02)
+				nx_inflate_hcrc_add(s, s->next_in, copy);
 			update_stream_in(s, copy);
 			if (!!c) goto inf_return; /* need more comment */
 		}
@@ -541,6 +795,9 @@ inf_forever:
 
 		s->length = 0;
 		s->inf_held = 0;
+		s->hcrc16 = 0;
+		/* the header crc covers everything up to here */
+		nx_inflate_hcrc_add(s, NULL, 0);
 		s->inf_state = inf_state_gzip_hcrc;
 		/* fall thru */
 
@@ -550,23 +807,22 @@ inf_forever:
 
 			while( s->inf_held < 2 ) {
 				nx_inflate_get_byte(s, c);
-				s->hcrc16 = s->hcrc16 << 8 | c;
+				s->hcrc16 = s->hcrc16 | (c << (8 * s->inf_held));
 				++ s->inf_held;
 			}
-			s->hcrc16 = le16toh(s->hcrc16);
-			s->gzhead->hcrc = 1;
-			s->gzhead->done = 1;
 
 			/* Compare stored and compute hcrc checksums here */
 
-			if (s->hcrc16 != s->cksum & 0xffff) {
+			if (s->hcrc16 != (s->cksum & 0xffff)) {
 				strm->msg = (char *)"header crc mismatch";
 				s->inf_state = inf_state_data_error;
 				break;
 			}
 		}
-		else if (s->gzhead != NULL)
-			s->gzhead->hcrc = 0;
+		if (s->gzhead != NULL) {
+			s->gzhead->hcrc = (s->gzflags >> 1) & 1;
+			s->gzhead->done = 1;
+		}
 
 		s->inf_held = 0;
 		s->adler = s->crc32 = INIT_CRC;
@@ -628,6 +884,8 @@ inf_forever:
 
 	case inf_state_zlib_dict:
 
+		if (s->dict_len == 0 && s->shared_dict != NULL && s->shared_dict->dict_id == s->dict_id)
+			nx_inflate_use_dict(s, s->shared_dict->buf + s->shared_dict->len, s->shared_dict->len);
 		if (s->dict_len == 0) {
 			return Z_NEED_DICT;
 		}
@@ -636,6 +894,13 @@ inf_forever:
 
 	case inf_state_inflate:
 
+		if ((flush == Z_BLOCK || flush == Z_TREES) && in_header && s->wrap != HEADER_RAW) {
+			/* like zlib, stop after the header before the first block */
+			s->data_type = 128;
+			rc = Z_OK;
+			goto inf_return;
+		}
+
 		rc = nx_inflate_(s, flush);
 		goto inf_return;
 
@@ -663,16 +928,40 @@ inf_forever:
 
 inf_return:
 
+	if (s->is_final == 1 && s->used_in > 0 && s->inf_state == inf_state_inflate) {
+		/* fifo_in holds bytes past the end of the stream.  As
+		   zlib does, leave next_in at the first of them; those
+		   copied from this call's next_in are given back.  Any
+		   from earlier calls stay in fifo_in */
+		unsigned int back = NX_MIN((unsigned long)s->used_in,
+					   (unsigned long)(s->next_in - (char *)strm->next_in));
+
+		s->next_in  -= back;
+		s->avail_in += back;
+		s->used_in  -= back;
+		if (s->used_in == 0)
+			s->cur_in = 0;
+	}
+
 	/* copy out to user stream */
 	copy_stream_in(s->zstrm, s);
 	copy_stream_out(s->zstrm, s);
 
+	if (flush == Z_BLOCK || flush == Z_TREES) {
+		/* not at the block boundary until its output is all out */
+		strm->data_type = (s->used_out > 0) ? (s->data_type & ~128) : s->data_type;
+	}
+
 	/* statistic */
-	if (nx_gzip_gather_statistics()) {
-		pthread_mutex_lock(&zlib_stats_mutex);
+	if (stats) {
 		t2 = get_nxtime_now();
-		zlib_stats.inflate_time += get_nxtime_diff(t1,t2);
-		pthread_mutex_unlock(&zlib_stats_mutex);
+		zlib_stats_add(inflate_time, get_nxtime_diff(t1,t2));
+		zlib_stats_add(inflate_len, strm->total_in - total_in);
+		zlib_stats_add(inflate_out_len, strm->total_out - total_out);
+		zlib_stats_add(inflate_hist_memcpy, s->hist_memcpy);
+		zlib_stats_add(inflate_out_memcpy, s->out_memcpy);
+		zlib_stats_add(inflate_hist_inplace, s->hist_inplace_cnt);
+		s->hist_memcpy = s->out_memcpy = s->hist_inplace_cnt = 0;
 	}
 	return rc;
 }
@@ -695,20 +984,29 @@ static inline void nx_inflate_update_checksum(nx_streamp s)
 static int nx_inflate_verify_checksum(nx_streamp s, int copy)
 {
 	nx_gzip_crb_cpb_t *cmdp = s->nxcmdp;
-	char *tail;
+	unsigned char *tail = (unsigned char *) s->trailer;
 	uint32_t cksum, isize;
-	int i;
+	int need;
 
-	if (copy > 0) {
+	if (s->wrap == HEADER_GZIP)
+		need = 8;
+	else if (s->wrap == HEADER_ZLIB)
+		need = 4;
+	else
+		need = 0;
+
+	if (copy == 2 && s->trailer_len == 0 && s->used_in == 0 && s->avail_in >= need) {
+		/* the whole trailer is in next_in; read it there and
+		   keep a copy for calls after the stream end */
+		tail = (unsigned char *) s->next_in;
+		memcpy(s->trailer, tail, need);
+		update_stream_in(s, need);
+		s->trailer_len = need;
+	}
+	else if (copy > 0) {
 		/* to handle the case of crc and isize spanning fifo_in
 		 * and next_in */
-		int need, got;
-		if (s->wrap == HEADER_GZIP)
-			need = 8;
-		else if (s->wrap == HEADER_ZLIB)
-			need = 4;
-		else
-			need = 0;
+		int got;
 
 		/* if partial copy exist from previous calls */
 		need = NX_MAX( NX_MIN(need - s->trailer_len, need), 0 );
@@ -734,13 +1032,21 @@ static int nx_inflate_verify_checksum(nx_streamp s, int copy)
 			return Z_OK; /* copy only */
 	}
 
-	tail = s->trailer;
+	if (s->sync_nocheck) {
+		/* inflateSync skipped part of the stream; the stored
+		   checksum cannot match; consume the trailer only */
+		if ((s->wrap == HEADER_GZIP && s->trailer_len < 8) ||
+		    (s->wrap == HEADER_ZLIB && s->trailer_len < 4))
+			return Z_OK;
+		nx_inflate_update_checksum(s);
+		return Z_STREAM_END;
+	}
 
 	if (s->wrap == HEADER_GZIP) {
 		if (s->trailer_len == 8) {
 			/* crc32 and isize are present; compare checksums */
-			cksum = (tail[0] | tail[1]<<8 | tail[2]<<16 | tail[3]<<24);
-			isize = (tail[4] | tail[5]<<8 | tail[6]<<16 | tail[7]<<24);
+			cksum = (tail[0] | tail[1]<<8 | tail[2]<<16 | (uint32_t)tail[3]<<24);
+			isize = (tail[4] | tail[5]<<8 | tail[6]<<16 | (uint32_t)tail[7]<<24);
 
 			prt_info("computed checksum %08x isize %08x\n", cmdp->cpb.out_crc, (uint32_t)(s->total_out % (1ULL<<32)));
 			prt_info("stored   checksum %08x isize %08x\n", cksum, isize);
@@ -759,7 +1065,7 @@ static int nx_inflate_verify_checksum(nx_streamp s, int copy)
 	else if (s->wrap == HEADER_ZLIB) {
 		if (s->trailer_len == 4) {
 			/* adler32 is present; compare checksums */
-			cksum = (tail[0] | tail[1]<<8 | tail[2]<<16 | tail[3]<<24);
+			cksum = (tail[0] | tail[1]<<8 | tail[2]<<16 | (uint32_t)tail[3]<<24);
 
 			prt_info("computed checksum %08x\n", cmdp->cpb.out_adler);
 			prt_info("stored   checksum %08x\n", cksum);
@@ -779,37 +1085,157 @@ static int nx_inflate_verify_checksum(nx_streamp s, int copy)
 	return Z_STREAM_END;
 }
 
-/* we need to overlay any dictionary on top of the inflate history
-   and calculate lengths rounding up to 16 byte integrals */
-static int nx_amend_history_with_dict(nx_streamp s, int *hlen, int *dlen )
+/*
+   Once a dictionary is set the history is the output before it, the
+   dictionary, and the output since, the last 32KB of the three.  The
+   output is in fifo_out before cur_out.  Appends them to ddl and
+   returns the history length, rounded up to quadwords by reading
+   before the oldest piece; no segfaults since nx_alloc_buffer and
+   nx_dictCreate pad in front.
+*/
+static int nx_amend_history_with_dict(nx_streamp s, nx_dde_t *ddl)
 {
-	int dict_len = NX_MIN(s->dict_len, INF_MAX_DICT_LEN);
-	int hist_len;
-
-	*hlen = *dlen = 0;
+	int new_len = NX_MIN(s->dict_hist, s->history_len);
+	int dict_len = NX_MIN((int)s->dict_len, INF_MAX_DICT_LEN - new_len);
+	int old_len = NX_MIN(s->history_len - new_len, INF_MAX_DICT_LEN - new_len - dict_len);
+	int pad = (NXQWSZ - (old_len + dict_len + new_len) % NXQWSZ) % NXQWSZ;
 
 	ASSERT(s->history_len >= 0);
 
-	if (s->history_len <= dict_len) {
-		/* dictionary takes over inflate history */
-		hist_len = 0;
-		/* round up per NX-gzip history alignment requirements;
-		   no segfaults since nx_alloc_buffer is padded in front */
-		dict_len = ((dict_len + NXQWSZ - 1) / NXQWSZ) * NXQWSZ;
+	if (old_len > 0)
+		old_len += pad;
+	else
+		dict_len += pad;
+
+	if (old_len > 0)
+		nx_append_dde(ddl, s->fifo_out + s->cur_out - new_len - old_len, old_len);
+	if (dict_len > 0)
+		nx_append_dde(ddl, s->dict_end - dict_len, dict_len);
+	if (new_len > 0)
+		nx_append_dde(ddl, s->fifo_out + s->cur_out - new_len, new_len);
+
+	return old_len + dict_len + new_len;
+}
+
+/*
+   The history of the next job is the last 32KB of the output.  It is
+   normally copied to fifo_out after each job.  With hist_inplace_ok
+   the user promises not to modify its output until the next inflate
+   call, and the history is left in next_out.  When the next job
+   writes right after it, i.e. next_out is contiguous, NX reads the
+   history from there and nothing is copied.  Otherwise this copies
+   the history to fifo_out where the rest of the code expects it.
+*/
+static void nx_inflate_materialize_history(nx_streamp s)
+{
+	int len;
+
+	if (s->hist_inplace == NULL)
+		return;
+
+	len = NX_MIN(s->history_len, s->hist_inplace_len);
+	memcpy(s->fifo_out + s->cur_out, s->hist_inplace - len, len);
+	s->cur_out += len;
+	fifo_out_len_check(s);
+	s->hist_memcpy += len;
+	s->hist_inplace = NULL;
+}
+
+/* byte at offset off of the job input, fifo_in followed by next_in */
+static inline int nx_inflate_src_byte(nx_streamp s, uint32_t off)
+{
+	if (off < s->used_in)
+		return (unsigned char) s->fifo_in[s->cur_in + off];
+	return (unsigned char) s->next_in[off - s->used_in];
+}
+
+/*
+   At a block boundary zlib has consumed the partially used input
+   byte and reports its unused bits in data_type.  NX supplies that
+   byte again to the next job.  Move it from next_in to fifo_in so
+   total_in is the same as zlib's.
+*/
+static int nx_inflate_take_partial_byte(nx_streamp s)
+{
+	if ((s->data_type & 7) == 0 || s->used_in > 0 || s->avail_in == 0)
+		return Z_OK;
+
+	if (s->fifo_in == NULL) {
+		s->len_in = nx_config.soft_copy_threshold * 2;
+		if (NULL == (s->fifo_in = nx_inflate_buf_alloc(s->len_in))) {
+			prt_err("nx_alloc_buffer for inflate fifo_in\n");
+			return Z_MEM_ERROR;
+		}
 	}
-	else {
-		/* dictionary overlays history; round up to 16 byte integral */
-		hist_len = ((s->history_len + NXQWSZ - 1) / NXQWSZ) * NXQWSZ;
-		hist_len = hist_len - dict_len;
-		/* at this point hist_len + dict_len are 16 byte integral;
-		   we need to add histlen bytes from s->fifo_out to the ddl;
-		   then add dict_len bytes from s->dict to the ddl;
-		   then comes the user data in next_in; */
+	s->cur_in = 0;
+	s->fifo_in[0] = *s->next_in;
+	update_stream_in(s, 1);
+	s->used_in = 1;
+
+	return Z_OK;
+}
+
+/* the last history_len bytes of output produced so far */
+static char *nx_inflate_history(nx_streamp s)
+{
+	if (s->used_out > 0)
+		return s->fifo_out + s->cur_out + s->used_out - s->history_len;
+	if (s->hist_inplace != NULL)
+		return s->hist_inplace - s->history_len;
+	return s->fifo_out + s->cur_out - s->history_len;
+}
+
+/*
+   Records a checkpoint after a job if span bytes were produced since
+   the last one.  The CPB already holds the state to resume the next
+   job.  Indexing is best effort; a failure here only costs a
+   checkpoint.
+*/
+static void nx_inflate_index_add(nx_streamp s)
+{
+	nx_index_t *idx = s->index;
+	nx_gzip_crb_cpb_t *cmdp = s->nxcmdp;
+	nx_index_point_t *pt;
+	uint64_t out = s->total_out + s->used_out;
+	uLongf zlen;
+
+	if (out < ((idx->num > 0) ? idx->pt[idx->num - 1].out : 0) + idx->span)
+		return;
+
+	if (idx->num == idx->alloc) {
+		int alloc = NX_MAX(2 * idx->alloc, 64);
+		nx_index_point_t *p = realloc(idx->pt, alloc * sizeof(*p));
+		if (p == NULL)
+			return;
+		idx->pt = p;
+		idx->alloc = alloc;
+	}
+	pt = &idx->pt[idx->num];
+
+	pt->in  = s->total_in - s->used_in;
+	pt->out = out;
+	pt->crc32 = s->crc32;
+	pt->adler32 = s->adler32;
+	pt->sfbt = getnn(cmdp->cpb, in_sfbt);
+	pt->subc = getnn(cmdp->cpb, in_subc);
+	pt->rembytecnt = (pt->sfbt >> 1 == 0b100) ? getnn(cmdp->cpb, in_rembytecnt) : 0;
+	pt->dhtlen = (pt->sfbt >> 1 == 0b110) ? getnn(cmdp->cpb, in_dhtlen) : 0;
+	memcpy(pt->dht, cmdp->cpb.in_dht_char, (pt->dhtlen + 7) / 8);
+
+	pt->hist_len = s->history_len;
+	zlen = nx_compressBound(pt->hist_len);
+	if (NULL == (pt->zhist = malloc(zlen)))
+		return;
+	if (nx_compress2((Bytef *)pt->zhist, &zlen, (Bytef *)nx_inflate_history(s), pt->hist_len, Z_BEST_SPEED) != Z_OK) {
+		prt_err("cannot compress the checkpoint history at %ld\n", (long)out);
+		free(pt->zhist);
+		return;
 	}
-	*hlen = hist_len;
-	*dlen = dict_len;
+	pt->zhist_len = zlen;
 
-	return 0;
+	prt_info("checkpoint %d in %ld out %ld sfbt %x subc %d hist %d/%d\n", idx->num,
+		 (long)pt->in, (long)pt->out, pt->sfbt, pt->subc, pt->hist_len, pt->zhist_len);
+	++idx->num;
 }
 
 static int nx_inflate_(nx_streamp s, int flush)
@@ -819,7 +1245,7 @@ static int nx_inflate_(nx_streamp s, int flush)
 	long loop_cnt = 0, loop_max = 0xffff;
 
 	/* inflate benefits from large jobs; memcopies must be amortized */
-	uint32_t inflate_per_job_len = 64 * nx_config.per_job_len;
+	uint32_t inflate_per_job_len = 64 * nx_stream_opt(s, NX_OPT_PER_JOB_LEN, per_job_len);
 
 	/* nx hardware */
 	uint32_t sfbt, subc, spbc, tpbc, nx_ce, fc;
@@ -831,6 +1257,8 @@ static int nx_inflate_(nx_streamp s, int flush)
 	int pgfault_retries, target_space_retries, partial_bits;
 	int cc, rc;
 	int nx_history_len; /* includes dictionary and history going in to nx-gzip */
+	int single_blk = (flush == Z_BLOCK || flush == Z_TREES);
+	int progressed = 0;
 
 	print_dbg_info(s, __LINE__);
 
@@ -864,7 +1292,9 @@ copy_fifo_out_to_next_out:
 	if (s->used_out > 0) {
 		write_sz = NX_MIN(s->used_out, s->avail_out);
 		if (write_sz > 0) {
+			progressed = 1;
 			memcpy(s->next_out, s->fifo_out + s->cur_out, write_sz);
+			s->out_memcpy += write_sz;
 			update_stream_out(s, write_sz);
 			s->used_out -= write_sz;
 			s->cur_out += write_sz;
@@ -882,6 +1312,11 @@ copy_fifo_out_to_next_out:
 		}
 	}
 
+	if (single_blk && progressed && (s->data_type & 128)) {
+		/* Z_BLOCK stops at the next deflate block boundary */
+		return nx_inflate_take_partial_byte(s);
+	}
+
 	assert(s->used_out == 0);
 
 	/* if s->avail_out and  s->avail_in is 0, return */
@@ -896,7 +1331,7 @@ small_next_in:
 	if (s->avail_in < nx_config.soft_copy_threshold && s->avail_out > 0) {
 		if (s->fifo_in == NULL) {
 			s->len_in = nx_config.soft_copy_threshold * 2;
-			if (NULL == (s->fifo_in = nx_alloc_buffer(s->len_in, nx_config.page_sz, 0))) {
+			if (NULL == (s->fifo_in = nx_inflate_buf_alloc(s->len_in))) {
 				prt_err("nx_alloc_buffer for inflate fifo_in\n");
 				return Z_MEM_ERROR;
 			}
@@ -925,6 +1360,16 @@ decomp_state:
 	clearp_dde(ddl_out);
 
 	nx_history_len = s->history_len;
+	s->sync_point = 0;
+
+	/* history left in next_out is usable only if this job writes
+	   right after it; NX reads a quadword multiple of history */
+	if (s->hist_inplace != NULL &&
+	    (s->dict_len > 0 || (!s->hist_ext && s->hist_inplace != s->next_out) ||
+	     s->hist_inplace_len < ((nx_history_len + NXQWSZ - 1) / NXQWSZ) * NXQWSZ))
+		nx_inflate_materialize_history(s);
+
+	nx_inflate_fifo_out_policy(s);
 
 	/* FC, CRC, HistLen, Table 6-6 */
 	if (s->resuming || (s->dict_len > 0)) {
@@ -934,7 +1379,7 @@ decomp_state:
 		   or less of the output earlier produced. And also
 		   make sure partial checksums are carried forward
 		*/
-		fc = GZIP_FC_DECOMPRESS_RESUME;
+		fc = single_blk ? GZIP_FC_DECOMPRESS_RESUME_SINGLE_BLK_N_SUSPEND : GZIP_FC_DECOMPRESS_RESUME;
 
 		/* Crc of prev job passed to the job to be resumed */
 		put32(cmdp->cpb, in_crc, s->crc32);
@@ -945,28 +1390,18 @@ decomp_state:
 		   nx_alloc_buffer has padding at the beginning */
 
 		if (s->dict_len > 0) {
-			int hlen, dlen;
-
-			/* lays dict on top of hist */
-			nx_amend_history_with_dict(s, &hlen, &dlen );
+			/* lays dict on top of hist; every job until 32KB
+			   of output follow the dictionary */
+			nx_history_len = nx_amend_history_with_dict(s, ddl_in);
 
 			/* sum is integral of 16 */
-			nx_history_len = hlen + dlen;
 			ASSERT( (nx_history_len % 16) == 0 );
 
 			cmdp->cpb.in_histlen = 0;
 			putnn(cmdp->cpb, in_histlen, nx_history_len / NXQWSZ);
-			ASSERT(!!s->dict && !!s->fifo_out);
-
-			/* add hlen bytes from the beginning of the history */
-			if (hlen > 0)
-				nx_append_dde(ddl_in, s->fifo_out + (s->cur_out - s->history_len), hlen);
+			ASSERT(!!s->dict_end && !!s->fifo_out);
 
-			/* add dlen bytes from the dictionary */
-			if (dlen > 0)
-				nx_append_dde(ddl_in, s->dict, dlen);
-
-			if (s->wrap == HEADER_ZLIB) {
+			if (s->wrap == HEADER_ZLIB && !s->resuming) {
 				/* in the raw mode pass crc as is; in the zlib mode
 				   initialize them */
 				put32(cmdp->cpb, in_crc, INIT_CRC );
@@ -986,7 +1421,12 @@ decomp_state:
 			putnn(cmdp->cpb, in_histlen, nx_history_len);
 			nx_history_len = nx_history_len * NXQWSZ; /* convert to bytes */
 
-			if (nx_history_len > 0) {
+			if (nx_history_len > 0 && s->hist_inplace != NULL) {
+				/* history is right before next_out */
+				nx_append_dde(ddl_in, s->hist_inplace - nx_history_len, nx_history_len);
+				++s->hist_inplace_cnt;
+			}
+			else if (nx_history_len > 0) {
 				/* deflate history goes in first */
 				ASSERT(s->cur_out >= nx_history_len);
 				nx_append_dde(ddl_in, s->fifo_out + (s->cur_out - nx_history_len), nx_history_len);
@@ -996,7 +1436,7 @@ decomp_state:
 	}
 	else {
 		/* First decompress job */
-		fc = GZIP_FC_DECOMPRESS;
+		fc = single_blk ? GZIP_FC_DECOMPRESS_SINGLE_BLK_N_SUSPEND : GZIP_FC_DECOMPRESS;
 
 		nx_history_len = s->history_len = 0;
 		/* writing a 0 clears out subc as well */
@@ -1061,6 +1501,10 @@ decomp_state:
 
 	target_sz_expected = NX_MIN(target_sz_expected, inflate_per_job_len);
 
+	/* indexing needs a job boundary about every span bytes */
+	if (s->index != NULL && s->index->span > 0)
+		target_sz_expected = NX_MIN(target_sz_expected, s->index->span);
+
 	/* e.g. if we want 100KB at the output and if the compression
 	   ratio is 10% we want 10KB if input */
 	uint32_t source_sz_expected = (uint32_t)(((uint64_t)target_sz_expected * s->last_comp_ratio + 1000L)/1000UL);
@@ -1206,6 +1650,7 @@ restart_nx:
 
 		prt_info("ERR_NX_TARGET_SPACE; retry with smaller input data src %d hist %d\n", source_sz, nx_history_len);
 		target_space_retries++;
+		s->fifo_out_grow = 1;
 		goto restart_nx;
 
 	case ERR_NX_OK:
@@ -1215,9 +1660,20 @@ restart_nx:
 		prt_info("ERR_NX_OK\n");
 		spbc = get32(cmdp->cpb, out_spbc_decomp);
 		tpbc = get32(cmdp->crb.csb, tpbc);
+		if (single_blk) {
+			/* suspended at the end of a non final block */
+			sfbt = getnn(cmdp->cpb, out_sfbt);
+			subc = getnn(cmdp->cpb, out_subc);
+			if (sfbt != 0b0000) {
+				ASSERT(target_sz >= tpbc);
+				cc = ERR_NX_DATA_LENGTH; /* not final */
+				goto ok_cc3;
+			}
+		}
 		ASSERT(target_sz >= tpbc);
 		ASSERT(spbc >= s->history_len);
 		source_sz = spbc - nx_history_len;
+		s->data_type = 64;
 		goto offsets_state;
 
 	default:
@@ -1239,6 +1695,21 @@ ok_cc3:
 
 	partial_bits = 0;
 
+	/* a sync or full flush ends with an empty stored block;
+	   stopping right after it on a byte boundary is a sync point */
+	s->sync_point = (sfbt == 0b1110 && subc == 0 && source_sz >= 4 &&
+			 nx_inflate_src_byte(s, source_sz - 4) == 0x00 &&
+			 nx_inflate_src_byte(s, source_sz - 3) == 0x00 &&
+			 nx_inflate_src_byte(s, source_sz - 2) == 0xff &&
+			 nx_inflate_src_byte(s, source_sz - 1) == 0xff);
+
+	/* zlib data_type: unused bits of the last byte, 64 if in or
+	   after the final block, 128 if at a block header */
+	if (sfbt == 0b0000)
+		s->data_type = 64 + subc % 8;
+	else
+		s->data_type = ((sfbt & 1) ? 64 : 0) + ((sfbt >> 1 == 0b111) ? 128 : 0) + subc % 8;
+
 	/* Table 6-4: Source Final Block Type (SFBT) describes the
 	   last processed deflate block and clues the software how to
 	   resume the next job.  SUBC indicates how many input bits NX
@@ -1337,6 +1808,7 @@ ok_cc3:
 
 offsets_state:
 
+	progressed = 1;
 	print_dbg_info(s, __LINE__);
 	prt_info("== %d source_sz %d used_in %d cur_in %d\n", __LINE__, source_sz, s->used_in, s->cur_in );
 
@@ -1358,19 +1830,37 @@ offsets_state:
 	nx_inflate_update_checksum(s);
 
 	int overflow_len = tpbc - len_next_out;
+	s->fifo_out_hwm = NX_MAX(s->fifo_out_hwm, overflow_len);
+	s->fifo_out_jobs++;
 	if (overflow_len <= 0) { /* there is no overflow */
 		assert(s->used_out == 0);
 		if (s->is_final == 0) {
 			int need_len = NX_MIN(INF_HIS_LEN, tpbc);
-			/* Copy the tail of data in next_out as the history to
-			   the current head of fifo_out. Size is 32KB commonly
-			   but can be less if the engine produce less than
-			   32KB.  Note that cur_out-32KB already contains the
-			   history of the previous operation. The new history
-			   is appended after the old history */
-			memcpy(s->fifo_out + s->cur_out, s->next_out + tpbc - need_len, need_len);
-			s->cur_out += need_len;
-			fifo_out_len_check(s);
+			/* output contiguous with the history in next_out;
+			   this job started at hist_inplace */
+			int avail = tpbc + ((s->hist_inplace != NULL && !s->hist_ext) ? s->hist_inplace_len : 0);
+			int hist_len = NX_MIN(INF_HIS_LEN, s->total_out + tpbc);
+
+			hist_len = ((hist_len + NXQWSZ - 1) / NXQWSZ) * NXQWSZ;
+			if (s->hist_inplace_ok && avail >= hist_len) {
+				/* leave the history in next_out */
+				s->hist_inplace = s->next_out + tpbc;
+				s->hist_inplace_len = NX_MIN(avail, INF_HIS_LEN);
+				s->hist_ext = 0;
+			}
+			else {
+				nx_inflate_materialize_history(s);
+				/* Copy the tail of data in next_out as the history to
+				   the current head of fifo_out. Size is 32KB commonly
+				   but can be less if the engine produce less than
+				   32KB.  Note that cur_out-32KB already contains the
+				   history of the previous operation. The new history
+				   is appended after the old history */
+				memcpy(s->fifo_out + s->cur_out, s->next_out + tpbc - need_len, need_len);
+				s->hist_memcpy += need_len;
+				s->cur_out += need_len;
+				fifo_out_len_check(s);
+			}
 		}
 		update_stream_out(s, tpbc);
 
@@ -1385,6 +1875,17 @@ offsets_state:
 		if (len_next_out + overflow_len > INF_HIS_LEN) {
 			len = INF_HIS_LEN - overflow_len;
 			memcpy(s->fifo_out + s->cur_out - len, s->next_out + len_next_out - len, len);
+			s->hist_memcpy += len;
+		}
+		else if (s->hist_inplace != NULL) {
+			/* the old history is still before next_out; the
+			   overflow is already at cur_out, so place the
+			   old history tail without moving cur_out */
+			len = INF_HIS_LEN - (len_next_out + overflow_len);
+			len = NX_MIN(len, s->hist_inplace_len);
+			memcpy(s->fifo_out + s->cur_out - len_next_out - len, s->hist_inplace - len, len);
+			memcpy(s->fifo_out + s->cur_out - len_next_out, s->next_out, len_next_out);
+			s->hist_memcpy += len + len_next_out;
 		}
 		else {
 			len = INF_HIS_LEN - (len_next_out + overflow_len);
@@ -1398,14 +1899,17 @@ offsets_state:
 			/* copies from next_out to the gap opened in
 			   fifo_out as a result of previous memcpy */
 			memcpy(s->fifo_out + s->cur_out - len_next_out, s->next_out, len_next_out);
+			s->hist_memcpy += len + len_next_out;
 		}
 
+		s->hist_inplace = NULL;
 		s->used_out += overflow_len;
 		update_stream_out(s, len_next_out);
 
 		print_dbg_info(s, __LINE__);
 	}
 	else { /* overflow_len > 1<<15 */
+		s->hist_inplace = NULL;
 		s->used_out += overflow_len;
 		update_stream_out(s, len_next_out);
 
@@ -1428,8 +1932,16 @@ offsets_state:
 
 	if (!s->is_final) s->resuming = 1;
 
-	/* raw mode will set this again for the next dictionary */
-	s->dict_len = 0;
+	if (s->index != NULL && s->index->span > 0 && !s->is_final)
+		nx_inflate_index_add(s);
+
+	/* the dictionary stays in the history until 32KB of output
+	   follow it */
+	if (s->dict_len > 0) {
+		s->dict_hist = NX_MIN(s->dict_hist + tpbc, INF_HIS_LEN);
+		if (s->dict_hist >= INF_HIS_LEN)
+			s->dict_len = 0;
+	}
 
 	print_dbg_info(s, __LINE__);
 
@@ -1455,6 +1967,11 @@ offsets_state:
 		}
 	}
 
+	if (single_blk && (s->data_type & 128)) {
+		/* returns there at the block boundary */
+		goto copy_fifo_out_to_next_out;
+	}
+
 	if (s->avail_in > 0 && s->avail_out > 0) {
 		goto copy_fifo_out_to_next_out;
 	}
@@ -1551,12 +2068,9 @@ int nx_inflateSetDictionary(z_streamp strm, const Bytef *dictionary, uInt dictLe
 		prt_err("supplied dictionary ID does not match the inflate header\n");
 		return Z_DATA_ERROR;
 	}
-	s->dict_len = dictLength;
-
-	/* TODO zlib says "window is amended" with the dictionary; it
-	   means that we must truncate the history in fifo_out to the
-	   maximum of 32KB and dictLength; recall the NX rounding
-	   requirements */
+	/* zlib says "window is amended" with the dictionary; see
+	   nx_amend_history_with_dict for the NX rounding */
+	nx_inflate_use_dict(s, s->dict + dictLength, dictLength);
 
 	return Z_OK;
 
@@ -1604,6 +2118,558 @@ int nx_inflateSetDictionary(z_streamp strm, const Bytef *dictionary, uInt dictLe
 	*/
 }
 
+/*
+  Attaches a dictionary made by nx_dictCreate() without copying it.
+  A zlib stream uses it whenever a header asks for its dict_id,
+  instead of returning Z_NEED_DICT; a raw stream uses it now and
+  after every inflateReset().  It stays attached until the stream
+  ends or d is NULL.
+*/
+int nx_inflateSetSharedDictionary(z_streamp strm, nx_dictp d)
+{
+	nx_streamp s;
+
+	if (strm == NULL || NULL == (s = (nx_streamp) strm->state))
+		return Z_STREAM_ERROR;
+
+	if (s->wrap == HEADER_GZIP)
+		return Z_STREAM_ERROR;
+
+	if (d != NULL && s->wrap == HEADER_ZLIB && s->inf_state == inf_state_zlib_dict &&
+	    s->dict_id != d->dict_id) {
+		prt_err("shared dictionary ID does not match the inflate header\n");
+		return Z_DATA_ERROR;
+	}
+
+	nx_dictRelease(s->shared_dict);
+	s->shared_dict = nx_dictGet(d);
+
+	if (d != NULL && s->wrap == HEADER_RAW)
+		nx_inflate_use_dict(s, d->buf + d->len, d->len);
+
+	return Z_OK;
+}
+
+/*
+   Overrides option opt for this stream: NX_OPT_PER_JOB_LEN or
+   NX_OPT_INF_STREAM_MEM.  fifo_out is sized within the new budget
+   from its next resize on.
+*/
+int nx_inflateSetOption(z_streamp strm, int opt, uint64_t value)
+{
+	nx_streamp s;
+
+	if (strm == NULL || NULL == (s = (nx_streamp) strm->state))
+		return Z_STREAM_ERROR;
+
+	value = nx_option_limit(opt, value);
+	switch (opt) {
+	case NX_OPT_PER_JOB_LEN:
+		s->opt.per_job_len = value;
+		break;
+	case NX_OPT_INF_STREAM_MEM:
+		s->opt.inflate_stream_mem = value;
+		break;
+	default:
+		return Z_STREAM_ERROR;
+	}
+	s->opt.set |= 1U << opt;
+	return Z_OK;
+}
+
+/*
+   Search buf for the 00 00 ff ff marker, the LEN and NLEN of the
+   empty stored block that deflate writes at Z_SYNC_FLUSH and
+   Z_FULL_FLUSH.  *have is the number of marker bytes matched so far
+   and carries a partial match across calls, as in zlib syncsearch().
+   Returns the number of bytes examined.  If *have is 4 on return the
+   marker ends right before the returned offset.
+*/
+long nx_sync_search(const unsigned char *buf, long len, int *have)
+{
+	long next = 0;
+	int got = *have;
+#if defined(SYNC_VSX)
+	const vector unsigned char ff = vec_splats((unsigned char)0xff);
+#endif
+
+	while (next < len && got < 4) {
+		if (got == 0) {
+			/* a marker cannot start at next unless
+			   buf[next+2] is 0xff; skip runs without any */
+#if defined(SYNC_VSX)
+			while (next + 2 + 16 <= len &&
+			       !vec_any_eq(vec_xl(next + 2, buf), ff))
+				next += 16;
+#else
+			uint64_t w;
+			while (next + 2 + 8 <= len) {
+				memcpy(&w, buf + next + 2, 8);
+				w = ~w; /* 0xff bytes become zero bytes */
+				if ((w - 0x0101010101010101ULL) & ~w & 0x8080808080808080ULL)
+					break;
+				next += 8;
+			}
+#endif
+			if (next >= len)
+				break;
+		}
+		if (buf[next] == (got < 2 ? 0 : 0xff))
+			got++;
+		else if (buf[next])
+			got = 0;
+		else
+			got = 4 - got;
+		next++;
+	}
+	*have = got;
+	return next;
+}
+
+/*
+   Skips input until the next full flush point and makes inflate
+   restart there with an empty history, the same as zlib.  Unused
+   input in fifo_in is searched first, then next_in.  Output in
+   fifo_out not yet copied to next_out is discarded.
+*/
+int nx_inflateSync(z_streamp strm)
+{
+	nx_streamp s;
+	long used;
+
+	if (strm == Z_NULL || NULL == (s = (nx_streamp) strm->state))
+		return Z_STREAM_ERROR;
+
+	zlib_stats_inc(inflateSync);
+
+	if (strm->avail_in == 0 && s->used_in == 0)
+		return Z_BUF_ERROR;
+
+	copy_stream_in(s, strm);
+
+	if (s->used_in > 0) {
+		used = nx_sync_search((unsigned char *)s->fifo_in + s->cur_in, s->used_in, &s->sync_have);
+		s->used_in -= used;
+		s->cur_in  += used;
+		if (s->used_in == 0)
+			s->cur_in = 0;
+	}
+	if (s->sync_have < 4) {
+		used = nx_sync_search((unsigned char *)s->next_in, s->avail_in, &s->sync_have);
+		update_stream_in(s, used);
+	}
+	copy_stream_in(strm, s);
+
+	prt_info("inflateSync: have %d total_in %ld\n", s->sync_have, (long)s->total_in);
+
+	if (s->sync_have < 4)
+		return Z_DATA_ERROR;
+
+	/* no header yet then treat as raw, like zlib */
+	if (s->inf_state < inf_state_inflate)
+		s->wrap = HEADER_RAW;
+	s->sync_nocheck = 1;
+	s->sync_have = 0;
+	s->sync_point = 0;
+	s->data_type = 128;
+
+	s->inf_state = inf_state_inflate;
+	s->resuming = 0;
+	s->history_len = 0;
+	s->hist_inplace = NULL;
+	s->dict_len = 0;
+	s->is_final = 0;
+	s->trailer_len = 0;
+	s->used_out = 0;
+	s->cur_out = INF_HIS_LEN;
+	s->crc32 = INIT_CRC;
+	s->adler32 = INIT_ADLER;
+
+	return Z_OK;
+}
+
+/* true if the last job stopped at the end of a sync or full flush */
+int nx_inflateSyncPoint(z_streamp strm)
+{
+	nx_streamp s;
+
+	if (strm == Z_NULL || NULL == (s = (nx_streamp) strm->state))
+		return Z_STREAM_ERROR;
+
+	return s->sync_point && s->used_out == 0;
+}
+
+static nx_index_t *nx_inflate_index_get(nx_streamp s)
+{
+	if (s->index == NULL)
+		s->index = calloc(1, sizeof(nx_index_t));
+	return s->index;
+}
+
+static void nx_inflate_index_free(nx_streamp s)
+{
+	nx_index_t *idx = s->index;
+	int i;
+
+	if (idx == NULL)
+		return;
+	for (i = 0; i < idx->num; i++)
+		free(idx->pt[i].zhist);
+	free(idx->pt);
+	free(idx);
+	s->index = NULL;
+}
+
+/*
+   Records a random access checkpoint every span bytes of output while
+   inflating; span 0 stops recording.  Jobs are cut to span bytes
+   of output so use spans of a few MB.
+*/
+int nx_inflateIndex(z_streamp strm, uint64_t span)
+{
+	nx_streamp s;
+
+	if (strm == Z_NULL || NULL == (s = (nx_streamp) strm->state))
+		return Z_STREAM_ERROR;
+
+	if (NULL == nx_inflate_index_get(s))
+		return Z_MEM_ERROR;
+	s->index->span = span;
+
+	return Z_OK;
+}
+
+int nx_inflateIndexSave(z_streamp strm, const char *fname)
+{
+	nx_streamp s;
+	nx_index_t *idx;
+	nx_index_hdr_t hdr;
+	nx_index_rec_t rec;
+	nx_index_point_t *pt;
+	FILE *fp;
+	uint32_t cksum;
+	int i, rc = Z_OK;
+
+	if (strm == Z_NULL || NULL == (s = (nx_streamp) strm->state) ||
+	    NULL == (idx = s->index) || fname == NULL)
+		return Z_STREAM_ERROR;
+
+	if (NULL == (fp = fopen(fname, "w"))) {
+		prt_err("cannot open index file %s\n", fname);
+		return Z_ERRNO;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, NX_INDEX_MAGIC, sizeof(hdr.magic));
+	hdr.version = htobe32(NX_INDEX_VERSION);
+	hdr.num = htobe32(idx->num);
+	hdr.span = htobe64(idx->span);
+	hdr.cksum = htobe32(nx_crc32(INIT_CRC, (unsigned char *)&hdr, sizeof(hdr)));
+	if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1)
+		rc = Z_ERRNO;
+
+	for (i = 0; i < idx->num && rc == Z_OK; i++) {
+		pt = &idx->pt[i];
+		rec.in = htobe64(pt->in);
+		rec.out = htobe64(pt->out);
+		rec.crc32 = htobe32(pt->crc32);
+		rec.adler32 = htobe32(pt->adler32);
+		rec.sfbt = htobe32(pt->sfbt);
+		rec.subc = htobe32(pt->subc);
+		rec.rembytecnt = htobe32(pt->rembytecnt);
+		rec.dhtlen = htobe32(pt->dhtlen);
+		rec.hist_len = htobe32(pt->hist_len);
+		rec.zhist_len = htobe32(pt->zhist_len);
+		rec.cksum = rec.reserved = 0;
+		cksum = nx_crc32(INIT_CRC, (unsigned char *)&rec, sizeof(rec));
+		cksum = nx_crc32(cksum, (unsigned char *)pt->dht, (pt->dhtlen + 7) / 8);
+		rec.cksum = htobe32(nx_crc32(cksum, (unsigned char *)pt->zhist, pt->zhist_len));
+		if (fwrite(&rec, sizeof(rec), 1, fp) != 1 ||
+		    fwrite(pt->dht, 1, (pt->dhtlen + 7) / 8, fp) != (pt->dhtlen + 7) / 8 ||
+		    fwrite(pt->zhist, 1, pt->zhist_len, fp) != pt->zhist_len)
+			rc = Z_ERRNO;
+	}
+
+	if (fclose(fp) != 0)
+		rc = Z_ERRNO;
+	if (rc != Z_OK)
+		prt_err("cannot write index file %s\n", fname);
+
+	return rc;
+}
+
+/* replaces any index of the stream with the one in fname */
+int nx_inflateIndexLoad(z_streamp strm, const char *fname)
+{
+	nx_streamp s;
+	nx_index_t *idx;
+	nx_index_hdr_t hdr;
+	nx_index_rec_t rec;
+	nx_index_point_t *pt;
+	FILE *fp;
+	uint32_t i, num, cksum;
+
+	if (strm == Z_NULL || NULL == (s = (nx_streamp) strm->state) || fname == NULL)
+		return Z_STREAM_ERROR;
+
+	if (NULL == (fp = fopen(fname, "r"))) {
+		prt_err("cannot open index file %s\n", fname);
+		return Z_ERRNO;
+	}
+
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	    memcmp(hdr.magic, NX_INDEX_MAGIC, sizeof(hdr.magic)) != 0 ||
+	    be32toh(hdr.version) != NX_INDEX_VERSION)
+		goto err;
+	cksum = be32toh(hdr.cksum);
+	hdr.cksum = 0;
+	if (cksum != nx_crc32(INIT_CRC, (unsigned char *)&hdr, sizeof(hdr)))
+		goto err;
+
+	nx_inflate_index_free(s);
+	if (NULL == (idx = nx_inflate_index_get(s)))
+		goto err;
+
+	num = be32toh(hdr.num);
+	idx->span = 0; /* loaded only; nx_inflateIndex() to record more */
+	if (num > 0 && NULL == (idx->pt = calloc(num, sizeof(nx_index_point_t))))
+		goto err;
+	idx->alloc = num;
+
+	for (i = 0; i < num; i++) {
+		pt = &idx->pt[i];
+		if (fread(&rec, sizeof(rec), 1, fp) != 1)
+			goto err;
+		pt->in = be64toh(rec.in);
+		pt->out = be64toh(rec.out);
+		pt->crc32 = be32toh(rec.crc32);
+		pt->adler32 = be32toh(rec.adler32);
+		pt->sfbt = be32toh(rec.sfbt);
+		pt->subc = be32toh(rec.subc);
+		pt->rembytecnt = be32toh(rec.rembytecnt);
+		pt->dhtlen = be32toh(rec.dhtlen);
+		pt->hist_len = be32toh(rec.hist_len);
+		pt->zhist_len = be32toh(rec.zhist_len);
+		/* the history is at most 32KB compressed by nx_compress2 */
+		if (pt->dhtlen > DHT_MAXSZ * 8 || pt->hist_len > INF_HIS_LEN ||
+		    pt->zhist_len > nx_compressBound(pt->hist_len) ||
+		    (i > 0 && pt->out < idx->pt[i-1].out))
+			goto err;
+		if (NULL == (pt->zhist = malloc(pt->zhist_len)))
+			goto err;
+		idx->num = i + 1;
+		if (fread(pt->dht, 1, (pt->dhtlen + 7) / 8, fp) != (pt->dhtlen + 7) / 8 ||
+		    fread(pt->zhist, 1, pt->zhist_len, fp) != pt->zhist_len)
+			goto err;
+		cksum = be32toh(rec.cksum);
+		rec.cksum = 0;
+		if (cksum != nx_crc32(nx_crc32(nx_crc32(INIT_CRC, (unsigned char *)&rec, sizeof(rec)),
+					       (unsigned char *)pt->dht, (pt->dhtlen + 7) / 8),
+				      (unsigned char *)pt->zhist, pt->zhist_len))
+			goto err;
+	}
+
+	fclose(fp);
+	return Z_OK;
+
+err:
+	prt_err("bad index file %s\n", fname);
+	nx_inflate_index_free(s);
+	fclose(fp);
+	return Z_DATA_ERROR;
+}
+
+/*
+   Positions the stream at the last checkpoint at or before the
+   uncompressed offset.  The caller supplies input from *in_offset of
+   the compressed stream and discards offset - *out_offset bytes of
+   output.  Without a checkpoint before offset the stream is reset to
+   the beginning and both are 0.  Checksums are carried forward so the
+   trailer still verifies.
+*/
+int nx_inflate_seek(z_streamp strm, uint64_t offset, uint64_t *in_offset, uint64_t *out_offset)
+{
+	nx_streamp s;
+	nx_index_t *idx;
+	nx_index_point_t *pt;
+	nx_gzip_crb_cpb_t *cmdp;
+	uLongf hlen;
+	int lo, hi, mid, rc;
+
+	if (strm == Z_NULL || NULL == (s = (nx_streamp) strm->state) ||
+	    NULL == (idx = s->index) || in_offset == NULL || out_offset == NULL)
+		return Z_STREAM_ERROR;
+
+	/* last point with out <= offset */
+	lo = 0;
+	hi = idx->num;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (idx->pt[mid].out <= offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if ((rc = nx_inflateReset(strm)) != Z_OK)
+		return rc;
+
+	*in_offset = *out_offset = 0;
+	if (lo == 0)
+		return Z_OK;
+	pt = &idx->pt[lo - 1];
+
+	if (s->fifo_out == NULL && nx_inflate_alloc_fifo_out(s) != Z_OK)
+		return Z_MEM_ERROR;
+
+	/* history goes right before cur_out */
+	hlen = pt->hist_len;
+	rc = nx_uncompress((Bytef *)s->fifo_out + s->cur_out - pt->hist_len, &hlen,
+			   (Bytef *)pt->zhist, pt->zhist_len);
+	if (rc != Z_OK || hlen != pt->hist_len) {
+		prt_err("checkpoint history at %ld is corrupt\n", (long)pt->out);
+		return Z_DATA_ERROR;
+	}
+	s->history_len = pt->hist_len;
+	s->resuming = 1;
+	s->last_comp_ratio = 1000;
+	s->inf_state = inf_state_inflate;
+
+	s->crc32 = pt->crc32;
+	s->adler32 = pt->adler32;
+	if (s->wrap == HEADER_GZIP)
+		strm->adler = s->adler = s->crc32;
+	else if (s->wrap == HEADER_ZLIB)
+		strm->adler = s->adler = s->adler32;
+
+	/* resume state as in ok_cc3 */
+	cmdp = s->nxcmdp;
+	cmdp->cpb.in_subc = 0;
+	cmdp->cpb.in_sfbt = 0;
+	putnn(cmdp->cpb, in_subc, pt->subc);
+	putnn(cmdp->cpb, in_sfbt, pt->sfbt);
+	if (pt->sfbt >> 1 == 0b100)
+		putnn(cmdp->cpb, in_rembytecnt, pt->rembytecnt);
+	if (pt->sfbt >> 1 == 0b110) {
+		putnn(cmdp->cpb, in_dhtlen, pt->dhtlen);
+		memcpy(cmdp->cpb.in_dht_char, pt->dht, (pt->dhtlen + 7) / 8);
+	}
+
+	strm->total_in = s->total_in = pt->in;
+	strm->total_out = s->total_out = pt->out;
+	*in_offset = pt->in;
+	*out_offset = pt->out;
+
+	prt_info("seek %ld: checkpoint in %ld out %ld\n", (long)offset, (long)pt->in, (long)pt->out);
+	return Z_OK;
+}
+
+/*
+   inflateBack: raw inflate driven by the caller's in() and out()
+   callbacks.  NX writes in to back_out, which is handed to out() as
+   is, so fifo_out is touched only when a job overflows back_out.
+   After out() returns, the tail of the output is kept in the
+   caller's window and the next job reads its history from there.
+*/
+int nx_inflateBackInit_(z_streamp strm, int windowBits, unsigned char *window, const char *version, int stream_size)
+{
+	nx_streamp s;
+	int rc;
+
+	if (strm == Z_NULL || window == Z_NULL || windowBits < 8 || windowBits > 15)
+		return Z_STREAM_ERROR;
+
+	rc = nx_inflateInit2_(strm, -windowBits, version, stream_size);
+	if (rc != Z_OK)
+		return rc;
+
+	s = (nx_streamp) strm->state;
+	s->back_window = window;
+	s->back_wsize = 1 << windowBits;
+	s->back_out_len = INF_BACK_OUT_LEN;
+	if (NULL == (s->back_out = nx_alloc_buffer(s->back_out_len, nx_config.page_sz, 0))) {
+		prt_err("nx_alloc_buffer for inflateBack\n");
+		nx_inflateEnd(strm);
+		return Z_MEM_ERROR;
+	}
+	/* back_out stays intact for the length of an nx_inflate call */
+	s->hist_inplace_ok = 1;
+
+	return Z_OK;
+}
+
+/* back_out is about to be reused; move the history out of it */
+static void nx_inflate_back_history(nx_streamp s)
+{
+	int len;
+
+	if (s->hist_inplace == NULL || s->hist_ext)
+		return;
+
+	if (s->back_wsize < INF_HIS_LEN) {
+		/* NX always resumes with up to 32KB of history */
+		nx_inflate_materialize_history(s);
+		return;
+	}
+
+	/* the job produced at least the history length; see
+	   the no overflow case of nx_inflate_ */
+	len = NX_MIN(s->hist_inplace_len, s->back_wsize);
+	memcpy(s->back_window + s->back_wsize - len, s->hist_inplace - len, len);
+	s->hist_memcpy += len;
+	s->hist_inplace = (char *) s->back_window + s->back_wsize;
+	s->hist_inplace_len = len;
+	s->hist_ext = 1;
+}
+
+int nx_inflateBack(z_streamp strm, in_func in, void *in_desc, out_func out, void *out_desc)
+{
+	nx_streamp s;
+	unsigned int have;
+	int rc, full = 0;
+
+	if (strm == Z_NULL || in == NULL || out == NULL) return Z_STREAM_ERROR;
+	s = (nx_streamp) strm->state;
+	if (s == NULL || s->back_out == NULL) return Z_STREAM_ERROR;
+
+	/* statistic */
+	zlib_stats_inc(inflateBack);
+
+	/* each call inflates a whole raw stream, as in zlib */
+	nx_inflateReset(strm);
+	if (strm->next_in == Z_NULL)
+		strm->avail_in = 0;
+
+	for (;;) {
+		/* pending output is drained before asking for input */
+		if (strm->avail_in == 0 && !full) {
+			strm->avail_in = in(in_desc, &strm->next_in);
+			if (strm->avail_in == 0) {
+				strm->next_in = Z_NULL;
+				return Z_BUF_ERROR;
+			}
+		}
+
+		strm->next_out = (unsigned char *) s->back_out;
+		strm->avail_out = s->back_out_len;
+		rc = nx_inflate(strm, Z_NO_FLUSH);
+
+		have = s->back_out_len - strm->avail_out;
+		full = (strm->avail_out == 0);
+		if (have > 0 && out(out_desc, (unsigned char *) s->back_out, have))
+			return Z_BUF_ERROR;
+		nx_inflate_back_history(s);
+
+		if (rc != Z_OK)
+			return rc;
+	}
+}
+
+int nx_inflateBackEnd(z_streamp strm)
+{
+	return nx_inflateEnd(strm);
+}
+
 #ifdef ZLIB_API
 int inflateInit_(z_streamp strm, const char *version, int stream_size)
 {
@@ -1629,4 +2695,24 @@ int inflateSetDictionary(z_streamp strm, const Bytef *dictionary, uInt dictLengt
 {
 	return nx_inflateSetDictionary(strm, dictionary, dictLength);
 }
+int inflateSync(z_streamp strm)
+{
+	return nx_inflateSync(strm);
+}
+int inflateSyncPoint(z_streamp strm)
+{
+	return nx_inflateSyncPoint(strm);
+}
+int inflateBackInit_(z_streamp strm, int windowBits, unsigned char *window, const char *version, int stream_size)
+{
+	return nx_inflateBackInit_(strm, windowBits, window, version, stream_size);
+}
+int inflateBack(z_streamp strm, in_func in, void *in_desc, out_func out, void *out_desc)
+{
+	return nx_inflateBack(strm, in, in_desc, out, out_desc);
+}
+int inflateBackEnd(z_streamp strm)
+{
+	return nx_inflateBackEnd(strm);
+}
 #endif
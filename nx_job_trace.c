@@ -0,0 +1,178 @@
+/*
+ * NX-GZIP compression accelerator user library
+ * implementing zlib compression library interfaces
+ *
+ * Copyright (C) IBM Corporation, 2011-2017
+ *
+ * Licenses for GPLv2 and Apache v2.0:
+ *
+ * GPLv2:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * Apache v2.0:
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+/*
+   Binary trace of NX jobs for samples/nx_replay.
+
+   nx_submit_job() calls nx_job_trace() after each job while the trace
+   file is open.  A record is the function code, DDE lengths, history
+   and DHT lengths, cc, spbc and tpbc, the nxu_run_job retry counts and
+   the submit and completion times, 64 bytes.  With payload capture the
+   CPB input and the source bytes follow, so that the job can be
+   submitted again; this costs a copy of every source byte.
+
+   Records go through a large stdio buffer under nx_job_trace_mutex, so
+   jobs on other threads wait for a copy to the buffer, and only one
+   in many for a write().
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <zlib.h>
+#include "nxu.h"
+#include "nx_zlib.h"
+#include "nx_dbg.h"
+
+#define NX_JOB_TRACE_BUFSZ (4UL<<20)
+
+FILE *nx_job_trace_fp;
+static int nx_job_trace_payload;
+static pthread_mutex_t nx_job_trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* a forked child leaves the parent's trace alone */
+static void nx_job_trace_atfork_child(void)
+{
+	pthread_mutex_init(&nx_job_trace_mutex, NULL);
+	nx_job_trace_fp = NULL;
+}
+
+void nx_job_trace_open(const char *path, int payload)
+{
+	struct nx_job_trace_hdr hdr;
+	char name[4096];
+	FILE *fp;
+
+	snprintf(name, sizeof(name), "%s.%d", path, (int)getpid());
+	if (NULL == (fp = fopen(name, "w"))) {
+		prt_err("cannot create NX_GZIP_JOB_TRACE %s\n", name);
+		return;
+	}
+	setvbuf(fp, NULL, _IOFBF, NX_JOB_TRACE_BUFSZ);
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = NX_JOB_TRACE_MAGIC;
+	hdr.version = NX_JOB_TRACE_VERSION;
+	hdr.tb_freq = nx_clock_freq();
+	hdr.pid = getpid();
+	hdr.flags = payload ? NX_JOB_TRACE_PAYLOAD : 0;
+	fwrite(&hdr, sizeof(hdr), 1, fp);
+
+	nx_job_trace_payload = payload;
+	pthread_atfork(NULL, NULL, nx_job_trace_atfork_child);
+	nx_job_trace_fp = fp;
+	prt_info("NX job trace in %s%s\n", name, payload ? " with payload" : "");
+}
+
+void nx_job_trace_close(void)
+{
+	pthread_mutex_lock(&nx_job_trace_mutex);
+	if (nx_job_trace_fp != NULL)
+		fclose(nx_job_trace_fp);
+	nx_job_trace_fp = NULL;
+	pthread_mutex_unlock(&nx_job_trace_mutex);
+}
+
+/* writes the bytes of the DDE list */
+static void nx_job_trace_dde(FILE *fp, nx_dde_t *ddep)
+{
+	uint32_t n = getpnn(ddep, dde_count), i;
+	nx_dde_t *ddl;
+
+	if (n == 0) {
+		fwrite((void *)getp64(ddep, ddead), 1, getp32(ddep, ddebc), fp);
+		return;
+	}
+	ddl = (nx_dde_t *)getp64(ddep, ddead);
+	for (i = 0; i < n && i < MAX_DDE_COUNT; i++)
+		fwrite((void *)get64(ddl[i], ddead), 1, get32(ddl[i], ddebc), fp);
+}
+
+void nx_job_trace(nx_gzip_crb_cpb_t *cmdp, int cc, uint64_t t_submit, uint64_t t_done)
+{
+	struct nx_job_trace_rec r;
+	int fc = getnn(cmdp->crb, gzip_fc);
+
+	memset(&r, 0, sizeof(r));
+	r.fc = fc;
+	r.cc = cc;
+	r.src_len = getp32(&cmdp->crb.source_dde, ddebc);
+	r.dst_len = getp32(&cmdp->crb.target_dde, ddebc);
+	if (fc_is_compress(fc)) {
+		if (fc & 0x8)		/* resume */
+			r.hist_len = getnn(cmdp->cpb, in_histlen) * sizeof(nx_qw_t);
+		if (fc & 0x2)		/* DHT */
+			r.dht_len = getnn(cmdp->cpb, in_dhtlen);
+		r.spbc = fc_has_count(fc) ? get32(cmdp->cpb, out_spbc_comp_with_count) :
+			get32(cmdp->cpb, out_spbc_comp);
+	}
+	else if (fc == GZIP_FC_WRAP) {
+		r.spbc = get32(cmdp->cpb, out_spbc_wrap);
+	}
+	else {
+		if (fc & 0x4)		/* resume */
+			r.hist_len = getnn(cmdp->cpb, in_histlen) * sizeof(nx_qw_t);
+		r.spbc = get32(cmdp->cpb, out_spbc_decomp);
+	}
+	if (cc == ERR_NX_OK || cc == ERR_NX_TPBC_GT_SPBC || cc == ERR_NX_TARGET_SPACE)
+		r.tpbc = get32(cmdp->crb.csb, tpbc);
+	r.paste_busy = nxu_run_stats.paste_busy;
+	r.csb_polls = nxu_run_stats.csb_polls;
+	r.faults = nxu_run_stats.faults;
+	r.tid = syscall(SYS_gettid);
+	r.t_submit = t_submit;
+	r.t_done = t_done;
+	r.len = sizeof(r);
+	if (nx_job_trace_payload) {
+		r.flags = NX_JOB_TRACE_PAYLOAD;
+		r.len += NX_JOB_TRACE_CPB_IN + r.src_len;
+	}
+
+	pthread_mutex_lock(&nx_job_trace_mutex);
+	if (nx_job_trace_fp != NULL) {
+		fwrite(&r, sizeof(r), 1, nx_job_trace_fp);
+		if (nx_job_trace_payload) {
+			fwrite(&cmdp->cpb, NX_JOB_TRACE_CPB_IN, 1, nx_job_trace_fp);
+			nx_job_trace_dde(nx_job_trace_fp, &cmdp->crb.source_dde);
+		}
+	}
+	pthread_mutex_unlock(&nx_job_trace_mutex);
+}
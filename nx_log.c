@@ -0,0 +1,335 @@
+/*
+ * NX-GZIP compression accelerator user library
+ * implementing zlib compression library interfaces
+ *
+ * Copyright (C) IBM Corporation, 2011-2017
+ *
+ * Licenses for GPLv2 and Apache v2.0:
+ *
+ * GPLv2:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * Apache v2.0:
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+/*
+   Asynchronous log.
+
+   With nx_log_async set (NX_GZIP_LOG_ASYNC=1), prt() and the trace macros do not take
+   mutex_log, flock() the log or flush it.  Each thread formats its
+   message in to the next record of its own ring, stamped with
+   CLOCK_REALTIME, and moves its head on; only that thread writes head
+   and only the drain thread writes tail, so neither takes a lock.  A
+   full ring drops the message and counts it.
+
+   The drain thread, started with the first ring, wakes every
+   NX_LOG_DRAIN_MS, merges the rings in time order and writes the
+   records in the text format of the synchronous log under one flock()
+   and fflush().  nx_hw_done() drains what is left at exit; a crash
+   loses the last few milliseconds.
+
+   The arguments are formatted when logged rather than when drained:
+   a %s may point at a buffer that is gone by then.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include "nx_dbg.h"
+
+#define NX_LOG_RECS      1024	/* per thread, a power of 2 */
+#define NX_LOG_MSG       240
+#define NX_LOG_DRAIN_MS  10
+
+struct nx_log_rec {
+	uint64_t ns;		/* CLOCK_REALTIME */
+	int32_t pid;
+	uint16_t kind;
+	uint16_t len;
+	char msg[NX_LOG_MSG];
+};
+
+struct nx_log_ring {
+	uint64_t head;		/* the thread's */
+	char pad1[120];
+	uint64_t tail;		/* the drain thread's */
+	uint64_t dropped;
+	uint64_t dropped_shown;
+	int32_t pid;
+	int dead;		/* the thread exited */
+	struct nx_log_ring *next;
+	char pad2[80];
+	struct nx_log_rec rec[NX_LOG_RECS];
+};
+
+int nx_log_async;
+static __thread struct nx_log_ring *nx_log_tls;
+static struct nx_log_ring *nx_log_rings;	/* under nx_log_mutex */
+static pthread_mutex_t nx_log_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t nx_log_key;
+static pthread_once_t nx_log_once = PTHREAD_ONCE_INIT;
+static int nx_log_started;
+static int nx_log_stopped;		/* at exit, the log may be closed */
+
+static void nx_log_drain_locked(void);
+
+static void nx_log_ring_exit(void *p)
+{
+	struct nx_log_ring *r = p;
+
+	/* the drain thread frees it once empty */
+	__atomic_store_n(&r->dead, 1, __ATOMIC_RELEASE);
+	nx_log_tls = NULL;
+}
+
+/* a forked child has no drain thread and its rings are copies */
+static void nx_log_atfork_child(void)
+{
+	pthread_mutex_init(&nx_log_mutex, NULL);
+	nx_log_rings = NULL;
+	nx_log_started = 0;
+	nx_log_tls = NULL;
+}
+
+/* once a process; a forked child inherits the key and the handler */
+static void nx_log_init(void)
+{
+	pthread_key_create(&nx_log_key, nx_log_ring_exit);
+	pthread_atfork(NULL, NULL, nx_log_atfork_child);
+}
+
+static void *nx_log_drain_thread(void *arg)
+{
+	struct timespec ts = { 0, NX_LOG_DRAIN_MS * 1000000L };
+
+	(void)arg;
+	for (;;) {
+		nanosleep(&ts, NULL);
+		pthread_mutex_lock(&nx_log_mutex);
+		if (!nx_log_stopped)
+			nx_log_drain_locked();
+		pthread_mutex_unlock(&nx_log_mutex);
+	}
+	return NULL;
+}
+
+static struct nx_log_ring *nx_log_ring_new(void)
+{
+	struct nx_log_ring *r;
+	pthread_attr_t attr;
+	pthread_t t;
+
+	if (posix_memalign((void **)&r, 128, sizeof(*r)) != 0)
+		return NULL;
+	memset(r, 0, offsetof(struct nx_log_ring, rec));
+	r->pid = getpid();
+
+	pthread_once(&nx_log_once, nx_log_init);
+	pthread_mutex_lock(&nx_log_mutex);
+	if (!nx_log_started) {
+		pthread_attr_init(&attr);
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+		if (pthread_create(&t, &attr, nx_log_drain_thread, NULL) != 0) {
+			pthread_attr_destroy(&attr);
+			pthread_mutex_unlock(&nx_log_mutex);
+			free(r);
+			return NULL;
+		}
+		pthread_attr_destroy(&attr);
+		nx_log_started = 1;
+	}
+	r->next = nx_log_rings;
+	nx_log_rings = r;
+	pthread_mutex_unlock(&nx_log_mutex);
+
+	pthread_setspecific(nx_log_key, r);
+	nx_log_tls = r;
+	return r;
+}
+
+/* the text of the synchronous log; returns 0 if there is no log yet */
+static int nx_log_write(int kind, int pid, uint64_t ns, const char *msg, int len)
+{
+	time_t t;
+	struct tm m;
+
+	if (nx_gzip_log == NULL)
+		return 0;
+	if (kind != NX_LOG_RAW) {
+		t = ns / 1000000000;
+		localtime_r(&t, &m);
+		fprintf(nx_gzip_log, "[%04d/%02d/%02d %02d:%02d:%02d] ",
+			(int)m.tm_year + 1900, (int)m.tm_mon+1, (int)m.tm_mday,
+			(int)m.tm_hour, (int)m.tm_min, (int)m.tm_sec);
+	}
+	if (kind == NX_LOG_PID)
+		fprintf(nx_gzip_log, "pid %d: ", pid);
+	fwrite(msg, 1, len, nx_gzip_log);
+	return 1;
+}
+
+void nx_log(int kind, const char *fmt, ...)
+{
+	struct nx_log_ring *r = nx_log_tls;
+	struct nx_log_rec *rec;
+	struct timespec ts;
+	uint64_t head;
+	va_list ap;
+	int len;
+
+	if (r == NULL && NULL == (r = nx_log_ring_new())) {
+		char msg[NX_LOG_MSG];
+
+		/* no ring; the synchronous way */
+		va_start(ap, fmt);
+		len = vsnprintf(msg, sizeof(msg), fmt, ap);
+		va_end(ap);
+		clock_gettime(CLOCK_REALTIME, &ts);
+		pthread_mutex_lock(&mutex_log);
+		if (nx_gzip_log != NULL) {
+			flock(fileno(nx_gzip_log), LOCK_EX);
+			nx_log_write(kind, getpid(), ts.tv_sec * 1000000000ULL + ts.tv_nsec,
+				     msg, (len < NX_LOG_MSG) ? len : NX_LOG_MSG - 1);
+			fflush(nx_gzip_log);
+			flock(fileno(nx_gzip_log), LOCK_UN);
+		}
+		pthread_mutex_unlock(&mutex_log);
+		return;
+	}
+
+	head = r->head;
+	if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= NX_LOG_RECS) {
+		__atomic_store_n(&r->dropped, r->dropped + 1, __ATOMIC_RELAXED);
+		return;
+	}
+	rec = &r->rec[head & (NX_LOG_RECS - 1)];
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	rec->ns = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	rec->pid = r->pid;
+	rec->kind = kind;
+	va_start(ap, fmt);
+	len = vsnprintf(rec->msg, NX_LOG_MSG, fmt, ap);
+	va_end(ap);
+	if (len >= NX_LOG_MSG) {
+		/* cut, keeping the line end */
+		len = NX_LOG_MSG - 1;
+		memcpy(&rec->msg[len - 4], "...\n", 4);
+	}
+	rec->len = (len > 0) ? len : 0;
+
+	__atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/* writes out all the rings hold now, oldest first; under nx_log_mutex */
+static void nx_log_drain_locked(void)
+{
+	struct nx_log_ring *r, *oldest, **pp;
+	struct nx_log_rec *rec;
+	int locked = 0;
+
+	if (nx_gzip_log == NULL)
+		return;
+
+	for (;;) {
+		oldest = NULL;
+		for (r = nx_log_rings; r != NULL; r = r->next) {
+			if (r->tail == __atomic_load_n(&r->head, __ATOMIC_ACQUIRE))
+				continue;
+			if (oldest == NULL || r->rec[r->tail & (NX_LOG_RECS - 1)].ns <
+			    oldest->rec[oldest->tail & (NX_LOG_RECS - 1)].ns)
+				oldest = r;
+		}
+		if (oldest == NULL)
+			break;
+		if (!locked) {
+			flock(fileno(nx_gzip_log), LOCK_EX);
+			locked = 1;
+		}
+		rec = &oldest->rec[oldest->tail & (NX_LOG_RECS - 1)];
+		nx_log_write(rec->kind, rec->pid, rec->ns, rec->msg, rec->len);
+		__atomic_store_n(&oldest->tail, oldest->tail + 1, __ATOMIC_RELEASE);
+	}
+
+	for (pp = &nx_log_rings; (r = *pp) != NULL; ) {
+		uint64_t dropped = __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+
+		if (dropped != r->dropped_shown) {
+			char msg[64];
+			struct timespec ts;
+			int len;
+
+			if (!locked) {
+				flock(fileno(nx_gzip_log), LOCK_EX);
+				locked = 1;
+			}
+			len = snprintf(msg, sizeof(msg), "Info: log ring full, %ld messages dropped\n",
+				       (long)(dropped - r->dropped_shown));
+			clock_gettime(CLOCK_REALTIME, &ts);
+			nx_log_write(NX_LOG_PID, r->pid, ts.tv_sec * 1000000000ULL + ts.tv_nsec, msg, len);
+			r->dropped_shown = dropped;
+		}
+		/* a thread that exited logs no more */
+		if (__atomic_load_n(&r->dead, __ATOMIC_ACQUIRE) &&
+		    r->tail == __atomic_load_n(&r->head, __ATOMIC_ACQUIRE)) {
+			*pp = r->next;
+			free(r);
+			continue;
+		}
+		pp = &r->next;
+	}
+
+	if (locked) {
+		fflush(nx_gzip_log);
+		flock(fileno(nx_gzip_log), LOCK_UN);
+	}
+}
+
+void nx_log_drain(void)
+{
+	pthread_mutex_lock(&nx_log_mutex);
+	if (!nx_log_stopped)
+		nx_log_drain_locked();
+	pthread_mutex_unlock(&nx_log_mutex);
+}
+
+/* at exit: writes out the rings and logs synchronously from now on */
+void nx_log_stop(void)
+{
+	pthread_mutex_lock(&nx_log_mutex);
+	if (!nx_log_stopped)
+		nx_log_drain_locked();
+	nx_log_async = 0;
+	nx_log_stopped = 1;
+	pthread_mutex_unlock(&nx_log_mutex);
+}
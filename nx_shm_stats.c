@@ -0,0 +1,179 @@
+/*
+ * NX-GZIP compression accelerator user library
+ * implementing zlib compression library interfaces
+ *
+ * Copyright (C) IBM Corporation, 2011-2017
+ *
+ * Licenses for GPLv2 and Apache v2.0:
+ *
+ * GPLv2:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * Apache v2.0:
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+/*
+   Live statistics for samples/nxstat.
+
+   With NX_GZIP_SHM_STATS=1 the first nx_open() of a process creates
+   the shared memory object /nxstat.<pid> holding a struct
+   nx_shm_stats.  A reader bumps readers while attached, then bumps
+   request and waits; the next nx_submit_job() sees request changed
+   and copies a nx_get_stats() snapshot in to the segment under a
+   sequence lock: seq is odd while st is written, so a reader retries
+   a copy when seq was odd or changed meanwhile.  With no reader a job
+   costs one load of request.
+
+   The object is created exclusively and never through a symlink; one
+   left by an earlier process of the same pid is removed first.
+   Counting is on only while readers is non zero, so the last reader
+   leaving bumps request once more to turn it off again.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <zlib.h>
+#include "nxu.h"
+#include "nx_zlib.h"
+#include "nx_dbg.h"
+
+struct nx_shm_stats *nx_shm_stats;
+uint64_t nx_shm_stats_seen;		/* request last served */
+static size_t nx_shm_stats_len;
+static pthread_mutex_t nx_shm_stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* the segment is the parent's */
+static void nx_shm_stats_atfork_child(void)
+{
+	if (nx_shm_stats != NULL)
+		munmap(nx_shm_stats, nx_shm_stats_len);
+	nx_shm_stats = NULL;
+	nx_gzip_stats_live = 0;
+	pthread_mutex_init(&nx_shm_stats_mutex, NULL);
+}
+
+void nx_shm_stats_open(void)
+{
+	static int atfork_done;
+	struct nx_shm_stats *sh;
+	char name[64];
+	size_t len;
+	int fd;
+
+	if (!nx_config.shm_stats || nx_shm_stats != NULL)
+		return;
+
+	len = (sizeof(*sh) + nx_config.page_sz - 1) & ~(nx_config.page_sz - 1);
+	snprintf(name, sizeof(name), NX_SHM_STATS_NAME, (int)getpid());
+	fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+	if (fd < 0 && errno == EEXIST) {
+		/* stale, from an exited process with our pid */
+		shm_unlink(name);
+		fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+	}
+	if (fd < 0) {
+		prt_info("nx_shm_stats: cannot create %s, errno %d\n", name, errno);
+		return;
+	}
+	if (ftruncate(fd, len) != 0) {
+		prt_info("nx_shm_stats: cannot size %s, errno %d\n", name, errno);
+		close(fd);
+		shm_unlink(name);
+		return;
+	}
+	sh = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (sh == MAP_FAILED) {
+		prt_info("nx_shm_stats: cannot map %s, errno %d\n", name, errno);
+		shm_unlink(name);
+		return;
+	}
+
+	sh->version = NX_SHM_STATS_VERSION;
+	sh->stats_size = sizeof(struct zlib_stats);
+	sh->pid = getpid();
+	sh->tb_freq = nx_clock_freq();
+	/* readers check magic last written */
+	__atomic_store_n(&sh->magic, NX_SHM_STATS_MAGIC, __ATOMIC_RELEASE);
+
+	if (!atfork_done) {
+		pthread_atfork(NULL, NULL, nx_shm_stats_atfork_child);
+		atfork_done = 1;
+	}
+	nx_shm_stats_len = len;
+	__atomic_store_n(&nx_shm_stats, sh, __ATOMIC_RELEASE);
+}
+
+void nx_shm_stats_close(void)
+{
+	struct nx_shm_stats *sh = nx_shm_stats;
+	char name[64];
+
+	if (sh == NULL)
+		return;
+	nx_shm_stats = NULL;
+	nx_gzip_stats_live = 0;
+	if (sh->pid == getpid()) {
+		snprintf(name, sizeof(name), NX_SHM_STATS_NAME, (int)getpid());
+		shm_unlink(name);
+	}
+	munmap(sh, nx_shm_stats_len);
+}
+
+/* a reader asked; one thread copies, the others go on */
+void nx_shm_stats_publish(void)
+{
+	struct nx_shm_stats *sh = nx_shm_stats;
+	uint64_t req, seq;
+
+	if (sh == NULL || pthread_mutex_trylock(&nx_shm_stats_mutex) != 0)
+		return;
+
+	req = __atomic_load_n(&sh->request, __ATOMIC_RELAXED);
+	if (req != nx_shm_stats_seen) {
+		/* count while someone reads; nxstat shows differences */
+		__atomic_store_n(&nx_gzip_stats_live,
+				 __atomic_load_n(&sh->readers, __ATOMIC_RELAXED) != 0,
+				 __ATOMIC_RELAXED);
+
+		seq = sh->seq;
+		__atomic_store_n(&sh->seq, seq + 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		nx_get_stats(&sh->st);
+		sh->time = get_nxtime_now();
+		__atomic_store_n(&sh->seq, seq + 2, __ATOMIC_RELEASE);
+
+		__atomic_store_n(&nx_shm_stats_seen, req, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&nx_shm_stats_mutex);
+}
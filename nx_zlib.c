@@ -72,15 +72,31 @@ int nx_gzip_accelerator = NX_GZIP_TYPE;
 int nx_gzip_chip_num = -1;
 
 int nx_gzip_trace = 0x4;		/* enable minimal sw trace */
+int nx_gzip_stats_live = 0;		/* counting for nxstat only */
 FILE *nx_gzip_log = NULL;		/* default is stderr, unless overwritten */
 int nx_strategy_override = 1;           /* 0 is fixed huffman, 1 is dynamic huffman */
 
-pthread_mutex_t zlib_stats_mutex; /* mutex to protect global stats */
+pthread_mutex_t zlib_stats_mutex = PTHREAD_MUTEX_INITIALIZER; /* the list of stats shards */
 pthread_mutex_t nx_devices_mutex; /* mutex to protect global stats */
-struct zlib_stats zlib_stats;	/* global statistics */
+
+/* per thread statistics; see zlib_stats_add */
+struct zlib_stats_shard {
+	struct zlib_stats st;
+	struct zlib_stats_shard *next;
+};
+static struct zlib_stats_shard *zlib_stats_shards;	/* under zlib_stats_mutex */
+static struct zlib_stats zlib_stats_retired;		/* of threads that exited */
+static pthread_key_t zlib_stats_key;
+static pthread_once_t zlib_stats_once = PTHREAD_ONCE_INIT;
+__thread struct zlib_stats *zlib_stats_tls;
+
+_Static_assert(sizeof(struct zlib_stats) % sizeof(uint64_t) == 0,
+	       "zlib_stats must be all 64 bit counters");
 
 struct sigaction act;
 void sigsegv_handler(int sig, siginfo_t *info, void *ctx);
+static void nx_copy_calibrate_start(nx_devp_t nxdevp);
+static void nx_copy_calibrate_stop(void);
 /* **************************************************************** */
 
 static int nx_wait_exclusive(int *excp)
@@ -444,6 +460,24 @@ void nx_print_dde(nx_dde_t *ddep, const char *msg)
 	return;
 }
 
+/* latency t of a job of function code fc on handle that ended with cc;
+   the caller checked nx_gzip_gather_statistics() */
+static void nx_job_stats(int fc, nx_devp_t nxdevp, int cc, uint64_t t)
+{
+	unsigned int slot = nx_lat_slot(t);
+	long engine = nxdevp - nx_devices;
+
+	engine = (engine >= 0 && engine < NX_ENGINE_SLOTS) ? engine : NX_ENGINE_SLOTS - 1;
+	cc = (cc >= 0 && cc < NX_CC_SLOTS - 1) ? cc : NX_CC_SLOTS - 1;
+
+	zlib_stats_count(job_lat_fc[(fc >> 1) & (NX_FC_SLOTS - 1)][slot], 1);
+	zlib_stats_count(job_lat_engine[engine][slot], 1);
+	zlib_stats_count(job_cc[cc], 1);
+	zlib_stats_count(job_paste_busy, nxu_run_stats.paste_busy);
+	zlib_stats_count(job_csb_polls, nxu_run_stats.csb_polls);
+	zlib_stats_count(job_faults, nxu_run_stats.faults);
+}
+
 /*
    Src and dst buffers are supplied in scatter gather lists.
    NX function code and other parameters supplied in cmdp
@@ -451,7 +485,10 @@ void nx_print_dde(nx_dde_t *ddep, const char *msg)
 int nx_submit_job(nx_dde_t *src, nx_dde_t *dst, nx_gzip_crb_cpb_t *cmdp, void *handle)
 {
 	int cc;
-	uint64_t csbaddr;
+	uint64_t csbaddr, t, t_done;
+	/* once, so that a job counted in job_submit is counted in job_cc
+	   even if nxstat attaches or leaves meanwhile */
+	int stats = nx_gzip_gather_statistics();
 
 	memset( (void *)&cmdp->crb.csb, 0, sizeof(cmdp->crb.csb) );
 
@@ -472,11 +509,21 @@ int nx_submit_job(nx_dde_t *src, nx_dde_t *dst, nx_gzip_crb_cpb_t *cmdp, void *h
 		nx_print_dde(dst, "target");
 	}
 
+	if (stats)
+		zlib_stats_count(job_submit, 1);
+	t = get_nxtime_now();
 	cc = nxu_run_job(cmdp, ((nx_devp_t)handle)->vas_handle);
+	t_done = get_nxtime_now();
 
 	if( !cc )
 		cc = getnn( cmdp->crb.csb, csb_cc );	/* CC Table 6-8 */
 
+	if (stats)
+		nx_job_stats(getnn(cmdp->crb, gzip_fc), handle, cc, get_nxtime_diff(t, t_done));
+	if (nx_job_trace_fp != NULL)
+		nx_job_trace(cmdp, cc, t, t_done);
+	nx_shm_stats_poll();
+
 	return cc;
 }
 
@@ -500,6 +547,9 @@ nx_devp_t nx_open(int nx_id)
 		nx_devp = &nx_devices[ nx_dev_count ];
 		nx_devp->vas_handle = vas_handle;
 		++ nx_dev_count;
+		nx_shm_stats_open();
+		if (__atomic_load_n(&nx_config.copy_crossover, __ATOMIC_ACQUIRE) == 0)
+			nx_copy_calibrate_start(nx_devp);
 		sw_trace("%s, pid: %d\n", __FUNCTION__, (int)getpid());
 	}
 	else {
@@ -636,12 +686,109 @@ void nx_lib_debug(int onoff)
 	nx_dbg = onoff;
 }
 
-static void print_stats(void)
+/* adds the counters of from, which its thread may be updating, to to */
+static void zlib_stats_sum(struct zlib_stats *to, struct zlib_stats *from)
 {
+	uint64_t *t = (uint64_t *)to, *f = (uint64_t *)from;
 	unsigned int i;
-	struct zlib_stats *s = &zlib_stats;
+
+	for (i = 0; i < sizeof(*to) / sizeof(uint64_t); i++)
+		t[i] += __atomic_load_n(&f[i], __ATOMIC_RELAXED);
+}
+
+/* a thread exits; its counts move to zlib_stats_retired */
+static void zlib_stats_shard_exit(void *p)
+{
+	struct zlib_stats_shard *sh = p, **pp;
+
+	pthread_mutex_lock(&zlib_stats_mutex);
+	zlib_stats_sum(&zlib_stats_retired, &sh->st);
+	for (pp = &zlib_stats_shards; *pp != NULL; pp = &(*pp)->next) {
+		if (*pp == sh) {
+			*pp = sh->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&zlib_stats_mutex);
+	zlib_stats_tls = NULL;
+	free(sh);
+}
+
+static void zlib_stats_key_init(void)
+{
+	pthread_key_create(&zlib_stats_key, zlib_stats_shard_exit);
+}
+
+/* the first count of a thread; returns NULL if out of memory */
+struct zlib_stats *zlib_stats_shard_new(void)
+{
+	struct zlib_stats_shard *sh;
+	size_t len = (sizeof(*sh) + 127) & ~127UL;	/* whole cache lines */
+
+	pthread_once(&zlib_stats_once, zlib_stats_key_init);
+	if (posix_memalign((void **)&sh, 128, len) != 0)
+		return NULL;
+	memset(sh, 0, len);
 
 	pthread_mutex_lock(&zlib_stats_mutex);
+	sh->next = zlib_stats_shards;
+	zlib_stats_shards = sh;
+	pthread_mutex_unlock(&zlib_stats_mutex);
+
+	pthread_setspecific(zlib_stats_key, sh);
+	zlib_stats_tls = &sh->st;
+	return zlib_stats_tls;
+}
+
+/*
+   Copies the statistics of all threads so far to st.  Counting goes
+   on meanwhile, so counters taken together may be a few calls apart,
+   but each is exact as of some moment during the call.
+*/
+int nx_get_stats(struct zlib_stats *st)
+{
+	struct zlib_stats_shard *sh;
+
+	if (st == NULL)
+		return Z_STREAM_ERROR;
+
+	pthread_mutex_lock(&zlib_stats_mutex);
+	memcpy(st, &zlib_stats_retired, sizeof(*st));
+	for (sh = zlib_stats_shards; sh != NULL; sh = sh->next)
+		zlib_stats_sum(st, &sh->st);
+	pthread_mutex_unlock(&zlib_stats_mutex);
+	return Z_OK;
+}
+
+#ifndef __KERNEL__
+/* what is a format for id */
+static void print_lat(const char *what, int id, const uint64_t *hist)
+{
+	char name[32];
+	uint64_t n = 0;
+	int i;
+
+	for (i = 0; i < NX_LAT_SLOTS; i++)
+		n += hist[i];
+	if (n == 0)
+		return;
+	snprintf(name, sizeof(name), what, id);
+	prt_stat("NX %s jobs: %ld latency p50 %1.1f p99 %1.1f p999 %1.1f us\n",
+		 name, (long)n, nx_lat_percentile(hist, 0.5),
+		 nx_lat_percentile(hist, 0.99), nx_lat_percentile(hist, 0.999));
+}
+#endif
+
+static void print_stats(void)
+{
+	unsigned int i;
+	uint64_t resident, peak;
+	struct zlib_stats *s;
+
+	if (NULL == (s = malloc(sizeof(*s))))
+		return;
+	nx_get_stats(s);
+
 	prt_stat("API call statistic:\n");
 	prt_stat("deflateInit: %ld\n", s->deflateInit);
 	prt_stat("deflate: %ld\n", s->deflate);
@@ -660,6 +807,8 @@ static void print_stats(void)
 			(i + 1) * 4, s->deflate_avail_out[i]);
 	}
 
+	prt_stat("deflate blocks fixed huffman: %ld dynamic huffman: %ld\n",
+		 s->deflate_fht_wins, s->deflate_dht_wins);
 	prt_stat("deflateBound: %ld\n", s->deflateBound);
 	prt_stat("deflateEnd: %ld\n", s->deflateEnd);
 	prt_stat("inflateInit: %ld\n", s->inflateInit);
@@ -680,20 +829,47 @@ static void print_stats(void)
 	}
 
 	prt_stat("inflateEnd: %ld\n", s->inflateEnd);
-
-	prt_stat("deflate data length: %ld KiB\n", s->deflate_len/1024);
+	prt_stat("inflateBack: %ld\n", s->inflateBack);
+	prt_stat("inflate history resumed in place: %ld\n", s->inflate_hist_inplace);
+	nx_inflate_mem_usage(&resident, &peak);
+	prt_stat("inflate buffers resident: %ld KiB peak %ld KiB\n", (long)(resident >> 10), (long)(peak >> 10));
+	prt_stat("inflate fifo_out grown: %ld shrunk: %ld\n", s->inflate_fifo_grow, s->inflate_fifo_shrink);
+	if (s->inflate_out_len > 0)
+		prt_stat("inflate memcpy per MiB out: history %ld fifo_out %ld bytes\n",
+			 (long)(s->inflate_hist_memcpy * (1<<20) / s->inflate_out_len),
+			 (long)(s->inflate_out_memcpy * (1<<20) / s->inflate_out_len));
+
+	prt_stat("deflate data length: %ld KiB out: %ld KiB\n", (long)(s->deflate_len/1024), (long)(s->deflate_out_len/1024));
 #ifndef __KERNEL__
 	prt_stat("deflate time: %1.2f secs\n",nxtime_to_us(s->deflate_time)/1000000);
-	prt_stat("deflate rate: %1.2f MiB/s\n", s->deflate_len/(1024*1024)/(nxtime_to_us(s->deflate_time)/1000000));
+	if (s->deflate_time > 0)
+		prt_stat("deflate rate: %1.2f MiB/s\n", (double)s->deflate_len/(1024*1024)/(nxtime_to_us(s->deflate_time)/1000000));
 #endif
 
 	prt_stat("inflate data length: %ld KiB\n", s->inflate_len/1024);
 #ifndef __KERNEL__
 	prt_stat("inflate time: %1.2f secs\n",nxtime_to_us(s->inflate_time)/1000000);
-	prt_stat("inflate rate: %1.2f MiB/s\n", s->inflate_len/(1024*1024)/(nxtime_to_us(s->inflate_time)/1000000));
+	if (s->inflate_time > 0)
+		prt_stat("inflate rate: %1.2f MiB/s\n", (double)s->inflate_len/(1024*1024)/(nxtime_to_us(s->inflate_time)/1000000));
+	prt_stat("clock: %s %lu Hz\n", nx_clock_name(), (unsigned long)nx_clock_freq());
+
+	for (i = 0; i < NX_FC_SLOTS; i++)
+		print_lat("fc 0x%02x", i << 1, s->job_lat_fc[i]);
+	for (i = 0; i < NX_ENGINE_SLOTS; i++)
+		print_lat((i < NX_ENGINE_SLOTS - 1) ? "engine %d" : "engine %d+", i, s->job_lat_engine[i]);
+	for (i = 0; i < NX_CC_SLOTS; i++) {
+		if (s->job_cc[i] == 0)
+			continue;
+		if (i == NX_CC_SLOTS - 1)
+			prt_stat("NX job submit errors: %ld\n", (long)s->job_cc[i]);
+		else
+			prt_stat("NX cc %d: %ld\n", i, (long)s->job_cc[i]);
+	}
+	prt_stat("NX paste busy: %ld csb polls: %ld faults touched: %ld\n",
+		 (long)s->job_paste_busy, (long)s->job_csb_polls, (long)s->job_faults);
 #endif
 
-	pthread_mutex_unlock(&zlib_stats_mutex);
+	free(s);
 
 	for (int i = 0; i <= NX_MIN(2, nx_gzip_chip_num+1); i++) {
 		prt_stat("nx_devices[%d].open_cnt %d\n", i, nx_devices[i].open_cnt);
@@ -701,16 +877,153 @@ static void print_stats(void)
 	return;
 }
 
+static pthread_mutex_t nx_option_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t nx_option_clamp(uint64_t v, uint64_t lo, uint64_t hi)
+{
+	return NX_MIN(NX_MAX(v, lo), hi);
+}
+
+/* value clamped to the range of option opt */
+uint64_t nx_option_limit(int opt, uint64_t value)
+{
+	switch (opt) {
+	case NX_OPT_PER_JOB_LEN:
+		/* to the suspend limit, as per_job_len defaults */
+		return nx_option_clamp(value, 1<<16, 1<<20);
+	case NX_OPT_COMPRESS_THRESHOLD:
+		/* small input waits in fifo_in, half of which is used */
+		return NX_MIN(value, (uint64_t)nx_config.deflate_fifo_in_len / 2);
+	case NX_OPT_DEF_BUF_SIZE:
+		return nx_option_clamp(value, nx_config.page_sz, 1<<23);
+	case NX_OPT_INF_STREAM_MEM:
+		/* fifo_out never goes under the max expansion of the
+		   smallest inflate job anyway */
+		return nx_option_clamp(value, nx_config.page_sz, 1<<30);
+	case NX_OPT_WAIT_SPIN_NS:
+	case NX_OPT_WAIT_SLEEP_NS:
+		return NX_MIN(value, 1000000000UL);
+	case NX_OPT_DHT_CONFIG:
+		return NX_MIN(value, INT_MAX);
+	case NX_OPT_STRATEGY:
+		return NX_MIN(value, 1);
+	case NX_OPT_COPY_CROSSOVER:
+		return NX_MIN(value, UINT32_MAX);
+	default:
+		return value;
+	}
+}
+
+/*
+   Sets option opt, one of NX_OPT_* in nx_zlib.h, to value for all
+   streams that do not override it.  Returns Z_OK, or Z_STREAM_ERROR
+   for an unknown opt.
+*/
+int nx_set_option(int opt, uint64_t value)
+{
+	uint64_t spin_ns, sleep_ns;
+
+	value = nx_option_limit(opt, value);
+	switch (opt) {
+	case NX_OPT_PER_JOB_LEN:
+		__atomic_store_n(&nx_config.per_job_len, (uint32_t)value, __ATOMIC_RELAXED);
+		break;
+	case NX_OPT_COMPRESS_THRESHOLD:
+		__atomic_store_n(&nx_config.compress_threshold, (uint32_t)value, __ATOMIC_RELAXED);
+		break;
+	case NX_OPT_DEF_BUF_SIZE:
+		/* one writer at a time keeps the two in step */
+		pthread_mutex_lock(&nx_option_mutex);
+		__atomic_store_n(&nx_config.strm_def_bufsz, (uint32_t)value, __ATOMIC_RELAXED);
+		__atomic_store_n(&nx_config.deflate_fifo_out_len, (int)value * 2, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&nx_option_mutex);
+		break;
+	case NX_OPT_INF_STREAM_MEM:
+		__atomic_store_n(&nx_config.inflate_stream_mem, (uint32_t)value, __ATOMIC_RELAXED);
+		break;
+	case NX_OPT_INF_MEM_MAX:
+		__atomic_store_n(&nx_config.inflate_mem_max, value, __ATOMIC_RELAXED);
+		break;
+	case NX_OPT_WAIT_SPIN_NS:
+	case NX_OPT_WAIT_SLEEP_NS:
+		pthread_mutex_lock(&nx_option_mutex);
+		nxu_get_wait(&spin_ns, &sleep_ns);
+		if (opt == NX_OPT_WAIT_SPIN_NS)
+			spin_ns = value;
+		else
+			sleep_ns = value;
+		nxu_set_wait(spin_ns, sleep_ns);
+		pthread_mutex_unlock(&nx_option_mutex);
+		break;
+	case NX_OPT_DHT_CONFIG:
+		__atomic_store_n(&nx_dht_config, (int)value, __ATOMIC_RELAXED);
+		break;
+	case NX_OPT_STRATEGY:
+		__atomic_store_n(&nx_strategy_override, (int)value, __ATOMIC_RELAXED);
+		break;
+	case NX_OPT_COPY_CROSSOVER:
+		__atomic_store_n(&nx_config.copy_crossover, (uint32_t)value, __ATOMIC_RELEASE);
+		break;
+	default:
+		return Z_STREAM_ERROR;
+	}
+	return Z_OK;
+}
+
+/* the value of option opt for streams that do not override it */
+int nx_get_option(int opt, uint64_t *value)
+{
+	uint64_t spin_ns, sleep_ns;
+
+	if (value == NULL)
+		return Z_STREAM_ERROR;
+
+	switch (opt) {
+	case NX_OPT_PER_JOB_LEN:
+		*value = __atomic_load_n(&nx_config.per_job_len, __ATOMIC_RELAXED);
+		break;
+	case NX_OPT_COMPRESS_THRESHOLD:
+		*value = __atomic_load_n(&nx_config.compress_threshold, __ATOMIC_RELAXED);
+		break;
+	case NX_OPT_DEF_BUF_SIZE:
+		*value = __atomic_load_n(&nx_config.strm_def_bufsz, __ATOMIC_RELAXED);
+		break;
+	case NX_OPT_INF_STREAM_MEM:
+		*value = __atomic_load_n(&nx_config.inflate_stream_mem, __ATOMIC_RELAXED);
+		break;
+	case NX_OPT_INF_MEM_MAX:
+		*value = __atomic_load_n(&nx_config.inflate_mem_max, __ATOMIC_RELAXED);
+		break;
+	case NX_OPT_WAIT_SPIN_NS:
+	case NX_OPT_WAIT_SLEEP_NS:
+		nxu_get_wait(&spin_ns, &sleep_ns);
+		*value = (opt == NX_OPT_WAIT_SPIN_NS) ? spin_ns : sleep_ns;
+		break;
+	case NX_OPT_DHT_CONFIG:
+		*value = __atomic_load_n(&nx_dht_config, __ATOMIC_RELAXED);
+		break;
+	case NX_OPT_STRATEGY:
+		*value = __atomic_load_n(&nx_strategy_override, __ATOMIC_RELAXED);
+		break;
+	case NX_OPT_COPY_CROSSOVER:
+		*value = __atomic_load_n(&nx_config.copy_crossover, __ATOMIC_ACQUIRE);
+		break;
+	default:
+		return Z_STREAM_ERROR;
+	}
+	return Z_OK;
+}
+
 /*
  * Execute on library load
  */
 void nx_hw_init(void)
 {
 	int nx_count = 0;
-	int rc = 0;
 
 	/* only init one time for the program */
 	if (nx_init_done == 1) return;
+	nx_clock_init();
 	pthread_mutex_init (&mutex_log, NULL);
 	pthread_mutex_init (&nx_devices_mutex, NULL);
 
@@ -722,6 +1035,20 @@ void nx_hw_init(void)
 	char *logfile    = getenv("NX_GZIP_LOGFILE");
 	char *trace_s    = getenv("NX_GZIP_TRACE");
 	char *dht_config = getenv("NX_GZIP_DHT_CONFIG");  /* default 0 is using literals only, odd is lit and lens */
+	char *dht_file   = getenv("NX_GZIP_DHT_FILE");    /* table set made by samples/dht_train */
+	char *inf_hist_s = getenv("NX_GZIP_INFLATE_HIST_INPLACE"); /* 1 if the output is kept until the next inflate */
+	char *inf_strm_mem = getenv("NX_GZIP_INF_STREAM_MEM"); /* KiB MiB GiB suffix */
+	char *inf_mem_max  = getenv("NX_GZIP_INF_MEM_MAX");    /* KiB MiB GiB suffix */
+	char *cksum_thr_s  = getenv("NX_GZIP_CKSUM_THREADS");  /* nx_checksum_mt threads */
+	char *copy_xover_s = getenv("NX_GZIP_COPY_CROSSOVER"); /* KiB MiB GiB suffix; 0 calibrate */
+	char *shm_stats_s  = getenv("NX_GZIP_SHM_STATS");      /* 1 for the nxstat segment */
+	char *log_async_s  = getenv("NX_GZIP_LOG_ASYNC");      /* 1 to queue messages per thread */
+	char *job_trace_s  = getenv("NX_GZIP_JOB_TRACE");      /* file for the NX job trace */
+	char *job_payload_s = getenv("NX_GZIP_JOB_TRACE_PAYLOAD"); /* 1 to capture the source bytes */
+	char *job_len_s    = getenv("NX_GZIP_PER_JOB_LEN");    /* KiB MiB suffix */
+	char *comp_th_s    = getenv("NX_GZIP_COMPRESS_THRESHOLD"); /* KiB suffix */
+	char *spin_ns_s    = getenv("NX_GZIP_WAIT_SPIN_NS");   /* after a busy paste */
+	char *sleep_ns_s   = getenv("NX_GZIP_WAIT_SLEEP_NS");  /* polling before sleeping */
 	char *strategy_ovrd  = getenv("NX_GZIP_DEFLATE");
 	strategy_ovrd = getenv("NX_GZIP_STRATEGY"); /* Z_FIXED: 0, Z_DEFAULT_STRATEGY: 1 */
 
@@ -737,6 +1064,7 @@ void nx_hw_init(void)
 	nx_config.strm_def_bufsz = (1024 * 1024); /* affect the deflate fifo_out */
 	nx_config.strm_inf_bufsz = (1<<16); /* affect the inflate fifo_in and fifo_out */
 	nx_config.soft_copy_threshold = 1024; /* choose memcpy or hwcopy */
+	nx_config.copy_crossover = 0; /* measured in the background from the first nx_open */
 	nx_config.compress_threshold = (10*1024); /* collect as much input */
 	nx_config.inflate_fifo_in_len = ((1<<16)*2); /* default 128K, half used */
 	nx_config.inflate_fifo_out_len = ((1<<24)*2); /* default 32M, half used */
@@ -745,6 +1073,11 @@ void nx_hw_init(void)
 	nx_config.retry_max = INT_MAX;
 	nx_config.pgfault_retries = INT_MAX;
 	nx_config.verbose = 0;
+	nx_config.inflate_hist_inplace = 0;
+	nx_config.inflate_stream_mem = (1<<23); /* default 8M fifo_out per stream at most */
+	nx_config.inflate_mem_max = 0;
+	nx_config.cksum_threads = NX_MIN(sysconf(_SC_NPROCESSORS_ONLN), 16);
+	nx_config.shm_stats = 0;
 
 	nx_gzip_accelerator = NX_GZIP_TYPE;
 
@@ -754,14 +1087,7 @@ void nx_hw_init(void)
 	else
 		nx_gzip_log = fopen("/tmp/nx.log", "a+");
 
-	/* Initialize the stats structure*/
-	if (nx_gzip_gather_statistics()) {
-		rc = pthread_mutex_init(&zlib_stats_mutex, NULL);
-		if (rc != 0){
-			prt_err("initializing phtread_mutex failed!\n");
-			return;
-		}
-	}
+	nx_log_async = (log_async_s != NULL) ? !!str_to_num(log_async_s) : 0;
 
 	nx_count = nx_enumerate_engines();
 	if (nx_count == 0) {
@@ -781,16 +1107,8 @@ void nx_hw_init(void)
 		nx_lib_debug(z);
 	}
 
-	if (def_bufsz != NULL) {
-		/* permit 64KB to 8MB */
-		uint64_t sz;
-		sz = str_to_num (def_bufsz);
-		if (sz > (1ULL<<23))
-			sz = (1ULL<<23);
-		else if (sz < nx_config.page_sz)
-			sz = nx_config.page_sz;
-		nx_config.strm_def_bufsz = (uint32_t) sz;
-	}
+	if (def_bufsz != NULL)
+		nx_set_option(NX_OPT_DEF_BUF_SIZE, str_to_num(def_bufsz));
 	if (inf_bufsz != NULL) {
 		/* permit 64KB to 1MB */
 		uint64_t sz;
@@ -815,6 +1133,38 @@ void nx_hw_init(void)
 		prt_info("DHT config set to 0x%x\n", nx_dht_config);
 	}
 
+	if (inf_hist_s != NULL)
+		nx_config.inflate_hist_inplace = !!str_to_num(inf_hist_s);
+
+	if (inf_strm_mem != NULL)
+		nx_set_option(NX_OPT_INF_STREAM_MEM, str_to_num(inf_strm_mem));
+	if (inf_mem_max != NULL)
+		nx_set_option(NX_OPT_INF_MEM_MAX, str_to_num(inf_mem_max));
+	if (job_len_s != NULL)
+		nx_set_option(NX_OPT_PER_JOB_LEN, str_to_num(job_len_s));
+	if (comp_th_s != NULL)
+		nx_set_option(NX_OPT_COMPRESS_THRESHOLD, str_to_num(comp_th_s));
+	if (spin_ns_s != NULL)
+		nx_set_option(NX_OPT_WAIT_SPIN_NS, str_to_num(spin_ns_s));
+	if (sleep_ns_s != NULL)
+		nx_set_option(NX_OPT_WAIT_SLEEP_NS, str_to_num(sleep_ns_s));
+	if (cksum_thr_s != NULL)
+		nx_config.cksum_threads = NX_MAX(1, str_to_num (cksum_thr_s));
+	if (copy_xover_s != NULL)
+		nx_set_option(NX_OPT_COPY_CROSSOVER, str_to_num(copy_xover_s));
+	if (shm_stats_s != NULL)
+		nx_config.shm_stats = !!str_to_num (shm_stats_s);
+
+	if (job_trace_s != NULL)
+		nx_job_trace_open(job_trace_s, (job_payload_s != NULL) ? !!str_to_num(job_payload_s) : 0);
+
+	if (dht_file != NULL) {
+		if (dht_set_default(dht_file) != 0)
+			prt_err("cannot load NX_GZIP_DHT_FILE %s, using builtin dht\n", dht_file);
+		else
+			prt_info("DHT table set %s\n", dht_file);
+	}
+
 	/* revalue the fifo_in and fifo_out */
 	nx_config.inflate_fifo_in_len  = (nx_config.strm_inf_bufsz * 2);
 	nx_config.inflate_fifo_out_len = (nx_config.strm_inf_bufsz * 2);
@@ -855,7 +1205,11 @@ void nx_hw_done(void)
 {
 	int flags = (nx_gzip_inflate_flags | nx_gzip_deflate_flags);
 
+	nx_copy_calibrate_stop();
 	nx_close_all();
+	nx_shm_stats_close();
+	nx_job_trace_close();
+	nx_log_stop();
 	
 	if (!!nx_gzip_log) fflush(nx_gzip_log);
 	fflush(stderr);
@@ -869,9 +1223,8 @@ static void _nx_hwdone(void) __attribute__((destructor));
 
 static void _nx_hwdone(void)
 {
-	if (nx_gzip_gather_statistics()) {
+	if (nx_gzip_print_statistics()) {
 		print_stats();
-		pthread_mutex_destroy(&zlib_stats_mutex);
 	}
 
 	nx_hw_done();
@@ -880,6 +1233,8 @@ static void _nx_hwdone(void)
 
 void sigsegv_handler(int sig, siginfo_t *info, void *ctx)
 {
+	/* nx_log() may allocate a ring and start a thread; write at once */
+	nx_log_async = 0;
 	prt_err("%d: Got signal %d si_code %d, si_addr %p\n", getpid(), sig, info->si_code, info->si_addr);
 
 	fprintf(stderr, "%d: signal %d si_code %d, si_addr %p\n", getpid(), sig, info->si_code, info->si_addr);
@@ -939,31 +1294,196 @@ static inline int __nx_copy(char *dst, char *src, uint32_t len, uint32_t *crc, u
 	return cc;
 }
 
+#define NX_COPY_CALIBRATE_TRIES 3
+#define NX_COPY_CALIBRATE_BYTES (1<<18)	/* timed per size and path */
+
+static int nx_copy_calibrate_tries;
+static int nx_copy_calibrate_running;
+static int nx_copy_calibrate_stopping;	/* at exit */
+
+/*
+  Smallest copy with checksums that a GZIP_FC_WRAP job does faster
+  than nx_copy_cksum.  Sizes double from 4KB up to per_job_len, each
+  timed over NX_COPY_CALIBRATE_BYTES of copies; returns UINT32_MAX
+  when software is faster at all of them or NX fails.  A size that
+  takes a translation fault is timed again; if it keeps faulting 0 is
+  returned and the next copy measures again, NX_COPY_CALIBRATE_TRIES
+  times at most.  0 too when stopped at exit.
+*/
+static uint32_t nx_copy_calibrate(nx_devp_t nxdevp)
+{
+	char *src, *dst;
+	uint32_t len, crc = INIT_CRC, adler = INIT_ADLER;
+	uint32_t max = __atomic_load_n(&nx_config.per_job_len, __ATOMIC_RELAXED);
+	uint64_t t, t_sw, t_nx;
+	int i, reps, retry, cc = ERR_NX_OK;
+
+	src = nx_alloc_buffer(max, nx_config.page_sz, 0);
+	dst = nx_alloc_buffer(max, nx_config.page_sz, 0);
+	if (src == NULL || dst == NULL) {
+		len = UINT32_MAX;
+		goto out;
+	}
+	for (i = 0; i < max; i++)
+		src[i] = (char)(i * 2654435761U >> 13);
+	memset(dst, 0, max);
+
+	for (len = 4096; len <= max; len *= 2) {
+		reps = NX_MAX(1, NX_COPY_CALIBRATE_BYTES / len);
+
+		t = get_nxtime_now();
+		for (i = 0; i < reps; i++)
+			nx_copy_cksum(dst, src, len, &crc, &adler);
+		t_sw = get_nxtime_diff(t, get_nxtime_now());
+
+		retry = NX_COPY_CALIBRATE_TRIES;
+		do {
+			cc = ERR_NX_OK;
+			t = get_nxtime_now();
+			for (i = 0; i < reps && cc == ERR_NX_OK; i++)
+				cc = __nx_copy(dst, src, len, &crc, &adler, nxdevp);
+			t_nx = get_nxtime_diff(t, get_nxtime_now());
+		} while (cc == ERR_NX_TRANSLATION && --retry > 0);
+
+		if (__atomic_load_n(&nx_copy_calibrate_stopping, __ATOMIC_RELAXED)) {
+			len = 0;
+			goto out;
+		}
+		if (cc == ERR_NX_TRANSLATION &&
+		    __atomic_add_fetch(&nx_copy_calibrate_tries, 1, __ATOMIC_RELAXED) < NX_COPY_CALIBRATE_TRIES) {
+			prt_warn("nx_copy calibration faulted at %u bytes, measuring again later\n", len);
+			len = 0;
+			goto out;
+		}
+		if (cc != ERR_NX_OK) {
+			len = UINT32_MAX;
+			break;
+		}
+		if (t_nx < t_sw)
+			break;
+	}
+	if (len > max)
+		len = UINT32_MAX;
+out:
+	if (src != NULL)
+		nx_free_buffer(src, max, 0);
+	if (dst != NULL)
+		nx_free_buffer(dst, max, 0);
+	prt_info("nx_copy with checksums uses NX from %u bytes\n", len);
+	return len;
+}
+
+static void *nx_copy_calibrate_thread(void *arg)
+{
+	uint32_t zero = 0, len = nx_copy_calibrate((nx_devp_t)arg);
+
+	/* unless nx_set_option() set one meanwhile */
+	if (len != 0)
+		__atomic_compare_exchange_n(&nx_config.copy_crossover, &zero, len, 0,
+					    __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+	__atomic_store_n(&nx_copy_calibrate_running, 0, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+/* the thread is the parent's */
+static void nx_copy_calibrate_atfork_child(void)
+{
+	nx_copy_calibrate_running = 0;
+}
+
+static void nx_copy_calibrate_init(void)
+{
+	pthread_atfork(NULL, NULL, nx_copy_calibrate_atfork_child);
+}
+
+/*
+  Measures copy_crossover on a thread of its own, from the first
+  nx_open() or a checksummed copy after it was set to 0; copies go to
+  software until it is done.  One at a time.
+*/
+static void nx_copy_calibrate_start(nx_devp_t nxdevp)
+{
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+	pthread_attr_t attr;
+	pthread_t t;
+	int idle = 0;
+
+	if (__atomic_load_n(&nx_copy_calibrate_tries, __ATOMIC_RELAXED) >= NX_COPY_CALIBRATE_TRIES ||
+	    __atomic_load_n(&nx_copy_calibrate_stopping, __ATOMIC_RELAXED) ||
+	    !__atomic_compare_exchange_n(&nx_copy_calibrate_running, &idle, 1, 0,
+					 __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return;
+
+	pthread_once(&once, nx_copy_calibrate_init);
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (pthread_create(&t, &attr, nx_copy_calibrate_thread, nxdevp) != 0) {
+		/* try again on a later copy, a few times */
+		__atomic_add_fetch(&nx_copy_calibrate_tries, 1, __ATOMIC_RELAXED);
+		__atomic_store_n(&nx_copy_calibrate_running, 0, __ATOMIC_RELEASE);
+	}
+	pthread_attr_destroy(&attr);
+}
+
+/* at exit, before the device closes: lets a running calibration end
+   its job and waits up to a second for it */
+static void nx_copy_calibrate_stop(void)
+{
+	struct timespec ts = { 0, 1000000 };
+	int ms;
+
+	__atomic_store_n(&nx_copy_calibrate_stopping, 1, __ATOMIC_RELAXED);
+	for (ms = 0; ms < 1000 && __atomic_load_n(&nx_copy_calibrate_running, __ATOMIC_ACQUIRE); ms++)
+		nanosleep(&ts, NULL);
+}
+
 /*
   Use NX-gzip hardware to copy src to dst. May use several NX jobs
-  crc and adler are inputs and outputs.
+  crc and adler are inputs and outputs.  Copies with checksums
+  shorter than nx_config.copy_crossover are done in software in one
+  pass.
 */
 int nx_copy(char *dst, char *src, uint64_t len, uint32_t *crc, uint32_t *adler, nx_devp_t nxdevp)
 {
 	int cc = ERR_NX_OK;
 	uint32_t in_crc, in_adler, out_crc, out_adler;
+	unsigned long crc_op = 0;
+	uint32_t per_job_len = __atomic_load_n(&nx_config.per_job_len, __ATOMIC_RELAXED);
 
 	if (len < nx_config.soft_copy_threshold && !crc && !adler) {
 		memcpy(dst, src, len);
 		return cc;
 	}
 
+	if (!!crc || !!adler) {
+		uint32_t crossover = __atomic_load_n(&nx_config.copy_crossover, __ATOMIC_ACQUIRE);
+
+		/* software while it is measured */
+		if (crossover == 0)
+			nx_copy_calibrate_start(nxdevp);
+		if (crossover == 0 || len < crossover) {
+			nx_copy_cksum(dst, src, len, crc, adler);
+			return cc;
+		}
+	}
+
 	/* caller supplies initial cksums */
 	if (!!crc) in_crc = *crc;
 	if (!!adler) in_adler = *adler;
 
+	/* all jobs but the last have the same length */
+	if (!!crc && len > per_job_len)
+		crc_op = nx_crc32_combine_gen(per_job_len);
+
 	while (len > 0) {
-		uint64_t job_len = NX_MIN((uint64_t)nx_config.per_job_len, len);
+		uint64_t job_len = NX_MIN((uint64_t)per_job_len, len);
 		cc = __nx_copy(dst, src, (uint32_t)job_len, &out_crc, &out_adler, nxdevp);
 		if (cc != ERR_NX_OK)
 			return cc;
 		/* combine initial cksums with the computed cksums */
-		if (!!crc) in_crc = nx_crc32_combine(in_crc, out_crc, job_len);
+		if (!!crc) in_crc = (job_len == per_job_len && crc_op != 0) ?
+				   nx_crc32_combine_op(in_crc, out_crc, crc_op) :
+				   nx_crc32_combine(in_crc, out_crc, job_len);
 		if (!!adler) in_adler = nx_adler32_combine(in_adler, out_adler, job_len);
 		len = len - job_len;
 		dst = dst + job_len;
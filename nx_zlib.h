@@ -50,7 +50,7 @@
 #include <sys/ioctl.h>
 #include <endian.h>
 #include <pthread.h>
-#include <sys/platform/ppc.h>
+#include "nx_clock.h"
 #include "nxu.h"
 #include "nx_dbg.h"
 
@@ -91,6 +91,68 @@
 
 extern FILE *nx_gzip_log;
 
+/* preset dictionary shared by streams; see nx_dictCreate() */
+typedef struct nx_dict_s {
+	struct nx_dict_s *next;  /* registry chain */
+	int      refcnt;
+	uint32_t dict_id;        /* adler32 of the whole dictionary */
+	uint32_t full_len;       /* length given to nx_dictCreate */
+	uint32_t len;            /* the last 32KB at most are kept */
+	uint32_t alloc_len;
+	char     *alloc;
+	char     *buf;           /* len bytes ending quadword aligned;
+				    16 or more zero bytes precede it */
+} nx_dict_t;
+typedef struct nx_dict_s *nx_dictp;
+
+/* inflate random access checkpoint; see nx_inflateIndex() */
+typedef struct nx_index_point_s {
+	uint64_t in;            /* compressed offset where the next job starts */
+	uint64_t out;           /* uncompressed offset */
+	uint32_t crc32;         /* running checksums up to out */
+	uint32_t adler32;
+	uint32_t sfbt;          /* NX resume state, Table 6-4 */
+	uint32_t subc;
+	uint32_t rembytecnt;    /* in a stored block */
+	uint32_t dhtlen;        /* in a dynamic huffman block, bits */
+	uint32_t hist_len;      /* history bytes before out */
+	uint32_t zhist_len;
+	char     *zhist;        /* history compressed with nx_compress2 */
+	char     dht[DHT_MAXSZ];
+} nx_index_point_t;
+
+typedef struct nx_index_s {
+	uint64_t span;          /* output bytes between checkpoints; 0 if not recording */
+	int      num;
+	int      alloc;
+	nx_index_point_t *pt;   /* sorted by out */
+} nx_index_t;
+
+/* Index file, all numbers big endian.  Header, then num records each
+   followed by (dhtlen+7)/8 dht bytes and zhist_len history bytes.
+   cksum is the crc32 of the header, or of a record and the bytes
+   following it, computed with cksum 0 */
+#define NX_INDEX_MAGIC   "NXGZINDX"
+#define NX_INDEX_VERSION 2
+
+typedef struct nx_index_hdr_s {
+	char     magic[8];
+	uint32_t version;
+	uint32_t num;
+	uint64_t span;
+	uint32_t cksum;
+	uint32_t reserved;
+} nx_index_hdr_t;
+
+typedef struct nx_index_rec_s {
+	uint64_t in, out;
+	uint32_t crc32, adler32;
+	uint32_t sfbt, subc, rembytecnt, dhtlen;
+	uint32_t hist_len, zhist_len;
+	uint32_t cksum;
+	uint32_t reserved;
+} nx_index_rec_t;
+
 /* common config variables for all streams */
 struct nx_config_t {
 	long     page_sz;
@@ -105,6 +167,7 @@ struct nx_config_t {
 	uint32_t strm_def_bufsz;
 	uint32_t strm_inf_bufsz;
 	uint32_t soft_copy_threshold;  /* choose memcpy or hwcopy */
+	uint32_t copy_crossover;       /* nx_copy with checksums uses NX from here; 0 calibrate */
 	uint32_t compress_threshold;   /* collect as much input */
 	int 	 inflate_fifo_in_len;
 	int 	 inflate_fifo_out_len;
@@ -114,12 +177,57 @@ struct nx_config_t {
 	int      window_max;
 	int      pgfault_retries;         
 	int      verbose;
+	int      inflate_hist_inplace;    /* keep inflate history in next_out */
+	uint32_t inflate_stream_mem;      /* fifo_out budget of one inflate stream */
+	uint64_t inflate_mem_max;         /* fifo_in and fifo_out of all inflate streams; 0 no cap */
+	int      cksum_threads;           /* nx_checksum_mt threads including the caller's */
+	int      shm_stats;               /* publish statistics for nxstat */
 };
 typedef struct nx_config_t *nx_configp_t;
 extern struct nx_config_t nx_config;
 
 extern int nx_dht_config;
 
+/*
+   Tunables that may change while streams run.  nx_set_option() sets
+   the value for all streams and nx_get_option() reads it back; the
+   NX_GZIP_* environment variables give the values at start up.
+   nx_deflateSetOption() and nx_inflateSetOption() override one for a
+   stream, kept across resets.  A value out of range is clamped to it.
+   Each value is stored atomically and a job reads it once when it is
+   set up, so a change applies from the next job on; fifo sizes apply
+   to the fifos allocated after the change.  NX_GZIP_INF_BUF_SIZE has
+   no option: inflate sizes fifo_in from soft_copy_threshold and
+   fifo_out from NX_OPT_INF_STREAM_MEM, not from strm_inf_bufsz.
+*/
+enum {
+	NX_OPT_PER_JOB_LEN = 0,      /* source bytes of one NX job; 64KiB to 1MiB */
+	NX_OPT_COMPRESS_THRESHOLD,   /* deflate buffers smaller input; to 64KiB */
+	NX_OPT_DEF_BUF_SIZE,         /* deflate output per job and fifo_out; a page to 8MiB */
+	NX_OPT_INF_STREAM_MEM,       /* inflate fifo_out budget of a stream; a page to 1GiB */
+	NX_OPT_INF_MEM_MAX,          /* inflate fifos of all streams; 0 no cap.  Global only */
+	NX_OPT_WAIT_SPIN_NS,         /* spin after a busy paste; to 1s.  Global only */
+	NX_OPT_WAIT_SLEEP_NS,        /* poll the CSB this long, then sleep; to 1s.  Global only */
+	NX_OPT_DHT_CONFIG,           /* NX_GZIP_DHT_CONFIG; 1 to search lengths too */
+	NX_OPT_STRATEGY,             /* NX_GZIP_STRATEGY; 0 fixed huffman.  Global, new streams */
+	NX_OPT_COPY_CROSSOVER,       /* NX_GZIP_COPY_CROSSOVER; 0 measures it again.  Global only */
+	NX_OPT_MAX
+};
+
+/* the option values of one stream; set has bit 1 << NX_OPT_x for
+   each that overrides nx_config */
+struct nx_stream_opt {
+	uint32_t set;
+	uint32_t per_job_len;
+	uint32_t compress_threshold;
+	uint32_t strm_def_bufsz;
+	uint32_t inflate_stream_mem;
+};
+
+/* option o of stream s: its own value f or else nx_config.f */
+#define nx_stream_opt(s, o, f) \
+	(((s)->opt.set & (1U << (o))) ? (s)->opt.f : __atomic_load_n(&nx_config.f, __ATOMIC_RELAXED))
+
 /* NX device handle */
 struct nx_dev_t {
 	int lock;       /* crb serializer */
@@ -194,10 +302,29 @@ typedef struct nx_stream_s {
 	int             inf_held;	
 	int		resuming;
 	int		history_len;
+	char		*hist_inplace;     /* history ends here in the user next_out; NULL when in fifo_out */
+	int		hist_inplace_len;  /* valid output bytes just before hist_inplace */
+	int		hist_inplace_ok;   /* user keeps its output intact until the next inflate */
+	int		hist_ext;          /* hist_inplace is in a buffer of its own, not before next_out */
+	unsigned long	hist_memcpy;       /* bytes memcpy'd for history, flushed to stats */
+	unsigned long	out_memcpy;        /* bytes memcpy'd from fifo_out to next_out */
+	unsigned long	hist_inplace_cnt;  /* jobs resumed from the history in next_out */
+	int		sync_have;         /* marker bytes matched by inflateSync */
+	int		sync_point;        /* last job ended with a flush marker */
+	int		sync_nocheck;      /* synced mid stream; trailer is not verified */
+	int		data_type;         /* zlib data_type where the last job stopped */
+	nx_index_t	*index;            /* random access checkpoints */
+	unsigned char	*back_window;      /* inflateBack window; holds the history */
+	int		back_wsize;
+	char		*back_out;         /* inflateBack NX target handed to out() */
+	int		back_out_len;
 	int		last_comp_ratio;
 	int		is_final;
 	int		invoke_cnt;  /* the times to invoke nx inflate or nx deflate */
 	void		*dhthandle;
+	int		fc_fht;      /* last fixed vs dynamic huffman choice */
+	uint32_t	fc_dhtlen;   /* and the dht and job length it was made for */
+	uint64_t	fc_nbytes;
 
         z_streamp       zstrm;          /* point to the parent  */
 
@@ -208,10 +335,15 @@ typedef struct nx_stream_s {
 	int             zlib_cmf;
 	int             zlib_flg;
 
-	unsigned int    dict_len;
+	unsigned int    dict_len;        /* dictionary in use ends at dict_end */
 	unsigned int    dict_alloc_len;  
 	uint32_t        dict_id;
 	char            *dict;
+	char            *dict_end;
+	int             dict_hist;       /* inflate output since the dictionary */
+	nx_dictp        shared_dict;     /* attached until detached or End */
+	struct nx_stream_opt opt;        /* nx_deflateSetOption, nx_inflateSetOption */
+	uint32_t        job_bufsz;       /* NX_OPT_DEF_BUF_SIZE of the job in flight */
 	
 	
 	int             status;         /* stream status */
@@ -235,6 +367,10 @@ typedef struct nx_stream_s {
         int32_t         used_out;
         int32_t         cur_out;
 
+	int32_t         fifo_out_hwm;   /* largest overflow since the last resize check */
+	int32_t         fifo_out_jobs;  /* jobs since the last resize check */
+	int             fifo_out_grow;  /* a job ran out of target space */
+
 	/* locate the BFINAL bit */ 	
 	/* char            *last_block_head;    /* the byte offset */
 	/* int             last_block_head_bit; /* the bfinal bit pos */
@@ -378,6 +514,14 @@ typedef enum {
 				   slot is represending everything
 				   which larger or equal 1024KiB */
 
+/* NX job latency in nx_clock ticks, log-linear: 4 slots for each power
+   of 2 so a slot is within 25% of its latencies, to 2^33 ticks */
+#define NX_LAT_SUB_BITS 2
+#define NX_LAT_SLOTS    128
+#define NX_FC_SLOTS     16	/* gzip function code / 2 */
+#define NX_ENGINE_SLOTS 8	/* nx_devices index, the last for the rest */
+#define NX_CC_SLOTS     257	/* CSB cc, the last for nxu_run_job errors */
+
 struct zlib_stats {
 	unsigned long deflateInit;
 	unsigned long deflate;
@@ -393,6 +537,8 @@ struct zlib_stats {
 	unsigned long deflatePrime;
 	unsigned long deflateCopy;
 	unsigned long deflateEnd;
+	unsigned long deflate_fht_wins;  /* per block fixed vs dynamic huffman */
+	unsigned long deflate_dht_wins;
 
 	unsigned long inflateInit;
 	unsigned long inflate;
@@ -409,49 +555,206 @@ struct zlib_stats {
 	unsigned long inflatePrime;
 	unsigned long inflateCopy;
 	unsigned long inflateEnd;
+	unsigned long inflateBack;
+	unsigned long inflate_hist_inplace;  /* jobs resumed from next_out */
+	unsigned long inflate_fifo_grow;     /* fifo_out resized up */
+	unsigned long inflate_fifo_shrink;   /* fifo_out resized down */
+	uint64_t inflate_hist_memcpy;        /* history bytes copied to fifo_out */
+	uint64_t inflate_out_memcpy;         /* bytes copied from fifo_out to next_out */
+	uint64_t inflate_out_len;
 	
 	uint64_t deflate_len;
+	uint64_t deflate_out_len;
 	uint64_t deflate_time;
 
 	uint64_t inflate_len;
 	uint64_t inflate_time;
 
+	/* per nx_submit_job; page fault and target space retries are
+	   the ERR_NX_TRANSLATION and ERR_NX_TARGET_SPACE counts */
+	uint64_t job_lat_fc[NX_FC_SLOTS][NX_LAT_SLOTS];
+	uint64_t job_lat_engine[NX_ENGINE_SLOTS][NX_LAT_SLOTS];
+	uint64_t job_cc[NX_CC_SLOTS];
+	uint64_t job_submit;		/* less the cc counts is the jobs in flight */
+	uint64_t job_paste_busy;
+	uint64_t job_csb_polls;
+	uint64_t job_faults;
+};
+
+/* Each thread counts in its own shard, which only it writes, so
+   counting takes no lock and shares no cache line; nx_get_stats()
+   adds up the shards.  Use as zlib_stats_add(inflate_len, n) or
+   zlib_stats_inc(deflate_avail_in[slot]). */
+extern __thread struct zlib_stats *zlib_stats_tls;
+extern struct zlib_stats *zlib_stats_shard_new(void);
+extern int nx_get_stats(struct zlib_stats *st);
+
+static inline struct zlib_stats *zlib_stats_shard(void)
+{
+	struct zlib_stats *s = zlib_stats_tls;
+
+	return (s != NULL) ? s : zlib_stats_shard_new();
+}
+
+/* relaxed stores so that a reader never sees a torn counter.
+   zlib_stats_count() counts regardless, for a caller that read
+   nx_gzip_gather_statistics() once for several counters */
+#define zlib_stats_count(field, n) do {					\
+		struct zlib_stats *_st = zlib_stats_shard();		\
+		if (_st != NULL)					\
+			__atomic_store_n(&_st->field, _st->field + (n), __ATOMIC_RELAXED); \
+	} while (0)
+#define zlib_stats_add(field, n) do {					\
+		if (nx_gzip_gather_statistics())			\
+			zlib_stats_count(field, n);			\
+	} while (0)
+#define zlib_stats_inc(field) zlib_stats_add(field, 1)
+
+/*
+   Live statistics for samples/nxstat in the POSIX shared memory object
+   /nxstat.<pid>.  A reader bumps readers while attached and request
+   for each sample; the next NX job of the process copies nx_get_stats()
+   in to st, making seq odd until done, and counts while readers is non
+   zero.  Nothing is copied while no one reads.
+*/
+#define NX_SHM_STATS_MAGIC   0x4e585354	/* "NXST" */
+#define NX_SHM_STATS_VERSION 2
+#define NX_SHM_STATS_NAME    "/nxstat.%d"
+
+struct nx_shm_stats {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t stats_size;	/* sizeof(struct zlib_stats) */
+	int32_t  pid;
+	uint64_t tb_freq;	/* nx_clock ticks per second */
+	uint64_t request;	/* bumped by readers */
+	uint64_t readers;	/* readers attached */
+	uint64_t seq;		/* odd while st is written */
+	uint64_t time;		/* nx_clock_now() when st was taken */
+	struct zlib_stats st;
 };
 
-extern pthread_mutex_t zlib_stats_mutex; 
-extern struct zlib_stats zlib_stats; 
-inline void zlib_stats_inc(unsigned long *count)
+extern struct nx_shm_stats *nx_shm_stats;
+extern uint64_t nx_shm_stats_seen;
+extern void nx_shm_stats_open(void);
+extern void nx_shm_stats_close(void);
+extern void nx_shm_stats_publish(void);
+
+static inline void nx_shm_stats_poll(void)
 {
-        if (!nx_gzip_gather_statistics())
-                return;
+	struct nx_shm_stats *sh = __atomic_load_n(&nx_shm_stats, __ATOMIC_ACQUIRE);
 
-        pthread_mutex_lock(&zlib_stats_mutex);
-        *count = *count + 1;
-        pthread_mutex_unlock(&zlib_stats_mutex);
+	if (sh != NULL && __atomic_load_n(&sh->request, __ATOMIC_RELAXED) !=
+	    __atomic_load_n(&nx_shm_stats_seen, __ATOMIC_RELAXED))
+		nx_shm_stats_publish();
 }
 
+/*
+   NX job trace, NX_GZIP_JOB_TRACE=file writes file.<pid>: a struct
+   nx_job_trace_hdr, then a struct nx_job_trace_rec per nx_submit_job.
+   With NX_JOB_TRACE_PAYLOAD a record is followed by the CPB input,
+   NX_JOB_TRACE_CPB_IN bytes, and the src_len source bytes, enough for
+   samples/nx_replay to submit the job again.  Native byte order.
+*/
+#define NX_JOB_TRACE_MAGIC   0x4e584a54	/* "NXJT" */
+#define NX_JOB_TRACE_VERSION 1
+#define NX_JOB_TRACE_PAYLOAD 0x1
+#define NX_JOB_TRACE_CPB_IN  (24 * sizeof(nx_qw_t))	/* qw[0:23] */
+
+struct nx_job_trace_hdr {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t tb_freq;	/* nx_clock ticks per second */
+	int32_t  pid;
+	uint32_t flags;
+};
+
+struct nx_job_trace_rec {
+	uint32_t len;		/* of the record and its payload */
+	uint8_t  fc;
+	uint8_t  flags;
+	int16_t  cc;		/* CSB cc, or the nxu_run_job error */
+	uint32_t src_len;	/* bytes in the source DDEs */
+	uint32_t dst_len;
+	uint32_t hist_len;	/* bytes of history, decompress */
+	uint32_t dht_len;	/* bits of DHT, compress */
+	uint32_t spbc;
+	uint32_t tpbc;
+	uint32_t paste_busy;
+	uint32_t csb_polls;
+	uint32_t faults;
+	uint32_t tid;
+	uint64_t t_submit;	/* nx_clock ticks */
+	uint64_t t_done;
+};
+
+extern FILE *nx_job_trace_fp;
+extern void nx_job_trace_open(const char *path, int payload);
+extern void nx_job_trace_close(void);
+extern void nx_job_trace(nx_gzip_crb_cpb_t *cmdp, int cc, uint64_t t_submit, uint64_t t_done);
+
+/* nx_clock.h ticks */
 static inline uint64_t get_nxtime_now(void)
 {
-	return __ppc_get_timebase();
+	return nx_clock_now();
 }
 
 static inline uint64_t get_nxtime_diff(uint64_t t1, uint64_t t2)
 {
-	if (t2 > t1) {
-		return t2-t1;
-	}else{
-		return (0xFFFFFFFFFFFFFFF-t1) + t2;
-	}
+	return nx_clock_diff(t1, t2);
+}
+
+static inline unsigned int nx_lat_slot(uint64_t t)
+{
+	unsigned int msb, slot;
+
+	if (t < (1 << NX_LAT_SUB_BITS))
+		return t;
+	msb = 63 - __builtin_clzll(t);
+	slot = ((msb - NX_LAT_SUB_BITS + 1) << NX_LAT_SUB_BITS) |
+		((t >> (msb - NX_LAT_SUB_BITS)) & ((1 << NX_LAT_SUB_BITS) - 1));
+	return NX_MIN(slot, NX_LAT_SLOTS - 1);
+}
+
+/* the least latency of slot */
+static inline uint64_t nx_lat_slot_min(unsigned int slot)
+{
+	if (slot < (1 << NX_LAT_SUB_BITS))
+		return slot;
+	return (uint64_t)((1 << NX_LAT_SUB_BITS) | (slot & ((1 << NX_LAT_SUB_BITS) - 1)))
+		<< ((slot >> NX_LAT_SUB_BITS) - 1);
 }
 
 #ifndef __KERNEL__
 static inline double nxtime_to_us(uint64_t nxtime)
 {
-	uint64_t freq;
+	return nx_clock_to_ns(nxtime) / 1000.0;
+}
 
-	freq = __ppc_get_timebase_freq();
-	
-	return (double)(nxtime * 1000000 / freq) ;
+/*
+   Microseconds within which fraction p of the jobs counted in hist, a
+   job_lat_ array of NX_LAT_SLOTS, completed; 0 if there are none.
+   Resolution is that of the slots, to 25%.
+*/
+static inline double nx_lat_percentile(const uint64_t *hist, double p)
+{
+	uint64_t n = 0, want, sum = 0;
+	unsigned int i;
+
+	for (i = 0; i < NX_LAT_SLOTS; i++)
+		n += hist[i];
+	if (n == 0)
+		return 0;
+
+	want = (uint64_t)(p * n + 0.5);
+	want = NX_MAX(want, 1);
+	for (i = 0; i < NX_LAT_SLOTS - 1; i++) {
+		sum += hist[i];
+		if (sum >= want)
+			break;
+	}
+	/* the most latency of the slot */
+	return nxtime_to_us(nx_lat_slot_min(i + 1));
 }
 #endif
 
@@ -465,9 +768,19 @@ extern void *nx_function_begin(int function, int pri);
 extern int nx_function_end(void *vas_handle);
 
 /* zlib crc32.c and adler32.c */
-extern unsigned long nx_crc32_combine(unsigned long crc1, unsigned long crc2, uint64_t len2);
+extern unsigned long nx_crc32_table(unsigned long crc, const unsigned char *buf, uint64_t len);
 extern unsigned long nx_adler32_combine(unsigned long adler1, unsigned long adler2, uint64_t len2);
+extern unsigned long nx_adler32_z(unsigned long adler, const char *buf, size_t len);
+
+/* nx_cksum.c */
+extern int nx_checksum_mt(const unsigned char *buf, uint64_t len, uint32_t *crc, uint32_t *adler, int threads);
+extern void nx_copy_cksum(char *dst, const char *src, uint64_t len, uint32_t *crc, uint32_t *adler);
+
+/* crc32_fold.c */
 extern unsigned long nx_crc32(unsigned long crc, const unsigned char *buf, uint64_t len);
+extern unsigned long nx_crc32_combine(unsigned long crc1, unsigned long crc2, uint64_t len2);
+extern unsigned long nx_crc32_combine_gen(uint64_t len2);
+extern unsigned long nx_crc32_combine_op(unsigned long crc1, unsigned long crc2, unsigned long op);
 
 /* nx_zlib.c */
 extern nx_devp_t nx_open(int nx_id);
@@ -481,6 +794,14 @@ extern int nx_touch_pages_dde(nx_dde_t *ddep, long buf_sz, long page_sz, int wr)
 extern int nx_copy(char *dst, char *src, uint64_t len, uint32_t *crc, uint32_t *adler, nx_devp_t nxdevp);
 extern void nx_hw_init(void);
 extern void nx_hw_done(void);
+extern int nx_set_option(int opt, uint64_t value);
+extern int nx_get_option(int opt, uint64_t *value);
+extern uint64_t nx_option_limit(int opt, uint64_t value);
+
+/* nx_dict.c */
+extern nx_dictp nx_dictCreate(const unsigned char *dictionary, unsigned int dictLength);
+extern nx_dictp nx_dictGet(nx_dictp d);
+extern void nx_dictRelease(nx_dictp d);
 
 /* nx_deflate.c */
 extern int nx_deflateInit_(z_streamp strm, int level, const char *version, int stream_size);
@@ -488,15 +809,35 @@ extern int nx_deflateInit2_(z_streamp strm, int level, int method, int windowBit
 		int memLevel __unused, int strategy, const char *version __unused, int stream_size __unused);
 #define nx_deflateInit(strm, level) nx_deflateInit_((strm), (level), ZLIB_VERSION, (int)sizeof(z_stream))
 extern int nx_deflate(z_streamp strm, int flush);
+extern int nx_deflateReset(z_streamp strm);
 extern int nx_deflateEnd(z_streamp strm);
 extern unsigned long nx_deflateBound(z_streamp strm, unsigned long sourceLen);
+extern int nx_deflateSetDhtSet(z_streamp strm, const char *fname);
+extern int nx_deflateSetSharedDictionary(z_streamp strm, nx_dictp d);
+extern int nx_deflateSetOption(z_streamp strm, int opt, uint64_t value);
 
 /* nx_inflate.c */
 extern int nx_inflateInit_(z_streamp strm, const char *version, int stream_size);
 extern int nx_inflateInit2_(z_streamp strm, int windowBits, const char *version, int stream_size);
 #define nx_inflateInit(strm) nx_inflateInit_((strm), ZLIB_VERSION, (int)sizeof(z_stream))
+#define nx_inflateInit2(strm, windowBits) nx_inflateInit2_((strm), (windowBits), ZLIB_VERSION, (int)sizeof(z_stream))
 extern int nx_inflate(z_streamp strm, int flush);
+extern int nx_inflateReset(z_streamp strm);
 extern int nx_inflateEnd(z_streamp strm);
+extern int nx_inflateSync(z_streamp strm);
+extern int nx_inflateSyncPoint(z_streamp strm);
+extern int nx_inflateBackInit_(z_streamp strm, int windowBits, unsigned char *window, const char *version, int stream_size);
+#define nx_inflateBackInit(strm, windowBits, window) nx_inflateBackInit_((strm), (windowBits), (window), ZLIB_VERSION, (int)sizeof(z_stream))
+extern int nx_inflateBack(z_streamp strm, in_func in, void *in_desc, out_func out, void *out_desc);
+extern int nx_inflateBackEnd(z_streamp strm);
+extern long nx_sync_search(const unsigned char *buf, long len, int *have);
+extern int nx_inflateSetSharedDictionary(z_streamp strm, nx_dictp d);
+extern int nx_inflateIndex(z_streamp strm, uint64_t span);
+extern int nx_inflateIndexSave(z_streamp strm, const char *fname);
+extern int nx_inflateIndexLoad(z_streamp strm, const char *fname);
+extern int nx_inflate_seek(z_streamp strm, uint64_t offset, uint64_t *in_offset, uint64_t *out_offset);
+extern void nx_inflate_mem_usage(uint64_t *resident, uint64_t *peak);
+extern int nx_inflateSetOption(z_streamp strm, int opt, uint64_t value);
 
 /* nx_compress.c */
 extern int nx_compress2(Bytef *dest, uLongf *destLen, const Bytef *source, uLong sourceLen, int level);
@@ -511,5 +852,8 @@ extern int nx_uncompress(Bytef *dest, uLongf *destLen, const Bytef *source, uLon
 extern void *dht_begin(char *ifile, char *ofile);
 extern void dht_end(void *handle);
 extern int dht_lookup(nx_gzip_crb_cpb_t *cmdp, int request, void *handle);
+extern int dht_set_default(const char *fname);
+extern int dht_use_set(void *handle, const char *fname);
+extern int dht_set_config(void *handle, int config);
 
 #endif /* _NX_ZLIB_H */
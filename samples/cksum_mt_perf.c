@@ -0,0 +1,97 @@
+/*
+ * Throughput of nx_checksum_mt over a large buffer as the thread
+ * count doubles, crc32 and adler32 together.
+ *
+ * The buffer is size MiB of the file, repeated when the file is
+ * shorter, or random data without a file.  Each thread count must
+ * give the single thread checksums.
+ *
+ * usage: cksum_mt_perf [-n size MiB] [-t max threads] [file]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <zlib.h>
+#include "nx_zlib.h"
+
+static double now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1.0e6;
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t size = 1024, len, i;
+	int maxt = sysconf(_SC_NPROCESSORS_ONLN), t, c, r, reps;
+	uint32_t crc1 = 0, adler1 = 1;
+	unsigned char *buf;
+	FILE *f = NULL;
+	double sec;
+
+	while ((c = getopt(argc, argv, "n:t:")) != -1) {
+		switch (c) {
+		case 'n': size = strtoull(optarg, NULL, 0); break;
+		case 't': maxt = atoi(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s [-n size MiB] [-t max threads] [file]\n", argv[0]);
+			return -1;
+		}
+	}
+	if (optind < argc)
+		assert(NULL != (f = fopen(argv[optind], "r")));
+
+	len = size << 20;
+	assert(NULL != (buf = malloc(len)));
+	i = 0;
+	if (f != NULL) {
+		while (i < len) {
+			size_t n = fread(buf + i, 1, len - i, f);
+			if (n == 0) {
+				if (i == 0)
+					break;
+				rewind(f);
+			}
+			i += n;
+		}
+		fclose(f);
+	}
+	for (; i < len; i++)
+		buf[i] = random();
+
+	/* a few passes of about a second each */
+	reps = NX_MAX(1, (int)(4096 / size));
+
+	printf("%8s %10s\n", "threads", "GB/s");
+	for (t = 1; t <= maxt; t = (t < maxt && t * 2 > maxt) ? maxt : t * 2) {
+		uint32_t crc = 0, adler = 1;
+
+		sec = now();
+		for (r = 0; r < reps; r++) {
+			crc = 0;
+			adler = 1;
+			assert(nx_checksum_mt(buf, len, &crc, &adler, t) == Z_OK);
+		}
+		sec = now() - sec;
+		if (t == 1) {
+			crc1 = crc;
+			adler1 = adler;
+		}
+		else if (crc != crc1 || adler != adler1) {
+			fprintf(stderr, "threads %d: crc32 %08x adler32 %08x, expected %08x %08x\n",
+				t, crc, adler, crc1, adler1);
+			return -1;
+		}
+		printf("%8d %10.2f\n", t, (double)len * reps / sec / 1.0e9);
+		if (t == maxt)
+			break;
+	}
+	printf("crc32 %08x adler32 %08x\n", crc1, adler1);
+
+	return 0;
+}
@@ -0,0 +1,117 @@
+/*
+ * Copy with crc32 and adler32 three ways across buffer sizes:
+ * memcpy followed by the two checksums, each its own pass; the
+ * one pass nx_copy_cksum; and NX GZIP_FC_WRAP jobs through nx_copy.
+ * Prints MB/s of each and the gain of the one pass copy, then the
+ * crossover that nx_copy calibrated.
+ *
+ * usage: copy_cksum_perf [-s secs]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <zlib.h>
+#include "nx_zlib.h"
+
+#define BUFSZ (1<<20)
+
+static const uint64_t sizes[] = { 1024, 4096, 16384, 65536, 262144, 1<<20 };
+
+static double now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1.0e6;
+}
+
+enum { TWO_PASS, ONE_PASS, NX_WRAP };
+
+static void copy(int how, char *dst, char *src, uint64_t len, uint32_t *crc, uint32_t *adler, nx_devp_t nxdevp)
+{
+	switch (how) {
+	case TWO_PASS:
+		memcpy(dst, src, len);
+		*crc = nx_crc32(*crc, (unsigned char *)dst, len);
+		*adler = nx_adler32_z(*adler, dst, len);
+		break;
+	case ONE_PASS:
+		nx_copy_cksum(dst, src, len, crc, adler);
+		break;
+	case NX_WRAP:
+		assert(nx_copy(dst, src, len, crc, adler, nxdevp) == ERR_NX_OK);
+		break;
+	}
+}
+
+/* MB/s of copy how of len bytes */
+static double rate(int how, char *dst, char *src, uint64_t len, double secs, nx_devp_t nxdevp)
+{
+	uint32_t crc = 0, adler = 1;
+	long i, reps = 1;
+	double t;
+
+	for (;;) {
+		t = now();
+		for (i = 0; i < reps; i++)
+			copy(how, dst, src, len, &crc, &adler, nxdevp);
+		t = now() - t;
+		if (t >= secs)
+			break;
+		reps = (t < secs / 100) ? reps * 10 : (long)(reps * secs / t) + 1;
+	}
+	return (double)len * reps / t / 1.0e6;
+}
+
+int main(int argc, char **argv)
+{
+	double secs = 0.2, r[3];
+	uint32_t crossover;
+	nx_devp_t nxdevp;
+	char *src, *dst;
+	unsigned s;
+	int c, i;
+
+	while ((c = getopt(argc, argv, "s:")) != -1) {
+		switch (c) {
+		case 's': secs = atof(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s [-s secs]\n", argv[0]);
+			return -1;
+		}
+	}
+
+	assert(NULL != (nxdevp = nx_open(-1)));
+	assert(NULL != (src = nx_alloc_buffer(BUFSZ, nx_config.page_sz, 0)));
+	assert(NULL != (dst = nx_alloc_buffer(BUFSZ, nx_config.page_sz, 0)));
+	for (i = 0; i < BUFSZ; i++)
+		src[i] = random();
+
+	/* calibrate first, then make nx_copy always use NX */
+	{
+		uint32_t crc = 0;
+		nx_copy(dst, src, 4096, &crc, NULL, nxdevp);
+	}
+	crossover = nx_config.copy_crossover;
+	nx_config.copy_crossover = 1;
+
+	printf("%8s %10s %10s %10s %8s  (MB/s)\n", "size", "two pass", "one pass", "NX wrap", "gain");
+	for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		for (i = TWO_PASS; i <= NX_WRAP; i++)
+			r[i] = rate(i, dst, src, sizes[s], secs, nxdevp);
+		printf("%8ld %10.0f %10.0f %10.0f %7.2fx\n", (long)sizes[s],
+		       r[TWO_PASS], r[ONE_PASS], r[NX_WRAP], r[ONE_PASS] / r[TWO_PASS]);
+	}
+	if (crossover == UINT32_MAX)
+		printf("crossover: software at all sizes\n");
+	else
+		printf("crossover: NX from %u bytes\n", crossover);
+
+	nx_free_buffer(src, BUFSZ, 0);
+	nx_free_buffer(dst, BUFSZ, 0);
+	nx_close(nxdevp);
+	return 0;
+}
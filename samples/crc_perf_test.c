@@ -1,27 +1,111 @@
+/*
+ * crc32 and adler32 throughput across buffer sizes and alignments.
+ *
+ * Built twice by the Makefile: crc_perf_test_zlib against the system
+ * zlib and crc_perf_test_vmx against libnxz.a, whose crc32 and
+ * adler32 are the vector versions.  Each measurement repeats the
+ * checksum for about a tenth of a second.  Data is read from stdin
+ * when it is not a terminal, otherwise it is random.  The last lines
+ * are crc32_combine calls per second for a few lengths.
+ *
+ * usage: crc_perf_test [-s secs] < file
+ */
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
 #include <zlib.h>
 
 typedef unsigned long ulong;
 
+#define BUFSZ (1<<20)
+
+static const size_t sizes[] = { 16, 64, 256, 1024, 4096, 16384, 65536, 1<<20 };
+static const size_t aligns[] = { 0, 1, 3, 8 };
+
+static double now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1.0e6;
+}
+
+/* MB/s of fn over len bytes at buf */
+static double rate(ulong (*fn)(ulong, const Bytef *, uInt), const Bytef *buf, size_t len, double secs, ulong *sum)
+{
+	long i, reps = 1;
+	double t;
+
+	for (;;) {
+		t = now();
+		for (i = 0; i < reps; i++)
+			*sum = fn(*sum, buf, len);
+		t = now() - t;
+		if (t >= secs)
+			break;
+		reps = (t < secs / 100) ? reps * 10 : (long)(reps * secs / t) + 1;
+	}
+	return (double)len * reps / t / 1.0e6;
+}
+
+/* millions of crc32_combine per second for len2 */
+static double combine_rate(off_t len2, double secs, ulong *sum)
+{
+	long i, reps = 1000;
+	double t;
+
+	for (;;) {
+		t = now();
+		for (i = 0; i < reps; i++)
+			*sum = crc32_combine(*sum, i, len2);
+		t = now() - t;
+		if (t >= secs)
+			break;
+		reps = (t < secs / 100) ? reps * 10 : (long)(reps * secs / t) + 1;
+	}
+	return reps / t / 1.0e6;
+}
+
 int main(int argc, char **argv)
 {
-	size_t bufsz = 1<<20; /* test up to 1MB */
-	size_t readsz;
-	char *buf;
-	ulong crc;
+	double secs = 0.1;
+	size_t readsz, s, a;
+	ulong sum = 0;
+	Bytef *buf;
 	long i;
+	int c;
 
-	assert(NULL != (buf = malloc(bufsz)));	
+	while ((c = getopt(argc, argv, "s:")) != -1) {
+		switch (c) {
+		case 's': secs = atof(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s [-s secs] < file\n", argv[0]);
+			return -1;
+		}
+	}
 
-	readsz = fread(buf, 1, bufsz, stdin);
+	assert(NULL != (buf = malloc(BUFSZ + 64)));
+	readsz = isatty(0) ? 0 : fread(buf, 1, BUFSZ + 64, stdin);
+	for (i = readsz; i < BUFSZ + 64; i++)
+		buf[i] = random();
+
+	printf("%8s %5s %10s %10s  (MB/s)\n", "size", "align", "crc32", "adler32");
+	for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		for (a = 0; a < sizeof(aligns) / sizeof(aligns[0]); a++) {
+			double crc = rate(crc32, buf + aligns[a], sizes[s], secs, &sum);
+			double adler = rate(adler32, buf + aligns[a], sizes[s], secs, &sum);
+			printf("%8ld %5ld %10.0f %10.0f\n", (long)sizes[s], (long)aligns[a], crc, adler);
+		}
+	}
+	for (s = 0; s < 3; s++) {
+		static const off_t lens[] = { 64, 1<<20, 1<<30 };
+		printf("crc32_combine len %10ld %8.2f Mops/s\n", (long)lens[s], combine_rate(lens[s], secs, &sum));
+	}
+	/* keeps the loops from being optimized out */
+	printf("checksum %08lx\n", sum);
 
-	for(i=0; i<100000; i++)
-		crc = crc32(0, buf, readsz);
-	printf("read %ld bytes %ld times, crc32 %08lx\n", readsz, i, crc );
-		
 	return 0;
 }
-
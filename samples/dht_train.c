@@ -0,0 +1,433 @@
+/*
+ * Trains a dht table set from a corpus.  Each input file is cut into
+ * chunks; every chunk is compressed once by NX with the default dht
+ * only to collect its LZ symbol counts.  The count histograms are
+ * then clustered into N groups by the number of bits each group's
+ * huffman code would spend on them, and a dht is made for each group
+ * with dhtgen.  The result is written as a table set file that
+ * libnxz loads in place of the nx_dht_builtin.c tables:
+ *
+ *   export NX_GZIP_DHT_FILE=my.dhtset     (all streams)
+ *   nx_deflateSetDhtSet(strm, "my.dhtset") (one stream)
+ *
+ * Train with the same NX_GZIP_DHT_CONFIG value used at run time since
+ * it decides whether lengths are part of the cache keys (-l here).
+ *
+ * Copyright (C) IBM Corporation, 2011-2017
+ *
+ * Licenses for GPLv2 and Apache v2.0:
+ *
+ * GPLv2:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Apache v2.0:
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <math.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <endian.h>
+#include <assert.h>
+#include <errno.h>
+#include "nxu.h"
+#include "nx_dht.h"
+#include "nx.h"
+#include "nx_dbg.h"
+
+int nx_dbg = 0;
+FILE *nx_gzip_log = NULL;
+
+#define NX_MIN(X,Y) (((X)<(Y))?(X):(Y))
+
+#define NSYM        (LLSZ+DSZ)
+#define NUMLIT      256
+#define MAX_ITER    20
+#define MAX_CODELEN 15.0
+
+typedef uint32_t hist_t[NSYM];
+
+static hist_t *samples = NULL;     /* one histogram per chunk */
+static long num_samples = 0;
+static long max_samples = 0;
+
+static int compress_count(char *src, uint32_t srclen, char *dst, uint32_t dstlen,
+			  nx_gzip_crb_cpb_t *cmdp, void *handle)
+{
+	put32(cmdp->crb, gzip_fc, 0);   /* clear */
+	putnn(cmdp->crb, gzip_fc, GZIP_FC_COMPRESS_RESUME_DHT_COUNT);
+	putnn(cmdp->cpb, in_histlen, 0);
+	memset((void *)&cmdp->crb.csb, 0, sizeof(cmdp->crb.csb));
+	put32(cmdp->cpb, out_spbc_comp_with_count, 0);
+
+	put64(cmdp->crb, csb_address, 0);
+	put64(cmdp->crb, csb_address, (uint64_t) &cmdp->crb.csb & csb_address_mask);
+
+	clear_dde(cmdp->crb.source_dde);
+	putnn(cmdp->crb.source_dde, dde_count, 0);
+	put32(cmdp->crb.source_dde, ddebc, srclen);
+	put64(cmdp->crb.source_dde, ddead, (uint64_t) src);
+
+	clear_dde(cmdp->crb.target_dde);
+	putnn(cmdp->crb.target_dde, dde_count, 0);
+	put32(cmdp->crb.target_dde, ddebc, dstlen);
+	put64(cmdp->crb.target_dde, ddead, (uint64_t) dst);
+
+	nxu_run_job(cmdp, handle);
+
+	do {;} while (getnn(cmdp->crb.csb, csb_v) == 0);
+
+	return getnn(cmdp->crb.csb, csb_cc);
+}
+
+static void touch_pages(char *buf, long len, int wr)
+{
+	volatile char t;
+	long i;
+
+	for (i = 0; i < len; i += 4096) {
+		t = buf[i];
+		if (wr) buf[i] = t;
+	}
+	t = buf[len-1];
+	if (wr) buf[len-1] = t;
+}
+
+static int add_sample(uint32_t *lzcount)
+{
+	hist_t *p;
+	long max;
+	int i;
+
+	if (num_samples == max_samples) {
+		max = (max_samples == 0) ? 1024 : 2 * max_samples;
+		if (NULL == (p = realloc(samples, max * sizeof(hist_t))))
+			return -1;
+		samples = p;
+		max_samples = max;
+	}
+	for (i = 0; i < NSYM; i++)
+		samples[num_samples][i] = be32toh(lzcount[i]);
+	++num_samples;
+	return 0;
+}
+
+static int sample_file(char *fname, uint32_t chunk, void *dhthandle, void *handle)
+{
+	FILE *fp;
+	char *src, *dst;
+	uint32_t srclen, dstlen;
+	nx_gzip_crb_cpb_t nxcmd, *cmdp = &nxcmd;
+	int cc = ERR_NX_OK, tries;
+
+	if (NULL == (fp = fopen(fname, "r"))) {
+		perror(fname);
+		return -1;
+	}
+
+	dstlen = 2 * chunk + 1024;
+	assert(NULL != (src = malloc(chunk)));
+	assert(NULL != (dst = malloc(dstlen)));
+
+	memset(&cmdp->crb, 0, sizeof(cmdp->crb));
+	put32(cmdp->cpb, in_crc, 0);
+	/* counts are what we are after; any dht will do */
+	dht_lookup(cmdp, dht_default_req, dhthandle);
+
+	while ((srclen = fread(src, 1, chunk, fp)) > 0) {
+		touch_pages(src, srclen, 0);
+		touch_pages(dst, dstlen, 1);
+		tries = 50;
+		do {
+			cc = compress_count(src, srclen, dst, dstlen, cmdp, handle);
+			if (cc == ERR_NX_TRANSLATION)
+				touch_pages((char *)cmdp->crb.csb.fsaddr, 1, 1);
+		} while (cc == ERR_NX_TRANSLATION && --tries > 0);
+
+		if (cc != ERR_NX_OK && cc != ERR_NX_TPBC_GT_SPBC) {
+			fprintf(stderr, "%s: nx error cc= %d\n", fname, cc);
+			break;
+		}
+		if (add_sample((uint32_t *)cmdp->cpb.out_lzcount)) {
+			fprintf(stderr, "out of memory\n");
+			cc = -1;
+			break;
+		}
+	}
+
+	free(src);
+	free(dst);
+	fclose(fp);
+	return (cc == ERR_NX_OK || cc == ERR_NX_TPBC_GT_SPBC) ? 0 : -1;
+}
+
+/* code length estimates of a cluster's summed histogram */
+static void code_lengths(uint64_t *sum, double *len)
+{
+	int i;
+	double tot = 0;
+
+	for (i = 0; i < NSYM; i++)
+		tot += sum[i] + 1;
+	for (i = 0; i < NSYM; i++) {
+		len[i] = log2(tot / (sum[i] + 1));
+		if (len[i] > MAX_CODELEN)
+			len[i] = MAX_CODELEN;
+	}
+}
+
+/* bits to encode the sample with the lengths */
+static double sample_cost(uint32_t *h, double *len)
+{
+	int i;
+	double bits = 0;
+
+	for (i = 0; i < NSYM; i++)
+		bits += h[i] * len[i];
+	return bits;
+}
+
+static void top_keys(uint64_t *sum, int llscan, int *key)
+{
+	int i, j, k;
+
+	for (k = 0; k < 3; k++)
+		key[k] = -1;
+
+	for (i = 0; i < llscan; i++) {
+		for (k = 0; k < 3; k++) {
+			if (key[k] < 0 || sum[i] > sum[key[k]]) {
+				for (j = 2; j > k; j--)
+					key[j] = key[j-1];
+				key[k] = i;
+				break;
+			}
+		}
+	}
+}
+
+/* k-means over the samples; cost is the bits the cluster's code
+   spends on a sample instead of a geometric distance */
+static int cluster(int k, int *member, uint64_t (*sum)[NSYM], long *count)
+{
+	double (*len)[NSYM];
+	double cost, best;
+	long s, changed;
+	int c, i, it, bc;
+
+	assert(NULL != (len = malloc(k * sizeof(*len))));
+
+	/* seed with evenly spaced samples */
+	for (s = 0; s < num_samples; s++)
+		member[s] = (int)((s * k) / num_samples);
+
+	for (it = 0; it < MAX_ITER; it++) {
+		memset(sum, 0, k * sizeof(*sum));
+		memset(count, 0, k * sizeof(*count));
+		for (s = 0; s < num_samples; s++) {
+			for (i = 0; i < NSYM; i++)
+				sum[member[s]][i] += samples[s][i];
+			count[member[s]]++;
+		}
+
+		for (c = 0; c < k; c++)
+			code_lengths(sum[c], len[c]);
+
+		changed = 0;
+		for (s = 0; s < num_samples; s++) {
+			bc = member[s];
+			best = sample_cost(samples[s], len[bc]);
+			for (c = 0; c < k; c++) {
+				if (count[c] == 0)
+					continue;
+				cost = sample_cost(samples[s], len[c]);
+				if (cost < best) {
+					best = cost;
+					bc = c;
+				}
+			}
+			if (bc != member[s]) {
+				member[s] = bc;
+				++changed;
+			}
+		}
+		fprintf(stderr, "iteration %d: %ld samples moved\n", it, changed);
+		if (changed == 0)
+			break;
+	}
+
+	/* sums of the final assignment */
+	memset(sum, 0, k * sizeof(*sum));
+	memset(count, 0, k * sizeof(*count));
+	for (s = 0; s < num_samples; s++) {
+		for (i = 0; i < NSYM; i++)
+			sum[member[s]][i] += samples[s][i];
+		count[member[s]]++;
+	}
+
+	free(len);
+	return 0;
+}
+
+static int make_entry(uint64_t *sum, int llscan, dht_entry_t *d)
+{
+	uint32_t h[NSYM];
+	uint64_t max = 1;
+	int i, shift = 0, dht_num_bytes, dht_num_valid_bits;
+
+	/* dhtgen takes 32 bit counts */
+	for (i = 0; i < NSYM; i++)
+		if (sum[i] > max) max = sum[i];
+	while ((max >> shift) >= (1ULL << 30))
+		++shift;
+	for (i = 0; i < NSYM; i++)
+		h[i] = (uint32_t)(sum[i] >> shift);
+
+	memset(d, 0, sizeof(*d));
+	top_keys(sum, llscan, d->litlen);
+
+	/* makes a universal dht with no missing codes */
+	fill_zero_lzcounts(h, h + LLSZ, 1);
+	dhtgen(h, LLSZ, h + LLSZ, DSZ, d->in_dht_char,
+	       &dht_num_bytes, &dht_num_valid_bits, 0);
+	d->in_dhtlen = 8 * dht_num_bytes - ((dht_num_valid_bits) ? 8 - dht_num_valid_bits : 0);
+	d->valid = 1;
+
+	return 0;
+}
+
+static void usage(char *prog)
+{
+	fprintf(stderr, "usage: %s [-n tables] [-c chunk_bytes] [-l] -o <set file> <file> ...\n", prog);
+	fprintf(stderr, "  -n  number of tables to make, 1 to %d, default 32\n", DHT_NUM_MAX);
+	fprintf(stderr, "  -c  sample size per histogram, default 262144\n");
+	fprintf(stderr, "  -l  key on literals and lengths (NX_GZIP_DHT_CONFIG=1)\n");
+	exit(-1);
+}
+
+int main(int argc, char **argv)
+{
+	int opt, i, c, k = 32, num = 0, llscan = NUMLIT;
+	uint32_t chunk = 1<<18;
+	char *ofile = NULL;
+	void *handle, *dhthandle;
+	int *member, *order;
+	uint64_t (*sum)[NSYM];
+	long *count;
+	dht_entry_t *set;
+
+	while ((opt = getopt(argc, argv, "n:c:lo:")) != -1) {
+		switch (opt) {
+		case 'n': k = atoi(optarg); break;
+		case 'c': chunk = strtoul(optarg, NULL, 0); break;
+		case 'l': llscan = LLSZ; break;
+		case 'o': ofile = optarg; break;
+		default: usage(argv[0]);
+		}
+	}
+	if (ofile == NULL || optind >= argc || k < 1 || k > DHT_NUM_MAX || chunk < 4096)
+		usage(argv[0]);
+
+	handle = nx_function_begin(NX_FUNC_COMP_GZIP, 0);
+	if (!handle) {
+		fprintf(stderr, "Unable to init NX, errno %d\n", errno);
+		exit(-1);
+	}
+	dhthandle = dht_begin(NULL, NULL);
+
+	for (i = optind; i < argc; i++) {
+		if (sample_file(argv[i], chunk, dhthandle, handle))
+			exit(-1);
+	}
+	dht_end(dhthandle);
+	nx_function_end(handle);
+
+	fprintf(stderr, "%ld samples of %u bytes\n", num_samples, chunk);
+	if (num_samples == 0)
+		exit(-1);
+
+	k = NX_MIN(k, num_samples);
+	assert(NULL != (member = malloc(num_samples * sizeof(int))));
+	assert(NULL != (sum = malloc(k * sizeof(*sum))));
+	assert(NULL != (count = malloc(k * sizeof(long))));
+	assert(NULL != (order = malloc(k * sizeof(int))));
+	assert(NULL != (set = calloc(k, sizeof(dht_entry_t))));
+
+	cluster(k, member, sum, count);
+
+	/* largest cluster first; the first entry is the default dht */
+	for (c = 0; c < k; c++)
+		order[c] = c;
+	for (c = 1; c < k; c++) {
+		int t = order[c], j = c;
+		for (; j > 0 && count[order[j-1]] < count[t]; j--)
+			order[j] = order[j-1];
+		order[j] = t;
+	}
+
+	for (c = 0; c < k; c++) {
+		int j, cl = order[c];
+
+		if (count[cl] == 0)
+			continue;
+
+		make_entry(sum[cl], llscan, &set[num]);
+
+		/* the lookup keys on the top two symbols; a later entry
+		   with the same keys would never be found */
+		for (j = 0; j < num; j++)
+			if (set[j].litlen[0] == set[num].litlen[0] &&
+			    set[j].litlen[1] == set[num].litlen[1])
+				break;
+		if (j < num) {
+			fprintf(stderr, "cluster %d (%ld samples) has the keys of table %d; dropped\n",
+				cl, count[cl], j);
+			continue;
+		}
+
+		fprintf(stderr, "table %d: %ld samples, keys {%d, %d, %d}, dht %d bits\n",
+			num, count[cl], set[num].litlen[0], set[num].litlen[1],
+			set[num].litlen[2], set[num].in_dhtlen);
+		++num;
+	}
+
+	if (dht_save_set(ofile, set, num)) {
+		fprintf(stderr, "cannot write %s\n", ofile);
+		exit(-1);
+	}
+	fprintf(stderr, "wrote %d tables to %s\n", num, ofile);
+
+	free(set);
+	free(order);
+	free(count);
+	free(sum);
+	free(member);
+	free(samples);
+
+	return 0;
+}
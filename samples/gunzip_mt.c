@@ -0,0 +1,309 @@
+/*
+ * Parallel gunzip of multi-member gzip files such as bgzip and pigz
+ * output.  Members are located first, then inflated by a pool of
+ * threads, each with its own libnxz stream and therefore its own NX
+ * send window, and written out in order.
+ *
+ * Member boundaries come from the BGZF BSIZE extra field when the
+ * first member has one; otherwise every 1f 8b 08 byte sequence with a
+ * plausible header is a candidate.  A candidate may be a false match
+ * inside compressed data.  Workers inflate all candidates; the writer
+ * accepts only those starting exactly where the previous member
+ * ended, so false matches cost time but not correctness.
+ *
+ * usage: gunzip_mt [-t threads] [-o outfile] file.gz
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/fcntl.h>
+#include <sys/mman.h>
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <zlib.h>
+#include "nx_zlib.h"
+
+#define GZ_HDR_MIN   18           /* header and trailer of an empty member */
+#define IN_CHUNK     (1<<20)      /* input given to inflate at a time */
+#define WINDOW_JOBS  16           /* jobs in flight per thread */
+
+typedef struct job_s {
+	long start;                /* member offset in the input */
+	long len;                  /* BSIZE + 1 if BGZF; else -1 */
+	long in_used;              /* compressed bytes of the member */
+	unsigned char *out;
+	long out_len;
+	int rc;
+	int done;
+} job_t;
+
+static struct {
+	const unsigned char *in;
+	long in_len;
+	job_t *jobs;
+	long njobs;
+	long next;                 /* next job to hand out */
+	long written;              /* jobs the writer is done with */
+	long window;
+	pthread_mutex_t lock;
+	pthread_cond_t ready;      /* a job is done */
+	pthread_cond_t space;      /* the writer freed a slot */
+} q;
+
+static double now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1.0e6;
+}
+
+/* BGZF BSIZE + 1 of the member at p, or -1 if p has no BC subfield */
+static long bgzf_size(const unsigned char *p, long avail)
+{
+	long xlen, i;
+
+	if (avail < 12 || p[0] != 0x1f || p[1] != 0x8b || p[2] != 8 || !(p[3] & 0x04))
+		return -1;
+	xlen = p[10] | (p[11] << 8);
+	if (12 + xlen > avail)
+		return -1;
+	for (i = 12; i + 4 <= 12 + xlen; i += 4 + (p[i+2] | (p[i+3] << 8))) {
+		if (p[i] == 66 && p[i+1] == 67 && p[i+2] == 2 && p[i+3] == 0 && i + 6 <= 12 + xlen)
+			return (p[i+4] | (p[i+5] << 8)) + 1;
+	}
+	return -1;
+}
+
+/* a header that gzip would accept; rfc1952 */
+static int gz_header_ok(const unsigned char *p, long avail)
+{
+	return avail >= GZ_HDR_MIN && p[0] == 0x1f && p[1] == 0x8b && p[2] == 8 &&
+		(p[3] & 0xe0) == 0 && (p[8] == 0 || p[8] == 2 || p[8] == 4) &&
+		(p[9] <= 13 || p[9] == 255);
+}
+
+static int add_job(long start, long len)
+{
+	static long alloc = 0;
+
+	if (q.njobs == alloc) {
+		alloc = alloc ? 2 * alloc : 1024;
+		if (NULL == (q.jobs = realloc(q.jobs, alloc * sizeof(job_t))))
+			return -1;
+	}
+	memset(&q.jobs[q.njobs], 0, sizeof(job_t));
+	q.jobs[q.njobs].start = start;
+	q.jobs[q.njobs].len = len;
+	++q.njobs;
+	return 0;
+}
+
+/* find member starts; BGZF chains them, others are scanned for */
+static int find_members(void)
+{
+	const unsigned char *p;
+	long off, len;
+
+	if (bgzf_size(q.in, q.in_len) > 0) {
+		for (off = 0; off < q.in_len; off += len) {
+			len = bgzf_size(q.in + off, q.in_len - off);
+			if (len < GZ_HDR_MIN || off + len > q.in_len) {
+				fprintf(stderr, "bad BGZF block at %ld\n", off);
+				return -1;
+			}
+			if (add_job(off, len))
+				return -1;
+		}
+		return 0;
+	}
+
+	for (off = 0; off < q.in_len; off = p - q.in + 1) {
+		p = memchr(q.in + off, 0x1f, q.in_len - off);
+		if (p == NULL)
+			break;
+		if (gz_header_ok(p, q.in_len - (p - q.in)) && add_job(p - q.in, -1))
+			return -1;
+	}
+	return 0;
+}
+
+/* inflate one member; input is fed in chunks so that libnxz sizes its
+   buffers for the chunk and not for the rest of the file */
+static void inflate_member(z_stream *strm, job_t *j)
+{
+	long end = (j->len > 0) ? j->start + j->len : q.in_len;
+	long out_alloc = (j->len > 0) ? 4 * j->len : 4 * IN_CHUNK;
+	int rc;
+
+	j->rc = Z_MEM_ERROR;
+	if (Z_OK != nx_inflateReset(strm))
+		return;
+	if (NULL == (j->out = malloc(out_alloc)))
+		return;
+
+	strm->next_in = (unsigned char *)q.in + j->start;
+	strm->avail_in = 0;
+	strm->next_out = j->out;
+	strm->avail_out = out_alloc;
+
+	do {
+		if (strm->avail_in == 0)
+			strm->avail_in = NX_MIN(IN_CHUNK, end - j->start - (long)strm->total_in);
+		if (strm->avail_out == 0) {
+			unsigned char *o = realloc(j->out, 2 * out_alloc);
+			if (o == NULL)
+				break;
+			j->out = o;
+			strm->next_out = o + out_alloc;
+			strm->avail_out = out_alloc;
+			out_alloc = 2 * out_alloc;
+		}
+		rc = nx_inflate(strm, Z_NO_FLUSH);
+	} while (rc == Z_OK && (strm->avail_in > 0 || strm->avail_out == 0 ||
+				j->start + strm->total_in < end));
+
+	j->rc = rc;
+	j->in_used = strm->total_in;
+	j->out_len = strm->total_out;
+}
+
+static void *worker(void *arg)
+{
+	z_stream strm;
+	job_t *j;
+
+	memset(&strm, 0, sizeof(strm));
+	if (Z_OK != nx_inflateInit2(&strm, 16 + 15)) {
+		fprintf(stderr, "cannot open an NX stream\n");
+		exit(-1);
+	}
+
+	for (;;) {
+		pthread_mutex_lock(&q.lock);
+		while (q.next < q.njobs && q.next >= q.written + q.window)
+			pthread_cond_wait(&q.space, &q.lock);
+		if (q.next >= q.njobs) {
+			pthread_mutex_unlock(&q.lock);
+			break;
+		}
+		j = &q.jobs[q.next++];
+		pthread_mutex_unlock(&q.lock);
+
+		inflate_member(&strm, j);
+
+		pthread_mutex_lock(&q.lock);
+		j->done = 1;
+		pthread_cond_broadcast(&q.ready);
+		pthread_mutex_unlock(&q.lock);
+	}
+
+	nx_inflateEnd(&strm);
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	int nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	const char *ofile = NULL;
+	pthread_t *th;
+	struct stat st;
+	FILE *fout = stdout;
+	long i, pos, members = 0, out_total = 0;
+	double t;
+	int fd, c;
+
+	while ((c = getopt(argc, argv, "t:o:")) != -1) {
+		switch (c) {
+		case 't': nthreads = atoi(optarg); break;
+		case 'o': ofile = optarg; break;
+		default:
+			fprintf(stderr, "usage: %s [-t threads] [-o outfile] file.gz\n", argv[0]);
+			return -1;
+		}
+	}
+	if (optind >= argc || nthreads < 1) {
+		fprintf(stderr, "usage: %s [-t threads] [-o outfile] file.gz\n", argv[0]);
+		return -1;
+	}
+
+	if ((fd = open(argv[optind], O_RDONLY)) < 0 || fstat(fd, &st) != 0) {
+		perror(argv[optind]);
+		return -1;
+	}
+	q.in_len = st.st_size;
+	q.in = mmap(NULL, q.in_len, PROT_READ, MAP_PRIVATE, fd, 0);
+	assert(q.in != MAP_FAILED);
+	if (ofile != NULL && NULL == (fout = fopen(ofile, "w"))) {
+		perror(ofile);
+		return -1;
+	}
+
+	t = now();
+	if (find_members() != 0 || q.njobs == 0) {
+		fprintf(stderr, "no gzip members found\n");
+		return -1;
+	}
+
+	q.window = (long)nthreads * WINDOW_JOBS;
+	pthread_mutex_init(&q.lock, NULL);
+	pthread_cond_init(&q.ready, NULL);
+	pthread_cond_init(&q.space, NULL);
+	assert(NULL != (th = malloc(nthreads * sizeof(pthread_t))));
+	for (i = 0; i < nthreads; i++)
+		assert(0 == pthread_create(&th[i], NULL, worker, NULL));
+
+	/* write in order; accept only members that start where the
+	   previous one ended */
+	for (i = 0, pos = 0; i < q.njobs; i++) {
+		job_t *j = &q.jobs[i];
+
+		pthread_mutex_lock(&q.lock);
+		while (!j->done)
+			pthread_cond_wait(&q.ready, &q.lock);
+		pthread_mutex_unlock(&q.lock);
+
+		if (j->start == pos) {
+			if (j->rc != Z_STREAM_END) {
+				fprintf(stderr, "member at %ld: inflate rc %d\n", j->start, j->rc);
+				return -1;
+			}
+			if (j->out_len != fwrite(j->out, 1, j->out_len, fout)) {
+				perror("write");
+				return -1;
+			}
+			pos += j->in_used;
+			out_total += j->out_len;
+			++members;
+		}
+		else if (j->start > pos) {
+			fprintf(stderr, "no gzip member at %ld\n", pos);
+			return -1;
+		}
+		free(j->out);
+		j->out = NULL;
+
+		pthread_mutex_lock(&q.lock);
+		q.written = i + 1;
+		pthread_cond_broadcast(&q.space);
+		pthread_mutex_unlock(&q.lock);
+	}
+
+	for (i = 0; i < nthreads; i++)
+		pthread_join(th[i], NULL);
+	t = now() - t;
+
+	if (pos != q.in_len)
+		fprintf(stderr, "%ld bytes of trailing garbage ignored\n", q.in_len - pos);
+	fprintf(stderr, "%ld members, %ld candidates, %ld MiB out in %.3f secs, %.1f MiB/s, %d threads\n",
+		members, q.njobs, out_total >> 20, t, out_total / (1024.0 * 1024.0) / t, nthreads);
+
+	fclose(fout);
+	return 0;
+}
@@ -0,0 +1,742 @@
+/*
+ * Parallel gunzip of a single-member gzip file by speculative decoding.
+ *
+ * The compressed file is cut into chunks.  Chunk 0 is inflated by NX
+ * from the gzip header on.  Each other chunk is decoded on a CPU core
+ * from the first plausible dynamic block header at or after its
+ * nominal start; back-references reaching before the chunk, in to
+ * the yet unknown 32KB window, are kept as placeholders.  Every chunk
+ * stops at the first block boundary at or after the next chunk's
+ * nominal start, so the true end of chunk i is the true start of
+ * chunk i+1.
+ *
+ * The writer walks the chunks in order.  A speculative chunk is used
+ * only if it started exactly where the previous one ended; its
+ * placeholders are then patched from the now known window and its
+ * crc combined with the running crc.  Otherwise, e.g. the block
+ * header found was a false match, the chunk is decoded again with the
+ * window known.  Output is therefore always correct; a bad guess only
+ * costs time.
+ *
+ * usage: gunzip_spec [-t threads] [-c chunk MiB] [-o outfile] file.gz
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <endian.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/fcntl.h>
+#include <sys/mman.h>
+#include <assert.h>
+#include <pthread.h>
+#include <zlib.h>
+#include "nx_zlib.h"
+
+#if defined(__POWER9_VECTOR__)
+#include <altivec.h>
+#define SPEC_VSX
+#endif
+
+#define WSIZE        (1<<15)      /* deflate window */
+#define PH           0x8000       /* placeholder: PH | window index */
+#define IN_CHUNK     (1<<20)      /* input given to nx_inflate at a time */
+#define WINDOW_JOBS  4            /* chunks in flight per thread */
+
+/* software inflate state; symbols are 16 bits wide to hold placeholders */
+typedef struct {
+	const unsigned char *in;
+	long in_len;
+	long pos;                  /* next byte to load in to bitbuf */
+	uint64_t bitbuf;
+	int bitcnt;
+	const unsigned char *win;  /* known window, or NULL to speculate */
+	uint16_t *out;
+	long len;
+	long alloc;
+	long ph;                   /* placeholders emitted */
+	int final;
+	int litbits, distbits;
+	uint16_t lit[1<<15];       /* entries are symbol << 4 | code length */
+	uint16_t dist[1<<15];
+} inf_t;
+
+typedef struct {
+	long start;                /* nominal start and stop bytes */
+	long stop;
+	uint64_t start_bit;        /* actual block boundaries */
+	uint64_t end_bit;
+	uint16_t *sym;
+	long len;
+	long ph;
+	int ok;
+	int final;
+	int done;
+} chunk_t;
+
+static struct {
+	const unsigned char *in;
+	long in_len;
+	chunk_t *chunks;
+	long n;
+	long next;
+	long written;
+	long window;
+	pthread_mutex_t lock;
+	pthread_cond_t ready;
+	pthread_cond_t space;
+} q;
+
+static const uint16_t len_base[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t len_extra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t dist_base[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+	8193, 12289, 16385, 24577 };
+static const uint8_t dist_extra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+static const uint8_t clen_order[19] = {
+	16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+static double now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1.0e6;
+}
+
+static inline uint64_t bitpos(inf_t *s)
+{
+	return (uint64_t)s->pos * 8 - s->bitcnt;
+}
+
+static void seek_bit(inf_t *s, uint64_t bit)
+{
+	s->pos = bit / 8;
+	s->bitbuf = 0;
+	s->bitcnt = 0;
+	if (bit % 8) {
+		s->bitbuf = s->in[s->pos++] >> (bit % 8);
+		s->bitcnt = 8 - bit % 8;
+	}
+}
+
+/* at least 56 valid bits after; past the input end zeros are shifted
+   in and the callers check pos against in_len */
+static inline void refill(inf_t *s)
+{
+	if (s->pos + 8 <= s->in_len) {
+		uint64_t w;
+		memcpy(&w, s->in + s->pos, 8);
+		s->bitbuf |= le64toh(w) << s->bitcnt;
+		s->pos += (63 - s->bitcnt) >> 3;
+		s->bitcnt |= 56;
+		return;
+	}
+	while (s->bitcnt <= 56) {
+		if (s->pos < s->in_len)
+			s->bitbuf |= (uint64_t)s->in[s->pos] << s->bitcnt;
+		s->pos++;
+		s->bitcnt += 8;
+	}
+}
+
+static inline unsigned bits(inf_t *s, int n)
+{
+	unsigned v = s->bitbuf & ((1ULL << n) - 1);
+	s->bitbuf >>= n;
+	s->bitcnt -= n;
+	return v;
+}
+
+static inline int decode(inf_t *s, const uint16_t *t, int tbits)
+{
+	uint16_t e = t[s->bitbuf & ((1U << tbits) - 1)];
+	int n = e & 15;
+
+	s->bitbuf >>= n;
+	s->bitcnt -= n;
+	return n ? (e >> 4) : -1;
+}
+
+/* canonical huffman lookup table over the longest code; incomplete
+   codes are allowed only for a single code of length 1, as in zlib,
+   and never for the code length code */
+static int build(uint16_t *t, int *tbits, const uint8_t *lens, int n, int incomplete_ok)
+{
+	int count[16] = {0}, next[16];
+	int i, len, maxbits = 0, left = 1, code = 0;
+
+	for (i = 0; i < n; i++) {
+		count[lens[i]]++;
+		maxbits = NX_MAX(maxbits, lens[i]);
+	}
+	if (maxbits == 0) {
+		*tbits = 1;
+		t[0] = t[1] = 0;
+		return incomplete_ok ? 0 : -1;
+	}
+	for (len = 1; len < 16; len++) {
+		left = (left << 1) - count[len];
+		if (left < 0)
+			return -1;
+	}
+	if (left > 0 && (!incomplete_ok || maxbits != 1))
+		return -1;
+
+	count[0] = 0;
+	for (len = 1; len < 16; len++) {
+		code = (code + count[len - 1]) << 1;
+		next[len] = code;
+	}
+	memset(t, 0, sizeof(uint16_t) << maxbits);
+	for (i = 0; i < n; i++) {
+		int rev = 0, k;
+		if ((len = lens[i]) == 0)
+			continue;
+		code = next[len]++;
+		for (k = 0; k < len; k++)
+			rev |= ((code >> k) & 1) << (len - 1 - k);
+		for (k = rev; k < (1 << maxbits); k += 1 << len)
+			t[k] = (i << 4) | len;
+	}
+	*tbits = maxbits;
+	return 0;
+}
+
+static int grow(inf_t *s, long need)
+{
+	uint16_t *o;
+	long alloc = NX_MAX(2 * s->alloc, need + (1<<20));
+
+	if (NULL == (o = realloc(s->out, alloc * sizeof(uint16_t))))
+		return -1;
+	s->out = o;
+	s->alloc = alloc;
+	return 0;
+}
+
+static int dynamic_tables(inf_t *s)
+{
+	uint8_t lens[286 + 30], clens[19] = {0};
+	int hlit, hdist, hclen, i, sym, rep, tb;
+
+	refill(s);
+	hlit = bits(s, 5) + 257;
+	hdist = bits(s, 5) + 1;
+	hclen = bits(s, 4) + 4;
+	if (hlit > 286 || hdist > 30)
+		return -1;
+	for (i = 0; i < hclen; i++) {
+		refill(s);
+		clens[clen_order[i]] = bits(s, 3);
+	}
+	if (build(s->lit, &tb, clens, 19, 0) != 0)
+		return -1;
+
+	for (i = 0; i < hlit + hdist; ) {
+		refill(s);
+		if ((sym = decode(s, s->lit, tb)) < 0)
+			return -1;
+		if (sym < 16) {
+			lens[i++] = sym;
+			continue;
+		}
+		if (sym == 16) {
+			if (i == 0)
+				return -1;
+			sym = lens[i - 1];
+			rep = 3 + bits(s, 2);
+		}
+		else {
+			rep = (sym == 17) ? 3 + bits(s, 3) : 11 + bits(s, 7);
+			sym = 0;
+		}
+		if (i + rep > hlit + hdist)
+			return -1;
+		while (rep--)
+			lens[i++] = sym;
+	}
+	if (lens[256] == 0)
+		return -1;
+	if (build(s->lit, &s->litbits, lens, hlit, 1) != 0 ||
+	    build(s->dist, &s->distbits, lens + hlit, hdist, 1) != 0)
+		return -1;
+	return 0;
+}
+
+static void fixed_tables(inf_t *s)
+{
+	uint8_t lens[288];
+
+	memset(lens, 8, 144);
+	memset(lens + 144, 9, 112);
+	memset(lens + 256, 7, 24);
+	memset(lens + 280, 8, 8);
+	build(s->lit, &s->litbits, lens, 288, 0);
+	memset(lens, 5, 32);
+	build(s->dist, &s->distbits, lens, 32, 0);
+}
+
+static int stored(inf_t *s)
+{
+	long p = s->pos - s->bitcnt / 8;  /* drops the bits to the byte */
+	unsigned len;
+
+	if (p + 4 > s->in_len)
+		return -1;
+	len = s->in[p] | (s->in[p + 1] << 8);
+	if ((len ^ 0xffff) != (s->in[p + 2] | (s->in[p + 3] << 8)) || p + 4 + len > s->in_len)
+		return -1;
+	if (s->len + len > s->alloc && grow(s, s->len + len))
+		return -1;
+	for (p += 4; len > 0; len--)
+		s->out[s->len++] = s->in[p++];
+	seek_bit(s, (uint64_t)p * 8);
+	return 0;
+}
+
+/* one block; header included */
+static int inf_block(inf_t *s)
+{
+	int type, sym, d;
+	long n, src;
+
+	refill(s);
+	s->final = bits(s, 1);
+	type = bits(s, 2);
+	if (type == 0)
+		return stored(s);
+	if (type == 1)
+		fixed_tables(s);
+	else if (type == 3 || dynamic_tables(s) != 0)
+		return -1;
+
+	for (;;) {
+		if (s->pos > s->in_len + 8)
+			return -1;
+		if (s->len + 258 > s->alloc && grow(s, s->len + 258))
+			return -1;
+		refill(s);
+		sym = decode(s, s->lit, s->litbits);
+		if (sym < 256) {
+			if (sym < 0)
+				return -1;
+			s->out[s->len++] = sym;
+			continue;
+		}
+		if (sym == 256)
+			break;
+		if ((sym -= 257) >= 29)
+			return -1;
+		n = len_base[sym] + bits(s, len_extra[sym]);
+		if ((sym = decode(s, s->dist, s->distbits)) < 0 || sym >= 30)
+			return -1;
+		d = dist_base[sym] + bits(s, dist_extra[sym]);
+
+		src = s->len - d;
+		if (src >= 0) {
+			uint16_t *o = s->out + s->len;
+			s->len += n;
+			while (n--) {
+				*o = o[-d];
+				o++;
+			}
+			continue;
+		}
+		/* reaches before this chunk */
+		for (; n > 0; n--, src++) {
+			if (src >= 0)
+				s->out[s->len] = s->out[src];
+			else if (s->win)
+				s->out[s->len] = s->win[WSIZE + src];
+			else {
+				s->out[s->len] = PH | (WSIZE + src);
+				s->ph++;
+			}
+			s->len++;
+		}
+	}
+	return (bitpos(s) <= (uint64_t)s->in_len * 8) ? 0 : -1;
+}
+
+/* decode blocks until a block boundary at or after stop_bit, or the
+   end of the final block */
+static int inf_run(inf_t *s, uint64_t stop_bit, uint64_t *end_bit)
+{
+	while (bitpos(s) < stop_bit) {
+		if (inf_block(s) != 0)
+			return -1;
+		if (s->final)
+			break;
+	}
+	*end_bit = bitpos(s);
+	return 0;
+}
+
+/* first bit in [from, to) where a non-final dynamic block decodes
+   cleanly and is followed by a valid block type; the block's output
+   is left in s */
+static int inf_find(inf_t *s, uint64_t from, uint64_t to, uint64_t *found)
+{
+	uint64_t b;
+	long p;
+
+	for (b = from; b < to; b++) {
+		p = b / 8;
+		if (p + 2 > s->in_len)
+			break;
+		if ((((s->in[p] | (s->in[p + 1] << 8)) >> (b % 8)) & 7) != 4)
+			continue;
+		seek_bit(s, b);
+		s->len = 0;
+		s->ph = 0;
+		if (inf_block(s) != 0 || s->final)
+			continue;
+		refill(s);
+		if (((s->bitbuf >> 1) & 3) == 3)
+			continue;
+		*found = b;
+		return 0;
+	}
+	return -1;
+}
+
+static inf_t *inf_new(const unsigned char *win)
+{
+	inf_t *s = malloc(sizeof(inf_t));
+
+	if (s == NULL)
+		return NULL;
+	memset(s, 0, offsetof(inf_t, lit));
+	s->in = q.in;
+	s->in_len = q.in_len;
+	s->win = win;
+	return s;
+}
+
+/* symbols to bytes; placeholders are looked up in the window */
+static void resolve_sym(unsigned char *dst, const uint16_t *src, long len, const unsigned char *win)
+{
+	long i;
+
+	for (i = 0; i < len; i++)
+		dst[i] = (src[i] & PH) ? win[src[i] & (WSIZE - 1)] : src[i];
+}
+
+/* literal runs are narrowed a vector at a time; a vector holding a
+   placeholder is patched from the window one symbol at a time as
+   there is no byte gather, and the loop carries on */
+static void resolve(unsigned char *dst, const uint16_t *src, long len, const unsigned char *win)
+{
+	long i = 0;
+
+#if defined(SPEC_VSX)
+	vector unsigned short lim = vec_splats((unsigned short)255);
+
+	for (; i + 16 <= len; i += 16) {
+		vector unsigned short a = vec_xl(0, src + i);
+		vector unsigned short b = vec_xl(0, src + i + 8);
+		if (vec_any_gt(vec_max(a, b), lim))
+			resolve_sym(dst + i, src + i, 16, win);
+		else
+			vec_xst(vec_pack(a, b), 0, dst + i);
+	}
+#else
+	for (; i + 4 <= len; i += 4) {
+		uint64_t w;
+		memcpy(&w, src + i, 8);
+		if (w & 0xff00ff00ff00ff00ULL) {
+			resolve_sym(dst + i, src + i, 4, win);
+			continue;
+		}
+		dst[i] = src[i];
+		dst[i + 1] = src[i + 1];
+		dst[i + 2] = src[i + 2];
+		dst[i + 3] = src[i + 3];
+	}
+#endif
+	resolve_sym(dst + i, src + i, len - i, win);
+}
+
+static void *worker(void *arg)
+{
+	inf_t *s = inf_new(NULL);
+	chunk_t *c;
+
+	assert(s != NULL);
+	for (;;) {
+		pthread_mutex_lock(&q.lock);
+		while (q.next < q.n && q.next >= q.written + q.window)
+			pthread_cond_wait(&q.space, &q.lock);
+		if (q.next >= q.n) {
+			pthread_mutex_unlock(&q.lock);
+			break;
+		}
+		c = &q.chunks[q.next++];
+		pthread_mutex_unlock(&q.lock);
+
+		c->ok = inf_find(s, (uint64_t)c->start * 8, (uint64_t)c->stop * 8, &c->start_bit) == 0 &&
+			inf_run(s, (c->stop < q.in_len) ? (uint64_t)c->stop * 8 : UINT64_MAX, &c->end_bit) == 0;
+		if (c->ok) {
+			c->sym = s->out;
+			c->len = s->len;
+			c->ph = s->ph;
+			c->final = s->final;
+			s->out = NULL;
+			s->alloc = 0;
+		}
+
+		pthread_mutex_lock(&q.lock);
+		c->done = 1;
+		pthread_cond_broadcast(&q.ready);
+		pthread_mutex_unlock(&q.lock);
+	}
+	free(s->out);
+	free(s);
+	return NULL;
+}
+
+/* chunk 0 on NX; Z_BLOCK stops at every block boundary */
+static int nx_chunk0(unsigned char **out, long *out_len, uint64_t stop_bit, uint64_t *end_bit, int *final)
+{
+	z_stream strm;
+	long alloc = 4 * IN_CHUNK;
+	unsigned char *o;
+	int rc = Z_MEM_ERROR;
+
+	*final = 0;
+	memset(&strm, 0, sizeof(strm));
+	if (Z_OK != nx_inflateInit2(&strm, 16 + 15))
+		return -1;
+	if (NULL == (*out = malloc(alloc)))
+		return -1;
+	strm.next_in = (unsigned char *)q.in;
+	strm.avail_in = 0;
+	strm.next_out = *out;
+	strm.avail_out = alloc;
+
+	for (;;) {
+		if (strm.avail_in == 0)
+			strm.avail_in = NX_MIN(IN_CHUNK, q.in_len - (long)strm.total_in);
+		if (strm.avail_out == 0) {
+			if (NULL == (o = realloc(*out, 2 * alloc)))
+				break;
+			*out = o;
+			strm.next_out = o + alloc;
+			strm.avail_out = alloc;
+			alloc = 2 * alloc;
+		}
+		rc = nx_inflate(&strm, Z_BLOCK);
+		if (rc == Z_STREAM_END) {
+			*final = 1;
+			break;
+		}
+		if (rc != Z_OK)
+			break;
+		if ((strm.data_type & 128) && !(strm.data_type & 64) &&
+		    strm.total_in * 8 - (strm.data_type & 7) >= stop_bit) {
+			*end_bit = strm.total_in * 8 - (strm.data_type & 7);
+			break;
+		}
+	}
+	*out_len = strm.total_out;
+	nx_inflateEnd(&strm);
+	return (rc == Z_OK || rc == Z_STREAM_END) ? 0 : rc;
+}
+
+static struct {
+	FILE *fp;
+	unsigned char win[WSIZE];
+	unsigned long crc;
+	uint64_t total;
+} w;
+
+static int emit(const unsigned char *buf, long len)
+{
+	if (len != fwrite(buf, 1, len, w.fp))
+		return -1;
+	w.crc = nx_crc32_combine(w.crc, nx_crc32(0, buf, len), len);
+	w.total += len;
+	if (len >= WSIZE)
+		memcpy(w.win, buf + len - WSIZE, WSIZE);
+	else {
+		memmove(w.win, w.win + len, WSIZE - len);
+		memcpy(w.win + WSIZE - len, buf, len);
+	}
+	return 0;
+}
+
+static int emit_sym(const uint16_t *sym, long len)
+{
+	static unsigned char *buf;
+	static long alloc;
+
+	if (len > alloc) {
+		free(buf);
+		alloc = len;
+		if (NULL == (buf = malloc(alloc)))
+			return -1;
+	}
+	resolve(buf, sym, len, w.win);
+	return emit(buf, len);
+}
+
+int main(int argc, char **argv)
+{
+	int nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	long chunk = 4L << 20;
+	const char *ofile = NULL;
+	unsigned char *out0;
+	long i, k, out0_len, used = 0, redone = 0, ph = 0;
+	uint64_t pos_bit = 0, end_bit;
+	int fd, c, final, verified;
+	pthread_t *th;
+	struct stat st;
+	inf_t *s;
+	double t;
+
+	while ((c = getopt(argc, argv, "t:c:o:")) != -1) {
+		switch (c) {
+		case 't': nthreads = atoi(optarg); break;
+		case 'c': chunk = atol(optarg) << 20; break;
+		case 'o': ofile = optarg; break;
+		default:
+			fprintf(stderr, "usage: %s [-t threads] [-c chunk MiB] [-o outfile] file.gz\n", argv[0]);
+			return -1;
+		}
+	}
+	if (optind >= argc || nthreads < 1 || chunk <= 0) {
+		fprintf(stderr, "usage: %s [-t threads] [-c chunk MiB] [-o outfile] file.gz\n", argv[0]);
+		return -1;
+	}
+
+	if ((fd = open(argv[optind], O_RDONLY)) < 0 || fstat(fd, &st) != 0) {
+		perror(argv[optind]);
+		return -1;
+	}
+	q.in_len = st.st_size;
+	q.in = mmap(NULL, q.in_len, PROT_READ, MAP_PRIVATE, fd, 0);
+	assert(q.in != MAP_FAILED);
+	w.fp = stdout;
+	if (ofile != NULL && NULL == (w.fp = fopen(ofile, "w"))) {
+		perror(ofile);
+		return -1;
+	}
+
+	t = now();
+	q.n = NX_MAX(1, q.in_len / chunk);
+	assert(NULL != (q.chunks = calloc(q.n, sizeof(chunk_t))));
+	for (i = 0; i < q.n; i++) {
+		q.chunks[i].start = i * chunk;
+		q.chunks[i].stop = (i + 1 < q.n) ? (i + 1) * chunk : q.in_len;
+	}
+	q.next = 1;
+	q.written = 1;
+	q.window = (long)nthreads * WINDOW_JOBS;
+	pthread_mutex_init(&q.lock, NULL);
+	pthread_cond_init(&q.ready, NULL);
+	pthread_cond_init(&q.space, NULL);
+	assert(NULL != (th = malloc(nthreads * sizeof(pthread_t))));
+	for (i = 0; i < nthreads; i++)
+		assert(0 == pthread_create(&th[i], NULL, worker, NULL));
+
+	if (nx_chunk0(&out0, &out0_len, (q.n > 1) ? (uint64_t)q.chunks[0].stop * 8 : UINT64_MAX,
+		      &pos_bit, &final) != 0) {
+		fprintf(stderr, "inflate of the first chunk failed\n");
+		return -1;
+	}
+	verified = final;
+	if (emit(out0, out0_len) != 0) {
+		perror("write");
+		return -1;
+	}
+	free(out0);
+
+	assert(NULL != (s = inf_new(w.win)));
+	for (k = 1; !final; k++) {
+		chunk_t *ck = &q.chunks[k];
+
+		if (k >= q.n) {
+			fprintf(stderr, "deflate stream does not end\n");
+			return -1;
+		}
+		pthread_mutex_lock(&q.lock);
+		while (!ck->done)
+			pthread_cond_wait(&q.ready, &q.lock);
+		pthread_mutex_unlock(&q.lock);
+
+		if (ck->ok && ck->start_bit == pos_bit) {
+			++used;
+			ph += ck->ph;
+			pos_bit = ck->end_bit;
+			final = ck->final;
+			c = emit_sym(ck->sym, ck->len);
+		}
+		else {
+			/* a false start; decode again knowing the window */
+			++redone;
+			seek_bit(s, pos_bit);
+			s->len = 0;
+			if (inf_run(s, (ck->stop < q.in_len) ? (uint64_t)ck->stop * 8 : UINT64_MAX, &end_bit) != 0) {
+				fprintf(stderr, "invalid deflate data at bit %lu\n", (unsigned long)pos_bit);
+				return -1;
+			}
+			pos_bit = end_bit;
+			final = s->final;
+			c = emit_sym(s->out, s->len);
+		}
+		if (c != 0) {
+			perror("write");
+			return -1;
+		}
+		free(ck->sym);
+		ck->sym = NULL;
+
+		pthread_mutex_lock(&q.lock);
+		q.written = k + 1;
+		pthread_cond_broadcast(&q.space);
+		pthread_mutex_unlock(&q.lock);
+	}
+
+	/* stop handing out chunks past the end of the stream */
+	pthread_mutex_lock(&q.lock);
+	q.next = q.n;
+	pthread_cond_broadcast(&q.space);
+	pthread_mutex_unlock(&q.lock);
+	for (i = 0; i < nthreads; i++)
+		pthread_join(th[i], NULL);
+	t = now() - t;
+
+	if (!verified) {
+		const unsigned char *p = q.in + (pos_bit + 7) / 8;
+		if (p + 8 > q.in + q.in_len ||
+		    (p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24) != (uint32_t)w.crc ||
+		    (p[4] | p[5] << 8 | p[6] << 16 | (uint32_t)p[7] << 24) != (uint32_t)w.total) {
+			fprintf(stderr, "gzip trailer mismatch\n");
+			return -1;
+		}
+	}
+
+	fprintf(stderr, "%lu MiB out in %.3f secs, %.1f MiB/s, %d threads\n",
+		(unsigned long)(w.total >> 20), t, w.total / (1024.0 * 1024.0) / t, nthreads);
+	fprintf(stderr, "%ld chunks: %ld speculative used, %ld decoded again, %ld placeholders patched\n",
+		q.n, used, redone, ph);
+
+	for (i = 0; i < q.n; i++)
+		free(q.chunks[i].sym);
+	free(s->out);
+	free(s);
+	fclose(w.fp);
+	return 0;
+}
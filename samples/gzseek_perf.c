@@ -0,0 +1,117 @@
+/*
+ * Random 4KB reads out of a .gz file with a checkpoint index versus
+ * full decompression.
+ *
+ * Inflates the whole file once while recording checkpoints every span
+ * MiB, saves the index next to the file as file.nxidx, loads it back
+ * in to a new stream and times reads of 4KB at random offsets, each
+ * one seeking to the nearest checkpoint first.
+ *
+ * usage: gzseek_perf file.gz [span MiB] [number of reads]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include "nx_zlib.h"
+
+#define READ_SZ  4096
+#define CHUNK    (1<<20)
+
+static double now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1.0e6;
+}
+
+/* inflate until total_out reaches end; returns the last inflate rc */
+static int inflate_to(z_stream *strm, unsigned char *out, uint64_t end)
+{
+	int rc = Z_OK;
+
+	while (rc == Z_OK && strm->total_out < end) {
+		strm->next_out = out;
+		strm->avail_out = NX_MIN(CHUNK, end - strm->total_out);
+		rc = nx_inflate(strm, Z_NO_FLUSH);
+	}
+	return rc;
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t span, in_off, out_off, total, offset;
+	long reads, i, skipped = 0;
+	unsigned char *in, *out;
+	char idxname[1024];
+	struct stat st;
+	z_stream strm;
+	double t_full, t_read;
+	FILE *fp;
+	int rc;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s file.gz [span MiB] [number of reads]\n", argv[0]);
+		return -1;
+	}
+	span  = ((argc > 2) ? atol(argv[2]) : 4) << 20;
+	reads = (argc > 3) ? atol(argv[3]) : 1000;
+	snprintf(idxname, sizeof(idxname), "%s.nxidx", argv[1]);
+
+	assert(0 == stat(argv[1], &st));
+	assert(NULL != (in = malloc(st.st_size)));
+	assert(NULL != (out = malloc(CHUNK)));
+	assert(NULL != (fp = fopen(argv[1], "r")));
+	assert(st.st_size == fread(in, 1, st.st_size, fp));
+	fclose(fp);
+
+	/* full decompression building the index */
+	memset(&strm, 0, sizeof(strm));
+	assert(Z_OK == nx_inflateInit2(&strm, 16 + 15));
+	assert(Z_OK == nx_inflateIndex(&strm, span));
+	strm.next_in = in;
+	strm.avail_in = st.st_size;
+	t_full = now();
+	rc = inflate_to(&strm, out, UINT64_MAX);
+	t_full = now() - t_full;
+	assert(rc == Z_STREAM_END);
+	total = strm.total_out;
+	assert(Z_OK == nx_inflateIndexSave(&strm, idxname));
+	nx_inflateEnd(&strm);
+
+	printf("%s: %ld MiB in %.3f secs, %.1f MiB/s\n", argv[1], (long)(total >> 20),
+	       t_full, total / (1024.0 * 1024.0) / t_full);
+
+	/* random reads through the saved index */
+	memset(&strm, 0, sizeof(strm));
+	assert(Z_OK == nx_inflateInit2(&strm, 16 + 15));
+	assert(Z_OK == nx_inflateIndexLoad(&strm, idxname));
+
+	srand(1);
+	t_read = now();
+	for (i = 0; i < reads; i++) {
+		offset = (((uint64_t)rand() << 31) | rand()) % (total > READ_SZ ? total - READ_SZ : 1);
+		assert(Z_OK == nx_inflate_seek(&strm, offset, &in_off, &out_off));
+		strm.next_in = in + in_off;
+		strm.avail_in = st.st_size - in_off;
+		rc = inflate_to(&strm, out, offset + READ_SZ);
+		assert(rc == Z_OK || rc == Z_STREAM_END);
+		skipped += offset - out_off;
+	}
+	t_read = now() - t_read;
+	nx_inflateEnd(&strm);
+
+	printf("%ld random %d byte reads, span %ld MiB: %.3f ms per read, %.1f KiB skipped per read\n",
+	       reads, READ_SZ, (long)(span >> 20), t_read * 1000 / reads,
+	       skipped / 1024.0 / reads);
+	printf("full decompression per read would be %.3f ms, %.0fx\n",
+	       t_full * 1000, t_full * reads / t_read);
+
+	free(in);
+	free(out);
+	return 0;
+}
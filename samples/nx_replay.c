@@ -0,0 +1,228 @@
+/*
+ * Replays an NX job trace, written with NX_GZIP_JOB_TRACE=file and
+ * NX_GZIP_JOB_TRACE_PAYLOAD=1, to reproduce and time the jobs of an
+ * application outside it.  Each job is submitted again with its
+ * function code, CPB input and source bytes in to a target of the
+ * recorded size.  Prints for each function code the jobs, the
+ * recorded and replayed p50/p99 latency, and the jobs whose cc or
+ * tpbc differ from the recording.  Recorded page faults are counted
+ * but not replayed, as they depend on the memory of the application.
+ *
+ * nx_replay_zlib, built from this file with -DREPLAY_ZLIB, runs the
+ * same jobs with zlib instead: inflate of decompress jobs with the
+ * history as the dictionary, raw deflate level 1 of compress jobs,
+ * and memcpy with crc32 and adler32 of wrap jobs.  Decompress jobs
+ * resumed within a block have no zlib equivalent and are skipped.
+ *
+ * Without payload only the recorded figures are printed.
+ *
+ * usage: nx_replay [-n repeat] trace
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "nx_zlib.h"
+
+struct fc_stats {
+	uint64_t rec[NX_LAT_SLOTS];	/* recorded latency */
+	uint64_t rep[NX_LAT_SLOTS];	/* replayed */
+	long jobs, replayed, faults, skipped, cc_diff, tpbc_diff;
+};
+
+static struct fc_stats st[NX_FC_SLOTS];
+static nx_gzip_crb_cpb_t cmd;
+static char *src, *dst;
+static uint32_t src_sz, dst_sz;
+
+static void *grow(char *buf, uint32_t *sz, uint32_t len)
+{
+	if (len <= *sz)
+		return buf;
+	free(buf);
+	*sz = NX_MAX(len, 2 * *sz);
+	if (posix_memalign((void **)&buf, 4096, *sz) != 0) {
+		fprintf(stderr, "out of memory for %u bytes\n", *sz);
+		exit(-1);
+	}
+	memset(buf, 0, *sz);
+	return buf;
+}
+
+#ifdef REPLAY_ZLIB
+
+static z_stream inf, def[2];
+
+/* nx_clock ticks of zlib doing job r; 0 if it has no zlib equivalent */
+static uint64_t run(struct nx_job_trace_rec *r)
+{
+	int fc = r->fc, dht = !!(fc & 0x2);
+	uint64_t t = get_nxtime_now();
+
+	if (fc == GZIP_FC_WRAP) {
+		memcpy(dst, src, NX_MIN(r->src_len, r->dst_len));
+		crc32(adler32(1, (Bytef *)dst, r->src_len), (Bytef *)dst, r->src_len);
+	}
+	else if (!fc_is_compress(fc)) {
+		if ((fc & 0x4) && (getnn(cmd.cpb, in_subc) != 0 || getnn(cmd.cpb, in_sfbt) != 0))
+			return 0;
+		inflateReset(&inf);
+		if (r->hist_len > 0)
+			inflateSetDictionary(&inf, (Bytef *)src, r->hist_len);
+		inf.next_in = (Bytef *)src + r->hist_len;
+		inf.avail_in = r->src_len - r->hist_len;
+		inf.next_out = (Bytef *)dst;
+		inf.avail_out = r->dst_len;
+		inflate(&inf, Z_SYNC_FLUSH);
+	}
+	else {
+		deflateReset(&def[dht]);
+		if (r->hist_len > 0)
+			deflateSetDictionary(&def[dht], (Bytef *)src, r->hist_len);
+		def[dht].next_in = (Bytef *)src + r->hist_len;
+		def[dht].avail_in = r->src_len - r->hist_len;
+		def[dht].next_out = (Bytef *)dst;
+		def[dht].avail_out = r->dst_len;
+		deflate(&def[dht], Z_SYNC_FLUSH);
+	}
+	return NX_MAX(get_nxtime_diff(t, get_nxtime_now()), 1);
+}
+
+static void init(void)
+{
+	inflateInit2(&inf, -15);
+	deflateInit2(&def[0], 1, Z_DEFLATED, -15, 8, Z_FIXED);
+	deflateInit2(&def[1], 1, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+}
+
+#else
+
+static nx_devp_t nxdevp;
+
+/* nx_clock ticks of the NX job r; counts differences from the recording */
+static uint64_t run(struct nx_job_trace_rec *r)
+{
+	struct fc_stats *s = &st[(r->fc >> 1) & (NX_FC_SLOTS - 1)];
+	int cc, retries = 0;
+	uint64_t t;
+
+	memset(&cmd.crb, 0, sizeof(cmd.crb));
+	put32(cmd.crb, gzip_fc, 0);
+	putnn(cmd.crb, gzip_fc, r->fc);
+
+	putnn(cmd.crb.source_dde, dde_count, 0);
+	put32(cmd.crb.source_dde, ddebc, r->src_len);
+	put64(cmd.crb.source_dde, ddead, (uint64_t)src);
+	putnn(cmd.crb.target_dde, dde_count, 0);
+	put32(cmd.crb.target_dde, ddebc, r->dst_len);
+	put64(cmd.crb.target_dde, ddead, (uint64_t)dst);
+
+	do {
+		nx_touch_pages(dst, r->dst_len, nx_config.page_sz, 1);
+		nx_touch_pages(src, r->src_len, nx_config.page_sz, 0);
+		t = get_nxtime_now();
+		cc = nx_submit_job(&cmd.crb.source_dde, &cmd.crb.target_dde, &cmd, nxdevp);
+		t = get_nxtime_diff(t, get_nxtime_now());
+	} while (cc == ERR_NX_TRANSLATION && ++retries < 16);
+
+	if (cc != r->cc)
+		++s->cc_diff;
+	else if ((cc == ERR_NX_OK || cc == ERR_NX_TPBC_GT_SPBC) &&
+		 get32(cmd.crb.csb, tpbc) != r->tpbc)
+		++s->tpbc_diff;
+	return NX_MAX(t, 1);
+}
+
+static void init(void)
+{
+	if (NULL == (nxdevp = nx_open(-1))) {
+		fprintf(stderr, "cannot open NX\n");
+		exit(-1);
+	}
+}
+
+#endif
+
+int main(int argc, char **argv)
+{
+	struct nx_job_trace_hdr hdr;
+	struct nx_job_trace_rec r;
+	double scale;
+	long repeat = 1, n;
+	uint64_t t;
+	FILE *f;
+	int c, i;
+
+	while ((c = getopt(argc, argv, "n:")) != -1) {
+		switch (c) {
+		case 'n': repeat = atol(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s [-n repeat] trace\n", argv[0]);
+			return -1;
+		}
+	}
+	if (optind >= argc || NULL == (f = fopen(argv[optind], "r"))) {
+		fprintf(stderr, "usage: %s [-n repeat] trace\n", argv[0]);
+		return -1;
+	}
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1 || hdr.magic != NX_JOB_TRACE_MAGIC ||
+	    hdr.version != NX_JOB_TRACE_VERSION) {
+		fprintf(stderr, "%s: not a version %d NX job trace\n", argv[optind], NX_JOB_TRACE_VERSION);
+		return -1;
+	}
+	/* recorded ticks to ours */
+	scale = (double)nx_clock_freq() / hdr.tb_freq;
+	if (hdr.flags & NX_JOB_TRACE_PAYLOAD)
+		init();
+
+	for (n = 0; n < repeat; n++) {
+		fseek(f, sizeof(hdr), SEEK_SET);
+		while (fread(&r, sizeof(r), 1, f) == 1) {
+			struct fc_stats *s = &st[(r.fc >> 1) & (NX_FC_SLOTS - 1)];
+
+			if (n == 0) {
+				++s->jobs;
+				s->rec[nx_lat_slot((r.t_done - r.t_submit) * scale)]++;
+			}
+			if (!(r.flags & NX_JOB_TRACE_PAYLOAD)) {
+				fseek(f, r.len - sizeof(r), SEEK_CUR);
+				continue;
+			}
+			src = grow(src, &src_sz, r.src_len);
+			dst = grow(dst, &dst_sz, r.dst_len);
+			if (fread(&cmd.cpb, NX_JOB_TRACE_CPB_IN, 1, f) != 1 ||
+			    fread(src, 1, r.src_len, f) != r.src_len) {
+				fprintf(stderr, "%s: truncated\n", argv[optind]);
+				break;
+			}
+			if (r.cc == ERR_NX_TRANSLATION) {
+				s->faults += (n == 0);
+				continue;
+			}
+			if ((t = run(&r)) == 0) {
+				s->skipped += (n == 0);
+				continue;
+			}
+			++s->replayed;
+			s->rep[nx_lat_slot(t)]++;
+		}
+	}
+
+	printf("%6s %8s %9s %9s %9s %9s %8s %8s %8s %8s\n", "fc", "jobs", "rec p50", "rec p99",
+	       "rep p50", "rep p99", "faults", "skipped", "cc diff", "tpbc diff");
+	for (i = 0; i < NX_FC_SLOTS; i++) {
+		struct fc_stats *s = &st[i];
+
+		if (s->jobs == 0)
+			continue;
+		printf("  0x%02x %8ld %9.1f %9.1f %9.1f %9.1f %8ld %8ld %8ld %8ld\n", i << 1, s->jobs,
+		       nx_lat_percentile(s->rec, 0.5), nx_lat_percentile(s->rec, 0.99),
+		       nx_lat_percentile(s->rep, 0.5), nx_lat_percentile(s->rep, 0.99),
+		       s->faults, s->skipped, s->cc_diff, s->tpbc_diff);
+	}
+	printf("latency in us\n");
+	fclose(f);
+	return 0;
+}
@@ -0,0 +1,217 @@
+/*
+ * vmstat like view of the NX GZIP statistics of a running process
+ * linked with libnxz and run with NX_GZIP_SHM_STATS=1, read from the
+ * /nxstat.<pid> shared memory object the library keeps.  Each
+ * interval asks the process for a snapshot and prints the change:
+ * deflate input and inflate output MB/s with their compression ratios,
+ * NX jobs per second with their p50/p99/p999 latency, jobs in flight,
+ * and jobs that ended with a non zero condition code.
+ *
+ * The process counts while nxstat is attached, and takes a snapshot
+ * at its next NX job; "idle" means no job ran in the interval.
+ *
+ * usage: nxstat [-i secs] [-c count] pid
+ *        nxstat                         lists the processes to watch
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include "nx_zlib.h"
+
+static struct zlib_stats prev, cur;
+static uint64_t lat[NX_LAT_SLOTS];
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static int list(void)
+{
+	struct dirent *de;
+	char comm[64], path[300];
+	DIR *d;
+	FILE *f;
+	int pid;
+
+	if (NULL == (d = opendir("/dev/shm")))
+		return -1;
+	printf("%8s %s\n", "pid", "command");
+	while ((de = readdir(d)) != NULL) {
+		if (sscanf(de->d_name, "nxstat.%d", &pid) != 1)
+			continue;
+		if (kill(pid, 0) != 0 && errno == ESRCH) {
+			printf("%8d (exited; remove /dev/shm/%s)\n", pid, de->d_name);
+			continue;
+		}
+		comm[0] = '\0';
+		snprintf(path, sizeof(path), "/proc/%d/comm", pid);
+		if (NULL != (f = fopen(path, "r"))) {
+			if (fgets(comm, sizeof(comm), f) != NULL)
+				comm[strcspn(comm, "\n")] = '\0';
+			fclose(f);
+		}
+		printf("%8d %s\n", pid, comm);
+	}
+	closedir(d);
+	return 0;
+}
+
+static struct nx_shm_stats *attach(int pid)
+{
+	struct nx_shm_stats *sh;
+	struct stat st;
+	char name[64];
+	int fd;
+
+	snprintf(name, sizeof(name), NX_SHM_STATS_NAME, pid);
+	if ((fd = shm_open(name, O_RDWR | O_NOFOLLOW, 0)) < 0) {
+		fprintf(stderr, "%s: %s\n", name, strerror(errno));
+		return NULL;
+	}
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(*sh)) {
+		fprintf(stderr, "%s: too short for this nxstat\n", name);
+		close(fd);
+		return NULL;
+	}
+	sh = mmap(NULL, sizeof(*sh), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (sh == MAP_FAILED) {
+		fprintf(stderr, "%s: %s\n", name, strerror(errno));
+		return NULL;
+	}
+	if (__atomic_load_n(&sh->magic, __ATOMIC_ACQUIRE) != NX_SHM_STATS_MAGIC ||
+	    sh->version != NX_SHM_STATS_VERSION || sh->stats_size != sizeof(struct zlib_stats)) {
+		fprintf(stderr, "%s: version %u, this nxstat reads version %u\n",
+			name, sh->version, NX_SHM_STATS_VERSION);
+		munmap(sh, sizeof(*sh));
+		return NULL;
+	}
+	/* the process counts while readers is non zero */
+	__atomic_add_fetch(&sh->readers, 1, __ATOMIC_RELAXED);
+	return sh;
+}
+
+/* the next job of the process sees readers and stops counting if we
+   were the last */
+static void detach(struct nx_shm_stats *sh)
+{
+	__atomic_sub_fetch(&sh->readers, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&sh->request, 1, __ATOMIC_RELEASE);
+	munmap(sh, sizeof(*sh));
+}
+
+/* a consistent copy of the snapshot; returns its seq */
+static uint64_t snapshot(struct nx_shm_stats *sh, struct zlib_stats *st, uint64_t *time)
+{
+	uint64_t s1, s2;
+
+	for (;;) {
+		s1 = __atomic_load_n(&sh->seq, __ATOMIC_ACQUIRE);
+		if (s1 & 1) {
+			usleep(100);
+			continue;
+		}
+		memcpy(st, &sh->st, sizeof(*st));
+		*time = sh->time;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		s2 = __atomic_load_n(&sh->seq, __ATOMIC_RELAXED);
+		if (s1 == s2)
+			return s1;
+	}
+}
+
+/* asks for a snapshot and waits up to ms for it */
+static void request(struct nx_shm_stats *sh, uint64_t seq, int ms)
+{
+	__atomic_add_fetch(&sh->request, 1, __ATOMIC_RELAXED);
+	while (ms-- > 0 && __atomic_load_n(&sh->seq, __ATOMIC_ACQUIRE) == seq)
+		usleep(1000);
+}
+
+static double ratio(uint64_t a, uint64_t b)
+{
+	return (b > 0) ? (double)a / b : 0;
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t seq, pseq, t, pt, jobs, errs, done;
+	struct nx_shm_stats *sh;
+	double secs = 1, dt;
+	long count = -1, n;
+	int c, i, j;
+
+	while ((c = getopt(argc, argv, "i:c:")) != -1) {
+		switch (c) {
+		case 'i': secs = atof(optarg); break;
+		case 'c': count = atol(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s [-i secs] [-c count] [pid]\n", argv[0]);
+			return -1;
+		}
+	}
+	if (optind >= argc)
+		return list();
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	if (NULL == (sh = attach(atoi(argv[optind]))))
+		return -1;
+
+	pseq = snapshot(sh, &prev, &pt);
+	request(sh, pseq, secs * 1000);
+	pseq = snapshot(sh, &prev, &pt);
+
+	for (n = 0; !stop && (count < 0 || n < count); n++) {
+		if (n % 20 == 0)
+			printf("%10s %6s %10s %6s %8s %8s %8s %8s %8s %6s\n",
+			       "defl MB/s", "ratio", "infl MB/s", "ratio", "jobs/s",
+			       "p50 us", "p99 us", "p999 us", "inflight", "cc!=0");
+		usleep(secs * 1000000);
+		if (stop)
+			break;
+		request(sh, pseq, secs * 1000);
+		seq = snapshot(sh, &cur, &t);
+		if (seq == pseq) {
+			printf("%10s\n", "idle");
+			continue;
+		}
+
+		dt = (double)(t - pt) / sh->tb_freq;
+		memset(lat, 0, sizeof(lat));
+		for (i = 0; i < NX_FC_SLOTS; i++)
+			for (j = 0; j < NX_LAT_SLOTS; j++)
+				lat[j] += cur.job_lat_fc[i][j] - prev.job_lat_fc[i][j];
+		for (errs = 0, i = 1; i < NX_CC_SLOTS; i++)
+			errs += cur.job_cc[i] - prev.job_cc[i];
+		for (done = 0, i = 0; i < NX_CC_SLOTS; i++)
+			done += cur.job_cc[i];
+		jobs = cur.job_submit - prev.job_submit;
+
+		printf("%10.1f %6.2f %10.1f %6.2f %8.0f %8.1f %8.1f %8.1f %8ld %6ld\n",
+		       (cur.deflate_len - prev.deflate_len) / dt / 1.0e6,
+		       ratio(cur.deflate_len - prev.deflate_len, cur.deflate_out_len - prev.deflate_out_len),
+		       (cur.inflate_out_len - prev.inflate_out_len) / dt / 1.0e6,
+		       ratio(cur.inflate_out_len - prev.inflate_out_len, cur.inflate_len - prev.inflate_len),
+		       jobs / dt, nx_lat_percentile(lat, 0.5), nx_lat_percentile(lat, 0.99),
+		       nx_lat_percentile(lat, 0.999), (long)(cur.job_submit - done), (long)errs);
+		fflush(stdout);
+
+		memcpy(&prev, &cur, sizeof(prev));
+		pseq = seq;
+		pt = t;
+	}
+	detach(sh);
+	return 0;
+}
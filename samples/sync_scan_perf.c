@@ -0,0 +1,91 @@
+/*
+ * Throughput of the inflateSync flush marker scan.
+ *
+ * Fills a buffer with random bytes free of 00 00 ff ff, plants the
+ * marker at the end, and scans it repeatedly until the requested
+ * number of GiB is covered, once with nx_sync_search() and once with
+ * the byte at a time search of zlib for comparison.
+ *
+ * usage: sync_scan_perf [GiB to scan] [buffer MiB]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <sys/time.h>
+#include <zlib.h>
+#include "nx_zlib.h"
+
+/* zlib syncsearch() */
+static long byte_search(const unsigned char *buf, long len, int *have)
+{
+	long next = 0;
+	int got = *have;
+
+	while (next < len && got < 4) {
+		if (buf[next] == (got < 2 ? 0 : 0xff))
+			got++;
+		else if (buf[next])
+			got = 0;
+		else
+			got = 4 - got;
+		next++;
+	}
+	*have = got;
+	return next;
+}
+
+static double now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1.0e6;
+}
+
+static void run(const char *name, long (*search)(const unsigned char *, long, int *),
+		const unsigned char *buf, long len, long iters)
+{
+	double t;
+	long i, used;
+	int have;
+
+	t = now();
+	for (i = 0; i < iters; i++) {
+		have = 0;
+		used = search(buf, len, &have);
+		assert(have == 4 && used == len);
+	}
+	t = now() - t;
+	printf("%-12s %ld GiB in %.3f secs, %.2f GiB/s\n", name,
+	       (len * iters) >> 30, t, (double)len * iters / (1<<30) / t);
+}
+
+int main(int argc, char **argv)
+{
+	long gib = (argc > 1) ? atol(argv[1]) : 4;
+	long len = ((argc > 2) ? atol(argv[2]) : 256) << 20;
+	long iters, i;
+	unsigned char *buf;
+
+	assert(len > 4 && gib > 0);
+	assert(NULL != (buf = malloc(len)));
+
+	srand(1);
+	for (i = 0; i < len; i++)
+		buf[i] = rand();
+	/* break any chance markers */
+	for (i = 0; i + 4 <= len; i++)
+		if (buf[i] == 0 && buf[i+1] == 0 && buf[i+2] == 0xff && buf[i+3] == 0xff)
+			buf[i+3] = 0xfe;
+	memcpy(buf + len - 4, "\x00\x00\xff\xff", 4);
+
+	iters = NX_MAX(1, (gib << 30) / len);
+	printf("buffer %ld MiB, %ld passes\n", len >> 20, iters);
+
+	run("nx_sync", nx_sync_search, buf, len, iters);
+	run("bytewise", byte_search, buf, len, iters);
+
+	free(buf);
+	return 0;
+}
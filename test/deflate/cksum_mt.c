@@ -0,0 +1,66 @@
+#include "../test_deflate.h"
+#include "../test_utils.h"
+
+static int check(const unsigned char *buf, uint64_t len, int threads, uint32_t crc0, uint32_t adler0)
+{
+	uint32_t crc = crc0, adler = adler0;
+	uint32_t ref_c = ref_crc32(crc0, buf, len), ref_a = ref_adler32(adler0, buf, len);
+
+	if (nx_checksum_mt(buf, len, &crc, &adler, threads) != Z_OK ||
+	    crc != ref_c || adler != ref_a) {
+		printf("len %lu threads %d: crc %08x adler %08x, expected %08x %08x\n",
+		       (unsigned long)len, threads, crc, adler, ref_c, ref_a);
+		return TEST_ERROR;
+	}
+
+	/* either checksum alone */
+	crc = crc0;
+	adler = adler0;
+	if (nx_checksum_mt(buf, len, &crc, NULL, threads) != Z_OK || crc != ref_c ||
+	    nx_checksum_mt(buf, len, NULL, &adler, threads) != Z_OK || adler != ref_a) {
+		printf("len %lu threads %d: single checksum differs\n", (unsigned long)len, threads);
+		return TEST_ERROR;
+	}
+	return TEST_OK;
+}
+
+static int run(unsigned int len, const char* test)
+{
+	static const int threads[] = { 1, 2, 4, 0 };
+	const unsigned char *src;
+	uint32_t crc, adler;
+	int i;
+
+	/* the check values of the catalogue */
+	crc = 0;
+	adler = 1;
+	if (nx_checksum_mt((const unsigned char *)"123456789", 9, &crc, &adler, 0) != Z_OK ||
+	    crc != 0xcbf43926 || adler != 0x091e01de) {
+		printf("check values crc %08x adler %08x\n", crc, adler);
+		return TEST_ERROR;
+	}
+	if (nx_checksum_mt((const unsigned char *)"", 0, NULL, NULL, 0) != Z_STREAM_ERROR)
+		return TEST_ERROR;
+
+	generate_random_data(len);
+	src = (const unsigned char *)&ran_data[0];
+
+	for (i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+		/* whole chunks, a short last chunk, and a running checksum */
+		if (check(src, len, threads[i], 0, 1) ||
+		    check(src + 3, len - 12345, threads[i], 0, 1) ||
+		    check(src, len - 1, threads[i], 0x12345678, 0x00ff00ff))
+			return TEST_ERROR;
+	}
+
+	printf("*** %s %s passed\n", __FILE__, test);
+	return TEST_OK;
+}
+
+/* case prefix is 46 */
+
+/* nx_checksum_mt against bitwise crc32 and adler32 across chunks */
+int run_case46()
+{
+	return run(1024*1024*12, __func__);
+}
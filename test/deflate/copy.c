@@ -0,0 +1,104 @@
+#include "../test_deflate.h"
+#include "../test_utils.h"
+
+/* nx_copy of len bytes with running checksums against the references */
+static int check(nx_devp_t nxdevp, char *dst, const char *src, uint64_t len, uint32_t crc0, uint32_t adler0)
+{
+	uint32_t crc = crc0, adler = adler0;
+	uint32_t ref_c = ref_crc32(crc0, (const unsigned char *)src, len);
+	uint32_t ref_a = ref_adler32(adler0, (const unsigned char *)src, len);
+	int cc;
+
+	memset(dst, 0, len);
+	cc = nx_copy(dst, (char *)src, len, &crc, &adler, nxdevp);
+	if (cc != ERR_NX_OK || crc != ref_c || adler != ref_a ||
+	    compare_data(dst, (char *)src, len)) {
+		printf("len %lu: cc %d crc %08x adler %08x, expected %08x %08x\n",
+		       (unsigned long)len, cc, crc, adler, ref_c, ref_a);
+		return TEST_ERROR;
+	}
+
+	/* either checksum alone */
+	crc = crc0;
+	adler = adler0;
+	if (nx_copy(dst, (char *)src, len, &crc, NULL, nxdevp) != ERR_NX_OK || crc != ref_c ||
+	    nx_copy(dst, (char *)src, len, NULL, &adler, nxdevp) != ERR_NX_OK || adler != ref_a) {
+		printf("len %lu: single checksum differs\n", (unsigned long)len);
+		return TEST_ERROR;
+	}
+	return TEST_OK;
+}
+
+/* crossover 0 is measured in the background; the copies go to
+   software meanwhile */
+static int run(uint32_t crossover, const char* test)
+{
+	uint64_t lens[7];
+	uint64_t old, xover;
+	uint32_t crc = 0;
+	nx_devp_t nxdevp;
+	char *dst;
+	int i, rc = TEST_ERROR;
+
+	generate_random_data(4*1024*1024);
+	if (NULL == (dst = malloc(4*1024*1024)))
+		return TEST_ERROR;
+	if (NULL == (nxdevp = nx_open(-1))) {
+		free(dst);
+		return TEST_ERROR;
+	}
+
+	if (nx_get_option(NX_OPT_COPY_CROSSOVER, &old) != Z_OK ||
+	    nx_set_option(NX_OPT_COPY_CROSSOVER, crossover) != Z_OK)
+		goto out;
+	if (crossover == 0) {
+		/* starts the measure if nothing runs it yet */
+		nx_copy(dst, ran_data, 4096, &crc, NULL, nxdevp);
+		if (check(nxdevp, dst, ran_data, 300000, 0, 1))
+			goto out;
+		for (i = 0; i < 5000; i++) {
+			nx_get_option(NX_OPT_COPY_CROSSOVER, &xover);
+			if (xover != 0)
+				break;
+			usleep(1000);
+		}
+		/* software at all sizes when NX is never faster */
+		crossover = (xover > 0 && xover < 2*1024*1024) ? xover : 64*1024;
+	}
+
+	/* under, at and over the crossover; the last takes several jobs */
+	lens[0] = 1;
+	lens[1] = 100;
+	lens[2] = crossover - 1;
+	lens[3] = crossover;
+	lens[4] = crossover + 1;
+	lens[5] = 300000;
+	lens[6] = 3*1024*1024 + 17;
+
+	for (i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+		if (check(nxdevp, dst, ran_data + 3, lens[i], 0, 1) ||
+		    check(nxdevp, dst, ran_data, lens[i], 0x12345678, 0x00ff00ff))
+			goto out;
+	}
+	rc = TEST_OK;
+	printf("*** %s %s passed\n", __FILE__, test);
+out:
+	nx_set_option(NX_OPT_COPY_CROSSOVER, old);
+	nx_close(nxdevp);
+	free(dst);
+	return rc;
+}
+
+/* case prefix is 47 */
+
+/* nx_copy checksums on both sides of a 64KB crossover */
+int run_case47()
+{
+	return run(64*1024, __func__);
+}
+
+/* the same about the crossover measured in the background */
+int run_case47_1()
+{
+	return run(0, __func__);
+}
@@ -0,0 +1,105 @@
+#include "../test_deflate.h"
+#include "../test_utils.h"
+#include "nx_dht.h"
+
+#define SRC_BYTES 4000
+
+/* lzcounts as the nx unit returns them after a _COUNT job */
+static void set_counts(nx_gzip_crb_cpb_t *cmdp, const int (*cnt)[2], int n, long src_bytes)
+{
+	uint32_t *lz = (uint32_t *)cmdp->cpb.out_lzcount;
+	int i;
+
+	memset(cmdp, 0, sizeof(*cmdp));
+	for (i = 0; i < n; i++)
+		lz[cnt[i][0]] = htobe32(cnt[i][1]);
+	putnn(cmdp->crb, gzip_fc, GZIP_FC_COMPRESS_DHT_COUNT);
+	put32(cmdp->cpb, out_spbc_comp_with_count, src_bytes);
+}
+
+static int run(const char* test)
+{
+	/* symbol, count; 256 is EOB, 257..285 lengths, 286.. distances */
+	static const int cnt[][2] = {
+		{ 97, 1000 }, { 98, 500 }, { 200, 300 }, { 256, 1 },
+		{ 257, 100 }, { 285, 50 }, { LLSZ + 0, 100 }, { LLSZ + 29, 50 },
+	};
+	const int n = sizeof(cnt) / sizeof(cnt[0]);
+	/* lits 8 or 9 bits, lens 7 or 8 bits, dists 5 bits in the fixed table */
+	const uint64_t fht = 1000*8 + 500*8 + 300*9 + 1*7 + 100*7 + 50*8 + 150*5;
+	nx_gzip_crb_cpb_t cmd __attribute__ ((aligned (128)));
+	void *handle;
+	dht_hist_t *h;
+	uint64_t fht_bits, dht_bits;
+	int i;
+
+	if (NULL == (handle = dht_begin(NULL, NULL)))
+		return TEST_ERROR;
+	dht_set_config(handle, 0);
+	h = &((dht_tab_t *) handle)->hist;
+
+	set_counts(&cmd, cnt, n, SRC_BYTES);
+	dht_lookup(&cmd, dht_search_req, handle);
+
+	for (i = 0; i < n; i++) {
+		if (h->lzcount[cnt[i][0]] != cnt[i][1]) {
+			printf("lzcount[%d] %u, expected %d\n", cnt[i][0], h->lzcount[cnt[i][0]], cnt[i][1]);
+			goto err;
+		}
+	}
+	if (h->lit != 1800 || h->len != 150 || h->dist != 150) {
+		printf("lit %lu len %lu dist %lu\n", (unsigned long)h->lit, (unsigned long)h->len, (unsigned long)h->dist);
+		goto err;
+	}
+	if (h->fht_bits != fht || h->src_bytes != SRC_BYTES) {
+		printf("fht_bits %lu src_bytes %ld\n", (unsigned long)h->fht_bits, h->src_bytes);
+		goto err;
+	}
+	if (h->top.sorted[0].sym != 97 || h->top.sorted[1].sym != 98 || h->top.sorted[2].sym != 200) {
+		printf("top %d %d %d\n", h->top.sorted[0].sym, h->top.sorted[1].sym, h->top.sorted[2].sym);
+		goto err;
+	}
+	/* three skewed literals code well below 8 bits each */
+	if (h->incompressible || h->ent_bits == 0 || h->ent_bits >= h->fht_bits || h->lit_bits >= 1800 * 2) {
+		printf("lit_bits %lu ent_bits %lu incompressible %d\n", (unsigned long)h->lit_bits, (unsigned long)h->ent_bits, h->incompressible);
+		goto err;
+	}
+
+	/* the estimate scales with the byte count */
+	dht_estimate(&cmd, handle, 2 * SRC_BYTES, &fht_bits, &dht_bits);
+	if (fht_bits != 2 * fht || dht_bits != 2 * h->ent_bits + getnn(cmd.cpb, in_dhtlen)) {
+		printf("estimate fht %lu dht %lu\n", (unsigned long)fht_bits, (unsigned long)dht_bits);
+		goto err;
+	}
+
+	/* every literal equally likely and no matches */
+	{
+		int flat[256][2];
+
+		for (i = 0; i < 256; i++) {
+			flat[i][0] = i;
+			flat[i][1] = 100;
+		}
+		set_counts(&cmd, (const int (*)[2])flat, 256, 256 * 100);
+		dht_lookup(&cmd, dht_search_req, handle);
+		if (h->lit != 256 * 100 || h->len != 0 || !h->incompressible) {
+			printf("flat lit %lu len %lu incompressible %d\n", (unsigned long)h->lit, (unsigned long)h->len, h->incompressible);
+			goto err;
+		}
+	}
+
+	dht_end(handle);
+	printf("*** %s %s passed\n", __FILE__, test);
+	return TEST_OK;
+err:
+	dht_end(handle);
+	return TEST_ERROR;
+}
+
+/* case prefix is 44 */
+
+/* lzcount histogram summary and bit estimates against known values */
+int run_case44()
+{
+	return run(__func__);
+}
@@ -0,0 +1,90 @@
+#include "../test_deflate.h"
+#include "../test_utils.h"
+#include "nx_dht.h"
+
+extern dht_entry_t *get_builtin_table();
+
+#define SET_LEN 8
+
+/* flips one byte of the file at off */
+static int corrupt(const char *fname, long off)
+{
+	FILE *fp;
+	int c;
+
+	if (NULL == (fp = fopen(fname, "r+")))
+		return -1;
+	fseek(fp, off, SEEK_SET);
+	c = fgetc(fp);
+	fseek(fp, off, SEEK_SET);
+	fputc(c ^ 0x5a, fp);
+	return fclose(fp);
+}
+
+static int run(const char* test)
+{
+	char fname[] = "/tmp/nx_test_dhtset.XXXXXX";
+	dht_entry_t *builtin = get_builtin_table();
+	dht_entry_t *set = NULL;
+	int fd, num, i, rc;
+
+	if ((fd = mkstemp(fname)) < 0)
+		return TEST_ERROR;
+	close(fd);
+
+	rc = dht_save_set(fname, builtin, SET_LEN);
+	if (rc != 0) {
+		printf("dht_save_set rc %d\n", rc);
+		goto err;
+	}
+
+	num = dht_load_set(fname, &set);
+	if (num != SET_LEN) {
+		printf("dht_load_set returned %d, expected %d\n", num, SET_LEN);
+		goto err;
+	}
+	for (i = 0; i < SET_LEN; i++) {
+		if (set[i].in_dhtlen != builtin[i].in_dhtlen ||
+		    memcmp(set[i].in_dht_char, builtin[i].in_dht_char, (builtin[i].in_dhtlen + 7) / 8) != 0 ||
+		    memcmp(set[i].litlen, builtin[i].litlen, sizeof(set[i].litlen)) != 0 ||
+		    memcmp(set[i].dist, builtin[i].dist, sizeof(set[i].dist)) != 0) {
+			printf("entry %d differs after load\n", i);
+			goto err;
+		}
+	}
+	free(set);
+	set = NULL;
+
+	/* a bad magic */
+	corrupt(fname, 0);
+	num = dht_load_set(fname, &set);
+	if (num >= 0) {
+		printf("dht_load_set took a bad magic\n");
+		goto err;
+	}
+
+	/* a bad record checksum */
+	rc = dht_save_set(fname, builtin, SET_LEN);
+	corrupt(fname, sizeof(dht_set_hdr_t) + 2 * sizeof(dht_set_rec_t) + 100);
+	num = dht_load_set(fname, &set);
+	if (num >= 0) {
+		printf("dht_load_set took a bad record\n");
+		goto err;
+	}
+
+	unlink(fname);
+	printf("*** %s %s passed\n", __FILE__, test);
+	return TEST_OK;
+err:
+	free(set);
+	unlink(fname);
+	return TEST_ERROR;
+}
+
+/* case prefix is 43 */
+
+/* dht table set file save, load and corrupt files */
+int run_case43()
+{
+	return run(__func__);
+}
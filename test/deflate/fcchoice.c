@@ -0,0 +1,172 @@
+#include "../test_deflate.h"
+#include "../test_utils.h"
+#include "nx_dht.h"
+
+static alloc_func zalloc = (alloc_func)0;
+static free_func zfree = (free_func)0;
+
+static void set_counts(nx_gzip_crb_cpb_t *cmdp, int lits, uint32_t cnt)
+{
+	uint32_t *lz = (uint32_t *)cmdp->cpb.out_lzcount;
+	int i;
+
+	memset(cmdp, 0, sizeof(*cmdp));
+	for (i = 0; i < lits; i++)
+		lz['a' + i] = htobe32(cnt);
+	lz[256] = htobe32(1);
+	putnn(cmdp->crb, gzip_fc, GZIP_FC_COMPRESS_DHT_COUNT);
+	put32(cmdp->cpb, out_spbc_comp_with_count, lits * cnt);
+}
+
+/* the estimate behind nx_deflate_choose_fc: the dht header decides
+   small blocks and the entropy large ones */
+static int run_estimate(void)
+{
+	nx_gzip_crb_cpb_t cmd __attribute__ ((aligned (128)));
+	uint64_t fht_bits, dht_bits;
+	void *handle;
+	int rc = TEST_ERROR;
+
+	if (NULL == (handle = dht_begin(NULL, NULL)))
+		return TEST_ERROR;
+
+	/* 16 literals; 4 bits with a dht, 8 with the fixed table */
+	set_counts(&cmd, 16, 1000);
+	dht_lookup(&cmd, dht_search_req, handle);
+	if (!dht_hist_changed(handle)) {
+		printf("first histogram not marked changed\n");
+		goto out;
+	}
+
+	dht_estimate(&cmd, handle, 16, &fht_bits, &dht_bits);
+	if (!(fht_bits < dht_bits)) {
+		printf("16 bytes: fht %lu dht %lu; fixed table expected\n", (unsigned long)fht_bits, (unsigned long)dht_bits);
+		goto out;
+	}
+	dht_estimate(&cmd, handle, 64*1024, &fht_bits, &dht_bits);
+	if (!(dht_bits < fht_bits)) {
+		printf("64KB: fht %lu dht %lu; dynamic table expected\n", (unsigned long)fht_bits, (unsigned long)dht_bits);
+		goto out;
+	}
+
+	/* the same counts again may reuse the last choice */
+	set_counts(&cmd, 16, 1000);
+	dht_lookup(&cmd, dht_search_req, handle);
+	if (dht_hist_changed(handle)) {
+		printf("same histogram marked changed\n");
+		goto out;
+	}
+	set_counts(&cmd, 17, 1000);
+	dht_lookup(&cmd, dht_search_req, handle);
+	if (!dht_hist_changed(handle)) {
+		printf("new histogram not marked changed\n");
+		goto out;
+	}
+	rc = TEST_OK;
+out:
+	dht_end(handle);
+	return rc;
+}
+
+/* nx deflate a stream in small jobs; every job after the first is
+   a fixed or dynamic huffman choice */
+static int run_stream(Byte *src, unsigned int src_len, Byte *compr, unsigned int compr_len,
+		      Byte *uncompr, unsigned int uncompr_len)
+{
+	struct zlib_stats before, after;
+	z_stream c, d;
+	int trace = nx_gzip_trace;
+	int err, rc = TEST_ERROR;
+
+	__atomic_or_fetch(&nx_gzip_trace, 0x8, __ATOMIC_RELAXED);
+	nx_get_stats(&before);
+
+	memset(&c, 0, sizeof(c));
+	c.zalloc = zalloc;
+	c.zfree = zfree;
+	err = nx_deflateInit(&c, Z_DEFAULT_COMPRESSION);
+	if (err != Z_OK)
+		goto out;
+	err = nx_deflateSetOption(&c, NX_OPT_PER_JOB_LEN, 64*1024);
+	if (err != Z_OK)
+		goto out;
+	c.next_in = src;
+	c.avail_in = src_len;
+	c.next_out = compr;
+	c.avail_out = compr_len;
+	err = nx_deflate(&c, Z_FINISH);
+	nx_deflateEnd(&c);
+	if (err != Z_STREAM_END) {
+		printf("nx_deflate err %d\n", err);
+		goto out;
+	}
+
+	nx_get_stats(&after);
+	if (after.deflate_fht_wins + after.deflate_dht_wins <=
+	    before.deflate_fht_wins + before.deflate_dht_wins + 1) {
+		printf("no fixed/dynamic choices counted\n");
+		goto out;
+	}
+	/* a 33 letter alphabet codes in about 5 bits */
+	if (after.deflate_dht_wins == before.deflate_dht_wins) {
+		printf("dynamic table never chosen\n");
+		goto out;
+	}
+
+	memset(&d, 0, sizeof(d));
+	memset(uncompr, 0, uncompr_len);
+	d.next_in = compr;
+	d.avail_in = c.total_out;
+	d.next_out = uncompr;
+	d.avail_out = uncompr_len;
+	inflateInit(&d);
+	err = inflate(&d, Z_FINISH);
+	inflateEnd(&d);
+	if (err != Z_STREAM_END || d.total_out != src_len ||
+	    compare_data((char *)uncompr, (char *)src, src_len)) {
+		printf("inflate err %d\n", err);
+		goto out;
+	}
+	rc = TEST_OK;
+out:
+	__atomic_store_n(&nx_gzip_trace, trace, __ATOMIC_RELAXED);
+	return rc;
+}
+
+static int run(unsigned int len, const char* test)
+{
+	Byte *src, *compr, *uncompr;
+	unsigned int compr_len = len*2;
+	unsigned int uncompr_len = len*2;
+	int rc;
+
+	generate_random_data(len);
+	src = (Byte*)&ran_data[0];
+
+	compr = (Byte*)calloc((uInt)compr_len, 1);
+	uncompr = (Byte*)calloc((uInt)uncompr_len, 1);
+	if (compr == NULL || uncompr == NULL ) {
+		printf("*** alloc buffer failed\n");
+		free(compr);
+		free(uncompr);
+		return TEST_ERROR;
+	}
+
+	rc = run_estimate();
+	if (rc == TEST_OK)
+		rc = run_stream(src, len, compr, compr_len, uncompr, uncompr_len);
+
+	free(compr);
+	free(uncompr);
+	if (rc == TEST_OK)
+		printf("*** %s %s passed\n", __FILE__, test);
+	return rc;
+}
+
+/* case prefix is 45 */
+
+/* fixed vs dynamic huffman choice per block */
+int run_case45()
+{
+	return run(1024*1024, __func__);
+}
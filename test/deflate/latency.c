@@ -0,0 +1,95 @@
+#include "../test_deflate.h"
+#include "../test_utils.h"
+
+/* slot bounds: t is in [min(slot), min(slot + 1)) and a slot is at
+   most a quarter of its least latency wide */
+static int check_slot(uint64_t t)
+{
+	unsigned int s = nx_lat_slot(t);
+	uint64_t lo = nx_lat_slot_min(s), hi = nx_lat_slot_min(s + 1);
+
+	if (s == NX_LAT_SLOTS - 1)
+		return (t >= lo) ? TEST_OK : TEST_ERROR;
+	if (t < lo || t >= hi || hi - lo > NX_MAX(1, lo >> NX_LAT_SUB_BITS)) {
+		printf("t %lu slot %u [%lu, %lu)\n", (unsigned long)t, s, (unsigned long)lo, (unsigned long)hi);
+		return TEST_ERROR;
+	}
+	return TEST_OK;
+}
+
+static int run_slot(void)
+{
+	uint64_t t;
+	unsigned int last = 0;
+
+	for (t = 0; t < (1 << 20); t++) {
+		if (check_slot(t) || nx_lat_slot(t) < last)
+			return TEST_ERROR;
+		last = nx_lat_slot(t);
+	}
+	for (t = 1 << 20; t < (1ULL << 40); t += t / 7 + 1)
+		if (check_slot(t))
+			return TEST_ERROR;
+
+	if (nx_lat_slot(0) != 0 || nx_lat_slot(3) != 3 || nx_lat_slot(4) != 4 ||
+	    nx_lat_slot(7) != 7 || nx_lat_slot(8) != 8 || nx_lat_slot(10) != 9 ||
+	    nx_lat_slot(~0ULL) != NX_LAT_SLOTS - 1) {
+		printf("slots of 0 3 4 7 8 10 max: %u %u %u %u %u %u %u\n", nx_lat_slot(0),
+		       nx_lat_slot(3), nx_lat_slot(4), nx_lat_slot(7), nx_lat_slot(8),
+		       nx_lat_slot(10), nx_lat_slot(~0ULL));
+		return TEST_ERROR;
+	}
+	return TEST_OK;
+}
+
+/* the percentile is the top of the slot holding it, so within a
+   quarter above the latency */
+static int near(double us, uint64_t t)
+{
+	return us >= nxtime_to_us(t) && us <= nxtime_to_us(t + (t >> NX_LAT_SUB_BITS) + 1);
+}
+
+static int run_percentile(void)
+{
+	uint64_t hist[NX_LAT_SLOTS];
+
+	memset(hist, 0, sizeof(hist));
+	if (nx_lat_percentile(hist, 0.5) != 0)
+		return TEST_ERROR;
+
+	/* 90 jobs of 1000 ticks, 9 of 100000 and 1 of 10000000 */
+	hist[nx_lat_slot(1000)] = 90;
+	hist[nx_lat_slot(100000)] = 9;
+	hist[nx_lat_slot(10000000)] = 1;
+
+	if (!near(nx_lat_percentile(hist, 0.5), 1000) ||
+	    !near(nx_lat_percentile(hist, 0.9), 1000) ||
+	    !near(nx_lat_percentile(hist, 0.95), 100000) ||
+	    !near(nx_lat_percentile(hist, 0.99), 100000) ||
+	    !near(nx_lat_percentile(hist, 0.999), 10000000) ||
+	    !near(nx_lat_percentile(hist, 0), 1000)) {
+		printf("p50 %.3f p90 %.3f p95 %.3f p99 %.3f p999 %.3f us\n",
+		       nx_lat_percentile(hist, 0.5), nx_lat_percentile(hist, 0.9),
+		       nx_lat_percentile(hist, 0.95), nx_lat_percentile(hist, 0.99),
+		       nx_lat_percentile(hist, 0.999));
+		return TEST_ERROR;
+	}
+	return TEST_OK;
+}
+
+static int run(const char* test)
+{
+	if (run_slot() || run_percentile())
+		return TEST_ERROR;
+
+	printf("*** %s %s passed\n", __FILE__, test);
+	return TEST_OK;
+}
+
+/* case prefix is 48 */
+
+/* job latency slots and percentiles against known latencies */
+int run_case48()
+{
+	return run(__func__);
+}
@@ -0,0 +1,108 @@
+#include <pthread.h>
+#include <sys/wait.h>
+#include "../test_deflate.h"
+#include "../test_utils.h"
+
+#define LOG_THREADS 4
+#define LOG_MSGS    200		/* per thread, less than a ring holds */
+
+static void *log_thread(void *arg)
+{
+	int t = (int)(long)arg, i;
+
+	for (i = 0; i < LOG_MSGS; i++)
+		nx_log(NX_LOG_RAW, "log %d %d\n", t, i);
+	return NULL;
+}
+
+/* each thread's messages once and in order, and the child's */
+static int check_log(FILE *fp, int child_msgs)
+{
+	int next[LOG_THREADS] = { 0 };
+	int t, i, child = 0;
+	char line[256];
+
+	rewind(fp);
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if (sscanf(line, "log %d %d", &t, &i) == 2) {
+			if (t < 0 || t >= LOG_THREADS || i != next[t]) {
+				printf("out of order: %s", line);
+				return TEST_ERROR;
+			}
+			next[t]++;
+		} else if (sscanf(line, "child %d", &i) == 1) {
+			child++;
+		}
+	}
+	for (t = 0; t < LOG_THREADS; t++) {
+		if (next[t] != LOG_MSGS) {
+			printf("thread %d logged %d of %d\n", t, next[t], LOG_MSGS);
+			return TEST_ERROR;
+		}
+	}
+	if (child != child_msgs) {
+		printf("child logged %d of %d\n", child, child_msgs);
+		return TEST_ERROR;
+	}
+	return TEST_OK;
+}
+
+static int run(const char* test)
+{
+	char fname[] = "/tmp/nx_test_log.XXXXXX";
+	pthread_t tid[LOG_THREADS];
+	FILE *old_log = nx_gzip_log;
+	int old_async = nx_log_async;
+	int fd, t, status, rc = TEST_ERROR;
+	pid_t pid;
+	FILE *fp;
+
+	if ((fd = mkstemp(fname)) < 0)
+		return TEST_ERROR;
+	if (NULL == (fp = fdopen(fd, "w+"))) {
+		close(fd);
+		unlink(fname);
+		return TEST_ERROR;
+	}
+	nx_log_drain();
+	nx_gzip_log = fp;
+	nx_log_async = 1;
+
+	for (t = 0; t < LOG_THREADS; t++)
+		pthread_create(&tid[t], NULL, log_thread, (void *)(long)t);
+	for (t = 0; t < LOG_THREADS; t++)
+		pthread_join(tid[t], NULL);
+	nx_log_drain();
+
+	/* a forked child logs through rings of its own */
+	pid = fork();
+	if (pid == 0) {
+		for (t = 0; t < 10; t++)
+			nx_log(NX_LOG_RAW, "child %d\n", t);
+		nx_log_drain();
+		_exit(0);
+	}
+	if (pid < 0 || waitpid(pid, &status, 0) != pid ||
+	    !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		printf("child failed\n");
+		goto out;
+	}
+
+	rc = check_log(fp, 10);
+out:
+	nx_log_async = old_async;
+	nx_gzip_log = old_log;
+	fclose(fp);
+	unlink(fname);
+	if (rc == TEST_OK)
+		printf("*** %s %s passed\n", __FILE__, test);
+	return rc;
+}
+
+/* case prefix is 49 */
+
+/* asynchronous log: threads, drain and fork */
+int run_case49()
+{
+	return run(__func__);
+}
@@ -0,0 +1,240 @@
+#include "../test_deflate.h"
+#include "../test_utils.h"
+
+static alloc_func zalloc = (alloc_func)0;
+static free_func zfree = (free_func)0;
+
+/* use nx to deflate step bytes at a time; the global options change
+   half way when live is set */
+static int _test_nx_deflate(Byte* src, unsigned int src_len, Byte* compr, unsigned int compr_len,
+			    unsigned int *total, int step, int per_stream, int live)
+{
+	int err;
+	z_stream c_stream;
+
+	c_stream.zalloc = zalloc;
+	c_stream.zfree = zfree;
+	c_stream.opaque = (voidpf)0;
+
+	err = nx_deflateInit(&c_stream, Z_DEFAULT_COMPRESSION);
+	if (err != 0) {
+		printf("nx_deflateInit err %d\n", err);
+		return TEST_ERROR;
+	}
+	if (per_stream) {
+		err = nx_deflateSetOption(&c_stream, NX_OPT_PER_JOB_LEN, 64*1024);
+		assert(err == Z_OK);
+		err = nx_deflateSetOption(&c_stream, NX_OPT_DEF_BUF_SIZE, 64*1024);
+		assert(err == Z_OK);
+		err = nx_deflateSetOption(&c_stream, NX_OPT_COMPRESS_THRESHOLD, 0);
+		assert(err == Z_OK);
+		err = nx_deflateSetOption(&c_stream, NX_OPT_DHT_CONFIG, 1);
+		assert(err == Z_OK);
+		err = nx_deflateSetOption(&c_stream, NX_OPT_WAIT_SPIN_NS, 0);
+		assert(err == Z_STREAM_ERROR);
+	}
+
+	c_stream.next_in  = (z_const unsigned char *)src;
+	c_stream.next_out = compr;
+	while (c_stream.total_in < src_len) {
+		if (live && c_stream.total_in >= src_len / 2) {
+			err = nx_set_option(NX_OPT_PER_JOB_LEN, 256*1024);
+			assert(err == Z_OK);
+			err = nx_set_option(NX_OPT_DEF_BUF_SIZE, 128*1024);
+			assert(err == Z_OK);
+			live = 0;
+		}
+		c_stream.avail_in = NX_MIN(step, src_len - c_stream.total_in);
+		c_stream.avail_out = NX_MIN(step, compr_len - c_stream.total_out);
+		err = nx_deflate(&c_stream, Z_NO_FLUSH);
+		if (err != Z_OK) {
+			printf("nx_deflate err %d\n", err);
+			return TEST_ERROR;
+		}
+	}
+	do {
+		c_stream.avail_out = NX_MIN(step, compr_len - c_stream.total_out);
+		err = nx_deflate(&c_stream, Z_FINISH);
+	} while (err == Z_OK);
+	assert(err == Z_STREAM_END);
+	*total = c_stream.total_out;
+
+	err = nx_deflateEnd(&c_stream);
+	if (err != 0) {
+		return TEST_ERROR;
+	}
+
+	return TEST_OK;
+}
+
+/* use zlib inflate to inflate */
+static int _test_inflate(Byte* compr, unsigned int comprLen, Byte* uncompr, unsigned int uncomprLen, Byte* src, unsigned int src_len)
+{
+	int err;
+	z_stream d_stream;
+
+	memset(uncompr, 0, uncomprLen);
+
+	d_stream.zalloc = zalloc;
+	d_stream.zfree = zfree;
+	d_stream.opaque = (voidpf)0;
+
+	d_stream.next_in  = compr;
+	d_stream.avail_in = comprLen;
+	d_stream.next_out = uncompr;
+	d_stream.avail_out = uncomprLen;
+
+	err = inflateInit(&d_stream);
+	err = inflate(&d_stream, Z_FINISH);
+	if (err != Z_STREAM_END) {
+		printf("inflate err %d\n", err);
+		return TEST_ERROR;
+	}
+	inflateEnd(&d_stream);
+
+	if (d_stream.total_out != src_len || compare_data(uncompr, src, src_len)) {
+		return TEST_ERROR;
+	}
+
+	return TEST_OK;
+}
+
+/* use nx inflate with its own job length and fifo_out budget */
+static int _test_nx_inflate(Byte* compr, unsigned int comprLen, Byte* uncompr, unsigned int uncomprLen, Byte* src, unsigned int src_len, int step)
+{
+	int err;
+	z_stream d_stream;
+
+	memset(uncompr, 0, uncomprLen);
+
+	d_stream.zalloc = zalloc;
+	d_stream.zfree = zfree;
+	d_stream.opaque = (voidpf)0;
+
+	d_stream.next_in  = compr;
+	d_stream.avail_in = 0;
+	d_stream.next_out = uncompr;
+
+	err = nx_inflateInit(&d_stream);
+	err = nx_inflateSetOption(&d_stream, NX_OPT_PER_JOB_LEN, 64*1024);
+	assert(err == Z_OK);
+	err = nx_inflateSetOption(&d_stream, NX_OPT_INF_STREAM_MEM, 0);
+	assert(err == Z_OK);
+	err = nx_inflateSetOption(&d_stream, NX_OPT_DEF_BUF_SIZE, 0);
+	assert(err == Z_STREAM_ERROR);
+	while (d_stream.total_out < uncomprLen && d_stream.total_in < comprLen) {
+		d_stream.avail_in = NX_MIN(step, comprLen - d_stream.total_in);
+		d_stream.avail_out = step;
+		err = nx_inflate(&d_stream, Z_NO_FLUSH);
+		if (err == Z_STREAM_END) break;
+	}
+
+	err = nx_inflateEnd(&d_stream);
+
+	if (compare_data(uncompr, src, src_len)) {
+		return TEST_ERROR;
+	}
+
+	return TEST_OK;
+}
+
+static int run(unsigned int len, int step, int per_stream, int live, const char* test)
+{
+	Byte *src, *compr, *uncompr;
+	unsigned int src_len = len;
+	unsigned int compr_len = src_len*2;
+	unsigned int uncompr_len = src_len*2;
+	unsigned int total;
+	uint64_t job_len, bufsz;
+	int err;
+
+	generate_random_data(src_len);
+	src = &ran_data[0];
+
+	compr = (Byte*)calloc((uInt)compr_len, 1);
+	uncompr = (Byte*)calloc((uInt)uncompr_len, 1);
+	if (compr == NULL || uncompr == NULL ) {
+		printf("*** alloc buffer failed\n");
+		return TEST_ERROR;
+	}
+
+	err = nx_get_option(NX_OPT_PER_JOB_LEN, &job_len);
+	assert(err == Z_OK);
+	err = nx_get_option(NX_OPT_DEF_BUF_SIZE, &bufsz);
+	assert(err == Z_OK);
+
+	if (_test_nx_deflate(src, src_len, compr, compr_len, &total, step, per_stream, live)) goto err;
+	if (_test_inflate(compr, total, uncompr, uncompr_len, src, src_len)) goto err;
+	if (_test_nx_inflate(compr, total, uncompr, uncompr_len, src, src_len, step)) goto err;
+
+	nx_set_option(NX_OPT_PER_JOB_LEN, job_len);
+	nx_set_option(NX_OPT_DEF_BUF_SIZE, bufsz);
+
+	printf("*** %s %s passed\n", __FILE__, test);
+	free(compr);
+	free(uncompr);
+	return TEST_OK;
+err:
+	nx_set_option(NX_OPT_PER_JOB_LEN, job_len);
+	nx_set_option(NX_OPT_DEF_BUF_SIZE, bufsz);
+	free(compr);
+	free(uncompr);
+	return TEST_ERROR;
+}
+
+/* case prefix is 42 */
+
+/* options read back, clamped to their range */
+int run_case42()
+{
+	uint64_t v, old;
+	int err;
+
+	err = nx_get_option(NX_OPT_COMPRESS_THRESHOLD, &old);
+	assert(err == Z_OK);
+	err = nx_set_option(NX_OPT_COMPRESS_THRESHOLD, 1ULL<<40);
+	assert(err == Z_OK);
+	err = nx_get_option(NX_OPT_COMPRESS_THRESHOLD, &v);
+	assert(err == Z_OK && v == 64*1024);
+	err = nx_set_option(NX_OPT_COMPRESS_THRESHOLD, old);
+	assert(err == Z_OK);
+
+	/* no more than the suspend limit */
+	err = nx_get_option(NX_OPT_PER_JOB_LEN, &old);
+	assert(err == Z_OK);
+	err = nx_set_option(NX_OPT_PER_JOB_LEN, 1<<24);
+	assert(err == Z_OK);
+	err = nx_get_option(NX_OPT_PER_JOB_LEN, &v);
+	assert(err == Z_OK && v == 1<<20);
+	err = nx_set_option(NX_OPT_PER_JOB_LEN, old);
+	assert(err == Z_OK);
+
+	err = nx_get_option(NX_OPT_WAIT_SPIN_NS, &old);
+	assert(err == Z_OK);
+	err = nx_set_option(NX_OPT_WAIT_SPIN_NS, 2000);
+	assert(err == Z_OK);
+	err = nx_get_option(NX_OPT_WAIT_SPIN_NS, &v);
+	assert(err == Z_OK && v == 2000);
+	err = nx_set_option(NX_OPT_WAIT_SPIN_NS, old);
+	assert(err == Z_OK);
+
+	err = nx_set_option(NX_OPT_MAX, 0);
+	assert(err == Z_STREAM_ERROR);
+	err = nx_get_option(NX_OPT_MAX, &v);
+	assert(err == Z_STREAM_ERROR);
+
+	printf("*** %s %s passed\n", __FILE__, __func__);
+	return TEST_OK;
+}
+
+/* job length and buffer size changed for all streams mid stream */
+int run_case42_1()
+{
+	return run(1024*1024*4, 1024*100, 0, 1, __func__);
+}
+
+/* one stream with its own job length, buffer size and threshold */
+int run_case42_2()
+{
+	return run(1024*1024*4, 1024*100, 1, 0, __func__);
+}
@@ -0,0 +1,158 @@
+#include "../test_inflate.h"
+#include "../test_utils.h"
+
+static alloc_func zalloc = (alloc_func)0;
+static free_func zfree = (free_func)0;
+
+/* use zlib to deflate raw */
+static int _test_deflate(Byte* src, unsigned int src_len, Byte* compr, unsigned int compr_len, int wbits, unsigned int *total)
+{
+	int err;
+	z_stream c_stream;
+
+	c_stream.zalloc = zalloc;
+	c_stream.zfree = zfree;
+	c_stream.opaque = (voidpf)0;
+
+	err = deflateInit2(&c_stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -wbits, 8, Z_DEFAULT_STRATEGY);
+	if (err != 0) {
+		printf("deflateInit2 err %d\n", err);
+		return TEST_ERROR;
+	}
+
+	c_stream.next_in  = (z_const unsigned char *)src;
+	c_stream.avail_in = src_len;
+	c_stream.next_out = compr;
+	c_stream.avail_out = compr_len;
+	err = deflate(&c_stream, Z_FINISH);
+	assert(err == Z_STREAM_END);
+	*total = c_stream.total_out;
+	printf("\n*** c_stream.total_out %d\n", *total);
+
+	err = deflateEnd(&c_stream);
+	if (err != 0) {
+		return TEST_ERROR;
+	}
+
+	return TEST_OK;
+}
+
+struct back_io {
+	Byte *buf;
+	unsigned int len;
+	unsigned int pos;
+	unsigned int step;
+};
+
+static unsigned in_cb(void *desc, z_const unsigned char **buf)
+{
+	struct back_io *io = desc;
+	unsigned int n = NX_MIN(io->step, io->len - io->pos);
+
+	*buf = io->buf + io->pos;
+	io->pos += n;
+	return n;
+}
+
+static int out_cb(void *desc, unsigned char *buf, unsigned len)
+{
+	struct back_io *io = desc;
+
+	if (io->pos + len > io->len)
+		return 1;
+	memcpy(io->buf + io->pos, buf, len);
+	io->pos += len;
+	return 0;
+}
+
+/* nx inflateBack with the input given step bytes at a time */
+static int _test_nx_inflate_back(Byte* compr, unsigned int compr_len, Byte* uncompr, unsigned int uncompr_len, Byte* src, unsigned int src_len, int wbits, int step)
+{
+	int err;
+	z_stream d_stream;
+	unsigned char *window;
+	/* bytes following the stream are left in next_in */
+	const unsigned int extra = 16;
+	struct back_io in = { compr, compr_len + extra, 0, step };
+	struct back_io out = { uncompr, uncompr_len, 0, 0 };
+
+	memset(uncompr, 0, uncompr_len);
+	memset(&d_stream, 0, sizeof(d_stream));
+	d_stream.zalloc = zalloc;
+	d_stream.zfree = zfree;
+	d_stream.opaque = (voidpf)0;
+
+	window = malloc(1 << wbits);
+	err = nx_inflateBackInit(&d_stream, wbits, window);
+	if (err != Z_OK)
+		return TEST_ERROR;
+
+	err = nx_inflateBack(&d_stream, in_cb, &in, out_cb, &out);
+	printf("*** inflateBack err %d out %d\n", err, out.pos);
+	assert(err == Z_STREAM_END);
+	assert(out.pos == src_len);
+	assert(d_stream.next_in == compr + compr_len);
+	assert(d_stream.avail_in == in.pos - compr_len);
+
+	/* input ending early is a buffer error */
+	in.pos = 0;
+	in.len = compr_len / 2;
+	out.pos = 0;
+	d_stream.next_in = Z_NULL;
+	err = nx_inflateBack(&d_stream, in_cb, &in, out_cb, &out);
+	assert(err == Z_BUF_ERROR && d_stream.next_in == Z_NULL);
+
+	err = nx_inflateBackEnd(&d_stream);
+	free(window);
+
+	if (compare_data(uncompr, src, src_len)) {
+		return TEST_ERROR;
+	}
+
+	return TEST_OK;
+}
+
+static int run(unsigned int len, int wbits, int step, const char* test)
+{
+	Byte *src, *compr, *uncompr;
+	unsigned int src_len = len;
+	unsigned int compr_len = src_len*2;
+	unsigned int uncompr_len = src_len*2;
+	unsigned int total;
+	generate_random_data(src_len);
+	src = &ran_data[0];
+
+	compr = (Byte*)calloc((uInt)compr_len, 1);
+	uncompr = (Byte*)calloc((uInt)uncompr_len, 1);
+	if (compr == NULL || uncompr == NULL ) {
+		printf("*** alloc buffer failed\n");
+		return TEST_ERROR;
+	}
+
+	if (_test_deflate(src, src_len, compr, compr_len, wbits, &total)) goto err;
+	memset(compr + total, 0xa5, 16);
+	if (_test_nx_inflate_back(compr, total, uncompr, uncompr_len, src, src_len, wbits, step)) goto err;
+
+	printf("*** %s %s passed\n", __FILE__, test);
+	free(compr);
+	free(uncompr);
+	return TEST_OK;
+err:
+	free(compr);
+	free(uncompr);
+	return TEST_ERROR;
+}
+
+/* case prefix is 13 */
+
+/* 32KB window holds the history; 64KB of input per in() call */
+int run_case13()
+{
+	return run(8*1024*1024, 15, 64*1024, __func__);
+}
+
+/* a 4KB window and small in() calls */
+int run_case13_1()
+{
+	return run(1024*1024, 12, 1000, __func__);
+}
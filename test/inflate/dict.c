@@ -0,0 +1,182 @@
+#include "../test_inflate.h"
+#include "../test_utils.h"
+
+static alloc_func zalloc = (alloc_func)0;
+static free_func zfree = (free_func)0;
+
+#define DICT_LEN  (32*1024)
+#define MSGS      8
+
+/* use zlib to deflate one message with a preset dictionary */
+static int _test_deflate(Byte* src, unsigned int src_len, Byte* compr, unsigned int compr_len, unsigned int *total, Byte* dict, int wbits)
+{
+	int err;
+	z_stream c_stream;
+
+	c_stream.zalloc = zalloc;
+	c_stream.zfree = zfree;
+	c_stream.opaque = (voidpf)0;
+
+	err = deflateInit2(&c_stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, wbits, 8, Z_DEFAULT_STRATEGY);
+	if (err != 0) {
+		printf("deflateInit2 err %d\n", err);
+		return TEST_ERROR;
+	}
+	err = deflateSetDictionary(&c_stream, dict, DICT_LEN);
+	assert(err == Z_OK);
+
+	c_stream.next_in  = (z_const unsigned char *)src;
+	c_stream.avail_in = src_len;
+	c_stream.next_out = compr;
+	c_stream.avail_out = compr_len;
+	err = deflate(&c_stream, Z_FINISH);
+	assert(err == Z_STREAM_END);
+	*total = c_stream.total_out;
+
+	err = deflateEnd(&c_stream);
+	if (err != 0) {
+		return TEST_ERROR;
+	}
+
+	return TEST_OK;
+}
+
+/* nx inflate of several messages on one stream with a shared
+   dictionary; 4KB of output per call so that the dictionary must stay
+   in the history of later jobs */
+static int _test_nx_inflate(Byte* compr, unsigned int compr_len, Byte* uncompr, unsigned int uncompr_len, Byte* src, unsigned int src_len, z_stream *d_stream)
+{
+	int err = Z_OK;
+
+	memset(uncompr, 0, uncompr_len);
+	err = nx_inflateReset(d_stream);
+	assert(err == Z_OK);
+
+	d_stream->next_in  = compr;
+	d_stream->avail_in = compr_len;
+	d_stream->next_out = uncompr;
+
+	while (err == Z_OK && d_stream->total_out < uncompr_len) {
+		d_stream->avail_out = NX_MIN(4096, uncompr_len - d_stream->total_out);
+		err = nx_inflate(d_stream, Z_NO_FLUSH);
+	}
+	assert(err == Z_STREAM_END);
+	assert(d_stream->total_out == src_len);
+
+	if (compare_data(uncompr, src, src_len)) {
+		return TEST_ERROR;
+	}
+
+	return TEST_OK;
+}
+
+/* nx deflate with the shared dictionary; zlib inflates it back */
+static int _test_nx_deflate(Byte* src, unsigned int src_len, Byte* compr, unsigned int compr_len, Byte* uncompr, unsigned int uncompr_len, Byte* dict, z_stream *c_stream)
+{
+	int err;
+	z_stream d_stream;
+
+	err = nx_deflateReset(c_stream);
+	assert(err == Z_OK);
+	c_stream->next_in  = src;
+	c_stream->avail_in = src_len;
+	c_stream->next_out = compr;
+	c_stream->avail_out = compr_len;
+	err = nx_deflate(c_stream, Z_FINISH);
+	assert(err == Z_STREAM_END);
+
+	memset(&d_stream, 0, sizeof(d_stream));
+	err = inflateInit(&d_stream);
+	assert(err == Z_OK);
+	d_stream.next_in  = compr;
+	d_stream.avail_in = c_stream->total_out;
+	d_stream.next_out = uncompr;
+	d_stream.avail_out = uncompr_len;
+	err = inflate(&d_stream, Z_FINISH);
+	assert(err == Z_NEED_DICT);
+	err = inflateSetDictionary(&d_stream, dict, DICT_LEN);
+	assert(err == Z_OK);
+	err = inflate(&d_stream, Z_FINISH);
+	assert(err == Z_STREAM_END);
+	assert(d_stream.total_out == src_len);
+	inflateEnd(&d_stream);
+
+	if (compare_data(uncompr, src, src_len)) {
+		return TEST_ERROR;
+	}
+
+	return TEST_OK;
+}
+
+static int run(unsigned int len, int wbits, const char* test)
+{
+	Byte *src, *dict, *compr, *uncompr;
+	unsigned int src_len = len;
+	unsigned int compr_len = src_len*2;
+	unsigned int uncompr_len = src_len*2;
+	unsigned int total, i, off;
+	z_stream c_stream, d_stream;
+	nx_dictp d, d2;
+
+	/* messages are pieces of the data; the dictionary its start */
+	generate_random_data(DICT_LEN + src_len * 2);
+	dict = (Byte *)&ran_data[0];
+
+	compr = (Byte*)calloc((uInt)compr_len, 1);
+	uncompr = (Byte*)calloc((uInt)uncompr_len, 1);
+	if (compr == NULL || uncompr == NULL ) {
+		printf("*** alloc buffer failed\n");
+		return TEST_ERROR;
+	}
+
+	d = nx_dictCreate(dict, DICT_LEN);
+	assert(d != NULL);
+	d2 = nx_dictCreate(dict, DICT_LEN);
+	assert(d2 == d);
+	nx_dictRelease(d2);
+
+	memset(&d_stream, 0, sizeof(d_stream));
+	assert(nx_inflateInit2(&d_stream, wbits) == Z_OK);
+	assert(nx_inflateSetSharedDictionary(&d_stream, d) == Z_OK);
+
+	memset(&c_stream, 0, sizeof(c_stream));
+	assert(nx_deflateInit(&c_stream, Z_DEFAULT_COMPRESSION) == Z_OK);
+	assert(nx_deflateSetSharedDictionary(&c_stream, d) == Z_OK);
+
+	/* the streams keep d after the caller lets it go */
+	nx_dictRelease(d);
+
+	for (i = 0; i < MSGS; i++) {
+		off = (DICT_LEN / MSGS) * i;
+		src = (Byte *)&ran_data[off];
+		if (_test_deflate(src, src_len, compr, compr_len, &total, dict, wbits)) goto err;
+		if (_test_nx_inflate(compr, total, uncompr, uncompr_len, src, src_len, &d_stream)) goto err;
+		if (_test_nx_deflate(src, src_len, compr, compr_len, uncompr, uncompr_len, dict, &c_stream)) goto err;
+	}
+
+	nx_inflateEnd(&d_stream);
+	nx_deflateEnd(&c_stream);
+
+	printf("*** %s %s passed\n", __FILE__, test);
+	free(compr);
+	free(uncompr);
+	return TEST_OK;
+err:
+	free(compr);
+	free(uncompr);
+	return TEST_ERROR;
+}
+
+/* case prefix is 15 */
+
+/* zlib messages asking for a shared dictionary */
+int run_case15()
+{
+	return run(64*1024, 15, __func__);
+}
+
+/* raw messages starting with a shared dictionary */
+int run_case15_1()
+{
+	return run(64*1024, -15, __func__);
+}
@@ -0,0 +1,133 @@
+#include "../test_inflate.h"
+#include "../test_utils.h"
+
+static alloc_func zalloc = (alloc_func)0;
+static free_func zfree = (free_func)0;
+
+/* use zlib to deflate in gzip format with all optional header fields */
+static int _test_deflate(Byte* src, unsigned int src_len, Byte* compr, unsigned int compr_len, unsigned int *total)
+{
+	int err;
+	z_stream c_stream;
+	gz_header head;
+	static Byte extra[] = "BC\002\000\000\000";
+
+	c_stream.zalloc = zalloc;
+	c_stream.zfree = zfree;
+	c_stream.opaque = (voidpf)0;
+
+	err = deflateInit2(&c_stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + 15, 8, Z_DEFAULT_STRATEGY);
+	if (err != 0) {
+		printf("deflateInit2 err %d\n", err);
+		return TEST_ERROR;
+	}
+
+	memset(&head, 0, sizeof(head));
+	head.text = 1;
+	head.time = 0x5f000000;
+	head.os = 3;
+	head.extra = extra;
+	head.extra_len = 6;
+	head.name = (Bytef *)"header.txt";
+	head.comment = (Bytef *)"gzip header with every optional field";
+	head.hcrc = 1;
+	err = deflateSetHeader(&c_stream, &head);
+	assert(err == Z_OK);
+
+	c_stream.next_in  = (z_const unsigned char *)src;
+	c_stream.avail_in = src_len;
+	c_stream.next_out = compr;
+	c_stream.avail_out = compr_len;
+	err = deflate(&c_stream, Z_FINISH);
+	assert(err == Z_STREAM_END);
+	*total = c_stream.total_out;
+	printf("\n*** c_stream.total_out %d\n", *total);
+
+	err = deflateEnd(&c_stream);
+	if (err != 0) {
+		return TEST_ERROR;
+	}
+
+	return TEST_OK;
+}
+
+/* nx inflate; the first call gets first bytes of input only, so
+   small values split the header over calls */
+static int _test_nx_inflate(Byte* compr, unsigned int compr_len, Byte* uncompr, unsigned int uncompr_len, Byte* src, unsigned int src_len, unsigned int first)
+{
+	int err;
+	z_stream d_stream;
+
+	memset(uncompr, 0, uncompr_len);
+	memset(&d_stream, 0, sizeof(d_stream));
+	d_stream.zalloc = zalloc;
+	d_stream.zfree = zfree;
+	d_stream.opaque = (voidpf)0;
+
+	err = nx_inflateInit2(&d_stream, 16 + 15);
+	if (err != Z_OK)
+		return TEST_ERROR;
+
+	d_stream.next_in  = compr;
+	d_stream.avail_in = NX_MIN(first, compr_len);
+	d_stream.next_out = uncompr;
+	d_stream.avail_out = uncompr_len;
+
+	while (d_stream.total_in < compr_len) {
+		err = nx_inflate(&d_stream, Z_NO_FLUSH);
+		if (err != Z_OK)
+			break;
+		d_stream.avail_in = compr_len - d_stream.total_in;
+	}
+	printf("*** first %d err %d total_in %ld total_out %ld\n", first, err, d_stream.total_in, d_stream.total_out);
+	assert(err == Z_STREAM_END);
+	assert(d_stream.total_out == src_len);
+
+	err = nx_inflateEnd(&d_stream);
+
+	if (compare_data(uncompr, src, src_len)) {
+		return TEST_ERROR;
+	}
+
+	return TEST_OK;
+}
+
+static int run(unsigned int len, const char* test)
+{
+	Byte *src, *compr, *uncompr;
+	unsigned int src_len = len;
+	unsigned int compr_len = src_len*2;
+	unsigned int uncompr_len = src_len*2;
+	unsigned int total, first;
+	generate_random_data(src_len);
+	src = &ran_data[0];
+
+	compr = (Byte*)calloc((uInt)compr_len, 1);
+	uncompr = (Byte*)calloc((uInt)uncompr_len, 1);
+	if (compr == NULL || uncompr == NULL ) {
+		printf("*** alloc buffer failed\n");
+		return TEST_ERROR;
+	}
+
+	if (_test_deflate(src, src_len, compr, compr_len, &total)) goto err;
+	/* whole header in one call, then split after the first bytes */
+	for (first = 1; first <= 80; first = (first < 16) ? first + 1 : first * 2)
+		if (_test_nx_inflate(compr, total, uncompr, uncompr_len, src, src_len, (first == 1) ? total : first)) goto err;
+
+	printf("*** %s %s passed\n", __FILE__, test);
+	free(compr);
+	free(uncompr);
+	return TEST_OK;
+err:
+	free(compr);
+	free(uncompr);
+	return TEST_ERROR;
+}
+
+/* case prefix is 14 */
+
+/* gzip header with extra, name, comment and header crc */
+int run_case14()
+{
+	return run(64*1024, __func__);
+}
@@ -0,0 +1,162 @@
+#include "../test_inflate.h"
+#include "../test_utils.h"
+
+static alloc_func zalloc = (alloc_func)0;
+static free_func zfree = (free_func)0;
+
+/* use zlib to deflate */
+static int _test_deflate(Byte* src, unsigned int src_len, Byte* compr, unsigned int compr_len, unsigned int *total)
+{
+	int err;
+	z_stream c_stream;
+
+	c_stream.zalloc = zalloc;
+	c_stream.zfree = zfree;
+	c_stream.opaque = (voidpf)0;
+
+	err = deflateInit(&c_stream, Z_DEFAULT_COMPRESSION);
+	if (err != 0) {
+		printf("deflateInit err %d\n", err);
+		return TEST_ERROR;
+	}
+
+	c_stream.next_in  = (z_const unsigned char *)src;
+	c_stream.avail_in = src_len;
+	c_stream.next_out = compr;
+	c_stream.avail_out = compr_len;
+	err = deflate(&c_stream, Z_FINISH);
+	assert(err == Z_STREAM_END);
+	*total = c_stream.total_out;
+
+	err = deflateEnd(&c_stream);
+	if (err != 0) {
+		return TEST_ERROR;
+	}
+
+	return TEST_OK;
+}
+
+/* nx inflate step bytes of input per call.  With bounce the output
+   of every call goes to the same step sized buffer, which is copied
+   away afterwards, so next_out never continues the last output */
+static int _test_nx_inflate(Byte* compr, unsigned int compr_len, Byte* uncompr, unsigned int uncompr_len,
+			    Byte* src, unsigned int src_len, int step, int inplace, int bounce, unsigned long *resumed)
+{
+	int err, saved = nx_config.inflate_hist_inplace;
+	int trace = nx_gzip_trace;
+	z_stream d_stream;
+	struct zlib_stats before, after;
+	Byte *out = NULL;
+	unsigned int have;
+
+	memset(uncompr, 0, uncompr_len);
+	if (bounce && NULL == (out = malloc(step)))
+		return TEST_ERROR;
+
+	memset(&d_stream, 0, sizeof(d_stream));
+	d_stream.zalloc = zalloc;
+	d_stream.zfree = zfree;
+	d_stream.opaque = (voidpf)0;
+
+	__atomic_or_fetch(&nx_gzip_trace, 0x8, __ATOMIC_RELAXED);
+	nx_get_stats(&before);
+
+	nx_config.inflate_hist_inplace = inplace;
+	err = nx_inflateInit(&d_stream);
+	nx_config.inflate_hist_inplace = saved;
+	if (err != Z_OK)
+		goto err;
+
+	d_stream.next_in  = compr;
+	d_stream.next_out = uncompr;
+	do {
+		d_stream.avail_in = NX_MIN(step, compr_len - d_stream.total_in);
+		if (bounce) {
+			d_stream.next_out = out;
+			d_stream.avail_out = step;
+		}
+		else
+			d_stream.avail_out = NX_MIN(step, uncompr_len - d_stream.total_out);
+		have = d_stream.total_out;
+		err = nx_inflate(&d_stream, Z_NO_FLUSH);
+		if (bounce)
+			memcpy(uncompr + have, out, d_stream.total_out - have);
+	} while (err == Z_OK);
+	nx_inflateEnd(&d_stream);
+
+	nx_get_stats(&after);
+	__atomic_store_n(&nx_gzip_trace, trace, __ATOMIC_RELAXED);
+	*resumed = after.inflate_hist_inplace - before.inflate_hist_inplace;
+
+	if (err != Z_STREAM_END || d_stream.total_out != src_len) {
+		printf("nx_inflate err %d total_out %lu\n", err, (unsigned long)d_stream.total_out);
+		goto err;
+	}
+	if (compare_data((char *)uncompr, (char *)src, src_len))
+		goto err;
+
+	free(out);
+	return TEST_OK;
+err:
+	__atomic_store_n(&nx_gzip_trace, trace, __ATOMIC_RELAXED);
+	free(out);
+	return TEST_ERROR;
+}
+
+static int run(unsigned int len, int step, int inplace, int bounce, const char* test)
+{
+	Byte *src, *compr, *uncompr;
+	unsigned int src_len = len;
+	unsigned int compr_len = src_len*2;
+	unsigned int uncompr_len = src_len*2;
+	unsigned int total;
+	unsigned long resumed;
+
+	generate_random_data(src_len);
+	src = (Byte*)&ran_data[0];
+
+	compr = (Byte*)calloc((uInt)compr_len, 1);
+	uncompr = (Byte*)calloc((uInt)uncompr_len, 1);
+	if (compr == NULL || uncompr == NULL ) {
+		printf("*** alloc buffer failed\n");
+		goto err;
+	}
+
+	if (_test_deflate(src, src_len, compr, compr_len, &total)) goto err;
+	if (_test_nx_inflate(compr, total, uncompr, uncompr_len, src, src_len, step, inplace, bounce, &resumed)) goto err;
+
+	/* contiguous output resumes from next_out; never unless asked */
+	if ((inplace && !bounce && resumed == 0) || (!inplace && resumed != 0)) {
+		printf("%lu jobs resumed in place\n", resumed);
+		goto err;
+	}
+
+	printf("*** %s %s passed\n", __FILE__, test);
+	free(compr);
+	free(uncompr);
+	return TEST_OK;
+err:
+	free(compr);
+	free(uncompr);
+	return TEST_ERROR;
+}
+
+/* case prefix is 16 */
+
+/* history left in next_out, which keeps advancing */
+int run_case16()
+{
+	return run(1024*1024*4, 64*1024, 1, 0, __func__);
+}
+
+/* history left in next_out, but next_out is the same buffer each call */
+int run_case16_1()
+{
+	return run(1024*1024*4, 64*1024, 1, 1, __func__);
+}
+
+/* history copied to fifo_out after every job as before */
+int run_case16_2()
+{
+	return run(1024*1024*4, 64*1024, 0, 0, __func__);
+}
@@ -0,0 +1,176 @@
+#include "../test_inflate.h"
+#include "../test_utils.h"
+
+static alloc_func zalloc = (alloc_func)0;
+static free_func zfree = (free_func)0;
+
+#define STREAMS 8
+
+/* use zlib to deflate */
+static int _test_deflate(Byte* src, unsigned int src_len, Byte* compr, unsigned int compr_len, unsigned int *total)
+{
+	int err;
+	z_stream c_stream;
+
+	c_stream.zalloc = zalloc;
+	c_stream.zfree = zfree;
+	c_stream.opaque = (voidpf)0;
+
+	err = deflateInit(&c_stream, Z_DEFAULT_COMPRESSION);
+	if (err != 0) {
+		printf("deflateInit err %d\n", err);
+		return TEST_ERROR;
+	}
+
+	c_stream.next_in  = (z_const unsigned char *)src;
+	c_stream.avail_in = src_len;
+	c_stream.next_out = compr;
+	c_stream.avail_out = compr_len;
+	err = deflate(&c_stream, Z_FINISH);
+	assert(err == Z_STREAM_END);
+	*total = c_stream.total_out;
+
+	err = deflateEnd(&c_stream);
+	if (err != 0) {
+		return TEST_ERROR;
+	}
+
+	return TEST_OK;
+}
+
+static uint64_t page_up(uint64_t n)
+{
+	return (n + nx_config.page_sz - 1) & ~((uint64_t)nx_config.page_sz - 1);
+}
+
+/* STREAMS streams get all their input at once and step bytes of
+   output per call, round robin, so most of the output waits in
+   fifo_out.  The fifos of all streams must stay within limit bytes
+   and all be given back at the end */
+static int _test_nx_inflate(Byte* compr, unsigned int compr_len, Byte* uncompr, unsigned int uncompr_len,
+			    Byte* src, unsigned int src_len, int step, uint64_t limit)
+{
+	z_stream d[STREAMS];
+	int err[STREAMS];
+	uint64_t start, resident, peak;
+	int i, live, rc = TEST_ERROR;
+
+	nx_inflate_mem_usage(&start, NULL);
+
+	for (i = 0; i < STREAMS; i++) {
+		memset(&d[i], 0, sizeof(d[i]));
+		d[i].zalloc = zalloc;
+		d[i].zfree = zfree;
+		d[i].opaque = (voidpf)0;
+		if (nx_inflateInit(&d[i]) != Z_OK)
+			return TEST_ERROR;
+		d[i].next_in = compr;
+		d[i].avail_in = compr_len;
+		d[i].next_out = uncompr + (uint64_t)i * src_len;
+		err[i] = Z_OK;
+	}
+
+	do {
+		live = 0;
+		for (i = 0; i < STREAMS; i++) {
+			if (err[i] != Z_OK)
+				continue;
+			d[i].avail_out = NX_MIN(step, src_len - d[i].total_out);
+			err[i] = nx_inflate(&d[i], Z_NO_FLUSH);
+			live++;
+
+			nx_inflate_mem_usage(&resident, NULL);
+			if (resident - start > limit) {
+				printf("fifos of %d streams hold %lu bytes, limit %lu\n", STREAMS,
+				       (unsigned long)(resident - start), (unsigned long)limit);
+				goto out;
+			}
+		}
+	} while (live > 0);
+
+	for (i = 0; i < STREAMS; i++) {
+		if (err[i] != Z_STREAM_END || d[i].total_out != src_len ||
+		    compare_data((char *)uncompr + (uint64_t)i * src_len, (char *)src, src_len)) {
+			printf("stream %d err %d total_out %lu\n", i, err[i], (unsigned long)d[i].total_out);
+			goto out;
+		}
+	}
+	rc = TEST_OK;
+out:
+	for (i = 0; i < STREAMS; i++)
+		nx_inflateEnd(&d[i]);
+
+	nx_inflate_mem_usage(&resident, &peak);
+	if (resident != start || peak < start) {
+		printf("fifos hold %lu bytes after the streams ended, %lu before\n",
+		       (unsigned long)resident, (unsigned long)start);
+		return TEST_ERROR;
+	}
+	return rc;
+}
+
+static int run(unsigned int len, int step, uint64_t stream_mem, uint64_t mem_max, const char* test)
+{
+	Byte *src, *compr, *uncompr;
+	unsigned int src_len = len;
+	unsigned int compr_len = src_len*2;
+	unsigned int uncompr_len = src_len*STREAMS;
+	unsigned int total;
+	uint64_t old_stream_mem, old_mem_max, floor, limit;
+	int rc = TEST_ERROR;
+
+	generate_random_data(src_len);
+	src = (Byte*)&ran_data[0];
+
+	compr = (Byte*)calloc((uInt)compr_len, 1);
+	uncompr = (Byte*)calloc((uInt)uncompr_len, 1);
+	if (compr == NULL || uncompr == NULL ) {
+		printf("*** alloc buffer failed\n");
+		goto err;
+	}
+
+	if (_test_deflate(src, src_len, compr, compr_len, &total)) goto err;
+
+	if (nx_get_option(NX_OPT_INF_STREAM_MEM, &old_stream_mem) != Z_OK ||
+	    nx_get_option(NX_OPT_INF_MEM_MAX, &old_mem_max) != Z_OK)
+		goto err;
+	nx_set_option(NX_OPT_INF_STREAM_MEM, stream_mem);
+	nx_set_option(NX_OPT_INF_MEM_MAX, mem_max);
+
+	/* fifo_out is never cut under the max expansion of the
+	   smallest job; fifo_in is fixed */
+	floor = page_up(NX_MAX(300 * 1032, 8 * 32768));
+	limit = STREAMS * (NX_MAX(floor, page_up(stream_mem)) + 2 * nx_config.soft_copy_threshold);
+	if (mem_max > 0)
+		limit = NX_MIN(limit, mem_max + STREAMS * (floor + 2 * nx_config.soft_copy_threshold));
+
+	rc = _test_nx_inflate(compr, total, uncompr, uncompr_len, src, src_len, step, limit);
+
+	nx_set_option(NX_OPT_INF_STREAM_MEM, old_stream_mem);
+	nx_set_option(NX_OPT_INF_MEM_MAX, old_mem_max);
+	if (rc != TEST_OK)
+		goto err;
+
+	printf("*** %s %s passed\n", __FILE__, test);
+	free(compr);
+	free(uncompr);
+	return TEST_OK;
+err:
+	free(compr);
+	free(uncompr);
+	return TEST_ERROR;
+}
+
+/* case prefix is 17 */
+
+/* each stream's fifo_out within NX_GZIP_INF_STREAM_MEM */
+int run_case17()
+{
+	return run(1024*1024*8, 64*1024, 1024*1024, 0, __func__);
+}
+
+/* all streams within NX_GZIP_INF_MEM_MAX */
+int run_case17_1()
+{
+	return run(1024*1024*8, 64*1024, 1<<23, 4*1024*1024, __func__);
+}
@@ -0,0 +1,235 @@
+#include "../test_inflate.h"
+#include "../test_utils.h"
+#include <stddef.h>
+#include <sys/stat.h>
+
+static alloc_func zalloc = (alloc_func)0;
+static free_func zfree = (free_func)0;
+
+/* use zlib to deflate in gzip format */
+static int _test_deflate(Byte* src, unsigned int src_len, Byte* compr, unsigned int compr_len, unsigned int *total)
+{
+	int err;
+	z_stream c_stream;
+
+	c_stream.zalloc = zalloc;
+	c_stream.zfree = zfree;
+	c_stream.opaque = (voidpf)0;
+
+	err = deflateInit2(&c_stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + 15, 8, Z_DEFAULT_STRATEGY);
+	if (err != 0) {
+		printf("deflateInit2 err %d\n", err);
+		return TEST_ERROR;
+	}
+
+	c_stream.next_in  = (z_const unsigned char *)src;
+	c_stream.avail_in = src_len;
+	c_stream.next_out = compr;
+	c_stream.avail_out = compr_len;
+	err = deflate(&c_stream, Z_FINISH);
+	assert(err == Z_STREAM_END);
+	*total = c_stream.total_out;
+	printf("\n*** c_stream.total_out %d\n", *total);
+
+	err = deflateEnd(&c_stream);
+	if (err != 0) {
+		return TEST_ERROR;
+	}
+
+	return TEST_OK;
+}
+
+/* flips one byte of the file at off */
+static int corrupt(const char *fname, long off)
+{
+	FILE *fp;
+	int c;
+
+	if (NULL == (fp = fopen(fname, "r+")))
+		return -1;
+	fseek(fp, off, SEEK_SET);
+	c = fgetc(fp);
+	fseek(fp, off, SEEK_SET);
+	fputc(c ^ 0x5a, fp);
+	return fclose(fp);
+}
+
+/* saves the index of d_stream to fname and continues with a new
+   stream that loads it */
+static int _test_index_reload(z_stream *d_stream, const char *fname)
+{
+	int err;
+
+	err = nx_inflateIndexSave(d_stream, fname);
+	if (err != Z_OK) {
+		printf("nx_inflateIndexSave err %d\n", err);
+		return TEST_ERROR;
+	}
+	nx_inflateEnd(d_stream);
+
+	memset(d_stream, 0, sizeof(*d_stream));
+	err = nx_inflateInit2(d_stream, 16 + 15);
+	if (err != Z_OK)
+		return TEST_ERROR;
+	err = nx_inflateIndexLoad(d_stream, fname);
+	if (err != Z_OK) {
+		printf("nx_inflateIndexLoad err %d\n", err);
+		return TEST_ERROR;
+	}
+	return TEST_OK;
+}
+
+/* a flipped byte in the header or in the last record's history is
+   refused; corrupt() flips it back */
+static int _test_index_corrupt(z_stream *d_stream, const char *fname)
+{
+	struct stat st;
+	int err;
+
+	if (nx_inflateIndexSave(d_stream, fname) != Z_OK || stat(fname, &st) != 0)
+		return TEST_ERROR;
+
+	corrupt(fname, st.st_size - 1);
+	err = nx_inflateIndexLoad(d_stream, fname);
+	if (err != Z_DATA_ERROR) {
+		printf("nx_inflateIndexLoad took a bad record, err %d\n", err);
+		return TEST_ERROR;
+	}
+	corrupt(fname, st.st_size - 1);
+
+	corrupt(fname, offsetof(nx_index_hdr_t, num));
+	err = nx_inflateIndexLoad(d_stream, fname);
+	if (err != Z_DATA_ERROR) {
+		printf("nx_inflateIndexLoad took a bad header, err %d\n", err);
+		return TEST_ERROR;
+	}
+	corrupt(fname, offsetof(nx_index_hdr_t, num));
+
+	err = nx_inflateIndexLoad(d_stream, fname);
+	if (err != Z_OK) {
+		printf("nx_inflateIndexLoad err %d after restoring\n", err);
+		return TEST_ERROR;
+	}
+	return TEST_OK;
+}
+
+/* index while inflating everything, then read pieces through the index;
+   with fname through an index saved to and loaded from the file */
+static int _test_nx_inflate_seek(Byte* compr, unsigned int compr_len, Byte* uncompr, unsigned int uncompr_len, Byte* src, unsigned int src_len, uint64_t span, int reads, const char *fname)
+{
+	int err, i;
+	z_stream d_stream;
+	uint64_t offset, in_off, out_off;
+	unsigned int piece = 4096;
+
+	memset(&d_stream, 0, sizeof(d_stream));
+	d_stream.zalloc = zalloc;
+	d_stream.zfree = zfree;
+	d_stream.opaque = (voidpf)0;
+
+	err = nx_inflateInit2(&d_stream, 16 + 15);
+	if (err != Z_OK)
+		return TEST_ERROR;
+	assert(nx_inflateIndex(&d_stream, span) == Z_OK);
+
+	d_stream.next_in  = compr;
+	d_stream.avail_in = compr_len;
+	d_stream.next_out = uncompr;
+	d_stream.avail_out = uncompr_len;
+	err = nx_inflate(&d_stream, Z_FINISH);
+	assert(err == Z_STREAM_END);
+	assert(d_stream.total_out == src_len);
+
+	if (fname != NULL && _test_index_reload(&d_stream, fname) != TEST_OK)
+		return TEST_ERROR;
+
+	for (i = 0; i < reads; i++) {
+		offset = rand() % (src_len - piece);
+		assert(nx_inflate_seek(&d_stream, offset, &in_off, &out_off) == Z_OK);
+		assert(out_off <= offset && in_off < compr_len);
+
+		memset(uncompr, 0, uncompr_len);
+		d_stream.next_in  = compr + in_off;
+		d_stream.avail_in = compr_len - in_off;
+		d_stream.next_out = uncompr;
+		d_stream.avail_out = offset - out_off + piece;
+		err = nx_inflate(&d_stream, Z_NO_FLUSH);
+		assert(err == Z_OK || err == Z_STREAM_END);
+		assert(d_stream.total_out == offset + piece);
+
+		if (compare_data(uncompr + offset - out_off, src + offset, piece)) {
+			printf("*** seek to %ld from checkpoint %ld failed\n", (long)offset, (long)out_off);
+			return TEST_ERROR;
+		}
+	}
+
+	/* the trailer still verifies after a seek */
+	assert(nx_inflate_seek(&d_stream, src_len - 1, &in_off, &out_off) == Z_OK);
+	d_stream.next_in  = compr + in_off;
+	d_stream.avail_in = compr_len - in_off;
+	d_stream.next_out = uncompr;
+	d_stream.avail_out = uncompr_len;
+	err = nx_inflate(&d_stream, Z_FINISH);
+	assert(err == Z_STREAM_END);
+
+	if (fname != NULL && _test_index_corrupt(&d_stream, fname) != TEST_OK)
+		return TEST_ERROR;
+
+	err = nx_inflateEnd(&d_stream);
+
+	return TEST_OK;
+}
+
+static int run(unsigned int len, uint64_t span, int reads, int file, const char* test)
+{
+	char fname[] = "/tmp/nx_test_seek.XXXXXX";
+	Byte *src, *compr, *uncompr;
+	unsigned int src_len = len;
+	unsigned int compr_len = src_len*2;
+	unsigned int uncompr_len = src_len*2;
+	unsigned int total;
+	generate_random_data(src_len);
+	src = &ran_data[0];
+
+	compr = (Byte*)calloc((uInt)compr_len, 1);
+	uncompr = (Byte*)calloc((uInt)uncompr_len, 1);
+	if (compr == NULL || uncompr == NULL ) {
+		printf("*** alloc buffer failed\n");
+		return TEST_ERROR;
+	}
+
+	if (_test_deflate(src, src_len, compr, compr_len, &total)) goto err;
+	if (file) {
+		int fd = mkstemp(fname);
+
+		if (fd < 0) goto err;
+		close(fd);
+	}
+	if (_test_nx_inflate_seek(compr, total, uncompr, uncompr_len, src, src_len, span, reads, file ? fname : NULL)) goto err;
+
+	printf("*** %s %s passed\n", __FILE__, test);
+	if (file) unlink(fname);
+	free(compr);
+	free(uncompr);
+	return TEST_OK;
+err:
+	if (file) unlink(fname);
+	free(compr);
+	free(uncompr);
+	return TEST_ERROR;
+}
+
+/* case prefix is 12 */
+
+/* 4KB reads through checkpoints every 1MB of 16MB */
+int run_case12()
+{
+	return run(16*1024*1024, 1024*1024, 64, 0, __func__);
+}
+
+/* the same through an index file saved, loaded in to a new stream
+   and then corrupted */
+int run_case12_1()
+{
+	return run(16*1024*1024, 1024*1024, 64, 1, __func__);
+}
@@ -0,0 +1,142 @@
+#include "../test_inflate.h"
+#include "../test_utils.h"
+
+static alloc_func zalloc = (alloc_func)0;
+static free_func zfree = (free_func)0;
+
+/* raw deflate src with a full flush after the first half_len bytes;
+   *flush_off is the compressed length up to the flush marker */
+static int _test_deflate_flush(Byte* src, unsigned int src_len, unsigned int half_len, Byte* compr, unsigned int compr_len, unsigned int *flush_off, unsigned int *total)
+{
+	int err;
+	z_stream c_stream;
+
+	c_stream.zalloc = zalloc;
+	c_stream.zfree = zfree;
+	c_stream.opaque = (voidpf)0;
+
+	err = deflateInit2(&c_stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+	if (err != 0) {
+		printf("deflateInit2 err %d\n", err);
+		return TEST_ERROR;
+	}
+
+	c_stream.next_in  = (z_const unsigned char *)src;
+	c_stream.avail_in = half_len;
+	c_stream.next_out = compr;
+	c_stream.avail_out = compr_len;
+	err = deflate(&c_stream, Z_FULL_FLUSH);
+	assert(err == Z_OK && c_stream.avail_in == 0);
+	*flush_off = c_stream.total_out;
+
+	c_stream.avail_in = src_len - half_len;
+	err = deflate(&c_stream, Z_FINISH);
+	assert(err == Z_STREAM_END);
+	*total = c_stream.total_out;
+
+	printf("\n*** c_stream.total_out %d flush at %d\n", *total, *flush_off);
+
+	err = deflateEnd(&c_stream);
+	if (err != 0) {
+		return TEST_ERROR;
+	}
+
+	return TEST_OK;
+}
+
+/* start inflating at a garbage offset, sync up to the flush point
+   step bytes at a time, and inflate the second half */
+static int _test_nx_inflate_sync(Byte* compr, unsigned int flush_off, unsigned int total, Byte* uncompr, unsigned int uncompr_len, Byte* src, unsigned int src_len, unsigned int half_len, int step)
+{
+	int err;
+	z_stream d_stream;
+	unsigned int start = 3;
+
+	memset(uncompr, 0, uncompr_len);
+
+	d_stream.zalloc = zalloc;
+	d_stream.zfree = zfree;
+	d_stream.opaque = (voidpf)0;
+
+	d_stream.next_in  = compr + start;
+	d_stream.avail_in = 0;
+	d_stream.next_out = uncompr;
+	d_stream.avail_out = uncompr_len;
+
+	err = nx_inflateInit2(&d_stream, -15);
+	if (err != Z_OK)
+		return TEST_ERROR;
+
+	err = nx_inflateSync(&d_stream);
+	assert(err == Z_BUF_ERROR);
+
+	do {
+		d_stream.avail_in = NX_MIN(step, total - start - d_stream.total_in);
+		err = nx_inflateSync(&d_stream);
+		assert(err == Z_OK || err == Z_DATA_ERROR);
+	} while (err != Z_OK && d_stream.avail_in == 0);
+
+	printf("*** synced at total_in %ld, flush marker ends at %d\n", d_stream.total_in, flush_off - start);
+	assert(err == Z_OK);
+	assert(d_stream.total_in == flush_off - start);
+	assert(d_stream.total_out == 0);
+
+	d_stream.avail_in = total - start - d_stream.total_in;
+	err = nx_inflate(&d_stream, Z_FINISH);
+	printf("*** d_stream.total_in %ld d_stream.total_out %ld\n", d_stream.total_in, d_stream.total_out);
+	assert(err == Z_STREAM_END);
+	assert(d_stream.total_out == src_len - half_len);
+
+	err = nx_inflateEnd(&d_stream);
+
+	if (compare_data(uncompr, src + half_len, src_len - half_len)) {
+		return TEST_ERROR;
+	}
+
+	return TEST_OK;
+}
+
+static int run(unsigned int len, int step, const char* test)
+{
+	Byte *src, *compr, *uncompr;
+	unsigned int src_len = len;
+	unsigned int half_len = len / 2;
+	unsigned int compr_len = src_len*2;
+	unsigned int uncompr_len = src_len*2;
+	unsigned int flush_off, total;
+	generate_random_data(src_len);
+	src = &ran_data[0];
+
+	compr = (Byte*)calloc((uInt)compr_len, 1);
+	uncompr = (Byte*)calloc((uInt)uncompr_len, 1);
+	if (compr == NULL || uncompr == NULL ) {
+		printf("*** alloc buffer failed\n");
+		return TEST_ERROR;
+	}
+
+	if (_test_deflate_flush(src, src_len, half_len, compr, compr_len, &flush_off, &total)) goto err;
+	if (_test_nx_inflate_sync(compr, flush_off, total, uncompr, uncompr_len, src, src_len, half_len, step)) goto err;
+
+	printf("*** %s %s passed\n", __FILE__, test);
+	free(compr);
+	free(uncompr);
+	return TEST_OK;
+err:
+	free(compr);
+	free(uncompr);
+	return TEST_ERROR;
+}
+
+/* case prefix is 10 */
+
+/* inflateSync with all input available */
+int run_case10()
+{
+	return run(128*1024, 128*1024, __func__);
+}
+
+/* inflateSync with 1 byte at a time; marker split across calls */
+int run_case10_1()
+{
+	return run(64*1024, 1, __func__);
+}
@@ -0,0 +1,133 @@
+#include "../test_inflate.h"
+#include "../test_utils.h"
+
+static alloc_func zalloc = (alloc_func)0;
+static free_func zfree = (free_func)0;
+
+/* use zlib to deflate; a sync flush every step bytes ends a block */
+static int _test_deflate(Byte* src, unsigned int src_len, Byte* compr, unsigned int compr_len, int step, unsigned int *total)
+{
+	int err;
+	z_stream c_stream;
+
+	c_stream.zalloc = zalloc;
+	c_stream.zfree = zfree;
+	c_stream.opaque = (voidpf)0;
+
+	err = deflateInit(&c_stream, Z_DEFAULT_COMPRESSION);
+	if (err != 0) {
+		printf("deflateInit err %d\n", err);
+		return TEST_ERROR;
+	}
+
+	c_stream.next_in  = (z_const unsigned char *)src;
+	c_stream.next_out = compr;
+	c_stream.avail_out = compr_len;
+
+	while (c_stream.total_in < src_len) {
+		c_stream.avail_in = NX_MIN(step, src_len - c_stream.total_in);
+		err = deflate(&c_stream, Z_SYNC_FLUSH);
+		assert(err == Z_OK);
+	}
+	err = deflate(&c_stream, Z_FINISH);
+	assert(err == Z_STREAM_END);
+	*total = c_stream.total_out;
+	printf("\n*** c_stream.total_out %d\n", *total);
+
+	err = deflateEnd(&c_stream);
+	if (err != 0) {
+		return TEST_ERROR;
+	}
+
+	return TEST_OK;
+}
+
+/* nx inflate one block per call */
+static int _test_nx_inflate_block(Byte* compr, unsigned int compr_len, Byte* uncompr, unsigned int uncompr_len, Byte* src, unsigned int src_len, int flush, int blocks)
+{
+	int err;
+	int stops = 0;
+	z_stream d_stream;
+
+	memset(uncompr, 0, uncompr_len);
+
+	d_stream.zalloc = zalloc;
+	d_stream.zfree = zfree;
+	d_stream.opaque = (voidpf)0;
+
+	d_stream.next_in  = compr;
+	d_stream.avail_in = compr_len;
+	d_stream.next_out = uncompr;
+	d_stream.avail_out = uncompr_len;
+
+	err = nx_inflateInit(&d_stream);
+	if (err != Z_OK)
+		return TEST_ERROR;
+
+	/* stops after the zlib header first */
+	err = nx_inflate(&d_stream, flush);
+	assert(err == Z_OK && d_stream.total_in == 2 && d_stream.data_type == 128);
+
+	do {
+		err = nx_inflate(&d_stream, flush);
+		if (err == Z_OK && (d_stream.data_type & 128))
+			++stops;
+	} while (err == Z_OK);
+
+	printf("*** d_stream.total_in %ld d_stream.total_out %ld block stops %d\n", d_stream.total_in, d_stream.total_out, stops);
+	assert(err == Z_STREAM_END);
+	assert(d_stream.total_out == src_len);
+	assert(stops >= blocks);
+
+	err = nx_inflateEnd(&d_stream);
+
+	if (compare_data(uncompr, src, src_len)) {
+		return TEST_ERROR;
+	}
+
+	return TEST_OK;
+}
+
+static int run(unsigned int len, int step, int flush, const char* test)
+{
+	Byte *src, *compr, *uncompr;
+	unsigned int src_len = len;
+	unsigned int compr_len = src_len*2;
+	unsigned int uncompr_len = src_len*2;
+	unsigned int total;
+	generate_random_data(src_len);
+	src = &ran_data[0];
+
+	compr = (Byte*)calloc((uInt)compr_len, 1);
+	uncompr = (Byte*)calloc((uInt)uncompr_len, 1);
+	if (compr == NULL || uncompr == NULL ) {
+		printf("*** alloc buffer failed\n");
+		return TEST_ERROR;
+	}
+
+	if (_test_deflate(src, src_len, compr, compr_len, step, &total)) goto err;
+	if (_test_nx_inflate_block(compr, total, uncompr, uncompr_len, src, src_len, flush, src_len / step)) goto err;
+
+	printf("*** %s %s passed\n", __FILE__, test);
+	free(compr);
+	free(uncompr);
+	return TEST_OK;
+err:
+	free(compr);
+	free(uncompr);
+	return TEST_ERROR;
+}
+
+/* case prefix is 11 */
+
+/* Z_BLOCK stops at each flushed block */
+int run_case11()
+{
+	return run(256*1024, 32*1024, Z_BLOCK, __func__);
+}
+
+/* Z_TREES stops at the same places as Z_BLOCK */
+int run_case11_1()
+{
+	return run(256*1024, 32*1024, Z_TREES, __func__);
+}
@@ -47,5 +47,16 @@ int main()
 	check ( run_case33_1() );
 	check ( run_case34() );
 	check ( run_case41() );
+	check ( run_case42() );
+	check ( run_case42_1() );
+	check ( run_case42_2() );
+	check ( run_case43() );
+	check ( run_case44() );
+	check ( run_case45() );
+	check ( run_case46() );
+	check ( run_case47() );
+	check ( run_case47_1() );
+	check ( run_case48() );
+	check ( run_case49() );
 }
 
@@ -28,4 +28,15 @@ extern int run_case33();
 extern int run_case33_1();
 extern int run_case34();
 extern int run_case41();
+extern int run_case42();
+extern int run_case42_1();
+extern int run_case42_2();
+extern int run_case43();
+extern int run_case44();
+extern int run_case45();
+extern int run_case46();
+extern int run_case47();
+extern int run_case47_1();
+extern int run_case48();
+extern int run_case49();
 
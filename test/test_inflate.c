@@ -28,5 +28,21 @@ int main()
 	check ( run_case8() );
 	check ( run_case9() );
 	check ( run_case9_1() );
+	check ( run_case10() );
+	check ( run_case10_1() );
+	check ( run_case11() );
+	check ( run_case11_1() );
+	check ( run_case12() );
+	check ( run_case12_1() );
+	check ( run_case13() );
+	check ( run_case13_1() );
+	check ( run_case14() );
+	check ( run_case15() );
+	check ( run_case15_1() );
+	check ( run_case16() );
+	check ( run_case16_1() );
+	check ( run_case16_2() );
+	check ( run_case17() );
+	check ( run_case17_1() );
 }
 
@@ -9,4 +9,20 @@ extern int run_case7();
 extern int run_case8();
 extern int run_case9();
 extern int run_case9_1();
+extern int run_case10();
+extern int run_case10_1();
+extern int run_case11();
+extern int run_case11_1();
+extern int run_case12();
+extern int run_case12_1();
+extern int run_case13();
+extern int run_case13_1();
+extern int run_case14();
+extern int run_case15();
+extern int run_case15_1();
+extern int run_case16();
+extern int run_case16_1();
+extern int run_case16_2();
+extern int run_case17();
+extern int run_case17_1();
 
@@ -72,3 +72,27 @@ int compare_data(char* src, char* dest, int len)
 	return TEST_OK;
 }
 
+/* bit at a time checksums, independent of the library under test */
+uint32_t ref_crc32(uint32_t crc, const unsigned char *buf, uint64_t len)
+{
+	int k;
+
+	crc = ~crc;
+	while (len--) {
+		crc ^= *buf++;
+		for (k = 0; k < 8; k++)
+			crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+	}
+	return ~crc;
+}
+
+uint32_t ref_adler32(uint32_t adler, const unsigned char *buf, uint64_t len)
+{
+	uint32_t a = adler & 0xffff, b = adler >> 16;
+
+	while (len--) {
+		a = (a + *buf++) % 65521;
+		b = (b + a) % 65521;
+	}
+	return (b << 16) | a;
+}
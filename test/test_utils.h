@@ -6,4 +6,6 @@ extern int generate_random_data(int len);
 extern char* generate_allocated_random_data(unsigned int len);
 extern int generate_all_data(int len, char digit);
 extern int compare_data(char* src, char* dest, int len);
+extern uint32_t ref_crc32(uint32_t crc, const unsigned char *buf, uint64_t len);
+extern uint32_t ref_adler32(uint32_t adler, const unsigned char *buf, uint64_t len);
 